@@ -0,0 +1,201 @@
+#include "ImageProcessor.h"
+#include "ParallelExecutor.h"
+#include "SimdKernels.h"
+
+#include <QColor>
+#include <QElapsedTimer>
+#include <QImage>
+
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iterator>
+
+using namespace Knoux::Utils;
+
+namespace {
+
+// ============================================================================
+// Per-pixel Loops
+// ============================================================================
+
+// The point operations as ImageProcessor ran them before the scanline
+// kernels: pixelColor() and setPixelColor() with a QColor per pixel
+
+QImage perPixelBrightness(const QImage &input, int value) {
+    QImage result = input.copy();
+    int adjustment = value * 255 / 100;
+
+    for (int y = 0; y < result.height(); ++y) {
+        for (int x = 0; x < result.width(); ++x) {
+            QColor c = result.pixelColor(x, y);
+            int r = qBound(0, c.red() + adjustment, 255);
+            int g = qBound(0, c.green() + adjustment, 255);
+            int b = qBound(0, c.blue() + adjustment, 255);
+            result.setPixelColor(x, y, QColor(r, g, b, c.alpha()));
+        }
+    }
+    return result;
+}
+
+QImage perPixelContrast(const QImage &input, float value) {
+    QImage result = input.copy();
+    float factor = (value + 100.0f) / 100.0f;
+    factor = factor * factor;
+
+    for (int y = 0; y < result.height(); ++y) {
+        for (int x = 0; x < result.width(); ++x) {
+            QColor c = result.pixelColor(x, y);
+            int r = qBound(0, static_cast<int>((c.red() - 128) * factor + 128), 255);
+            int g = qBound(0, static_cast<int>((c.green() - 128) * factor + 128), 255);
+            int b = qBound(0, static_cast<int>((c.blue() - 128) * factor + 128), 255);
+            result.setPixelColor(x, y, QColor(r, g, b, c.alpha()));
+        }
+    }
+    return result;
+}
+
+QImage perPixelSaturation(const QImage &input, float value) {
+    QImage result = input.copy();
+    float factor = (value + 100.0f) / 100.0f;
+
+    for (int y = 0; y < result.height(); ++y) {
+        for (int x = 0; x < result.width(); ++x) {
+            QColor c = result.pixelColor(x, y);
+            int gray = qGray(c.rgb());
+            int r = qBound(0, static_cast<int>(gray + (c.red() - gray) * factor), 255);
+            int g = qBound(0, static_cast<int>(gray + (c.green() - gray) * factor), 255);
+            int b = qBound(0, static_cast<int>(gray + (c.blue() - gray) * factor), 255);
+            result.setPixelColor(x, y, QColor(r, g, b, c.alpha()));
+        }
+    }
+    return result;
+}
+
+QImage perPixelHueShift(const QImage &input, int degrees) {
+    QImage result = input.copy();
+
+    for (int y = 0; y < result.height(); ++y) {
+        for (int x = 0; x < result.width(); ++x) {
+            QColor c = result.pixelColor(x, y);
+            int h, s, v;
+            c.getHsv(&h, &s, &v);
+            h = (h + degrees) % 360;
+            if (h < 0) h += 360;
+            c.setHsv(h, s, v);
+            result.setPixelColor(x, y, c);
+        }
+    }
+    return result;
+}
+
+// ============================================================================
+// Timing
+// ============================================================================
+
+// Fastest of runs, in milliseconds
+double bestOf(int runs, const std::function<QImage()> &operation, QImage *output) {
+    double best = 0.0;
+    for (int i = 0; i < runs; ++i) {
+        QElapsedTimer timer;
+        timer.start();
+        QImage result = operation();
+        const double ms = timer.nsecsElapsed() / 1.0e6;
+        if (i == 0 || ms < best) best = ms;
+        if (output) *output = std::move(result);
+    }
+    return best;
+}
+
+// Largest difference of any color channel, to show both paths agree
+int maxDifference(const QImage &a, const QImage &b) {
+    const QImage x = a.convertToFormat(QImage::Format_ARGB32);
+    const QImage y = b.convertToFormat(QImage::Format_ARGB32);
+    int worst = 0;
+    for (int row = 0; row < x.height(); ++row) {
+        const QRgb *p = reinterpret_cast<const QRgb *>(x.constScanLine(row));
+        const QRgb *q = reinterpret_cast<const QRgb *>(y.constScanLine(row));
+        for (int col = 0; col < x.width(); ++col) {
+            worst = qMax(worst, qAbs(qRed(p[col]) - qRed(q[col])));
+            worst = qMax(worst, qAbs(qGreen(p[col]) - qGreen(q[col])));
+            worst = qMax(worst, qAbs(qBlue(p[col]) - qBlue(q[col])));
+        }
+    }
+    return worst;
+}
+
+// The speedup the kernels are held to, on one thread so that the number
+// measures the kernels and not the core count
+constexpr double ExpectedSpeedup = 10.0;
+
+struct Case {
+    const char *name;
+    std::function<QImage(const QImage &)> perPixel;
+    std::function<QImage(const QImage &)> kernels;
+};
+
+} // namespace
+
+// Times the old per-pixel loops against the scanline kernels on a photo
+// sized image, one thread and all of them. Exits with 1 when a kernel on
+// one thread misses ExpectedSpeedup.
+// Usage: PixelKernelsBench [width height [runs]]
+int main(int argc, char *argv[]) {
+    const int width = argc > 2 ? std::atoi(argv[1]) : 6000;
+    const int height = argc > 2 ? std::atoi(argv[2]) : 4000;
+    const int runs = argc > 3 ? std::atoi(argv[3]) : 3;
+
+    // Smooth gradients with noise, so every hue and tone shows up
+    QImage image(width, height, QImage::Format_ARGB32);
+    quint32 seed = 1;
+    for (int y = 0; y < height; ++y) {
+        QRgb *row = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 0; x < width; ++x) {
+            seed = seed * 1664525u + 1013904223u;
+            const int noise = int(seed >> 28) - 8;
+            row[x] = qRgba(qBound(0, x * 255 / width + noise, 255), qBound(0, y * 255 / height + noise, 255),
+                           qBound(0, (x + y) * 255 / (width + height) - noise, 255), 255);
+        }
+    }
+
+    const Case cases[] = {
+        {"brightness", [](const QImage &in) { return perPixelBrightness(in, 20); },
+                       [](const QImage &in) { return ImageProcessor::applyBrightness(in, 20); }},
+        {"contrast", [](const QImage &in) { return perPixelContrast(in, 30.0f); },
+                     [](const QImage &in) { return ImageProcessor::applyContrast(in, 30.0f); }},
+        {"saturation", [](const QImage &in) { return perPixelSaturation(in, 40.0f); },
+                       [](const QImage &in) { return ImageProcessor::applySaturation(in, 40.0f); }},
+        {"hue shift", [](const QImage &in) { return perPixelHueShift(in, 45); },
+                      [](const QImage &in) { return ImageProcessor::applyHueShift(in, 45); }},
+    };
+
+    const int threads = ParallelExecutor::defaultThreadCount();
+    std::printf("%dx%d, best of %d, %s kernels, %d threads\n", width, height, runs,
+                SimdKernels::levelName(SimdKernels::activeLevel()), threads);
+    std::printf("%-12s %12s %12s %9s %12s %9s %8s\n", "operation", "per-pixel ms", "1 thread ms", "speedup",
+                "all ms", "speedup", "max diff");
+
+    int slow = 0;
+    for (const Case &c : cases) {
+        QImage expected, actual;
+        const double perPixel = bestOf(runs, [&] { return c.perPixel(image); }, &expected);
+
+        ParallelExecutor::setThreadCount(1);
+        const double single = bestOf(runs, [&] { return c.kernels(image); }, &actual);
+        ParallelExecutor::setThreadCount(threads);
+        const double parallel = bestOf(runs, [&] { return c.kernels(image); }, nullptr);
+
+        const double speedup = perPixel / single;
+        std::printf("%-12s %12.1f %12.1f %8.1fx %12.1f %8.1fx %8d%s\n", c.name, perPixel, single, speedup,
+                    parallel, perPixel / parallel, maxDifference(expected, actual),
+                    speedup < ExpectedSpeedup ? "  SLOW" : "");
+        if (speedup < ExpectedSpeedup) ++slow;
+    }
+
+    if (slow > 0) {
+        std::printf("WARNING: %d of %d kernels below %.0fx on one thread\n", slow, int(std::size(cases)),
+                    ExpectedSpeedup);
+        return 1;
+    }
+    return 0;
+}
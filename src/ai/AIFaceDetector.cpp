@@ -1,4 +1,7 @@
 #include "AIFaceDetector.h"
+#include "../utils/ImagePyramid.h"
+#include "../utils/PixelKernels.h"
+#include "../utils/SummedAreaTable.h"
 #include <QPainter>
 #include <QtMath>
 
@@ -55,21 +58,27 @@ public:
         QVector<float> scales = {0.25f, 0.5f, 1.0f, 1.5f, 2.0f};
         
         for (float scale : scales) {
-            QImage scaledImage = image.scaled(
-                image.width() * scale,
-                image.height() * scale,
-                Qt::KeepAspectRatio,
-                Qt::SmoothTransformation
+            // Reductions start from the shared pyramid of this image, which
+            // repeated calls on the same image find already built
+            QImage scaledImage = Utils::ImagePyramid::cachedScaled(
+                image,
+                QSize(static_cast<int>(image.width() * scale), static_cast<int>(image.height() * scale))
             );
             
             // Sliding window detection
             int windowSize = static_cast<int>(100 * scale);
             int step = static_cast<int>(20 * scale);
             
+            // Brightness and edge features are box sums, so they are read
+            // from integral images built once per scale
+            const QImage pixels = Utils::PixelKernels::toWorkingFormat(scaledImage);
+            const Utils::SummedAreaTable intensity(pixels, Utils::SummedAreaTable::Source::Intensity, true);
+            const Utils::SummedAreaTable edges(edgeMap(pixels), Utils::SummedAreaTable::Source::Gray);
+            
             for (int y = 0; y < scaledImage.height() - windowSize; y += step) {
                 for (int x = 0; x < scaledImage.width() - windowSize; x += step) {
                     QRect window(x, y, windowSize, windowSize);
-                    float confidence = classifyWindow(scaledImage, window);
+                    float confidence = classifyWindow(pixels, window, intensity, edges);
                     
                     if (confidence > confidenceThreshold) {
                         DetectedFace face;
@@ -92,16 +101,16 @@ public:
         return faces;
     }
     
-    float classifyWindow(const QImage &image, const QRect &window) {
+    float classifyWindow(const QImage &image, const QRect &window,
+                         const Utils::SummedAreaTable &intensity,
+                         const Utils::SummedAreaTable &edges) {
         // Simplified face classification
         // In real implementation, this would use the neural network
         
-        QImage windowImage = image.copy(window);
-        
         // Extract features
-        float skinToneVariance = calculateSkinToneVariance(windowImage);
-        float edgeDensity = calculateEdgeDensity(windowImage);
-        float symmetry = calculateSymmetry(windowImage);
+        float skinToneVariance = calculateSkinToneVariance(intensity, window);
+        float edgeDensity = calculateEdgeDensity(edges, window);
+        float symmetry = calculateSymmetry(image, window);
         
         // Face-like score
         float score = 0.0f;
@@ -124,84 +133,75 @@ public:
         return score;
     }
     
-    float calculateSkinToneVariance(const QImage &image) {
-        if (image.isNull()) return 0.0f;
-        
-        float sum = 0.0f;
-        float sumSq = 0.0f;
-        int count = 0;
-        
-        for (int y = 0; y < image.height(); ++y) {
-            for (int x = 0; x < image.width(); ++x) {
-                QColor c = image.pixelColor(x, y);
-                float brightness = (c.red() + c.green() + c.blue()) / 3.0f / 255.0f;
-                sum += brightness;
-                sumSq += brightness * brightness;
-                count++;
-            }
-        }
-        
-        if (count == 0) return 0.0f;
-        
-        float mean = sum / count;
-        float variance = (sumSq / count) - (mean * mean);
+    float calculateSkinToneVariance(const Utils::SummedAreaTable &intensity, const QRect &window) {
+        if (intensity.isNull()) return 0.0f;
         
-        return variance;
+        // Variance of the brightness (r + g + b) / 3 / 255
+        return intensity.variance(window) / (765.0f * 765.0f);
     }
     
-    float calculateEdgeDensity(const QImage &image) {
-        if (image.isNull()) return 0.0f;
-        
-        int edgeCount = 0;
+    QImage edgeMap(const QImage &image) {
+        // 1 where a pixel differs from its right or lower neighbour
+        QImage edges(image.size(), QImage::Format_Grayscale8);
+        edges.fill(0);
         int threshold = 30;
         
-        for (int y = 1; y < image.height() - 1; ++y) {
-            for (int x = 1; x < image.width() - 1; ++x) {
-                QColor c = image.pixelColor(x, y);
-                QColor right = image.pixelColor(x + 1, y);
-                QColor down = image.pixelColor(x, y + 1);
+        for (int y = 0; y < image.height() - 1; ++y) {
+            const QRgb *row = reinterpret_cast<const QRgb *>(image.constScanLine(y));
+            const QRgb *below = reinterpret_cast<const QRgb *>(image.constScanLine(y + 1));
+            uchar *out = edges.scanLine(y);
+            for (int x = 0; x < image.width() - 1; ++x) {
+                const QRgb c = row[x];
+                const QRgb right = row[x + 1];
+                const QRgb down = below[x];
                 
-                int diffX = std::abs(c.red() - right.red()) +
-                           std::abs(c.green() - right.green()) +
-                           std::abs(c.blue() - right.blue());
+                int diffX = std::abs(qRed(c) - qRed(right)) +
+                           std::abs(qGreen(c) - qGreen(right)) +
+                           std::abs(qBlue(c) - qBlue(right));
                 
-                int diffY = std::abs(c.red() - down.red()) +
-                           std::abs(c.green() - down.green()) +
-                           std::abs(c.blue() - down.blue());
+                int diffY = std::abs(qRed(c) - qRed(down)) +
+                           std::abs(qGreen(c) - qGreen(down)) +
+                           std::abs(qBlue(c) - qBlue(down));
                 
-                if (diffX > threshold || diffY > threshold) {
-                    edgeCount++;
-                }
+                out[x] = (diffX > threshold || diffY > threshold) ? 1 : 0;
             }
         }
         
-        return static_cast<float>(edgeCount) / (image.width() * image.height());
+        return edges;
     }
     
-    float calculateSymmetry(const QImage &image) {
-        if (image.isNull()) return 0.0f;
+    float calculateEdgeDensity(const Utils::SummedAreaTable &edges, const QRect &window) {
+        if (edges.isNull() || window.isEmpty()) return 0.0f;
+        
+        // Edge pixels inside the window, its outer ring excluded
+        int edgeCount = static_cast<int>(edges.sum(window.adjusted(1, 1, -1, -1)));
         
-        int centerX = image.width() / 2;
-        float diffSum = 0.0f;
+        return static_cast<float>(edgeCount) / (window.width() * window.height());
+    }
+    
+    float calculateSymmetry(const QImage &image, const QRect &window) {
+        if (image.isNull() || window.isEmpty()) return 0.0f;
+        
+        int centerX = window.width() / 2;
+        qint64 diffSum = 0;
         int count = 0;
         
-        for (int y = 0; y < image.height(); ++y) {
+        for (int y = window.top(); y <= window.bottom(); ++y) {
+            const QRgb *row = reinterpret_cast<const QRgb *>(image.constScanLine(y));
             for (int x = 0; x < centerX; ++x) {
-                QColor left = image.pixelColor(x, y);
-                QColor right = image.pixelColor(image.width() - 1 - x, y);
-                
-                float diff = std::abs(left.redF() - right.redF()) +
-                            std::abs(left.greenF() - right.greenF()) +
-                            std::abs(left.blueF() - right.blueF());
+                const QRgb left = row[window.left() + x];
+                const QRgb right = row[window.right() - x];
                 
-                diffSum += diff;
+                diffSum += std::abs(qRed(left) - qRed(right)) +
+                           std::abs(qGreen(left) - qGreen(right)) +
+                           std::abs(qBlue(left) - qBlue(right));
                 count++;
             }
         }
         
         if (count == 0) return 0.0f;
         
-        float avgDiff = diffSum / count;
+        float avgDiff = diffSum / (255.0f * count);
         return 1.0f - avgDiff;
     }
     
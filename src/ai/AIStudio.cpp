@@ -1,6 +1,10 @@
 #include "AIStudio.h"
 #include "../ui/GlassButton.h"
 #include "../ui/GlassPanel.h"
+#include "../utils/EdgeAwareFilters.h"
+#include "../utils/ImagePyramid.h"
+#include "../utils/PixelKernels.h"
+#include "../utils/Resampler.h"
 
 #include <QPainter>
 #include <QVBoxLayout>
@@ -165,11 +169,10 @@ QImage AIWorker::processUpscale()
     emit progressUpdated(10);
     QThread::msleep(100);
 
-    QImage result = m_inputImage.scaled(
-        m_inputImage.width() * scale,
-        m_inputImage.height() * scale,
-        Qt::IgnoreAspectRatio,
-        Qt::SmoothTransformation
+    QImage result = Knoux::Utils::Resampler::resize(
+        m_inputImage,
+        m_inputImage.size() * scale,
+        Knoux::Utils::ResampleFilter::Lanczos3
     );
 
     emit progressUpdated(50);
@@ -231,42 +234,33 @@ QImage AIWorker::processRemoveBackground()
 
 QImage AIWorker::processPortraitEnhance()
 {
+    using Knoux::Utils::PixelKernels;
+
     if (m_inputImage.isNull()) return QImage();
 
     emit progressUpdated(10);
     QThread::msleep(100);
 
-    QImage result = m_inputImage.copy();
-
-    // Skin smoothing simulation
-    for (int y = 1; y < result.height() - 1; ++y) {
-        emit progressUpdated(10 + (y * 80 / result.height()));
+    // Skin smoothing: skin tones take the edge-preserving smooth of the
+    // image, everything else keeps its detail
+    const QImage smooth = Knoux::Utils::EdgeAwareFilters::guided(m_inputImage, QImage(), 4, 400.0f);
+    emit progressUpdated(60);
 
-        for (int x = 1; x < result.width() - 1; ++x) {
-            QColor c = result.pixelColor(x, y);
+    QImage result = PixelKernels::toWorkingFormat(m_inputImage);
+    PixelKernels::forEachRow(result, [&smooth](QRgb *row, int width, int y) {
+        const QRgb *smoothRow = reinterpret_cast<const QRgb *>(smooth.constScanLine(y));
+        for (int x = 0; x < width; ++x) {
+            const int r = qRed(row[x]);
+            const int g = qGreen(row[x]);
+            const int b = qBlue(row[x]);
 
             // Detect skin tones
-            bool isSkin = (c.red() > 60 && c.red() < 255 &&
-                          c.green() > 40 && c.green() < 220 &&
-                          c.blue() > 20 && c.blue() < 170 &&
-                          c.red() > c.green() && c.green() > c.blue());
-
+            const bool isSkin = r > 60 && r < 255 && g > 40 && g < 220 && b > 20 && b < 170 && r > g && g > b;
             if (isSkin) {
-                // Apply slight blur
-                int r = 0, g = 0, b = 0, a = 0;
-                for (int dy = -1; dy <= 1; ++dy) {
-                    for (int dx = -1; dx <= 1; ++dx) {
-                        QColor nc = m_inputImage.pixelColor(x + dx, y + dy);
-                        r += nc.red();
-                        g += nc.green();
-                        b += nc.blue();
-                        a += nc.alpha();
-                    }
-                }
-                result.setPixelColor(x, y, QColor(r / 9, g / 9, b / 9, a / 9));
+                row[x] = PixelKernels::pack(qRed(smoothRow[x]), qGreen(smoothRow[x]), qBlue(smoothRow[x]), row[x]);
             }
         }
-    }
+    });
 
     emit progressUpdated(100);
     return result;
@@ -909,8 +903,8 @@ void AIStudio::onHistoryItemClicked(int index)
     if (index >= 0 && index < m_historyImages.size()) {
         m_currentImage = m_historyImages[index];
 
-        QPixmap pixmap = QPixmap::fromImage(m_currentImage.scaled(
-            m_previewLabel->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
+        QPixmap pixmap = QPixmap::fromImage(Knoux::Utils::ImagePyramid::cachedScaled(
+            m_currentImage, m_currentImage.size().scaled(m_previewLabel->size(), Qt::KeepAspectRatio)));
         m_previewLabel->setPixmap(pixmap);
         m_previewLabel->setText("");
 
@@ -948,8 +942,8 @@ void AIStudio::resizeEvent(QResizeEvent *event)
 
     // Update preview if image exists
     if (!m_currentImage.isNull() && m_previewLabel->pixmap()) {
-        QPixmap pixmap = QPixmap::fromImage(m_currentImage.scaled(
-            m_previewLabel->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
+        QPixmap pixmap = QPixmap::fromImage(Knoux::Utils::ImagePyramid::cachedScaled(
+            m_currentImage, m_currentImage.size().scaled(m_previewLabel->size(), Qt::KeepAspectRatio)));
         m_previewLabel->setPixmap(pixmap);
     }
 }
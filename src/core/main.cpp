@@ -1,5 +1,6 @@
 #include "MainWindow.h"
 #include "../ui/CyberpunkSplash.h"
+#include "../utils/ParallelExecutor.h"
 
 #include <QApplication>
 #include <QFontDatabase>
@@ -62,6 +63,12 @@ void setupApplication(QApplication &app)
     if (rtl) {
         app.setLayoutDirection(Qt::RightToLeft);
     }
+
+    // Size the image processing thread pool from the settings panel store
+    QSettings panelSettings("Knoux", "ArtStudio");
+    int threads = panelSettings.value("Performance/threadCount",
+        Knoux::Utils::ParallelExecutor::defaultThreadCount()).toInt();
+    Knoux::Utils::ParallelExecutor::setThreadCount(threads);
 }
 
 void createDefaultDirectories()
@@ -1,6 +1,8 @@
 #include "FaceRetouch.h"
 #include "../ui/GlassButton.h"
 #include "../ui/GlassPanel.h"
+#include "../utils/EdgeAwareFilters.h"
+#include "../utils/ImageProcessor.h"
 
 #include <QPainter>
 #include <QVBoxLayout>
@@ -473,29 +475,15 @@ QImage FaceRetouch::applyFaceTransformations(const QImage &input)
 
 QImage FaceRetouch::smoothSkinInternal(const QImage &input)
 {
-    QImage result(input.size(), QImage::Format_ARGB32);
-    
-    int radius = int(m_params.smoothness * 5) + 1;
-    
-    for (int y = radius; y < input.height() - radius; ++y) {
-        for (int x = radius; x < input.width() - radius; ++x) {
-            int r = 0, g = 0, b = 0, count = 0;
-            
-            for (int dy = -radius; dy <= radius; ++dy) {
-                for (int dx = -radius; dx <= radius; ++dx) {
-                    QColor c = input.pixelColor(x + dx, y + dy);
-                    r += c.red();
-                    g += c.green();
-                    b += c.blue();
-                    count++;
-                }
-            }
-            
-            result.setPixelColor(x, y, QColor(r / count, g / count, b / count));
-        }
-    }
-    
-    return result;
+    using Knoux::Utils::EdgeAwareFilters;
+
+    // Self-guided filter: texture below the epsilon variance is averaged
+    // away within the radius while the edges of eyes, lips and hair stay.
+    // Stronger settings widen the window and let stronger texture go.
+    const int radius = int(m_params.smoothness * 10) + 2;
+    const float spread = 8.0f + m_params.smoothness * 24.0f;
+
+    return EdgeAwareFilters::guided(input, QImage(), radius, spread * spread);
 }
 
 QImage FaceRetouch::removeBlemishesInternal(const QImage &input)
@@ -539,35 +527,27 @@ QImage FaceRetouch::removeWrinklesInternal(const QImage &input)
 
 QImage FaceRetouch::brightenEyesInternal(const QImage &input)
 {
-    QImage result = input.copy();
+    using Knoux::Utils::ImageProcessor;
+
+    if (!m_faceDetected) return input;
     
-    if (!m_faceDetected) return result;
-    
-    // Brighten eye areas
-    QPointF leftEye = m_landmarks.leftEyeCenter;
-    QPointF rightEye = m_landmarks.rightEyeCenter;
-    
-    int radius = 30;
-    int brightness = int(m_params.brightenEyes * 30);
-    
-    for (const QPointF &eye : {leftEye, rightEye}) {
-        for (int y = int(eye.y()) - radius; y < int(eye.y()) + radius; ++y) {
-            for (int x = int(eye.x()) - radius; x < int(eye.x()) + radius; ++x) {
-                if (x < 0 || x >= input.width() || y < 0 || y >= input.height()) continue;
-                
-                float dist = std::sqrt(std::pow(x - eye.x(), 2) + std::pow(y - eye.y(), 2));
-                if (dist > radius) continue;
-                
-                float factor = 1.0f - (dist / radius);
-                factor = factor * factor;
-                
-                QColor c = input.pixelColor(x, y);
-                int r = qMin(255, c.red() + int(brightness * factor));
-                int g = qMin(255, c.green() + int(brightness * factor));
-                int b = qMin(255, c.blue() + int(brightness * factor));
-                result.setPixelColor(x, y, QColor(r, g, b));
-            }
+    // Brighten eye areas, only the pixels around each eye are processed and
+    // a radial mask fades the lift out towards the edge. Its coverage is
+    // squared, so the lift falls off as fast as it always did.
+    const int radius = 30;
+    const int brightness = int(m_params.brightenEyes * 30);
+    QImage result = input;
+    
+    for (const QPointF &eye : {m_landmarks.leftEyeCenter, m_landmarks.rightEyeCenter}) {
+        const QRect area(int(eye.x()) - radius, int(eye.y()) - radius, 2 * radius, 2 * radius);
+        QImage mask = ImageProcessor::createRadialMask(area.size(), eye - area.topLeft(), radius);
+        for (int y = 0; y < mask.height(); ++y) {
+            uchar *row = mask.scanLine(y);
+            for (int x = 0; x < mask.width(); ++x) row[x] = uchar((row[x] * row[x] + 127) / 255);
         }
+        result = ImageProcessor::applyInRegion(std::move(result), area, mask, [brightness](QImage pixels) {
+            return ImageProcessor::applyColorBalance(std::move(pixels), brightness, brightness, brightness);
+        });
     }
     
     return result;
@@ -575,32 +555,29 @@ QImage FaceRetouch::brightenEyesInternal(const QImage &input)
 
 QImage FaceRetouch::whitenTeethInternal(const QImage &input)
 {
-    QImage result = input.copy();
-    
-    if (!m_faceDetected) return result;
+    using Knoux::Utils::ImageProcessor;
+
+    if (!m_faceDetected) return input;
     
     // Whiten teeth area (mouth region)
-    QPointF mouth = m_landmarks.mouthCenter;
-    int radius = 25;
-    int whiteness = int(m_params.teethWhiteness * 40);
-    
-    for (int y = int(mouth.y()) - radius; y < int(mouth.y()) + radius; ++y) {
-        for (int x = int(mouth.x()) - radius; x < int(mouth.x()) + radius; ++x) {
-            if (x < 0 || x >= input.width() || y < 0 || y >= input.height()) continue;
-            
-            QColor c = input.pixelColor(x, y);
-            
-            // Detect teeth (bright areas in mouth)
-            if (c.lightness() > 180 && c.saturation() < 30) {
-                int r = qMin(255, c.red() + whiteness);
-                int g = qMin(255, c.green() + whiteness);
-                int b = qMin(255, c.blue() + whiteness);
-                result.setPixelColor(x, y, QColor(r, g, b));
-            }
-        }
-    }
-    
-    return result;
+    const QPointF mouth = m_landmarks.mouthCenter;
+    const int radius = 25;
+    const int whiteness = int(m_params.teethWhiteness * 40);
+    const QRect area(int(mouth.x()) - radius, int(mouth.y()) - radius, 2 * radius, 2 * radius);
+    
+    return ImageProcessor::applyInRegion(input, area, QImage(), [whiteness](QImage pixels) {
+        return ImageProcessor::processParallel(std::move(pixels), [whiteness](QRgb p) {
+            // Detect teeth (bright areas in mouth), HSL lightness and HSV
+            // saturation rounded the way QColor rounds them
+            const int high = qMax(qMax(qRed(p), qGreen(p)), qBlue(p));
+            const int low = qMin(qMin(qRed(p), qGreen(p)), qBlue(p));
+            const int lightness = (high + low + 1) / 2;
+            const int saturation = high == 0 ? 0 : ((high - low) * 255 + high / 2) / high;
+            if (lightness <= 180 || saturation >= 30) return p;
+            return qRgba(qMin(255, qRed(p) + whiteness), qMin(255, qGreen(p) + whiteness),
+                         qMin(255, qBlue(p) + whiteness), qAlpha(p));
+        });
+    });
 }
 
 QImage FaceRetouch::applySkinTone(const QImage &input)
@@ -1152,17 +1152,21 @@ QImage MakeupStudio::applyLipstickToImage(const QImage &input, const QColor &col
     float alpha = intensity / 100.0f;
     float glossFactor = gloss / 100.0f;
     
-    for (int y = 0; y < result.height(); ++y) {
-        for (int x = 0; x < result.width(); ++x) {
+    // Only pixels inside the lips' bounding box can be inside the polygon
+    const QRect lipsRect = lipsPoly.boundingRect();
+    const QRect area = lipsRect.intersected(result.rect());
+    const QPointF lipsCenter = lipsRect.center();
+    const float maxDist = std::max(lipsRect.width(), lipsRect.height()) / 2.0f;
+    
+    for (int y = area.top(); y <= area.bottom(); ++y) {
+        for (int x = area.left(); x <= area.right(); ++x) {
             QPoint pt(x, y);
             
             if (lipsPoly.containsPoint(pt, Qt::OddEvenFill)) {
                 QColor pixel = result.pixelColor(x, y);
                 
                 // Distance from center of lips for gradient effect
-                QPointF lipsCenter = lipsPoly.boundingRect().center();
                 float dist = std::sqrt(std::pow(x - lipsCenter.x(), 2) + std::pow(y - lipsCenter.y(), 2));
-                float maxDist = std::max(lipsPoly.boundingRect().width(), lipsPoly.boundingRect().height()) / 2.0f;
                 float edgeFactor = 1.0f - (dist / maxDist);
                 edgeFactor = std::max(0.0f, edgeFactor);
                 
@@ -1,6 +1,12 @@
 #include "PhotoEditor.h"
 #include "../ui/GlassButton.h"
 #include "../ui/GlassPanel.h"
+#include "../utils/Compositor.h"
+#include "../utils/EdgeAwareFilters.h"
+#include "../utils/HistogramStats.h"
+#include "../utils/ImageProcessor.h"
+#include "../utils/PixelKernels.h"
+#include "../utils/ScratchArena.h"
 
 #include <QPainter>
 #include <QVBoxLayout>
@@ -20,6 +26,7 @@
 #include <QImageReader>
 #include <QImageWriter>
 #include <QBuffer>
+#include <QSettings>
 #include <QtMath>
 #include <QDebug>
 
@@ -40,6 +47,7 @@ PhotoEditor::PhotoEditor(QWidget *parent)
     , m_secondaryColor(Qt::white)
     , m_currentLayerIndex(0)
     , m_isModified(false)
+    , m_workingDepth(Knoux::Utils::WorkingDepth::Bits8)
     , m_isDrawing(false)
     , m_hasSelection(false)
     , m_isAIProcessing(false)
@@ -60,6 +68,9 @@ PhotoEditor::PhotoEditor(QWidget *parent)
 
 PhotoEditor::~PhotoEditor()
 {
+    // Nothing left to reuse the scratch buffers of this document
+    m_renderScheduler.cancel();
+    Knoux::Utils::ScratchArena::trim();
 }
 
 void PhotoEditor::setupUI()
@@ -297,6 +308,7 @@ void PhotoEditor::setupConnections()
     // Panel connections
     connect(m_layersPanel, &LayersPanel::layerSelected, this, &PhotoEditor::onLayerSelected);
     connect(m_adjustmentsPanel, &AdjustmentsPanel::adjustmentChanged, this, &PhotoEditor::onAdjustmentChanged);
+    connect(&m_renderScheduler, &Knoux::Utils::RenderScheduler::rendered, this, &PhotoEditor::onAdjustmentsRendered);
     connect(m_aiPanel, &AIPanel::autoEnhanceClicked, this, &PhotoEditor::aiAutoEnhance);
     connect(m_aiPanel, &AIPanel::removeBackgroundClicked, this, &PhotoEditor::aiRemoveBackground);
     connect(m_aiPanel, &AIPanel::upscaleClicked, this, &PhotoEditor::aiUpscale);
@@ -319,6 +331,14 @@ void PhotoEditor::openImage(const QString &path)
         return;
     }
 
+    // Converted once here, edits then stay at this depth until export
+    const auto requestedDepth = storedDepth(image);
+    m_workingDepth = budgetedDepth(requestedDepth, image.size());
+    image = toDocumentDepth(std::move(image));
+
+    // A render of the previous image must not land on this one
+    m_renderScheduler.cancel();
+    budgetScratch(image);
     m_originalImage = image;
     m_currentImage = image;
     m_currentPath = path;
@@ -339,6 +359,9 @@ void PhotoEditor::openImage(const QString &path)
 
     // Update status
     emit statusMessage(tr("تم فتح: %1").arg(QFileInfo(path).fileName()));
+    if (m_workingDepth != requestedDepth) {
+        emit statusMessage(tr("الصورة أكبر من حد الذاكرة لعمق 16 بت، تتم المعالجة بعمق 8 بت"));
+    }
     emit imageModified(false);
 
     // Update dimension label
@@ -360,7 +383,7 @@ void PhotoEditor::saveImage()
         m_currentPath = path;
     }
 
-    if (m_currentImage.save(m_currentPath)) {
+    if (writeImage(m_currentPath, QFileInfo(m_currentPath).suffix().toLower().toUtf8())) {
         m_isModified = false;
         emit statusMessage(tr("تم الحفظ: %1").arg(m_currentPath));
         emit imageModified(false);
@@ -383,26 +406,113 @@ void PhotoEditor::exportImage(const QString &path, const QString &format)
     QString fmt = format.toLower();
     if (fmt == "jpg") fmt = "jpeg";
 
-    if (m_currentImage.save(path, fmt.toUtf8().constData())) {
+    if (writeImage(path, fmt.toUtf8())) {
         emit statusMessage(tr("تم التصدير: %1").arg(path));
     } else {
         emit statusMessage(tr("فشل التصدير"));
     }
 }
 
+bool PhotoEditor::writeImage(const QString &path, const QByteArray &format) const
+{
+    // The depth travels with the document, the pixels are not copied for it
+    QImageWriter writer(path, format);
+    writer.setText(WORKING_DEPTH_KEY, QString::number(int(m_workingDepth)));
+    return writer.write(imageForExport(QString::fromLatin1(format)));
+}
+
+Knoux::Utils::WorkingDepth PhotoEditor::storedDepth(const QImage &image) const
+{
+    using Knoux::Utils::WorkingDepth;
+
+    bool stored = false;
+    const int depth = image.text(WORKING_DEPTH_KEY).toInt(&stored);
+    if (stored && depth >= int(WorkingDepth::Bits8) && depth <= int(WorkingDepth::Float16)) {
+        return WorkingDepth(depth);
+    }
+
+    QSettings settings("Knoux", "ArtStudio");
+    return WorkingDepth(settings.value("Performance/workingDepth", 0).toInt());
+}
+
+QImage PhotoEditor::imageForExport(const QString &format) const
+{
+    using Knoux::Utils::WorkingDepth;
+    if (m_workingDepth == WorkingDepth::Bits8) return m_currentImage;
+
+    // PNG and TIFF store 16-bit integers, the other formats 8 bits
+    const QString fmt = format.toLower();
+    const bool deepFormat = fmt == "png" || fmt == "tif" || fmt == "tiff";
+    return Knoux::Utils::PixelKernels::toDepth(QImage(m_currentImage),
+                                               deepFormat ? WorkingDepth::Bits16 : WorkingDepth::Bits8);
+}
+
+void PhotoEditor::setWorkingDepth(Knoux::Utils::WorkingDepth depth)
+{
+    depth = budgetedDepth(depth, m_originalImage.size());
+    if (depth == m_workingDepth) return;
+    settleAdjustments();
+    m_workingDepth = depth;
+
+    // Going deeper cannot bring back lost bits, but later edits keep theirs
+    m_originalImage = toDocumentDepth(std::move(m_originalImage));
+    m_currentImage = toDocumentDepth(std::move(m_currentImage));
+    for (Layer &layer : m_layers) {
+        layer.image = toDocumentDepth(std::move(layer.image));
+    }
+
+    m_canvas->setImage(m_currentImage);
+    updateCanvas();
+
+    // Saved with the document, which opens at this depth from then on
+    m_isModified = true;
+    emit imageModified(true);
+}
+
+Knoux::Utils::WorkingDepth PhotoEditor::budgetedDepth(Knoux::Utils::WorkingDepth depth, const QSize &size) const
+{
+    if (depth == Knoux::Utils::WorkingDepth::Bits8 || size.isEmpty()) return depth;
+
+    // The original, current and preview images are kept at full size, deep
+    // documents need the three of them to fit in half of the memory limit
+    QSettings settings("Knoux", "ArtStudio");
+    const qint64 limit = settings.value("Performance/memoryLimit", 4).toLongLong() << 30;
+    const qint64 bytes = qint64(size.width()) * size.height() * 8 * 3;
+    return bytes <= limit / 2 ? depth : Knoux::Utils::WorkingDepth::Bits8;
+}
+
+void PhotoEditor::budgetScratch(const QImage &image) const
+{
+    // Buffers cached for the previous image rarely fit this one. The cache
+    // keeps two frames of the document, each rounded up by at most an eighth
+    // to the arena's size classes, within a quarter of the memory limit.
+    QSettings settings("Knoux", "ArtStudio");
+    const qint64 limit = settings.value("Performance/memoryLimit", 4).toLongLong() << 30;
+    const qint64 frames = 2 * image.sizeInBytes() * 9 / 8;
+    Knoux::Utils::ScratchArena::trim();
+    Knoux::Utils::ScratchArena::setCacheLimit(qMin(frames, limit / 4));
+}
+
+QImage PhotoEditor::toDocumentDepth(QImage &&image) const
+{
+    return Knoux::Utils::PixelKernels::toDepth(std::move(image), m_workingDepth);
+}
+
 void PhotoEditor::undo()
 {
     if (m_undoStack.isEmpty()) return;
+    m_renderScheduler.cancel();
 
     EditState state = m_undoStack.pop();
     m_redoStack.push(state);
 
     // Restore image
     if (!m_undoStack.isEmpty()) {
-        m_currentImage = m_undoStack.top().image;
+        m_currentImage = toDocumentDepth(m_undoStack.top().image.toImage());
     } else {
         m_currentImage = m_originalImage;
     }
+    m_historyImageKey = m_currentImage.cacheKey();
 
     m_canvas->setImage(m_currentImage);
     updateCanvas();
@@ -414,11 +524,13 @@ void PhotoEditor::undo()
 void PhotoEditor::redo()
 {
     if (m_redoStack.isEmpty()) return;
+    m_renderScheduler.cancel();
 
     EditState state = m_redoStack.pop();
     m_undoStack.push(state);
 
-    m_currentImage = state.image;
+    m_currentImage = toDocumentDepth(state.image.toImage());
+    m_historyImageKey = m_currentImage.cacheKey();
     m_canvas->setImage(m_currentImage);
     updateCanvas();
 
@@ -426,14 +538,21 @@ void PhotoEditor::redo()
     emit historyChanged(!m_undoStack.isEmpty(), !m_redoStack.isEmpty());
 }
 
-void PhotoEditor::addHistoryState(const QString &action)
+void PhotoEditor::addHistoryState(const QString &action, const QRect &dirty)
 {
     EditState state;
-    state.image = m_currentImage;
+    // Start from the previous state so tiles that did not change stay shared,
+    // only the tiles touching dirty are compared when it is given. Callers
+    // pass dirty only when the previous state matches the image outside it.
+    if (!m_undoStack.isEmpty()) {
+        state.image = m_undoStack.top().image;
+    }
+    state.image.update(m_currentImage, dirty);
     state.action = action;
     state.timestamp = QDateTime::currentDateTime();
 
     m_undoStack.push(state);
+    m_historyImageKey = m_currentImage.cacheKey();
 
     // Clear redo stack on new action
     m_redoStack.clear();
@@ -483,11 +602,10 @@ void PhotoEditor::zoomTo100()
 
 void PhotoEditor::rotate(int degrees)
 {
+    settleAdjustments();
     if (m_currentImage.isNull()) return;
 
-    QTransform transform;
-    transform.rotate(degrees);
-    m_currentImage = m_currentImage.transformed(transform, Qt::SmoothTransformation);
+    m_currentImage = Knoux::Utils::ImageProcessor::rotate(m_currentImage, degrees);
 
     m_canvas->setImage(m_currentImage);
     updateCanvas();
@@ -496,6 +614,7 @@ void PhotoEditor::rotate(int degrees)
 
 void PhotoEditor::flipHorizontal()
 {
+    settleAdjustments();
     if (m_currentImage.isNull()) return;
 
     m_currentImage = m_currentImage.mirrored(true, false);
@@ -506,6 +625,7 @@ void PhotoEditor::flipHorizontal()
 
 void PhotoEditor::flipVertical()
 {
+    settleAdjustments();
     if (m_currentImage.isNull()) return;
 
     m_currentImage = m_currentImage.mirrored(false, true);
@@ -516,6 +636,7 @@ void PhotoEditor::flipVertical()
 
 void PhotoEditor::crop(const QRect &rect)
 {
+    settleAdjustments();
     if (m_currentImage.isNull() || rect.isEmpty()) return;
 
     m_currentImage = m_currentImage.copy(rect);
@@ -526,9 +647,10 @@ void PhotoEditor::crop(const QRect &rect)
 
 void PhotoEditor::resize(int width, int height)
 {
+    settleAdjustments();
     if (m_currentImage.isNull() || width <= 0 || height <= 0) return;
 
-    m_currentImage = m_currentImage.scaled(width, height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    m_currentImage = Knoux::Utils::ImageProcessor::resize(m_currentImage, QSize(width, height), Qt::IgnoreAspectRatio);
     m_canvas->setImage(m_currentImage);
     updateCanvas();
     addHistoryState(tr("تغيير الحجم"));
@@ -556,83 +678,82 @@ void PhotoEditor::applyAdjustments()
 {
     if (m_originalImage.isNull()) return;
 
-    // Apply adjustments to a copy
-    m_currentImage = m_originalImage.copy();
-
-    // Apply brightness and contrast
-    if (m_adjustments.brightness != 0 || m_adjustments.contrast != 0) {
-        int brightness = m_adjustments.brightness * 255 / 100;
-        float contrast = (m_adjustments.contrast + 100.0f) / 100.0f;
-
-        for (int y = 0; y < m_currentImage.height(); ++y) {
-            for (int x = 0; x < m_currentImage.width(); ++x) {
-                QColor c = m_currentImage.pixelColor(x, y);
-                int r = qBound(0, int((c.red() + brightness - 128) * contrast + 128), 255);
-                int g = qBound(0, int((c.green() + brightness - 128) * contrast + 128), 255);
-                int b = qBound(0, int((c.blue() + brightness - 128) * contrast + 128), 255);
-                m_currentImage.setPixelColor(x, y, QColor(r, g, b, c.alpha()));
-            }
-        }
-    }
+    // Rendered off the GUI thread: a newer slider tick stops the running
+    // render before its next stage and only the newest result reaches
+    // onAdjustmentsRendered. The stage whose slider moved and the ones
+    // after it run again, the earlier ones hand over the result they kept.
+    // A new original (opened, or converted to another depth) starts them
+    // all over.
+    m_renderScheduler.request(m_originalImage, m_adjustments);
+}
 
-    // Apply saturation
-    if (m_adjustments.saturation != 0) {
-        float saturation = (m_adjustments.saturation + 100.0f) / 100.0f;
-        for (int y = 0; y < m_currentImage.height(); ++y) {
-            for (int x = 0; x < m_currentImage.width(); ++x) {
-                QColor c = m_currentImage.pixelColor(x, y);
-                int h, s, v;
-                c.getHsv(&h, &s, &v);
-                s = qBound(0, int(s * saturation), 255);
-                c.setHsv(h, s, v);
-                m_currentImage.setPixelColor(x, y, c);
-            }
-        }
-    }
+void PhotoEditor::onAdjustmentsRendered(const QImage &image)
+{
+    if (image.isNull()) return;
+
+    // The tone pass keeps a deep document deep, the detail filters return 8 bits
+    m_currentImage = toDocumentDepth(QImage(image));
 
     m_canvas->setImage(m_currentImage);
     updateCanvas();
 }
 
-void PhotoEditor::applyGrayscale()
+void PhotoEditor::settleAdjustments()
 {
+    onAdjustmentsRendered(m_renderScheduler.finish());
+}
+
+void PhotoEditor::applyToSelection(const std::function<QImage(QImage)> &filter, const QString &action)
+{
+    settleAdjustments();
     if (m_currentImage.isNull()) return;
 
-    for (int y = 0; y < m_currentImage.height(); ++y) {
-        for (int x = 0; x < m_currentImage.width(); ++x) {
-            QColor c = m_currentImage.pixelColor(x, y);
-            int gray = qGray(c.rgb());
-            m_currentImage.setPixelColor(x, y, QColor(gray, gray, gray, c.alpha()));
-        }
-    }
+    // Filters only touch the selected pixels, so they cost in proportion to it
+    const QRect region = m_hasSelection ? m_selection.intersected(m_currentImage.rect()) : QRect();
+    if (m_hasSelection && region.isEmpty()) return;
 
-    m_canvas->setImage(m_currentImage);
+    // The history only needs the region read again when its top state still
+    // holds the image the filter starts from, slider moves replace all of it
+    const bool historyCurrent = !m_undoStack.isEmpty() && m_currentImage.cacheKey() == m_historyImageKey;
+
+    m_currentImage = Knoux::Utils::ImageProcessor::applyInRegion(std::move(m_currentImage), region, QImage(), filter);
+    m_canvas->updateImage(m_currentImage, region);
     updateCanvas();
-    addHistoryState(tr("تدرج رمادي"));
+    addHistoryState(action, historyCurrent ? region : QRect());
 }
 
-void PhotoEditor::applySepia()
+QImage PhotoEditor::filterSelection(const std::function<QImage(QImage)> &filter, int margin) const
 {
-    if (m_currentImage.isNull()) return;
+    const QRect region = m_hasSelection ? m_selection.intersected(m_currentImage.rect()) : QRect();
+    if (m_hasSelection && region.isEmpty()) return m_currentImage;
+    return Knoux::Utils::ImageProcessor::applyInRegion(m_currentImage, region, QImage(), filter, margin);
+}
 
-    for (int y = 0; y < m_currentImage.height(); ++y) {
-        for (int x = 0; x < m_currentImage.width(); ++x) {
-            QColor c = m_currentImage.pixelColor(x, y);
-            int r = c.red();
-            int g = c.green();
-            int b = c.blue();
+void PhotoEditor::applyGrayscale()
+{
+    applyToSelection([](QImage pixels) {
+        return Knoux::Utils::ImageProcessor::processParallel(std::move(pixels), [](QRgb p) {
+            const int gray = qGray(p);
+            return qRgba(gray, gray, gray, qAlpha(p));
+        });
+    }, tr("تدرج رمادي"));
+}
 
-            int tr = qBound(0, int(0.393 * r + 0.769 * g + 0.189 * b), 255);
-            int tg = qBound(0, int(0.349 * r + 0.686 * g + 0.168 * b), 255);
-            int tb = qBound(0, int(0.272 * r + 0.534 * g + 0.131 * b), 255);
+void PhotoEditor::applySepia()
+{
+    applyToSelection([](QImage pixels) {
+        return Knoux::Utils::ImageProcessor::processParallel(std::move(pixels), [](QRgb p) {
+            const int r = qRed(p);
+            const int g = qGreen(p);
+            const int b = qBlue(p);
 
-            m_currentImage.setPixelColor(x, y, QColor(tr, tg, tb, c.alpha()));
-        }
-    }
+            const int tr = qBound(0, int(0.393 * r + 0.769 * g + 0.189 * b), 255);
+            const int tg = qBound(0, int(0.349 * r + 0.686 * g + 0.168 * b), 255);
+            const int tb = qBound(0, int(0.272 * r + 0.534 * g + 0.131 * b), 255);
 
-    m_canvas->setImage(m_currentImage);
-    updateCanvas();
-    addHistoryState(tr("سيبيا"));
+            return qRgba(tr, tg, tb, qAlpha(p));
+        });
+    }, tr("سيبيا"));
 }
 
 void PhotoEditor::addLayer(const QString &name)
@@ -677,11 +798,7 @@ void PhotoEditor::mergeLayerDown(int index)
     Layer &top = m_layers[index];
     Layer &bottom = m_layers[index - 1];
 
-    QPainter painter(&bottom.image);
-    painter.setOpacity(top.opacity);
-    painter.setCompositionMode(top.blendMode);
-    painter.drawImage(0, 0, top.image);
-    painter.end();
+    Knoux::Utils::Compositor::drawLayer(bottom.image, top.image, top.blendMode, top.opacity);
 
     m_layers.removeAt(index);
     m_currentLayerIndex--;
@@ -699,20 +816,14 @@ void PhotoEditor::renderLayers()
     QImage result(m_layers[0].image.size(), QImage::Format_ARGB32);
     result.fill(Qt::transparent);
 
-    QPainter painter(&result);
-
-    // Render each visible layer
+    // Render each visible layer, supported blend modes go through the SIMD compositor
     for (const Layer &layer : m_layers) {
         if (!layer.visible) continue;
 
-        painter.setOpacity(layer.opacity);
-        painter.setCompositionMode(layer.blendMode);
-        painter.drawImage(0, 0, layer.image);
+        Knoux::Utils::Compositor::drawLayer(result, layer.image, layer.blendMode, layer.opacity);
     }
 
-    painter.end();
-
-    m_currentImage = result;
+    m_currentImage = toDocumentDepth(std::move(result));
     m_canvas->setImage(m_currentImage);
     updateCanvas();
 }
@@ -730,13 +841,10 @@ void PhotoEditor::setBrushSize(int size)
 
 void PhotoEditor::onCanvasMousePress(const QPoint &pos)
 {
+    settleAdjustments();
     m_isDrawing = true;
     m_lastPos = pos;
 
-    if (m_currentLayerIndex >= 0 && m_currentLayerIndex < m_layers.size()) {
-        m_layerBeforeStroke = m_layers[m_currentLayerIndex].image.copy();
-    }
-
     applyTool(pos);
 }
 
@@ -785,6 +893,16 @@ void PhotoEditor::onAdjustmentChanged(const QString &name, int value)
     if (name == "brightness") setBrightness(value);
     else if (name == "contrast") setContrast(value);
     else if (name == "saturation") setSaturation(value);
+    else if (name == "hue") setHue(value);
+    else if (name == "exposure") setExposure(value);
+    else if (name == "highlights") setHighlights(value);
+    else if (name == "shadows") setShadows(value);
+    else if (name == "sharpness") setSharpness(value);
+    else if (name == "blur") setBlur(value);
+    else if (name == "vignette") setVignette(value);
+    else if (name == "temperature") setTemperature(value);
+    else if (name == "tint") setTint(value);
+    else if (name == "noiseReduction") setNoiseReduction(value);
 }
 
 void PhotoEditor::applyTool(const QPoint &pos)
@@ -964,6 +1082,7 @@ void PhotoEditor::setBlur(int value) { m_adjustments.blur = value; applyAdjustme
 void PhotoEditor::setVignette(int value) { m_adjustments.vignette = value; applyAdjustments(); }
 void PhotoEditor::setTemperature(int value) { m_adjustments.temperature = value; applyAdjustments(); }
 void PhotoEditor::setTint(int value) { m_adjustments.tint = value; applyAdjustments(); }
+void PhotoEditor::setNoiseReduction(int value) { m_adjustments.noiseReduction = value; applyAdjustments(); }
 
 void PhotoEditor::applyFilter(const QString &filterName)
 {
@@ -974,32 +1093,22 @@ void PhotoEditor::applyFilter(const QString &filterName)
 
 void PhotoEditor::applyInvert()
 {
-    if (m_currentImage.isNull()) return;
-
-    m_currentImage.invertPixels();
-    m_canvas->setImage(m_currentImage);
-    updateCanvas();
-    addHistoryState(tr("عكس الألوان"));
+    applyToSelection([](QImage pixels) {
+        pixels.invertPixels();
+        return pixels;
+    }, tr("عكس الألوان"));
 }
 
 void PhotoEditor::applyPosterize(int levels)
 {
-    if (m_currentImage.isNull() || levels < 2) return;
-
-    int step = 256 / levels;
-    for (int y = 0; y < m_currentImage.height(); ++y) {
-        for (int x = 0; x < m_currentImage.width(); ++x) {
-            QColor c = m_currentImage.pixelColor(x, y);
-            int r = (c.red() / step) * step;
-            int g = (c.green() / step) * step;
-            int b = (c.blue() / step) * step;
-            m_currentImage.setPixelColor(x, y, QColor(r, g, b, c.alpha()));
-        }
-    }
+    if (levels < 2) return;
 
-    m_canvas->setImage(m_currentImage);
-    updateCanvas();
-    addHistoryState(tr("بوسترايز"));
+    const int step = 256 / levels;
+    applyToSelection([step](QImage pixels) {
+        return Knoux::Utils::ImageProcessor::processParallel(std::move(pixels), [step](QRgb p) {
+            return qRgba(qRed(p) / step * step, qGreen(p) / step * step, qBlue(p) / step * step, qAlpha(p));
+        });
+    }, tr("بوسترايز"));
 }
 
 void PhotoEditor::duplicateLayer(int index)
@@ -1076,6 +1185,7 @@ void PhotoEditor::setSecondaryColor(const QColor &color)
 
 void PhotoEditor::aiAutoEnhance()
 {
+    settleAdjustments();
     if (m_currentImage.isNull()) return;
 
     emit aiProcessingStarted(tr("تحسين تلقائي"));
@@ -1095,7 +1205,9 @@ void PhotoEditor::aiAutoEnhance()
             m_aiProgressTimer->deleteLater();
 
             // Apply enhancement
-            m_currentImage = processAIAutoEnhance(m_currentImage);
+            m_currentImage = toDocumentDepth(filterSelection([this](QImage pixels) {
+                return processAIAutoEnhance(pixels);
+            }));
             m_canvas->setImage(m_currentImage);
             updateCanvas();
             addHistoryState(tr("تحسين AI"));
@@ -1109,6 +1221,7 @@ void PhotoEditor::aiAutoEnhance()
 
 void PhotoEditor::aiRemoveBackground()
 {
+    settleAdjustments();
     if (m_currentImage.isNull()) return;
 
     emit aiProcessingStarted(tr("إزالة الخلفية"));
@@ -1126,7 +1239,7 @@ void PhotoEditor::aiRemoveBackground()
             m_aiProgressTimer->stop();
             m_aiProgressTimer->deleteLater();
 
-            m_currentImage = processAIRemoveBackground(m_currentImage);
+            m_currentImage = toDocumentDepth(processAIRemoveBackground(m_currentImage));
             m_canvas->setImage(m_currentImage);
             updateCanvas();
             addHistoryState(tr("إزالة خلفية AI"));
@@ -1140,6 +1253,7 @@ void PhotoEditor::aiRemoveBackground()
 
 void PhotoEditor::aiUpscale(int scale)
 {
+    settleAdjustments();
     if (m_currentImage.isNull()) return;
     scale = qBound(2, scale, 4);
 
@@ -1158,7 +1272,7 @@ void PhotoEditor::aiUpscale(int scale)
             m_aiProgressTimer->stop();
             m_aiProgressTimer->deleteLater();
 
-            m_currentImage = processAIUpscale(m_currentImage, scale);
+            m_currentImage = toDocumentDepth(processAIUpscale(m_currentImage, scale));
             m_canvas->setImage(m_currentImage);
             updateCanvas();
             addHistoryState(tr("تكبير AI %1x").arg(scale));
@@ -1172,6 +1286,7 @@ void PhotoEditor::aiUpscale(int scale)
 
 void PhotoEditor::aiPortraitEnhance()
 {
+    settleAdjustments();
     if (m_currentImage.isNull()) return;
 
     emit aiProcessingStarted(tr("تحسين البورتريه"));
@@ -1189,7 +1304,10 @@ void PhotoEditor::aiPortraitEnhance()
             m_aiProgressTimer->stop();
             m_aiProgressTimer->deleteLater();
 
-            m_currentImage = processAIPortraitEnhance(m_currentImage);
+            // The guided smooth reads two box radii around each pixel
+            m_currentImage = toDocumentDepth(filterSelection([this](QImage pixels) {
+                return processAIPortraitEnhance(pixels);
+            }, 8));
             m_canvas->setImage(m_currentImage);
             updateCanvas();
             addHistoryState(tr("تحسين بورتريه AI"));
@@ -1203,6 +1321,7 @@ void PhotoEditor::aiPortraitEnhance()
 
 void PhotoEditor::aiColorMatch(const QString &referencePath)
 {
+    settleAdjustments();
     if (m_currentImage.isNull()) return;
 
     QImage reference(referencePath);
@@ -1224,7 +1343,9 @@ void PhotoEditor::aiColorMatch(const QString &referencePath)
             m_aiProgressTimer->stop();
             m_aiProgressTimer->deleteLater();
 
-            m_currentImage = processAIColorMatch(m_currentImage, reference);
+            m_currentImage = toDocumentDepth(filterSelection([this, &reference](QImage pixels) {
+                return processAIColorMatch(pixels, reference);
+            }));
             m_canvas->setImage(m_currentImage);
             updateCanvas();
             addHistoryState(tr("مطابقة ألوان AI"));
@@ -1238,6 +1359,7 @@ void PhotoEditor::aiColorMatch(const QString &referencePath)
 
 void PhotoEditor::aiStyleTransfer(const QString &stylePath)
 {
+    settleAdjustments();
     if (m_currentImage.isNull()) return;
 
     QImage style(stylePath);
@@ -1259,7 +1381,9 @@ void PhotoEditor::aiStyleTransfer(const QString &stylePath)
             m_aiProgressTimer->stop();
             m_aiProgressTimer->deleteLater();
 
-            m_currentImage = processAIStyleTransfer(m_currentImage, style);
+            m_currentImage = toDocumentDepth(filterSelection([this, &style](QImage pixels) {
+                return processAIStyleTransfer(pixels, style);
+            }));
             m_canvas->setImage(m_currentImage);
             updateCanvas();
             addHistoryState(tr("نقل نمط AI"));
@@ -1273,6 +1397,7 @@ void PhotoEditor::aiStyleTransfer(const QString &stylePath)
 
 void PhotoEditor::aiGenerateMask(const QString &prompt)
 {
+    settleAdjustments();
     if (m_currentImage.isNull()) return;
 
     emit aiProcessingStarted(tr("توليد قناع: %1").arg(prompt));
@@ -1288,7 +1413,7 @@ void PhotoEditor::aiGenerateMask(const QString &prompt)
             m_aiProgressTimer->stop();
             m_aiProgressTimer->deleteLater();
 
-            m_currentImage = processAIGenerateMask(m_currentImage, prompt);
+            m_currentImage = toDocumentDepth(processAIGenerateMask(m_currentImage, prompt));
             m_canvas->setImage(m_currentImage);
             updateCanvas();
             addHistoryState(tr("قناع AI"));
@@ -1304,39 +1429,18 @@ void PhotoEditor::aiGenerateMask(const QString &prompt)
 
 QImage PhotoEditor::processAIAutoEnhance(const QImage &input)
 {
-    QImage output = input.copy();
-
-    // Auto-levels implementation
-    int minR = 255, minG = 255, minB = 255;
-    int maxR = 0, maxG = 0, maxB = 0;
-
-    // Find min/max values
-    for (int y = 0; y < output.height(); ++y) {
-        for (int x = 0; x < output.width(); ++x) {
-            QColor c = output.pixelColor(x, y);
-            minR = qMin(minR, c.red());
-            minG = qMin(minG, c.green());
-            minB = qMin(minB, c.blue());
-            maxR = qMax(maxR, c.red());
-            maxG = qMax(maxG, c.green());
-            maxB = qMax(maxB, c.blue());
-        }
-    }
+    // Auto-levels implementation, min/max come from the histogram
+    const Knoux::Utils::HistogramStats stats(input);
+    using Channel = Knoux::Utils::HistogramStats::Channel;
+    const int minimum[3] = {stats.minimum(Channel::Red), stats.minimum(Channel::Green), stats.minimum(Channel::Blue)};
+    const int maximum[3] = {stats.maximum(Channel::Red), stats.maximum(Channel::Green), stats.maximum(Channel::Blue)};
 
     // Apply auto-levels
-    float scaleR = 255.0f / (maxR - minR + 1);
-    float scaleG = 255.0f / (maxG - minG + 1);
-    float scaleB = 255.0f / (maxB - minB + 1);
-
-    for (int y = 0; y < output.height(); ++y) {
-        for (int x = 0; x < output.width(); ++x) {
-            QColor c = output.pixelColor(x, y);
-            int r = qBound(0, int((c.red() - minR) * scaleR), 255);
-            int g = qBound(0, int((c.green() - minG) * scaleG), 255);
-            int b = qBound(0, int((c.blue() - minB) * scaleB), 255);
-            output.setPixelColor(x, y, QColor(r, g, b, c.alpha()));
-        }
-    }
+    QImage output = Knoux::Utils::PixelKernels::toWorkingFormat(input);
+    Knoux::Utils::PixelKernels::applyLut(output, Knoux::Utils::PixelKernels::makeLut([&](int channel, int v) {
+        const float scale = 255.0f / (maximum[channel] - minimum[channel] + 1);
+        return int((v - minimum[channel]) * scale);
+    }));
 
     // Slight saturation boost
     for (int y = 0; y < output.height(); ++y) {
@@ -1355,42 +1459,48 @@ QImage PhotoEditor::processAIAutoEnhance(const QImage &input)
 
 QImage PhotoEditor::processAIRemoveBackground(const QImage &input)
 {
-    // Simplified background removal using edge detection and flood fill
-    QImage output(input.size(), QImage::Format_ARGB32);
-    output.fill(Qt::transparent);
+    using Knoux::Utils::PixelKernels;
+
+    // Simplified background removal: a coverage mask of edges and the
+    // central region, refined with the image as guide so its boundary
+    // follows nearby image edges and fades out instead of cutting pixels
+    const QImage source = PixelKernels::toWorkingFormat(input);
+    const int width = source.width();
+    const int height = source.height();
+    QImage mask(source.size(), QImage::Format_Grayscale8);
+    mask.fill(0);
 
     // Create a simple mask based on brightness difference from edges
     int threshold = 30;
+    auto lightness = [](QRgb p) {
+        return (qMax(qMax(qRed(p), qGreen(p)), qBlue(p)) + qMin(qMin(qRed(p), qGreen(p)), qBlue(p))) / 2;
+    };
 
-    for (int y = 0; y < input.height(); ++y) {
-        for (int x = 0; x < input.width(); ++x) {
-            QColor c = input.pixelColor(x, y);
-
+    for (int y = 0; y < height; ++y) {
+        const QRgb *row = reinterpret_cast<const QRgb *>(source.constScanLine(y));
+        uchar *cover = mask.scanLine(y);
+        for (int x = 0; x < width; ++x) {
             // Simple edge detection
             bool isEdge = false;
-            if (x > 0 && x < input.width() - 1 && y > 0 && y < input.height() - 1) {
-                QColor left = input.pixelColor(x - 1, y);
-                QColor right = input.pixelColor(x + 1, y);
-                QColor top = input.pixelColor(x, y - 1);
-                QColor bottom = input.pixelColor(x, y + 1);
-
-                int diff = qAbs(c.lightness() - left.lightness()) +
-                          qAbs(c.lightness() - right.lightness()) +
-                          qAbs(c.lightness() - top.lightness()) +
-                          qAbs(c.lightness() - bottom.lightness());
+            if (x > 0 && x < width - 1 && y > 0 && y < height - 1) {
+                const QRgb *above = reinterpret_cast<const QRgb *>(source.constScanLine(y - 1));
+                const QRgb *below = reinterpret_cast<const QRgb *>(source.constScanLine(y + 1));
+                const int center = lightness(row[x]);
+                const int diff = qAbs(center - lightness(row[x - 1])) + qAbs(center - lightness(row[x + 1])) +
+                                 qAbs(center - lightness(above[x])) + qAbs(center - lightness(below[x]));
 
                 isEdge = diff > threshold * 4;
             }
 
             // Keep pixels that are part of edges or interior
-            if (isEdge || (x > input.width() * 0.1 && x < input.width() * 0.9 &&
-                          y > input.height() * 0.1 && y < input.height() * 0.9)) {
-                output.setPixelColor(x, y, c);
+            if (isEdge || (x > width * 0.1 && x < width * 0.9 && y > height * 0.1 && y < height * 0.9)) {
+                cover[x] = 255;
             }
         }
     }
 
-    return output;
+    const QImage refined = Knoux::Utils::EdgeAwareFilters::guided(mask, source, 8, 100.0f);
+    return Knoux::Utils::ImageProcessor::applyMask(source, refined);
 }
 
 QImage PhotoEditor::processAIUpscale(const QImage &input, int scale)
@@ -1399,40 +1509,33 @@ QImage PhotoEditor::processAIUpscale(const QImage &input, int scale)
     int newWidth = input.width() * scale;
     int newHeight = input.height() * scale;
 
-    return input.scaled(newWidth, newHeight, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    return Knoux::Utils::ImageProcessor::resize(input, QSize(newWidth, newHeight), Qt::IgnoreAspectRatio,
+                                                Knoux::Utils::ResampleFilter::Lanczos3);
 }
 
 QImage PhotoEditor::processAIPortraitEnhance(const QImage &input)
 {
-    QImage output = input.copy();
+    using Knoux::Utils::PixelKernels;
 
-    // Skin smoothing simulation
-    for (int y = 1; y < output.height() - 1; ++y) {
-        for (int x = 1; x < output.width() - 1; ++x) {
-            QColor c = output.pixelColor(x, y);
+    // Skin tones take the edge-preserving smooth of the image, so pores
+    // soften without blurring across the outline of the face
+    const QImage smooth = Knoux::Utils::EdgeAwareFilters::guided(input, QImage(), 4, 400.0f);
+    QImage output = PixelKernels::toWorkingFormat(input);
 
-            // Detect skin tones (simplified)
-            bool isSkin = (c.red() > 60 && c.red() < 255 &&
-                          c.green() > 40 && c.green() < 220 &&
-                          c.blue() > 20 && c.blue() < 170 &&
-                          c.red() > c.green() && c.green() > c.blue());
+    PixelKernels::forEachRow(output, [&smooth](QRgb *row, int width, int y) {
+        const QRgb *smoothRow = reinterpret_cast<const QRgb *>(smooth.constScanLine(y));
+        for (int x = 0; x < width; ++x) {
+            const int r = qRed(row[x]);
+            const int g = qGreen(row[x]);
+            const int b = qBlue(row[x]);
 
+            // Detect skin tones (simplified)
+            const bool isSkin = r > 60 && r < 255 && g > 40 && g < 220 && b > 20 && b < 170 && r > g && g > b;
             if (isSkin) {
-                // Apply slight blur to skin areas
-                int r = 0, g = 0, b = 0, a = 0;
-                for (int dy = -1; dy <= 1; ++dy) {
-                    for (int dx = -1; dx <= 1; ++dx) {
-                        QColor nc = input.pixelColor(x + dx, y + dy);
-                        r += nc.red();
-                        g += nc.green();
-                        b += nc.blue();
-                        a += nc.alpha();
-                    }
-                }
-                output.setPixelColor(x, y, QColor(r / 9, g / 9, b / 9, a / 9));
+                row[x] = PixelKernels::pack(qRed(smoothRow[x]), qGreen(smoothRow[x]), qBlue(smoothRow[x]), row[x]);
             }
         }
-    }
+    });
 
     // Eye brightening (simplified - brighten upper portion)
     int eyeY = output.height() / 3;
@@ -1455,47 +1558,21 @@ QImage PhotoEditor::processAIPortraitEnhance(const QImage &input)
 
 QImage PhotoEditor::processAIColorMatch(const QImage &input, const QImage &reference)
 {
-    QImage output = input.copy();
-
     // Calculate mean colors
-    qint64 refR = 0, refG = 0, refB = 0;
-    qint64 inR = 0, inG = 0, inB = 0;
-    int refCount = 0, inCount = 0;
-
-    for (int y = 0; y < reference.height(); ++y) {
-        for (int x = 0; x < reference.width(); ++x) {
-            QColor c = reference.pixelColor(x, y);
-            refR += c.red();
-            refG += c.green();
-            refB += c.blue();
-            refCount++;
-        }
-    }
+    using Knoux::Utils::HistogramStats;
+    const HistogramStats refStats(reference);
+    const HistogramStats inStats(input);
 
-    for (int y = 0; y < input.height(); ++y) {
-        for (int x = 0; x < input.width(); ++x) {
-            QColor c = input.pixelColor(x, y);
-            inR += c.red();
-            inG += c.green();
-            inB += c.blue();
-            inCount++;
-        }
-    }
-
-    float ratioR = (refR / refCount) / (inR / inCount);
-    float ratioG = (refG / refCount) / (inG / inCount);
-    float ratioB = (refB / refCount) / (inB / inCount);
+    auto ratio = [&](HistogramStats::Channel channel) {
+        return float(refStats.mean(channel) / qMax(1.0, inStats.mean(channel)));
+    };
+    const float ratios[3] = {ratio(HistogramStats::Red), ratio(HistogramStats::Green), ratio(HistogramStats::Blue)};
 
     // Apply color matching
-    for (int y = 0; y < output.height(); ++y) {
-        for (int x = 0; x < output.width(); ++x) {
-            QColor c = output.pixelColor(x, y);
-            int r = qBound(0, int(c.red() * ratioR), 255);
-            int g = qBound(0, int(c.green() * ratioG), 255);
-            int b = qBound(0, int(c.blue() * ratioB), 255);
-            output.setPixelColor(x, y, QColor(r, g, b, c.alpha()));
-        }
-    }
+    QImage output = Knoux::Utils::PixelKernels::toWorkingFormat(input);
+    Knoux::Utils::PixelKernels::applyLut(output, Knoux::Utils::PixelKernels::makeLut([&](int channel, int v) {
+        return int(v * ratios[channel]);
+    }));
 
     return output;
 }
@@ -1526,45 +1603,39 @@ QImage PhotoEditor::processAIStyleTransfer(const QImage &input, const QImage &st
 
 QImage PhotoEditor::processAIGenerateMask(const QImage &input, const QString &prompt)
 {
-    // Simplified mask generation - create a gradient mask
-    QImage mask(input.size(), QImage::Format_ARGB32);
+    using Knoux::Utils::ImageProcessor;
+
+    // Simplified mask generation - one coverage byte per pixel
+    const QSize size = input.size();
 
     // Parse prompt for keywords (simplified)
     bool isCenter = prompt.contains("center") || prompt.contains("center");
     bool isTop = prompt.contains("top") || prompt.contains("top");
 
-    for (int y = 0; y < mask.height(); ++y) {
-        for (int x = 0; x < mask.width(); ++x) {
-            float alpha = 1.0f;
-
-            if (isCenter) {
-                float dx = (x - mask.width() / 2.0f) / (mask.width() / 2.0f);
-                float dy = (y - mask.height() / 2.0f) / (mask.height() / 2.0f);
-                alpha = 1.0f - qMin(1.0f, std::sqrt(dx * dx + dy * dy));
-            } else if (isTop) {
-                alpha = 1.0f - (float(y) / mask.height());
-            } else {
-                // Default gradient from left to right
-                alpha = float(x) / mask.width();
+    QImage mask;
+    if (isCenter) {
+        // Elliptical falloff that reaches the middle of every edge
+        using Gray = Knoux::Utils::PixelTraits<QImage::Format_Grayscale8>;
+        mask = QImage(size, QImage::Format_Grayscale8);
+        const float halfWidth = size.width() / 2.0f;
+        const float halfHeight = size.height() / 2.0f;
+        Knoux::Utils::PixelKernels::forEachRowAs<Gray>(Knoux::Utils::ImageView(mask),
+                                                       [&](quint8 *row, int width, int y) {
+            const float dy = (y - halfHeight) / halfHeight;
+            for (int x = 0; x < width; ++x) {
+                const float dx = (x - halfWidth) / halfWidth;
+                row[x] = quint8((1.0f - qMin(1.0f, std::sqrt(dx * dx + dy * dy))) * 255);
             }
-
-            int a = int(alpha * 255);
-            mask.setPixelColor(x, y, QColor(a, a, a, 255));
-        }
+        });
+    } else if (isTop) {
+        mask = ImageProcessor::createGradientMask(size, QPointF(0, 0), QPointF(0, size.height()));
+    } else {
+        // Default gradient from left to right
+        mask = ImageProcessor::createGradientMask(size, QPointF(size.width(), 0), QPointF(0, 0));
     }
 
     // Apply mask to input
-    QImage output(input.size(), QImage::Format_ARGB32);
-    for (int y = 0; y < output.height(); ++y) {
-        for (int x = 0; x < output.width(); ++x) {
-            QColor inColor = input.pixelColor(x, y);
-            int maskAlpha = mask.pixelColor(x, y).red();
-            inColor.setAlpha(maskAlpha);
-            output.setPixelColor(x, y, inColor);
-        }
-    }
-
-    return output;
+    return ImageProcessor::applyMask(input, mask);
 }
 
 // ==================== CanvasWidget Implementation ====================
@@ -1581,7 +1652,16 @@ CanvasWidget::CanvasWidget(QWidget *parent)
 
 void CanvasWidget::setImage(const QImage &image)
 {
-    m_image = image;
+    // Deep documents are drawn from an 8-bit copy, made once per change
+    m_image = image.depth() > 32 ? image.convertToFormat(QImage::Format_ARGB32) : image;
+    m_pyramid.update(m_image);
+    update();
+}
+
+void CanvasWidget::updateImage(const QImage &image, const QRect &dirty)
+{
+    m_image = image.depth() > 32 ? image.convertToFormat(QImage::Format_ARGB32) : image;
+    m_pyramid.update(m_image, dirty);
     update();
 }
 
@@ -1673,7 +1753,12 @@ void CanvasWidget::drawImage(QPainter &painter)
     }
 
     QRect imgRect = visibleImageRect();
-    painter.drawImage(imgRect, m_image);
+    if (m_zoom < 1.0f) {
+        // Zoomed out, draw the pyramid level closest to the screen size
+        painter.drawImage(imgRect, m_pyramid.level(m_pyramid.levelForScale(m_zoom)));
+    } else {
+        painter.drawImage(imgRect, m_image);
+    }
 }
 
 void CanvasWidget::drawSelection(QPainter &painter)
@@ -1873,7 +1958,8 @@ void LayersPanel::createLayerItem(int index, const Layer &layer)
     QLabel *thumbLabel = new QLabel(item);
     thumbLabel->setFixedSize(40, 40);
     if (!layer.image.isNull()) {
-        QPixmap thumb = QPixmap::fromImage(layer.image.scaled(40, 40, Qt::KeepAspectRatio, Qt::SmoothTransformation));
+        const QSize thumbSize = layer.image.size().scaled(40, 40, Qt::KeepAspectRatio);
+        QPixmap thumb = QPixmap::fromImage(Knoux::Utils::ImagePyramid::cachedScaled(layer.image, thumbSize));
         thumbLabel->setPixmap(thumb);
     }
     thumbLabel->setStyleSheet("background: rgba(0,0,0,0.3); border-radius: 4px;");
@@ -1944,13 +2030,17 @@ void AdjustmentsPanel::setupUI()
     QStringList labels = {
         tr("السطوع"), tr("التباين"), tr("التشبع"),
         tr("درجة اللون"), tr("التعريض"), tr("الإضاءة العالية"),
-        tr("الظلال"), tr("الحدة"), tr("الضبابية")
+        tr("الظلال"), tr("الحدة"), tr("الضبابية"),
+        tr("الحرارة"), tr("الصبغة"), tr("تقليل الضوضاء"),
+        tr("التعتيم")
     };
 
     QStringList names = {
         "brightness", "contrast", "saturation",
         "hue", "exposure", "highlights",
-        "shadows", "sharpness", "blur"
+        "shadows", "sharpness", "blur",
+        "temperature", "tint", "noiseReduction",
+        "vignette"
     };
 
     for (int i = 0; i < labels.size(); ++i) {
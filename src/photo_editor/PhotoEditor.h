@@ -6,6 +6,12 @@
 #include <QStack>
 #include <QTimer>
 #include <QPropertyAnimation>
+#include <functional>
+
+#include "../utils/ImagePyramid.h"
+#include "../utils/PixelFormat.h"
+#include "../utils/RenderScheduler.h"
+#include "../utils/TiledImage.h"
 
 class CanvasWidget;
 class LayersPanel;
@@ -19,7 +25,7 @@ class QSlider;
 class QProgressBar;
 
 struct EditState {
-    QImage image;
+    Knoux::Utils::TiledImage image;  // Shares unchanged tiles with the previous state
     QString action;
     QDateTime timestamp;
 };
@@ -49,6 +55,14 @@ public:
     int brushSize() const { return m_brushSize; }
     void setBrushSize(int size);
 
+    // Channel depth of the open document, saved with it. Documents that were
+    // not saved with one open at the depth from the settings.
+    Knoux::Utils::WorkingDepth workingDepth() const { return m_workingDepth; }
+    void setWorkingDepth(Knoux::Utils::WorkingDepth depth);
+
+    // Adjustment renders published, dropped and cancelled so far
+    Knoux::Utils::RenderScheduler::Stats adjustmentRenderStats() const { return m_renderScheduler.stats(); }
+
 public slots:
     void openImage(const QString &path);
     void saveImage();
@@ -82,6 +96,7 @@ public slots:
     void setVignette(int value);
     void setTemperature(int value);
     void setTint(int value);
+    void setNoiseReduction(int value);
 
     // Filters
     void applyFilter(const QString &filterName);
@@ -148,11 +163,12 @@ private slots:
     void onCanvasWheel(int delta);
     void onLayerSelected(int index);
     void onAdjustmentChanged(const QString &name, int value);
+    void onAdjustmentsRendered(const QImage &image);
     void onToolSelected(const QString &tool);
     void onAIOperationClicked(const QString &operation);
     void updateCanvas();
     void renderLayers();
-    void addHistoryState(const QString &action);
+    void addHistoryState(const QString &action, const QRect &dirty = QRect());
 
 private:
     void setupUI();
@@ -164,12 +180,31 @@ private:
     void setupShortcuts();
 
     void applyAdjustments();
+    // Waits for an adjustment render still running, for edits that build on it
+    void settleAdjustments();
+    // Runs filter on the selection, or the whole image without one
+    void applyToSelection(const std::function<QImage(QImage)> &filter, const QString &action);
+    // The current image with filter run on the selection only, margin pixels
+    // of context around it for filters that read neighbours
+    QImage filterSelection(const std::function<QImage(QImage)> &filter, int margin = 0) const;
     void applyTool(const QPoint &pos);
     void drawBrush(const QPoint &pos);
     void drawLine(const QPoint &from, const QPoint &to);
     void fillArea(const QPoint &pos);
     void pickColor(const QPoint &pos);
 
+    // Deep documents fall back to 8 bits when they would not fit the memory limit
+    Knoux::Utils::WorkingDepth budgetedDepth(Knoux::Utils::WorkingDepth depth, const QSize &size) const;
+    // Frees the scratch cache and sizes it to two frames of the document
+    void budgetScratch(const QImage &image) const;
+    QImage toDocumentDepth(QImage &&image) const;
+    QImage imageForExport(const QString &format) const;
+    bool writeImage(const QString &path, const QByteArray &format) const;
+    // Depth saved with image, or the settings' default when it has none
+    Knoux::Utils::WorkingDepth storedDepth(const QImage &image) const;
+    // Text key the working depth is saved under, in the formats that keep text
+    static constexpr const char *WORKING_DEPTH_KEY = "KnouxWorkingDepth";
+
     QImage processAIAutoEnhance(const QImage &input);
     QImage processAIRemoveBackground(const QImage &input);
     QImage processAIUpscale(const QImage &input, int scale);
@@ -206,6 +241,7 @@ private:
     QImage m_previewImage;
     QString m_currentPath;
     bool m_isModified;
+    Knoux::Utils::WorkingDepth m_workingDepth;
 
     // Layers
     QVector<Layer> m_layers;
@@ -215,6 +251,9 @@ private:
     QStack<EditState> m_undoStack;
     QStack<EditState> m_redoStack;
     static const int MAX_HISTORY_SIZE = 50;
+    // Cache key of m_currentImage when the top undo state was taken from or
+    // restored to it; anything else (an adjustment render) means they differ
+    qint64 m_historyImageKey = 0;
 
     // Tools
     QString m_currentTool;
@@ -230,26 +269,14 @@ private:
     QRect m_selection;
     bool m_hasSelection;
 
-    // Adjustments
-    struct Adjustments {
-        int brightness = 0;
-        int contrast = 0;
-        int saturation = 0;
-        int hue = 0;
-        int exposure = 0;
-        int highlights = 0;
-        int shadows = 0;
-        int sharpness = 0;
-        int blur = 0;
-        int vignette = 0;
-        int temperature = 0;
-        int tint = 0;
-    } m_adjustments;
+    // Adjustments, rendered from m_originalImage off the GUI thread by a
+    // graph that keeps the result of every stage for the next slider move
+    Knoux::Utils::AdjustmentGraph::Parameters m_adjustments;
+    Knoux::Utils::RenderScheduler m_renderScheduler;
 
     // Drawing state
     bool m_isDrawing;
     QPoint m_lastPos;
-    QImage m_layerBeforeStroke;
 
     // AI state
     bool m_isAIProcessing;
@@ -265,6 +292,8 @@ public:
     explicit CanvasWidget(QWidget *parent = nullptr);
 
     void setImage(const QImage &image);
+    // Same size as the current image, only dirty changed
+    void updateImage(const QImage &image, const QRect &dirty);
     void setZoom(float zoom);
     void setOffset(const QPoint &offset);
     void setSelection(const QRect &selection);
@@ -294,6 +323,7 @@ private:
     void drawOverlay(QPainter &painter);
 
     QImage m_image;
+    Knoux::Utils::ImagePyramid m_pyramid;  // Downscaled copies for zoomed-out drawing
     float m_zoom;
     QPoint m_offset;
     QRect m_selection;
@@ -1,6 +1,7 @@
 #include "SettingsPanel.h"
 #include "GlassButton.h"
 #include "GlassPanel.h"
+#include "../utils/ParallelExecutor.h"
 
 #include <QPainter>
 #include <QVBoxLayout>
@@ -303,10 +304,17 @@ void SettingsPanel::createPerformanceTab()
 
     hwLayout->addWidget(new QLabel(tr("عدد الخيوط:")), 2, 0);
     m_threadCountSpin = new QSpinBox();
-    m_threadCountSpin->setRange(1, 32);
-    m_threadCountSpin->setValue(DEFAULT_THREAD_COUNT);
+    m_threadCountSpin->setRange(1, Knoux::Utils::ParallelExecutor::MaxThreadCount);
+    m_threadCountSpin->setValue(Knoux::Utils::ParallelExecutor::defaultThreadCount());
     hwLayout->addWidget(m_threadCountSpin, 2, 1);
 
+    // Order matches Knoux::Utils::WorkingDepth. The photo editor opens images
+    // at this depth unless they were saved with one of their own.
+    hwLayout->addWidget(new QLabel(tr("عمق المعالجة الافتراضي:")), 3, 0);
+    m_workingDepthCombo = new QComboBox();
+    m_workingDepthCombo->addItems({tr("8 بت (سرعة)"), tr("16 بت (جودة)"), tr("16 بت عائم (مدى أعلى)")});
+    hwLayout->addWidget(m_workingDepthCombo, 3, 1);
+
     layout->addWidget(hwGroup);
 
     // Cache
@@ -520,7 +528,9 @@ void SettingsPanel::loadPerformanceSettings()
     m_settings->beginGroup("Performance");
     m_gpuAccelerationCheck->setChecked(m_settings->value("gpuAcceleration", true).toBool());
     m_memoryLimitSpin->setValue(m_settings->value("memoryLimit", DEFAULT_MEMORY_LIMIT).toInt());
-    m_threadCountSpin->setValue(m_settings->value("threadCount", DEFAULT_THREAD_COUNT).toInt());
+    m_threadCountSpin->setValue(m_settings->value("threadCount",
+        Knoux::Utils::ParallelExecutor::defaultThreadCount()).toInt());
+    m_workingDepthCombo->setCurrentIndex(m_settings->value("workingDepth", 0).toInt());
     m_cacheSizeSpin->setValue(m_settings->value("cacheSize", DEFAULT_CACHE_SIZE).toInt());
     m_previewOnHoverCheck->setChecked(m_settings->value("previewOnHover", true).toBool());
     m_previewQualityCombo->setCurrentIndex(m_settings->value("previewQuality", 1).toInt());
@@ -582,6 +592,7 @@ void SettingsPanel::savePerformanceSettings()
     m_settings->setValue("gpuAcceleration", m_gpuAccelerationCheck->isChecked());
     m_settings->setValue("memoryLimit", m_memoryLimitSpin->value());
     m_settings->setValue("threadCount", m_threadCountSpin->value());
+    m_settings->setValue("workingDepth", m_workingDepthCombo->currentIndex());
     m_settings->setValue("cacheSize", m_cacheSizeSpin->value());
     m_settings->setValue("previewOnHover", m_previewOnHoverCheck->isChecked());
     m_settings->setValue("previewQuality", m_previewQualityCombo->currentIndex());
@@ -612,6 +623,9 @@ void SettingsPanel::applySettings()
                              QColor(0, 255, 128), QColor(255, 128, 0)};
     applyAccentColor(accentColors[m_accentColorCombo->currentIndex()]);
 
+    // Resize the shared image processing pool
+    Knoux::Utils::ParallelExecutor::setThreadCount(m_threadCountSpin->value());
+
     emit settingsChanged("all");
 }
 
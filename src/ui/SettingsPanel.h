@@ -106,6 +106,7 @@ private:
     QCheckBox *m_gpuAccelerationCheck;
     QSpinBox *m_memoryLimitSpin;
     QSpinBox *m_threadCountSpin;
+    QComboBox *m_workingDepthCombo;
     QSpinBox *m_cacheSizeSpin;
     QCheckBox *m_previewOnHoverCheck;
     QComboBox *m_previewQualityCombo;
@@ -126,7 +127,6 @@ private:
     // Default values
     static constexpr int DEFAULT_AUTO_SAVE_INTERVAL = 5;
     static constexpr int DEFAULT_MEMORY_LIMIT = 4;
-    static constexpr int DEFAULT_THREAD_COUNT = 4;
     static constexpr int DEFAULT_CACHE_SIZE = 1024;
     static constexpr int DEFAULT_GLASS_OPACITY = 15;
     static constexpr int DEFAULT_ANIMATION_SPEED = 100;
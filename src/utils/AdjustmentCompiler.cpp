@@ -0,0 +1,356 @@
+#include "AdjustmentCompiler.h"
+#include "ImageProcessor.h"
+#include "SimdKernels.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace Knoux {
+namespace Utils {
+
+namespace {
+
+// Channel value at lattice index i of the color cube
+inline int latticeValue(int i) {
+    const int steps = CompiledAdjustment::CubeSize - 1;
+    return (i * 255 + steps / 2) / steps;
+}
+
+// Lattice cell holding value (in 8-bit units) and the position inside it
+inline int latticeCell(float value, float *fraction) {
+    const int last = CompiledAdjustment::CubeSize - 2;
+    int i = qBound(0, int(value * (last + 1) / 255.0f), last);
+    while (i < last && latticeValue(i + 1) <= value) ++i;
+    while (i > 0 && latticeValue(i) > value) --i;
+    const int lo = latticeValue(i);
+    *fraction = (value - lo) / (latticeValue(i + 1) - lo);
+    return i;
+}
+
+} // namespace
+
+// ============================================================================
+// CompiledAdjustment
+// ============================================================================
+
+QImage CompiledAdjustment::apply(const QImage &input) const {
+    return apply(QImage(input));
+}
+
+QImage CompiledAdjustment::apply(QImage &&input) const {
+    if (input.isNull()) return QImage();
+
+    // 16-bit images keep their depth, tables are sampled between entries
+    if (input.depth() == 64) {
+        QImage result;
+        const bool native = visitPixelFormat(input.format(), [&](auto traits) {
+            result = PixelKernels::toWritable(std::move(input));
+            applyAs<decltype(traits)>(ImageView(result));
+            return true;
+        });
+        if (native) return result;
+    }
+
+    QImage result = PixelKernels::toWorkingFormat(std::move(input));
+    applyInPlace(result);
+    return result;
+}
+
+void CompiledAdjustment::applyInPlace(QImage &image) const {
+    applyInPlace(ImageView(image));
+}
+
+void CompiledAdjustment::applyInPlace(const ImageView &view) const {
+    switch (m_kind) {
+    case Kind::Identity:
+        break;
+    case Kind::Channel:
+        PixelKernels::applyLut(view, m_lut);
+        break;
+    case Kind::Cube:
+        applyCube(view);
+        break;
+    }
+}
+
+void CompiledAdjustment::applyCube(const ImageView &view) const {
+    // Per 8-bit value: lattice cell along one axis and the position inside
+    // it in 1/256ths, packed as cell << 9 | fraction
+    static const QVector<int> axis = [] {
+        QVector<int> table(256);
+        for (int v = 0, i = 0; v < 256; ++v) {
+            while (i < CubeSize - 2 && latticeValue(i + 1) <= v) ++i;
+            const int lo = latticeValue(i);
+            const int span = latticeValue(i + 1) - lo;
+            table[v] = i << 9 | ((v - lo) * 256 + span / 2) / span;
+        }
+        return table;
+    }();
+
+    const CubeLutParams params = {m_cube.constData(), axis.constData(), CubeSize};
+    const SimdKernelTable &kernels = SimdKernels::table();
+    PixelKernels::forEachRow(view, [&](QRgb *row, int width, int) {
+        kernels.cube(row, width, params);
+    });
+}
+
+template <typename Traits>
+void CompiledAdjustment::applyAs(const ImageView &view) const {
+    switch (m_kind) {
+    case Kind::Identity:
+        break;
+    case Kind::Channel:
+        PixelKernels::applyLutAs<Traits>(view, m_lut);
+        break;
+    case Kind::Cube:
+        applyCubeAs<Traits>(view);
+        break;
+    }
+}
+
+template <typename Traits>
+void CompiledAdjustment::applyCubeAs(const ImageView &view) const {
+    // Same tetrahedral walk as the 8-bit kernel, in float so that the
+    // fraction bits of deeper channels reach the output
+    constexpr float toUnits = 255.0f / Traits::Max;
+    constexpr float fromUnits = Traits::Max / 255.0f;
+    const QRgb *lattice = m_cube.constData();
+
+    PixelKernels::forEachRowAs<Traits>(view, [&](typename Traits::Pixel *row, int width, int) {
+        for (int x = 0; x < width; ++x) {
+            const typename Traits::Pixel p = row[x];
+            float f[3];
+            const int base = latticeCell(Traits::red(p) * toUnits, &f[0])
+                           + latticeCell(Traits::green(p) * toUnits, &f[1]) * CubeSize
+                           + latticeCell(Traits::blue(p) * toUnits, &f[2]) * CubeSize * CubeSize;
+
+            // Axes by decreasing fraction, stepping along the largest first
+            int step[3] = {1, CubeSize, CubeSize * CubeSize};
+            for (int i = 0; i < 2; ++i) {
+                for (int j = 2; j > i; --j) {
+                    if (f[j] > f[j - 1]) {
+                        std::swap(f[j], f[j - 1]);
+                        std::swap(step[j], step[j - 1]);
+                    }
+                }
+            }
+            const QRgb c0 = lattice[base];
+            const QRgb c1 = lattice[base + step[0]];
+            const QRgb c2 = lattice[base + step[0] + step[1]];
+            const QRgb c3 = lattice[base + step[0] + step[1] + step[2]];
+            const float w0 = 1.0f - f[0];
+            const float w1 = f[0] - f[1];
+            const float w2 = f[1] - f[2];
+            const float w3 = f[2];
+
+            auto mix = [&](int (*channel)(QRgb)) {
+                const float v = channel(c0) * w0 + channel(c1) * w1 + channel(c2) * w2 + channel(c3) * w3;
+                return qBound(0, int(v * fromUnits + 0.5f), Traits::Max);
+            };
+            row[x] = Traits::make(mix(qRed), mix(qGreen), mix(qBlue), Traits::alpha(p));
+        }
+    });
+}
+
+// ============================================================================
+// AdjustmentCompiler
+// ============================================================================
+
+AdjustmentCompiler &AdjustmentCompiler::addBrightness(int value) {
+    return value == 0 ? *this : add(OpType::Brightness, value);
+}
+
+AdjustmentCompiler &AdjustmentCompiler::addContrast(float value) {
+    return qFuzzyIsNull(value) ? *this : add(OpType::Contrast, value);
+}
+
+AdjustmentCompiler &AdjustmentCompiler::addExposure(float value) {
+    return qFuzzyIsNull(value) ? *this : add(OpType::Exposure, value);
+}
+
+AdjustmentCompiler &AdjustmentCompiler::addWhites(float value) {
+    return qFuzzyIsNull(value) ? *this : add(OpType::Whites, value);
+}
+
+AdjustmentCompiler &AdjustmentCompiler::addBlacks(float value) {
+    return qFuzzyIsNull(value) ? *this : add(OpType::Blacks, value);
+}
+
+AdjustmentCompiler &AdjustmentCompiler::addLevels(int black, int gamma, int white) {
+    if (black == 0 && gamma == 100 && white == 255) return *this;
+    return add(OpType::Levels, black, gamma, white);
+}
+
+AdjustmentCompiler &AdjustmentCompiler::addCurves(const QVector<QPointF> &curve) {
+    if (curve.size() < 2) return *this;
+    add(OpType::Curves, 0);
+    m_ops.last().curve = curve;
+    return *this;
+}
+
+AdjustmentCompiler &AdjustmentCompiler::addColorBalance(int red, int green, int blue) {
+    if (red == 0 && green == 0 && blue == 0) return *this;
+    return add(OpType::ColorBalance, red, green, blue);
+}
+
+AdjustmentCompiler &AdjustmentCompiler::addTemperature(int kelvin) {
+    return kelvin == 6500 ? *this : add(OpType::Temperature, kelvin);
+}
+
+AdjustmentCompiler &AdjustmentCompiler::addTint(int value) {
+    return value == 0 ? *this : add(OpType::Tint, value);
+}
+
+AdjustmentCompiler &AdjustmentCompiler::addSaturation(float value) {
+    return qFuzzyIsNull(value) ? *this : add(OpType::Saturation, value);
+}
+
+AdjustmentCompiler &AdjustmentCompiler::addVibrance(float value) {
+    // Vibrance has no neutral setting, every value reshapes saturation
+    return add(OpType::Vibrance, value);
+}
+
+AdjustmentCompiler &AdjustmentCompiler::addHueShift(int degrees) {
+    return degrees % 360 == 0 ? *this : add(OpType::HueShift, degrees);
+}
+
+AdjustmentCompiler &AdjustmentCompiler::addHighlights(float value) {
+    // 0 is neutral, positive values brighten the bright tones, negative ones darken them
+    return qFuzzyIsNull(value) ? *this : add(OpType::Highlights, value);
+}
+
+AdjustmentCompiler &AdjustmentCompiler::addShadows(float value) {
+    // 0 is neutral, positive values lift the dark tones, negative ones deepen them
+    return qFuzzyIsNull(value) ? *this : add(OpType::Shadows, value);
+}
+
+void AdjustmentCompiler::clear() {
+    m_ops.clear();
+}
+
+bool AdjustmentCompiler::mixesChannels() const {
+    for (const Op &op : m_ops) {
+        if (op.type >= OpType::Saturation) return true;
+    }
+    return false;
+}
+
+CompiledAdjustment AdjustmentCompiler::compile() const {
+    CompiledAdjustment compiled;
+    if (m_ops.isEmpty()) return compiled;
+
+    if (!mixesChannels()) {
+        // Every channel sees the same input, so one gray ramp through the
+        // real operations yields all three tables exactly
+        QImage ramp(256, 1, QImage::Format_RGB32);
+        QRgb *in = reinterpret_cast<QRgb *>(ramp.scanLine(0));
+        for (int v = 0; v < 256; ++v) {
+            in[v] = qRgb(v, v, v);
+        }
+
+        const QImage mapped = evaluate(ramp);
+        const QRgb *out = reinterpret_cast<const QRgb *>(mapped.constScanLine(0));
+
+        bool identity = true;
+        for (int v = 0; v < 256; ++v) {
+            compiled.m_lut.red[v] = static_cast<uchar>(qRed(out[v]));
+            compiled.m_lut.green[v] = static_cast<uchar>(qGreen(out[v]));
+            compiled.m_lut.blue[v] = static_cast<uchar>(qBlue(out[v]));
+            identity = identity && (out[v] & 0xffffffu) == uint(v) * 0x010101u;
+        }
+
+        compiled.m_kind = identity ? CompiledAdjustment::Kind::Identity
+                                   : CompiledAdjustment::Kind::Channel;
+        return compiled;
+    }
+
+    // Lattice image, one row per blue level with red varying fastest
+    const int n = CompiledAdjustment::CubeSize;
+    QImage lattice(n * n, n, QImage::Format_RGB32);
+    for (int b = 0; b < n; ++b) {
+        QRgb *row = reinterpret_cast<QRgb *>(lattice.scanLine(b));
+        for (int g = 0; g < n; ++g) {
+            for (int r = 0; r < n; ++r) {
+                row[g * n + r] = qRgb(latticeValue(r), latticeValue(g), latticeValue(b));
+            }
+        }
+    }
+
+    const QImage mapped = evaluate(lattice);
+    compiled.m_cube.resize(n * n * n);
+    for (int b = 0; b < n; ++b) {
+        const QRgb *row = reinterpret_cast<const QRgb *>(mapped.constScanLine(b));
+        std::copy(row, row + n * n, compiled.m_cube.begin() + b * n * n);
+    }
+
+    compiled.m_kind = CompiledAdjustment::Kind::Cube;
+    return compiled;
+}
+
+AdjustmentCompiler &AdjustmentCompiler::add(OpType type, float a, float b, float c) {
+    m_ops.append({type, {a, b, c}, QVector<QPointF>()});
+    return *this;
+}
+
+QImage AdjustmentCompiler::evaluate(const QImage &probe) const {
+    // The first operation copies the probe, the rest reuse that buffer
+    QImage image = probe;
+
+    for (const Op &op : m_ops) {
+        const float *p = op.params;
+        switch (op.type) {
+        case OpType::Brightness:
+            image = ImageProcessor::applyBrightness(std::move(image), static_cast<int>(p[0]));
+            break;
+        case OpType::Contrast:
+            image = ImageProcessor::applyContrast(std::move(image), p[0]);
+            break;
+        case OpType::Exposure:
+            image = ImageProcessor::applyExposure(std::move(image), p[0]);
+            break;
+        case OpType::Whites:
+            image = ImageProcessor::applyWhites(std::move(image), p[0]);
+            break;
+        case OpType::Blacks:
+            image = ImageProcessor::applyBlacks(std::move(image), p[0]);
+            break;
+        case OpType::Levels:
+            image = ImageProcessor::applyLevels(std::move(image), static_cast<int>(p[0]),
+                                                static_cast<int>(p[1]), static_cast<int>(p[2]));
+            break;
+        case OpType::Curves:
+            image = ImageProcessor::applyCurves(std::move(image), op.curve);
+            break;
+        case OpType::ColorBalance:
+            image = ImageProcessor::applyColorBalance(std::move(image), static_cast<int>(p[0]),
+                                                      static_cast<int>(p[1]), static_cast<int>(p[2]));
+            break;
+        case OpType::Temperature:
+            image = ImageProcessor::applyColorTemperature(std::move(image), static_cast<int>(p[0]));
+            break;
+        case OpType::Tint:
+            image = ImageProcessor::applyTint(std::move(image), static_cast<int>(p[0]));
+            break;
+        case OpType::Saturation:
+            image = ImageProcessor::applySaturation(std::move(image), p[0]);
+            break;
+        case OpType::Vibrance:
+            image = ImageProcessor::applyVibrance(std::move(image), p[0]);
+            break;
+        case OpType::HueShift:
+            image = ImageProcessor::applyHueShift(std::move(image), static_cast<int>(p[0]));
+            break;
+        case OpType::Highlights:
+            image = ImageProcessor::applyHighlights(std::move(image), p[0]);
+            break;
+        case OpType::Shadows:
+            image = ImageProcessor::applyShadows(std::move(image), p[0]);
+            break;
+        }
+    }
+
+    return image;
+}
+
+} // namespace Utils
+} // namespace Knoux
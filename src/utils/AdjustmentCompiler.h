@@ -0,0 +1,126 @@
+#ifndef ADJUSTMENTCOMPILER_H
+#define ADJUSTMENTCOMPILER_H
+
+#include "PixelKernels.h"
+
+#include <QImage>
+#include <QPointF>
+#include <QVector>
+#include <utility>
+
+namespace Knoux {
+namespace Utils {
+
+/**
+ * @brief A chain of point operations baked into one lookup table
+ *
+ * Per-channel chains become a 1D table per channel. Chains that mix
+ * channels become a 33x33x33 color cube sampled with tetrahedral
+ * interpolation. Either way, applying it is a single pass over the image.
+ * 16-bit images are sampled between table entries and keep their depth.
+ */
+class CompiledAdjustment {
+public:
+    enum class Kind {
+        Identity,
+        Channel,
+        Cube
+    };
+
+    static constexpr int CubeSize = 33;
+
+    Kind kind() const { return m_kind; }
+    bool isIdentity() const { return m_kind == Kind::Identity; }
+
+    QImage apply(const QImage &input) const;
+    QImage apply(QImage &&input) const;  // Reuses the pixels of an unshared image
+    void applyInPlace(QImage &image) const;  // image must be in the working format
+    void applyInPlace(const ImageView &view) const;
+
+private:
+    friend class AdjustmentCompiler;
+
+    void applyCube(const ImageView &view) const;
+    // Any format with traits
+    template <typename Traits>
+    void applyAs(const ImageView &view) const;
+    template <typename Traits>
+    void applyCubeAs(const ImageView &view) const;
+
+    Kind m_kind = Kind::Identity;
+    ChannelLut m_lut;
+    QVector<QRgb> m_cube;  // CubeSize^3 entries, red varies fastest
+};
+
+/**
+ * @brief Builds a CompiledAdjustment from an ordered list of point operations
+ *
+ * Parameters mean the same as in the matching ImageProcessor functions, and
+ * neutral values are skipped. The chain is evaluated by running those
+ * functions on a probe image, so a compiled 1D chain matches applying the
+ * operations one by one exactly.
+ */
+class AdjustmentCompiler {
+public:
+    // Per-channel operations
+    AdjustmentCompiler &addBrightness(int value);
+    AdjustmentCompiler &addContrast(float value);
+    AdjustmentCompiler &addExposure(float value);
+    AdjustmentCompiler &addWhites(float value);
+    AdjustmentCompiler &addBlacks(float value);
+    AdjustmentCompiler &addLevels(int black, int gamma, int white);
+    AdjustmentCompiler &addCurves(const QVector<QPointF> &curve);
+    AdjustmentCompiler &addColorBalance(int red, int green, int blue);
+    AdjustmentCompiler &addTemperature(int kelvin);
+    AdjustmentCompiler &addTint(int value);
+
+    // Operations that mix channels, these need a color cube
+    AdjustmentCompiler &addSaturation(float value);
+    AdjustmentCompiler &addVibrance(float value);
+    AdjustmentCompiler &addHueShift(int degrees);
+    AdjustmentCompiler &addHighlights(float value);
+    AdjustmentCompiler &addShadows(float value);
+
+    void clear();
+    bool isEmpty() const { return m_ops.isEmpty(); }
+    bool mixesChannels() const;
+
+    CompiledAdjustment compile() const;
+    QImage apply(const QImage &input) const { return compile().apply(input); }
+    QImage apply(QImage &&input) const { return compile().apply(std::move(input)); }
+
+private:
+    enum class OpType {
+        Brightness,
+        Contrast,
+        Exposure,
+        Whites,
+        Blacks,
+        Levels,
+        Curves,
+        ColorBalance,
+        Temperature,
+        Tint,
+        Saturation,
+        Vibrance,
+        HueShift,
+        Highlights,
+        Shadows
+    };
+
+    struct Op {
+        OpType type;
+        float params[3];
+        QVector<QPointF> curve;
+    };
+
+    AdjustmentCompiler &add(OpType type, float a, float b = 0, float c = 0);
+    QImage evaluate(const QImage &probe) const;
+
+    QVector<Op> m_ops;
+};
+
+} // namespace Utils
+} // namespace Knoux
+
+#endif // ADJUSTMENTCOMPILER_H
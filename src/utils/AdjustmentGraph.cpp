@@ -0,0 +1,129 @@
+#include "AdjustmentGraph.h"
+#include "AdjustmentCompiler.h"
+#include "ImageProcessor.h"
+
+#include <initializer_list>
+#include <utility>
+
+namespace Knoux {
+namespace Utils {
+
+namespace {
+
+using Stage = AdjustmentGraph::Stage;
+using Parameters = AdjustmentGraph::Parameters;
+
+// Kelvin per step of the temperature slider, 0 sits at daylight
+constexpr int KelvinPerStep = 25;
+constexpr int NeutralKelvin = 6500;
+// Vignette feather in percent of the half diagonal
+constexpr float VignetteFeather = 50.0f;
+
+// FNV-1a over the values
+quint64 hashValues(std::initializer_list<int> values) {
+    quint64 hash = 0xcbf29ce484222325ull;
+    for (int value : values) {
+        hash ^= quint32(value);
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+quint64 stageKey(Stage stage, const Parameters &p) {
+    switch (stage) {
+    case Stage::Denoise: return hashValues({qMax(p.noiseReduction, 0)});
+    case Stage::Tone: return hashValues({p.exposure, p.brightness, p.contrast, p.highlights, p.shadows});
+    case Stage::Color: return hashValues({p.temperature, p.tint, p.saturation, p.hue});
+    case Stage::Detail: return hashValues({qMax(p.sharpness, 0)});
+    case Stage::Effects: return hashValues({qMax(p.blur, 0), p.vignette});
+    }
+    return 0;
+}
+
+QImage runStage(Stage stage, const QImage &input, const Parameters &p) {
+    switch (stage) {
+    case Stage::Denoise:
+        // Median filter, on the source noise before tone and color can
+        // stretch it. Returns 8 bits, a deep document continues from there.
+        return p.noiseReduction > 0 ? ImageProcessor::applyNoiseReduction(input, p.noiseReduction) : input;
+    case Stage::Tone: {
+        // Point operations, compiled into one lookup table pass
+        AdjustmentCompiler compiler;
+        compiler.addExposure(p.exposure)
+                .addBrightness(p.brightness)
+                .addContrast(p.contrast)
+                .addHighlights(p.highlights)
+                .addShadows(p.shadows);
+        return compiler.isEmpty() ? input : compiler.apply(input);
+    }
+    case Stage::Color: {
+        AdjustmentCompiler compiler;
+        compiler.addTemperature(NeutralKelvin + p.temperature * KelvinPerStep)
+                .addTint(p.tint)
+                .addSaturation(p.saturation)
+                .addHueShift(p.hue);
+        return compiler.isEmpty() ? input : compiler.apply(input);
+    }
+    case Stage::Detail:
+        return p.sharpness > 0 ? ImageProcessor::applySharpness(input, p.sharpness) : input;
+    case Stage::Effects: {
+        // Both cost the same at any radius, and the vignette gain field is
+        // cached per size and strength
+        QImage result = input;
+        if (p.blur > 0) result = ImageProcessor::applyGaussianBlur(std::move(result), p.blur / 4.0f);
+        if (p.vignette != 0) result = ImageProcessor::applyVignette(std::move(result), p.vignette, VignetteFeather);
+        return result;
+    }
+    }
+    return input;
+}
+
+} // namespace
+
+AdjustmentGraph::AdjustmentGraph() {
+    // A chain for now: denoising sees the source noise, sharpening the
+    // final colors, effects go last
+    const Stage order[] = {Stage::Denoise, Stage::Tone, Stage::Color, Stage::Detail, Stage::Effects};
+    for (Stage stage : order) {
+        Node node;
+        node.stage = stage;
+        node.input = int(m_nodes.size()) - 1;
+        m_nodes.append(node);
+    }
+}
+
+void AdjustmentGraph::setSource(const QImage &source) {
+    if (!m_source.isNull() && source.cacheKey() == m_source.cacheKey()) return;
+
+    m_source = source;
+    m_sourceVersion = ++m_versions;
+    for (Node &node : m_nodes) {
+        node.valid = false;
+        node.output = QImage();
+    }
+}
+
+QImage AdjustmentGraph::render(const Parameters &parameters, const std::function<bool()> &cancelled) {
+    m_lastRunCount = 0;
+    if (m_source.isNull()) return QImage();
+
+    for (Node &node : m_nodes) {
+        const quint64 key = stageKey(node.stage, parameters);
+        const quint64 inputVersion = node.input < 0 ? m_sourceVersion : m_nodes[node.input].version;
+        if (node.valid && node.key == key && node.inputVersion == inputVersion) continue;
+        if (cancelled && cancelled()) return QImage();
+
+        // The input stays shared with its node, the stages copy before writing
+        const QImage &input = node.input < 0 ? m_source : m_nodes[node.input].output;
+        node.output = runStage(node.stage, input, parameters);
+        node.key = key;
+        node.inputVersion = inputVersion;
+        node.version = ++m_versions;
+        node.valid = true;
+        ++m_lastRunCount;
+    }
+    return m_nodes.last().output;
+}
+
+} // namespace Utils
+} // namespace Knoux
@@ -0,0 +1,93 @@
+#ifndef ADJUSTMENTGRAPH_H
+#define ADJUSTMENTGRAPH_H
+
+#include <QImage>
+#include <QVector>
+
+#include <functional>
+
+namespace Knoux {
+namespace Utils {
+
+/**
+ * @brief The editor's slider adjustments as nodes that keep their results
+ *
+ * Adjustments run as a small graph of nodes (denoise, tone, color, detail,
+ * effects), each reading the output of the node before it. A node keeps its
+ * output together with a hash of the parameters that made it and the
+ * version of its input, so a render only runs the nodes whose parameters
+ * changed and the ones downstream of them. Noise reduction, the costliest
+ * stage, comes first and is reused by every other slider. Neutral nodes
+ * hand their input through without a copy; every other node holds one
+ * image.
+ */
+class AdjustmentGraph {
+public:
+    // Slider values from -100 to 100, 0 is neutral. Noise reduction and
+    // sharpness only act above 0, blur too.
+    struct Parameters {
+        // Denoise
+        int noiseReduction = 0;
+        // Tone
+        int exposure = 0;
+        int brightness = 0;
+        int contrast = 0;
+        int highlights = 0;
+        int shadows = 0;
+        // Color
+        int temperature = 0;
+        int tint = 0;
+        int saturation = 0;
+        int hue = 0;
+        // Detail
+        int sharpness = 0;
+        // Effects
+        int blur = 0;
+        int vignette = 0;
+    };
+
+    enum class Stage {
+        Denoise,
+        Tone,
+        Color,
+        Detail,
+        Effects
+    };
+
+    AdjustmentGraph();
+
+    // A new source drops every kept result; the image already set (same
+    // cache key) keeps them
+    void setSource(const QImage &source);
+    const QImage &source() const { return m_source; }
+
+    // The source through every node. cancelled is asked before each node
+    // runs; once it returns true the render stops and returns a null image,
+    // the nodes finished so far keep their results for the next render.
+    QImage render(const Parameters &parameters, const std::function<bool()> &cancelled = {});
+
+    // Nodes run by the last render, the others were reused
+    int lastRunCount() const { return m_lastRunCount; }
+
+private:
+    struct Node {
+        Stage stage;
+        int input = -1;            // Index of the node read, -1 for the source
+        quint64 key = 0;           // Parameter hash behind output
+        quint64 inputVersion = 0;  // Input version behind output
+        quint64 version = 0;       // Changes whenever output does
+        bool valid = false;
+        QImage output;
+    };
+
+    QImage m_source;
+    quint64 m_sourceVersion = 0;
+    quint64 m_versions = 0;
+    QVector<Node> m_nodes;  // Inputs come first, the last node is the result
+    int m_lastRunCount = 0;
+};
+
+} // namespace Utils
+} // namespace Knoux
+
+#endif // ADJUSTMENTGRAPH_H
@@ -0,0 +1,244 @@
+#include "BlurKernels.h"
+#include "PixelKernels.h"
+#include "ScratchArena.h"
+
+#include <QVector>
+#include <QtMath>
+#include <cstring>
+
+namespace Knoux {
+namespace Utils {
+
+namespace {
+
+// Interleaved 16-bit channels per pixel, in QRgb byte order
+constexpr int Channels = 4;
+// Pixels per side of a transpose tile, 32 rows of 8-byte pixels fill whole
+// cache lines on the column side
+constexpr int TileSize = 32;
+// Below this sigma three boxes are too coarse, and the exact kernel is short
+constexpr float MinBoxSigma = 2.0f;
+// Keeps the running sums of 16-bit values inside 32 bits
+constexpr float MaxSigma = 10000.0f;
+
+struct LinePlan {
+    QVector<int> taps;  // Exact kernel in 0.16 fixed point, empty for boxes
+    int boxRadius[3];
+};
+
+LinePlan makePlan(float sigma) {
+    LinePlan plan = {QVector<int>(), {0, 0, 0}};
+
+    if (sigma < MinBoxSigma) {
+        const int radius = qCeil(sigma * 3);
+        QVector<double> weights(2 * radius + 1);
+        double sum = 0;
+        for (int i = -radius; i <= radius; ++i) {
+            weights[i + radius] = std::exp(-(i * i) / (2.0 * sigma * sigma));
+            sum += weights[i + radius];
+        }
+
+        plan.taps.resize(weights.size());
+        int total = 0;
+        for (int i = 0; i < weights.size(); ++i) {
+            plan.taps[i] = qRound(weights[i] / sum * 65536);
+            total += plan.taps[i];
+        }
+        // Exact unit gain, flat areas stay flat
+        plan.taps[radius] += 65536 - total;
+        return plan;
+    }
+
+    // Box widths whose summed variance matches sigma^2 (Kovesi, "Fast almost
+    // Gaussian filtering")
+    const int passes = 3;
+    const float ideal = std::sqrt(12 * sigma * sigma / passes + 1);
+    int lower = static_cast<int>(ideal);
+    if (lower % 2 == 0) --lower;
+    const int upper = lower + 2;
+    const int lowerCount = qBound(0, qRound((12 * sigma * sigma - passes * lower * lower
+                                             - 4 * passes * lower - 3 * passes)
+                                            / (-4.0f * lower - 4)), passes);
+
+    for (int i = 0; i < passes; ++i) {
+        plan.boxRadius[i] = ((i < lowerCount ? lower : upper) - 1) / 2;
+    }
+    return plan;
+}
+
+void boxLine(const quint16 *in, quint16 *out, int n, int radius) {
+    // Running sum with clamped edges, the cost does not depend on radius.
+    // Channels are spelled out so the sums stay in registers.
+    const quint64 scale = ((quint64(1) << 32) + radius) / (2 * radius + 1);
+    const int last = n - 1;
+    const int inside = qMin(radius, last);
+
+    quint32 sum[Channels];
+    for (int c = 0; c < Channels; ++c) {
+        quint32 s = quint32(radius + 1) * in[c] + quint32(radius - inside) * in[last * Channels + c];
+        for (int i = 1; i <= inside; ++i) {
+            s += in[i * Channels + c];
+        }
+        sum[c] = s;
+    }
+
+    quint32 s0 = sum[0], s1 = sum[1], s2 = sum[2], s3 = sum[3];
+    for (int i = 0; i < n; ++i) {
+        const quint16 *enter = in + qMin(i + radius + 1, last) * Channels;
+        const quint16 *leave = in + qMax(i - radius, 0) * Channels;
+        quint16 *dst = out + i * Channels;
+        dst[0] = static_cast<quint16>((s0 * scale + 0x80000000u) >> 32);
+        dst[1] = static_cast<quint16>((s1 * scale + 0x80000000u) >> 32);
+        dst[2] = static_cast<quint16>((s2 * scale + 0x80000000u) >> 32);
+        dst[3] = static_cast<quint16>((s3 * scale + 0x80000000u) >> 32);
+        s0 += enter[0] - leave[0];
+        s1 += enter[1] - leave[1];
+        s2 += enter[2] - leave[2];
+        s3 += enter[3] - leave[3];
+    }
+}
+
+void kernelLine(const quint16 *in, quint16 *out, int n, const QVector<int> &taps) {
+    const int radius = taps.size() / 2;
+    const int *weights = taps.constData() + radius;
+
+    for (int i = 0; i < n; ++i) {
+        quint32 s0 = 0x8000, s1 = 0x8000, s2 = 0x8000, s3 = 0x8000;
+        // Clamp only near the ends of the line
+        const bool edge = i < radius || i >= n - radius;
+        for (int k = -radius; k <= radius; ++k) {
+            const quint16 *p = in + (edge ? qBound(0, i + k, n - 1) : i + k) * Channels;
+            const quint32 weight = weights[k];
+            s0 += weight * p[0];
+            s1 += weight * p[1];
+            s2 += weight * p[2];
+            s3 += weight * p[3];
+        }
+        quint16 *dst = out + i * Channels;
+        dst[0] = static_cast<quint16>(s0 >> 16);
+        dst[1] = static_cast<quint16>(s1 >> 16);
+        dst[2] = static_cast<quint16>(s2 >> 16);
+        dst[3] = static_cast<quint16>(s3 >> 16);
+    }
+}
+
+void blurLine(const quint16 *in, quint16 *out, quint16 *scratch, int n, const LinePlan &plan) {
+    if (!plan.taps.isEmpty()) {
+        kernelLine(in, out, n, plan.taps);
+        return;
+    }
+
+    boxLine(in, out, n, plan.boxRadius[0]);
+    boxLine(out, scratch, n, plan.boxRadius[1]);
+    boxLine(scratch, out, n, plan.boxRadius[2]);
+}
+
+inline void copyPixel(quint16 *dst, const quint16 *src) {
+    std::memcpy(dst, src, Channels * sizeof(quint16));
+}
+
+} // namespace
+
+// ============================================================================
+// Gaussian Blur
+// ============================================================================
+
+void BlurKernels::gaussian(QImage &image, float sigma) {
+    gaussian(ImageView(image), sigma);
+}
+
+void BlurKernels::gaussian(const ImageView &view, float sigma) {
+    if (view.isNull() || sigma <= 0) return;
+    Q_ASSERT(PixelKernels::isWorkingFormat(view.format()));
+
+    const int width = view.width();
+    const int height = view.height();
+
+    const LinePlan plan = makePlan(qMin(sigma, MaxSigma));
+
+    // Row x of the transposed buffer holds column x of the image. Every
+    // element is written before it is read, so skip zero-filling it. At 16
+    // bits it takes two 8-bit frames, the price of no banding between passes.
+    const ScratchArena::Buffer transposed = ScratchArena::acquire(qsizetype(width) * height * Channels * sizeof(quint16));
+    quint16 *columns = transposed.as<quint16>();
+    uchar *bits = view.bits();
+    const qsizetype stride = view.stride();
+
+    // Horizontal pass, a tile of rows at a time so that the transposed
+    // writes land in whole cache lines
+    const int rowTiles = (height + TileSize - 1) / TileSize;
+    ParallelExecutor::forEachBand(rowTiles, TileSize * stride, [&](int begin, int end) {
+        const qsizetype lineBytes = qsizetype(width) * Channels * sizeof(quint16);
+        const ScratchArena::Buffer lineBuffer = ScratchArena::acquire(lineBytes);
+        const ScratchArena::Buffer scratchBuffer = ScratchArena::acquire(lineBytes);
+        const ScratchArena::Buffer tileBuffer = ScratchArena::acquire(TileSize * lineBytes);
+        quint16 *line = lineBuffer.as<quint16>();
+        quint16 *scratch = scratchBuffer.as<quint16>();
+        quint16 *tile = tileBuffer.as<quint16>();
+
+        for (int t = begin; t < end; ++t) {
+            const int y0 = t * TileSize;
+            const int rows = qMin(TileSize, height - y0);
+
+            for (int j = 0; j < rows; ++j) {
+                const QRgb *src = reinterpret_cast<const QRgb *>(bits + (y0 + j) * stride);
+                for (int x = 0; x < width; ++x) {
+                    for (int c = 0; c < Channels; ++c) {
+                        line[x * Channels + c] = static_cast<quint16>(((src[x] >> (8 * c)) & 0xff) << 8);
+                    }
+                }
+                blurLine(line, tile + qsizetype(j) * width * Channels, scratch, width, plan);
+            }
+
+            for (int x0 = 0; x0 < width; x0 += TileSize) {
+                const int x1 = qMin(x0 + TileSize, width);
+                for (int x = x0; x < x1; ++x) {
+                    quint16 *dst = columns + (qsizetype(x) * height + y0) * Channels;
+                    for (int j = 0; j < rows; ++j) {
+                        copyPixel(dst + j * Channels, tile + (qsizetype(j) * width + x) * Channels);
+                    }
+                }
+            }
+        }
+    });
+
+    // Vertical pass over the transposed rows, written back to the image
+    // through the inverse transpose
+    const int columnTiles = (width + TileSize - 1) / TileSize;
+    const qsizetype columnTileBytes = qsizetype(TileSize) * height * Channels * sizeof(quint16);
+    ParallelExecutor::forEachBand(columnTiles, columnTileBytes, [&](int begin, int end) {
+        const qsizetype lineBytes = qsizetype(height) * Channels * sizeof(quint16);
+        const ScratchArena::Buffer scratchBuffer = ScratchArena::acquire(lineBytes);
+        const ScratchArena::Buffer tileBuffer = ScratchArena::acquire(TileSize * lineBytes);
+        quint16 *scratch = scratchBuffer.as<quint16>();
+        quint16 *tile = tileBuffer.as<quint16>();
+
+        for (int t = begin; t < end; ++t) {
+            const int x0 = t * TileSize;
+            const int cols = qMin(TileSize, width - x0);
+
+            for (int j = 0; j < cols; ++j) {
+                blurLine(columns + qsizetype(x0 + j) * height * Channels,
+                         tile + qsizetype(j) * height * Channels, scratch, height, plan);
+            }
+
+            for (int y0 = 0; y0 < height; y0 += TileSize) {
+                const int y1 = qMin(y0 + TileSize, height);
+                for (int y = y0; y < y1; ++y) {
+                    QRgb *dst = reinterpret_cast<QRgb *>(bits + y * stride) + x0;
+                    for (int j = 0; j < cols; ++j) {
+                        const quint16 *p = tile + (qsizetype(j) * height + y) * Channels;
+                        QRgb pixel = 0;
+                        for (int c = 0; c < Channels; ++c) {
+                            pixel |= QRgb((p[c] + 128) >> 8) << (8 * c);
+                        }
+                        dst[j] = pixel;
+                    }
+                }
+            }
+        }
+    });
+}
+
+} // namespace Utils
+} // namespace Knoux
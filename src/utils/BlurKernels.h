@@ -0,0 +1,30 @@
+#ifndef BLURKERNELS_H
+#define BLURKERNELS_H
+
+#include "ImageView.h"
+
+#include <QImage>
+
+namespace Knoux {
+namespace Utils {
+
+/**
+ * @brief Separable blur kernels with a cost independent of the radius
+ *
+ * Images are filtered on 16-bit per channel rows. The vertical pass runs on
+ * a cache-blocked transpose, so both directions stream through contiguous
+ * memory, and both passes are split across the ParallelExecutor threads.
+ */
+class BlurKernels {
+public:
+    // Gaussian blur of every channel, alpha included. Three stacked box
+    // blurs approximate the kernel, small sigmas use the exact kernel.
+    static void gaussian(QImage &image, float sigma);  // image must be in the working format
+    // Blurs the viewed region alone, edges clamp to the region
+    static void gaussian(const ImageView &view, float sigma);
+};
+
+} // namespace Utils
+} // namespace Knoux
+
+#endif // BLURKERNELS_H
@@ -0,0 +1,80 @@
+#include "Compositor.h"
+#include "PixelKernels.h"
+
+namespace Knoux {
+namespace Utils {
+
+void Compositor::blend(QImage &base, const QImage &layer, BlendMode mode, float opacity,
+                       const QPoint &offset) {
+    run(base, layer, SimdKernels::table().blend[int(mode)], opacity, offset);
+}
+
+void Compositor::composite(QImage &base, const QImage &layer, BlendMode mode, float opacity,
+                           const QPoint &offset) {
+    run(base, layer, SimdKernels::table().composite[int(mode)], opacity, offset);
+}
+
+bool Compositor::blendModeFor(QPainter::CompositionMode composition, BlendMode *mode) {
+    switch (composition) {
+    case QPainter::CompositionMode_SourceOver: *mode = BlendMode::Normal; return true;
+    case QPainter::CompositionMode_Multiply:   *mode = BlendMode::Multiply; return true;
+    case QPainter::CompositionMode_Screen:     *mode = BlendMode::Screen; return true;
+    case QPainter::CompositionMode_Overlay:    *mode = BlendMode::Overlay; return true;
+    case QPainter::CompositionMode_SoftLight:  *mode = BlendMode::SoftLight; return true;
+    case QPainter::CompositionMode_HardLight:  *mode = BlendMode::HardLight; return true;
+    case QPainter::CompositionMode_ColorDodge: *mode = BlendMode::ColorDodge; return true;
+    case QPainter::CompositionMode_ColorBurn:  *mode = BlendMode::ColorBurn; return true;
+    case QPainter::CompositionMode_Darken:     *mode = BlendMode::Darken; return true;
+    case QPainter::CompositionMode_Lighten:    *mode = BlendMode::Lighten; return true;
+    case QPainter::CompositionMode_Difference: *mode = BlendMode::Difference; return true;
+    case QPainter::CompositionMode_Exclusion:  *mode = BlendMode::Exclusion; return true;
+    default:
+        return false;
+    }
+}
+
+void Compositor::drawLayer(QImage &base, const QImage &layer, QPainter::CompositionMode composition,
+                           float opacity, const QPoint &offset) {
+    BlendMode mode;
+    if (PixelKernels::isWorkingFormat(base.format()) && blendModeFor(composition, &mode)) {
+        composite(base, layer, mode, opacity, offset);
+        return;
+    }
+
+    QPainter painter(&base);
+    painter.setOpacity(opacity);
+    painter.setCompositionMode(composition);
+    painter.drawImage(offset, layer);
+}
+
+void Compositor::run(QImage &base, const QImage &layer, RowKernel kernel, float opacity,
+                     const QPoint &offset) {
+    Q_ASSERT(PixelKernels::isWorkingFormat(base.format()));
+    if (base.isNull() || layer.isNull()) return;
+
+    // Clip once, the kernels then run over plain row spans
+    const QRect area = base.rect().intersected(QRect(offset, layer.size()));
+    if (area.isEmpty()) return;
+
+    const QImage source = PixelKernels::isWorkingFormat(layer.format())
+        ? layer : layer.convertToFormat(QImage::Format_ARGB32);
+    const int weight = qRound(qBound(0.0f, opacity, 1.0f) * 256);
+
+    uchar *bits = base.bits();
+    const qsizetype stride = base.bytesPerLine();
+    const int top = area.top();
+    const int left = area.left();
+    const int width = area.width();
+
+    ParallelExecutor::forEachBand(area.height(), qsizetype(width) * sizeof(QRgb), [&](int begin, int end) {
+        for (int y = top + begin; y < top + end; ++y) {
+            QRgb *row = reinterpret_cast<QRgb *>(bits + y * stride) + left;
+            const QRgb *layerRow = reinterpret_cast<const QRgb *>(source.constScanLine(y - offset.y()))
+                                 + (left - offset.x());
+            kernel(row, row, layerRow, width, weight);
+        }
+    });
+}
+
+} // namespace Utils
+} // namespace Knoux
@@ -0,0 +1,49 @@
+#ifndef COMPOSITOR_H
+#define COMPOSITOR_H
+
+#include "SimdKernels.h"
+
+#include <QImage>
+#include <QPainter>
+#include <QPoint>
+
+namespace Knoux {
+namespace Utils {
+
+/**
+ * @brief Image blending and layer compositing on the SIMD blend kernels
+ *
+ * The layer is placed at offset and its rectangle is clipped against the
+ * base once, so only the overlapping rows and columns are visited and
+ * pixels outside the layer stay untouched. Rows are split across the
+ * ParallelExecutor threads. The base must be in the working format.
+ */
+class Compositor {
+public:
+    // Filter blending, the base keeps its alpha and the layer alpha is ignored
+    static void blend(QImage &base, const QImage &layer, BlendMode mode, float opacity,
+                      const QPoint &offset = QPoint());
+
+    // Source-over compositing with a blend mode, like QPainter::drawImage()
+    static void composite(QImage &base, const QImage &layer, BlendMode mode, float opacity,
+                          const QPoint &offset = QPoint());
+
+    // Blend mode matching a QPainter composition mode, false if there is none
+    static bool blendModeFor(QPainter::CompositionMode composition, BlendMode *mode);
+
+    // Draws a layer with a QPainter composition mode. Modes without a kernel,
+    // and bases outside the working format, fall back to QPainter.
+    static void drawLayer(QImage &base, const QImage &layer, QPainter::CompositionMode composition,
+                          float opacity, const QPoint &offset = QPoint());
+
+private:
+    using RowKernel = void (*)(QRgb *dst, const QRgb *base, const QRgb *layer, int count, int opacity);
+
+    static void run(QImage &base, const QImage &layer, RowKernel kernel, float opacity,
+                    const QPoint &offset);
+};
+
+} // namespace Utils
+} // namespace Knoux
+
+#endif // COMPOSITOR_H
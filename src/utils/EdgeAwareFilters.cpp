@@ -0,0 +1,665 @@
+#include "EdgeAwareFilters.h"
+#include "ParallelExecutor.h"
+#include "PixelKernels.h"
+#include "Resampler.h"
+#include "ScratchArena.h"
+
+#include <QVector>
+#include <QtMath>
+#include <algorithm>
+#include <cmath>
+
+namespace Knoux {
+namespace Utils {
+
+namespace {
+
+// Color channels at most, alpha is never filtered
+constexpr int MaxChannels = 3;
+// Guided filter statistics keep at least this many pixels per side
+constexpr int MinStatisticsSide = 16;
+// Domain-transform iterations, three hide the stripes of the 1D passes
+constexpr int Iterations = 3;
+// Rows swept together by the domain transform
+constexpr int InterleavedRows = 4;
+
+bool isMask(QImage::Format format) {
+    return format == QImage::Format_Grayscale8 || format == QImage::Format_Alpha8;
+}
+
+// Masks as they are, everything else in the working format
+QImage prepare(const QImage &input) {
+    if (isMask(input.format()) || PixelKernels::isWorkingFormat(input.format())) return input;
+    return PixelKernels::toWorkingFormat(input);
+}
+
+enum class Source {
+    Color,  // The color channels, or the value of a mask
+    Gray    // Luma, or the value of a mask
+};
+
+int channelCount(const QImage &image, Source source) {
+    return source == Source::Color && !isMask(image.format()) ? MaxChannels : 1;
+}
+
+// Row y of a prepared image as float levels, out[channel][x]
+void readRow(const QImage &image, int y, Source source, float *const *out) {
+    const int width = image.width();
+    if (isMask(image.format())) {
+        const uchar *line = image.constScanLine(y);
+        for (int x = 0; x < width; ++x) out[0][x] = line[x];
+        return;
+    }
+
+    const QRgb *line = reinterpret_cast<const QRgb *>(image.constScanLine(y));
+    if (source == Source::Gray) {
+        for (int x = 0; x < width; ++x) {
+            out[0][x] = (qRed(line[x]) * 77 + qGreen(line[x]) * 150 + qBlue(line[x]) * 29) * (1.0f / 256);
+        }
+        return;
+    }
+    for (int x = 0; x < width; ++x) {
+        out[0][x] = qRed(line[x]);
+        out[1][x] = qGreen(line[x]);
+        out[2][x] = qBlue(line[x]);
+    }
+}
+
+inline int toLevel(float value) {
+    return PixelKernels::clampByte(int(value + 0.5f));
+}
+
+// Writes channel values over a row of a prepared image, alpha stays
+void writeRow(uchar *line, int width, bool mask, const float *const *values) {
+    if (mask) {
+        for (int x = 0; x < width; ++x) line[x] = uchar(toLevel(values[0][x]));
+        return;
+    }
+
+    QRgb *pixels = reinterpret_cast<QRgb *>(line);
+    for (int x = 0; x < width; ++x) {
+        pixels[x] = PixelKernels::pack(toLevel(values[0][x]), toLevel(values[1][x]), toLevel(values[2][x]), pixels[x]);
+    }
+}
+
+// Float levels, one plane after another
+struct Planes {
+    int width = 0;
+    int height = 0;
+    int count = 0;
+    QVector<float> data;
+
+    Planes() = default;
+    Planes(int w, int h, int c) : width(w), height(h), count(c), data(qsizetype(w) * h * c) {}
+
+    float *row(int plane, int y) { return data.data() + (qsizetype(plane) * height + y) * width; }
+    const float *row(int plane, int y) const { return data.constData() + (qsizetype(plane) * height + y) * width; }
+};
+
+// Average of each factor x factor block, the blocks cut by the right and
+// bottom edges average what they cover
+Planes shrink(const QImage &image, int factor, Source source) {
+    const int width = image.width();
+    const int height = image.height();
+    Planes result((width + factor - 1) / factor, (height + factor - 1) / factor, channelCount(image, source));
+
+    ParallelExecutor::forEachBand(result.height, image.bytesPerLine() * factor, [&](int begin, int end) {
+        const ScratchArena::Buffer line = ScratchArena::acquire(qsizetype(width) * result.count * sizeof(float));
+        float *channels[MaxChannels];
+        for (int c = 0; c < result.count; ++c) channels[c] = line.as<float>() + qsizetype(c) * width;
+
+        for (int y = begin; y < end; ++y) {
+            const int top = y * factor;
+            const int bottom = qMin(top + factor, height);
+            for (int sy = top; sy < bottom; ++sy) {
+                readRow(image, sy, source, channels);
+                for (int c = 0; c < result.count; ++c) {
+                    float *out = result.row(c, y);
+                    const float *in = channels[c];
+                    for (int x = 0; x < result.width; ++x) {
+                        float sum = 0.0f;
+                        for (int k = x * factor; k < qMin(x * factor + factor, width); ++k) sum += in[k];
+                        out[x] += sum;
+                    }
+                }
+            }
+            for (int c = 0; c < result.count; ++c) {
+                float *out = result.row(c, y);
+                for (int x = 0; x < result.width; ++x) {
+                    out[x] /= float((qMin(x * factor + factor, width) - x * factor) * (bottom - top));
+                }
+            }
+        }
+    });
+    return result;
+}
+
+// Mean of every (2 radius + 1)^2 box, boxes clipped to the plane. Running
+// sums, so the cost does not depend on radius.
+Planes boxMean(const Planes &input, int radius) {
+    const int width = input.width;
+    const int height = input.height;
+
+    Planes rows(width, height, input.count);
+    ParallelExecutor::forEachBand(input.count * height, width * sizeof(float), [&](int begin, int end) {
+        const ScratchArena::Buffer prefixBuffer = ScratchArena::acquire((width + 1) * sizeof(double));
+        double *prefix = prefixBuffer.as<double>();
+        prefix[0] = 0.0;
+        for (int line = begin; line < end; ++line) {
+            const float *in = input.row(line / height, line % height);
+            float *out = rows.row(line / height, line % height);
+            for (int x = 0; x < width; ++x) prefix[x + 1] = prefix[x] + in[x];
+            for (int x = 0; x < width; ++x) {
+                const int lo = qMax(x - radius, 0);
+                const int hi = qMin(x + radius + 1, width);
+                out[x] = float((prefix[hi] - prefix[lo]) / (hi - lo));
+            }
+        }
+    });
+
+    // Columns slide a window of summed rows down each band
+    Planes result(width, height, input.count);
+    ParallelExecutor::forEachBand(height, width * sizeof(float) * input.count, [&](int begin, int end) {
+        const ScratchArena::Buffer sumBuffer = ScratchArena::acquire(width * sizeof(double));
+        double *sums = sumBuffer.as<double>();
+        for (int p = 0; p < input.count; ++p) {
+            std::fill(sums, sums + width, 0.0);
+            int lo = qMax(begin - radius, 0);
+            int hi = lo;
+            for (int y = begin; y < end; ++y) {
+                for (; hi < qMin(y + radius + 1, height); ++hi) {
+                    const float *in = rows.row(p, hi);
+                    for (int x = 0; x < width; ++x) sums[x] += in[x];
+                }
+                for (; lo < y - radius; ++lo) {
+                    const float *in = rows.row(p, lo);
+                    for (int x = 0; x < width; ++x) sums[x] -= in[x];
+                }
+                const double scale = 1.0 / (hi - lo);
+                float *out = result.row(p, y);
+                for (int x = 0; x < width; ++x) out[x] = float(sums[x] * scale);
+            }
+        }
+    });
+    return result;
+}
+
+// Bilinear taps of full-resolution pixels on a plane factor times smaller,
+// pixel centers aligned
+struct UpsampleTaps {
+    QVector<int> first;
+    QVector<int> second;
+    QVector<float> weight;  // Of second
+};
+
+UpsampleTaps upsampleTaps(int size, int lowSize, int factor) {
+    UpsampleTaps taps;
+    taps.first.resize(size);
+    taps.second.resize(size);
+    taps.weight.resize(size);
+    for (int i = 0; i < size; ++i) {
+        const float position = qBound(0.0f, (i + 0.5f) / factor - 0.5f, float(lowSize - 1));
+        taps.first[i] = int(position);
+        taps.second[i] = qMin(taps.first[i] + 1, lowSize - 1);
+        taps.weight[i] = position - taps.first[i];
+    }
+    return taps;
+}
+
+// Bilateral grid cells hold the channel sums and the pixel count, masks
+// leave the second and third sum empty
+struct Grid {
+    static constexpr int Values = MaxChannels + 1;
+    static constexpr int Count = MaxChannels;
+
+    int width = 0;
+    int height = 0;
+    int depth = 0;
+    QVector<float> cells;
+
+    qsizetype index(int x, int y, int z) const { return ((qsizetype(y) * width + x) * depth + z) * Values; }
+};
+
+// [1 4 6 4 1] / 16 along one axis, outside cells are empty. Empty cells add
+// nothing to the sums and counts alike, so edges need no other care.
+Grid blurGrid(const Grid &input, int axis) {
+    static const float kernel[5] = {1 / 16.0f, 4 / 16.0f, 6 / 16.0f, 4 / 16.0f, 1 / 16.0f};
+    const qsizetype steps[3] = {qsizetype(input.depth) * Grid::Values,
+                                qsizetype(input.width) * input.depth * Grid::Values, Grid::Values};
+    const qsizetype step = steps[axis];
+    const int extent = axis == 0 ? input.width : (axis == 1 ? input.height : input.depth);
+
+    Grid result = input;
+    result.cells.fill(0.0f);
+    const float *in = input.cells.constData();
+    float *out = result.cells.data();
+    const qsizetype rowSize = qsizetype(input.width) * input.depth * Grid::Values;
+    ParallelExecutor::forEachBand(input.height, rowSize * sizeof(float), [&](int begin, int end) {
+        for (int y = begin; y < end; ++y) {
+            for (int x = 0; x < input.width; ++x) {
+                for (int z = 0; z < input.depth; ++z) {
+                    const int position = axis == 0 ? x : (axis == 1 ? y : z);
+                    const qsizetype cell = input.index(x, y, z);
+                    for (int k = -2; k <= 2; ++k) {
+                        if (position + k < 0 || position + k >= extent) continue;
+                        const float *tap = in + cell + k * step;
+                        for (int v = 0; v < Grid::Values; ++v) out[cell + v] += kernel[k + 2] * tap[v];
+                    }
+                }
+            }
+        }
+    });
+    return result;
+}
+
+// Recursive filter over Rows consecutive rows, left to right and back.
+// stretch indexes gain per pixel for the step from its left neighbour.
+template <int Rows>
+void sweepRows(float *rows, const quint16 *stretch, int width, const float *gain) {
+    for (int x = 1; x < width; ++x) {
+        for (int k = 0; k < Rows; ++k) {
+            float *row = rows + qsizetype(k) * width;
+            row[x] += gain[stretch[qsizetype(k) * width + x]] * (row[x - 1] - row[x]);
+        }
+    }
+    for (int x = width - 2; x >= 0; --x) {
+        for (int k = 0; k < Rows; ++k) {
+            float *row = rows + qsizetype(k) * width;
+            row[x] += gain[stretch[qsizetype(k) * width + x + 1]] * (row[x + 1] - row[x]);
+        }
+    }
+}
+
+// a and b of q = a I + b per channel of input, averaged over every box a
+// pixel belongs to. A null guide guides each channel by itself.
+QVector<Planes> guidedCoefficients(const Planes &input, const Planes *guide, int radius, float epsilon) {
+    const int width = input.width;
+    const int height = input.height;
+
+    QVector<Planes> coefficients(input.count);
+    for (int c = 0; c < input.count; ++c) {
+        Planes moments(width, height, 4);  // I, p, I I, I p
+        for (int y = 0; y < height; ++y) {
+            const float *g = guide ? guide->row(0, y) : input.row(c, y);
+            const float *p = input.row(c, y);
+            float *mean = moments.row(0, y);
+            float *value = moments.row(1, y);
+            float *square = moments.row(2, y);
+            float *product = moments.row(3, y);
+            for (int x = 0; x < width; ++x) {
+                mean[x] = g[x];
+                value[x] = p[x];
+                square[x] = g[x] * g[x];
+                product[x] = g[x] * p[x];
+            }
+        }
+        moments = boxMean(moments, radius);
+
+        Planes linear(width, height, 2);
+        for (int y = 0; y < height; ++y) {
+            const float *mean = moments.row(0, y);
+            const float *value = moments.row(1, y);
+            const float *square = moments.row(2, y);
+            const float *product = moments.row(3, y);
+            float *a = linear.row(0, y);
+            float *b = linear.row(1, y);
+            for (int x = 0; x < width; ++x) {
+                const float variance = square[x] - mean[x] * mean[x];
+                const float covariance = product[x] - mean[x] * value[x];
+                a[x] = covariance / (qMax(variance, 0.0f) + epsilon);
+                b[x] = value[x] - a[x] * mean[x];
+            }
+        }
+        coefficients[c] = boxMean(linear, radius);
+    }
+    return coefficients;
+}
+
+// One full-resolution row of a I + b, with a and b interpolated from the
+// coefficient planes. lowA and lowB hold a row of the planes each.
+void applyCoefficients(const Planes &linear, const UpsampleTaps &columns, const UpsampleTaps &rows, int y,
+                       const float *guide, float *lowA, float *lowB, float *out, int width) {
+    const float fy = rows.weight[y];
+    const float *a0 = linear.row(0, rows.first[y]);
+    const float *a1 = linear.row(0, rows.second[y]);
+    const float *b0 = linear.row(1, rows.first[y]);
+    const float *b1 = linear.row(1, rows.second[y]);
+    for (int x = 0; x < linear.width; ++x) {
+        lowA[x] = a0[x] + (a1[x] - a0[x]) * fy;
+        lowB[x] = b0[x] + (b1[x] - b0[x]) * fy;
+    }
+
+    for (int x = 0; x < width; ++x) {
+        const int x0 = columns.first[x];
+        const int x1 = columns.second[x];
+        const float fx = columns.weight[x];
+        const float a = lowA[x0] + (lowA[x1] - lowA[x0]) * fx;
+        const float b = lowB[x0] + (lowB[x1] - lowB[x0]) * fx;
+        out[x] = a * guide[x] + b;
+    }
+}
+
+} // namespace
+
+QImage EdgeAwareFilters::guided(const QImage &input, const QImage &guide, int radius, float epsilon) {
+    if (input.isNull()) return QImage();
+
+    const QImage source = prepare(input);
+    if (radius < 1) return source;
+
+    const bool self = guide.isNull();
+    const QImage guideImage = self ? QImage()
+                                   : prepare(guide.size() == input.size() ? guide : Resampler::resize(guide, input.size()));
+    const int width = source.width();
+    const int height = source.height();
+
+    // Statistics on blocks of a quarter radius (the fast guided filter),
+    // the coefficients they give vary slowly enough to be interpolated
+    const int factor = qBound(1, radius / 4, qMax(1, qMin(width, height) / MinStatisticsSide));
+    const Planes inputLow = shrink(source, factor, Source::Color);
+    const Planes guideLow = self ? Planes() : shrink(guideImage, factor, Source::Gray);
+    const QVector<Planes> coefficients = guidedCoefficients(inputLow, self ? nullptr : &guideLow,
+                                                            qMax(1, qRound(float(radius) / factor)), epsilon);
+    const int channels = inputLow.count;
+    const int lowWidth = inputLow.width;
+
+    const UpsampleTaps columns = upsampleTaps(width, lowWidth, factor);
+    const UpsampleTaps rows = upsampleTaps(height, inputLow.height, factor);
+    QImage result = PixelKernels::toWritable(source);
+    const bool mask = isMask(result.format());
+    uchar *bits = result.bits();
+    const qsizetype stride = result.bytesPerLine();
+    ParallelExecutor::forEachBand(height, stride, [&](int begin, int end) {
+        const qsizetype floats = qsizetype(width) * 2 * channels + qsizetype(lowWidth) * 2;
+        const ScratchArena::Buffer scratch = ScratchArena::acquire(floats * sizeof(float));
+        float *buffer = scratch.as<float>();
+        float *guideRow[MaxChannels];
+        float *output[MaxChannels];
+        for (int c = 0; c < channels; ++c) {
+            guideRow[c] = buffer + qsizetype(c) * width;
+            output[c] = buffer + qsizetype(channels + c) * width;
+        }
+        float *lowA = buffer + qsizetype(width) * 2 * channels;
+        float *lowB = lowA + lowWidth;
+
+        for (int y = begin; y < end; ++y) {
+            if (self) {
+                readRow(source, y, Source::Color, guideRow);
+            } else {
+                readRow(guideImage, y, Source::Gray, guideRow);
+            }
+            for (int c = 0; c < channels; ++c) {
+                applyCoefficients(coefficients[c], columns, rows, y, guideRow[self ? c : 0], lowA, lowB, output[c], width);
+            }
+            writeRow(bits + y * stride, width, mask, output);
+        }
+    });
+
+    return result;
+}
+
+void EdgeAwareFilters::guidedUpsample(const QVector<float> &values, int factor, const QImage &guide, int radius,
+                                      float epsilon, const RowFunc &row) {
+    if (guide.isNull() || factor < 1) return;
+
+    const QImage guideImage = prepare(guide);
+    const int width = guideImage.width();
+    const int height = guideImage.height();
+
+    Planes input((width + factor - 1) / factor, (height + factor - 1) / factor, 1);
+    Q_ASSERT(values.size() == input.data.size());
+    input.data = values;
+
+    const Planes guideLow = shrink(guideImage, factor, Source::Gray);
+    const QVector<Planes> coefficients = guidedCoefficients(input, &guideLow, qMax(1, qRound(float(radius) / factor)),
+                                                            epsilon);
+
+    const UpsampleTaps columns = upsampleTaps(width, input.width, factor);
+    const UpsampleTaps rows = upsampleTaps(height, input.height, factor);
+    ParallelExecutor::forEachBand(height, guideImage.bytesPerLine(), [&](int begin, int end) {
+        const qsizetype floats = qsizetype(width) * 2 + qsizetype(input.width) * 2;
+        const ScratchArena::Buffer scratch = ScratchArena::acquire(floats * sizeof(float));
+        float *buffer = scratch.as<float>();
+        float *guideRow = buffer;
+        float *output = guideRow + width;
+        float *lowA = output + width;
+        float *lowB = lowA + input.width;
+
+        for (int y = begin; y < end; ++y) {
+            readRow(guideImage, y, Source::Gray, &guideRow);
+            applyCoefficients(coefficients[0], columns, rows, y, guideRow, lowA, lowB, output, width);
+            row(y, output);
+        }
+    });
+}
+
+QImage EdgeAwareFilters::bilateral(const QImage &input, float spatialSigma, float rangeSigma) {
+    if (input.isNull()) return QImage();
+
+    const QImage source = prepare(input);
+    const int width = source.width();
+    const int height = source.height();
+    const int channels = channelCount(source, Source::Color);
+    const float cell = qMax(spatialSigma, MinGridCell);
+    const float range = qMax(rangeSigma, 1.0f);
+    const float inverseRange = 1.0f / range;
+
+    // Pixel (x, y) with gray level l sits at (x, y, l) / (cell, cell, range)
+    // in the grid; one extra cell per axis keeps interpolation inside
+    Grid grid;
+    grid.width = int((width - 1) / cell) + 2;
+    grid.height = int((height - 1) / cell) + 2;
+    grid.depth = int(255 / range) + 2;
+    grid.cells.fill(0.0f, grid.index(0, grid.height, 0));
+
+    QVector<int> columnCell(width);
+    for (int x = 0; x < width; ++x) columnCell[x] = int(x / cell + 0.5f);
+    // Image rows splatted into each grid row, firstRow[y] up to firstRow[y + 1]
+    QVector<int> firstRow(grid.height + 1, height);
+    for (int y = height - 1; y >= 0; --y) firstRow[int(y / cell + 0.5f)] = y;
+    for (int y = grid.height - 1; y >= 0; --y) firstRow[y] = qMin(firstRow[y], firstRow[y + 1]);
+
+    // Splat: every grid row gathers its own image rows, no two bands share
+    // a cell
+    float *cells = grid.cells.data();
+    ParallelExecutor::forEachBand(grid.height, source.bytesPerLine() * qCeil(cell), [&](int begin, int end) {
+        const ScratchArena::Buffer scratch = ScratchArena::acquire(qsizetype(width) * (channels + 1) * sizeof(float));
+        float *buffer = scratch.as<float>();
+        float *values[MaxChannels];
+        for (int c = 0; c < channels; ++c) values[c] = buffer + qsizetype(c) * width;
+        float *gray = buffer + qsizetype(channels) * width;
+
+        for (int gy = begin; gy < end; ++gy) {
+            for (int y = firstRow[gy]; y < firstRow[gy + 1]; ++y) {
+                readRow(source, y, Source::Color, values);
+                readRow(source, y, Source::Gray, &gray);
+                for (int x = 0; x < width; ++x) {
+                    float *target = cells + grid.index(columnCell[x], gy, int(gray[x] * inverseRange + 0.5f));
+                    for (int c = 0; c < channels; ++c) target[c] += values[c][x];
+                    target[Grid::Count] += 1.0f;
+                }
+            }
+        }
+    });
+
+    for (int axis = 0; axis < 3; ++axis) grid = blurGrid(grid, axis);
+
+    // Slice: trilinear reads at each pixel's own position, sums over count
+    const float *blurred = grid.cells.constData();
+    const qsizetype xStep = qsizetype(grid.depth) * Grid::Values;
+    QVector<int> columnFirst(width);
+    QVector<float> columnFraction(width);
+    for (int x = 0; x < width; ++x) {
+        columnFirst[x] = int(x / cell);
+        columnFraction[x] = x / cell - columnFirst[x];
+    }
+    QImage result = PixelKernels::toWritable(source);
+    const bool mask = isMask(result.format());
+    uchar *bits = result.bits();
+    const qsizetype stride = result.bytesPerLine();
+    ParallelExecutor::forEachBand(height, stride, [&](int begin, int end) {
+        const ScratchArena::Buffer scratch = ScratchArena::acquire(qsizetype(width) * (channels + 1) * sizeof(float));
+        float *buffer = scratch.as<float>();
+        float *values[MaxChannels];
+        for (int c = 0; c < channels; ++c) values[c] = buffer + qsizetype(c) * width;
+        float *gray = buffer + qsizetype(channels) * width;
+
+        for (int y = begin; y < end; ++y) {
+            readRow(source, y, Source::Color, values);
+            readRow(source, y, Source::Gray, &gray);
+
+            // Rows of the grid above and below, blended first
+            const float gy = y / cell;
+            const int y0 = int(gy);
+            const float fy = gy - y0;
+            const float *above = blurred + grid.index(0, y0, 0);
+            const float *below = blurred + grid.index(0, y0 + 1, 0);
+            for (int x = 0; x < width; ++x) {
+                const float gz = gray[x] * inverseRange;
+                const int z0 = int(gz);
+                const float fz = gz - z0;
+                const float fx = columnFraction[x];
+                const float weights[4] = {(1 - fx) * (1 - fz), (1 - fx) * fz, fx * (1 - fz), fx * fz};
+                const qsizetype base = qsizetype(columnFirst[x] * grid.depth + z0) * Grid::Values;
+
+                float sums[Grid::Values] = {0.0f, 0.0f, 0.0f, 0.0f};
+                for (int corner = 0; corner < 4; ++corner) {
+                    const qsizetype offset = base + (corner >> 1) * xStep + (corner & 1) * Grid::Values;
+                    for (int v = 0; v < Grid::Values; ++v) {
+                        const float tap = above[offset + v] + (below[offset + v] - above[offset + v]) * fy;
+                        sums[v] += weights[corner] * tap;
+                    }
+                }
+                if (sums[Grid::Count] <= 0.0f) continue;
+                const float scale = 1.0f / sums[Grid::Count];
+                for (int c = 0; c < channels; ++c) values[c][x] = sums[c] * scale;
+            }
+            writeRow(bits + y * stride, width, mask, values);
+        }
+    });
+
+    return result;
+}
+
+QImage EdgeAwareFilters::domainTransform(const QImage &input, float spatialSigma, float rangeSigma) {
+    if (input.isNull()) return QImage();
+
+    const QImage source = prepare(input);
+    if (spatialSigma <= 0.0f) return source;
+
+    const int width = source.width();
+    const int height = source.height();
+    const int channels = channelCount(source, Source::Color);
+    const float ratio = spatialSigma / qMax(rangeSigma, 0.01f);
+
+    // Summed channel differences to the left and upper neighbours. The
+    // transformed domain stretches by 1 + ratio * difference there, which
+    // with whole-level differences makes every feedback a table lookup.
+    QVector<quint16> horizontal(qsizetype(width) * height);
+    QVector<quint16> vertical(qsizetype(width) * height);
+    quint16 *across = horizontal.data();
+    quint16 *down = vertical.data();
+    ParallelExecutor::forEachBand(height, source.bytesPerLine() * 2, [&](int begin, int end) {
+        const ScratchArena::Buffer scratch = ScratchArena::acquire(qsizetype(width) * channels * 2 * sizeof(float));
+        float *buffer = scratch.as<float>();
+        float *current[MaxChannels];
+        float *previous[MaxChannels];
+        for (int c = 0; c < channels; ++c) {
+            current[c] = buffer + qsizetype(c) * width;
+            previous[c] = buffer + qsizetype(channels + c) * width;
+        }
+
+        for (int y = begin; y < end; ++y) {
+            readRow(source, y, Source::Color, current);
+            if (y > 0) readRow(source, y - 1, Source::Color, previous);
+            for (int x = 0; x < width; ++x) {
+                int left = 0;
+                int up = 0;
+                for (int c = 0; c < channels; ++c) {
+                    if (x > 0) left += qAbs(int(current[c][x] - current[c][x - 1]));
+                    if (y > 0) up += qAbs(int(current[c][x] - previous[c][x]));
+                }
+                across[qsizetype(y) * width + x] = quint16(left);
+                down[qsizetype(y) * width + x] = quint16(up);
+            }
+        }
+    });
+
+    QImage result = PixelKernels::toWritable(source);
+    const bool mask = isMask(result.format());
+    uchar *bits = result.bits();
+    const qsizetype stride = result.bytesPerLine();
+    Planes plane(width, height, 1);
+    QVector<float> feedback(255 * channels + 1);
+
+    // Channels one at a time, the stretch is shared and one plane of floats
+    // is enough
+    for (int c = 0; c < channels; ++c) {
+        ParallelExecutor::forEachBand(height, source.bytesPerLine(), [&](int begin, int end) {
+            const ScratchArena::Buffer scratch = ScratchArena::acquire(qsizetype(width) * channels * sizeof(float));
+            float *buffer = scratch.as<float>();
+            float *values[MaxChannels];
+            for (int k = 0; k < channels; ++k) values[k] = buffer + qsizetype(k) * width;
+            for (int y = begin; y < end; ++y) {
+                readRow(source, y, Source::Color, values);
+                std::copy(values[c], values[c] + width, plane.row(0, y));
+            }
+        });
+
+        for (int i = 0; i < Iterations; ++i) {
+            // Halving sigmas whose variances add up to spatialSigma^2
+            const double sigma = spatialSigma * std::sqrt(3.0) * std::pow(2.0, Iterations - i - 1)
+                                 / std::sqrt(std::pow(4.0, Iterations) - 1);
+            const double base = std::exp(-std::sqrt(2.0) / sigma);
+            for (int k = 0; k < feedback.size(); ++k) feedback[k] = float(std::pow(base, 1 + ratio * k));
+            const float *gain = feedback.constData();
+
+            // Each sweep is one long dependency chain, a few rows side by
+            // side keep the core busy while one waits
+            ParallelExecutor::forEachBand(height, width * sizeof(float), [&](int begin, int end) {
+                int y = begin;
+                for (; y + InterleavedRows <= end; y += InterleavedRows) {
+                    sweepRows<InterleavedRows>(plane.row(0, y), across + qsizetype(y) * width, width, gain);
+                }
+                for (; y < end; ++y) sweepRows<1>(plane.row(0, y), across + qsizetype(y) * width, width, gain);
+            });
+
+            // Columns in bands of neighbouring columns, walked a row at a time
+            ParallelExecutor::forEachBand(width, height * sizeof(float), [&](int begin, int end) {
+                for (int y = 1; y < height; ++y) {
+                    float *row = plane.row(0, y);
+                    const float *above = plane.row(0, y - 1);
+                    const quint16 *stretch = down + qsizetype(y) * width;
+                    for (int x = begin; x < end; ++x) row[x] += gain[stretch[x]] * (above[x] - row[x]);
+                }
+                for (int y = height - 2; y >= 0; --y) {
+                    float *row = plane.row(0, y);
+                    const float *below = plane.row(0, y + 1);
+                    const quint16 *stretch = down + qsizetype(y + 1) * width;
+                    for (int x = begin; x < end; ++x) row[x] += gain[stretch[x]] * (below[x] - row[x]);
+                }
+            });
+        }
+
+        ParallelExecutor::forEachBand(height, stride, [&](int begin, int end) {
+            for (int y = begin; y < end; ++y) {
+                const float *values = plane.row(0, y);
+                uchar *line = bits + y * stride;
+                if (mask) {
+                    for (int x = 0; x < width; ++x) line[x] = uchar(toLevel(values[x]));
+                    continue;
+                }
+                const int shift = 16 - 8 * c;
+                QRgb *pixels = reinterpret_cast<QRgb *>(line);
+                for (int x = 0; x < width; ++x) {
+                    pixels[x] = (pixels[x] & ~(0xffu << shift)) | (QRgb(toLevel(values[x])) << shift);
+                }
+            }
+        });
+    }
+
+    return result;
+}
+
+} // namespace Utils
+} // namespace Knoux
@@ -0,0 +1,59 @@
+#ifndef EDGEAWAREFILTERS_H
+#define EDGEAWAREFILTERS_H
+
+#include <QImage>
+#include <QVector>
+#include <functional>
+
+namespace Knoux {
+namespace Utils {
+
+/**
+ * @brief Edge-preserving smoothing with a cost linear in the pixel count
+ *
+ * Three filters that average a pixel with its neighbours but not across
+ * edges: the guided filter, built from box means; the bilateral grid; and
+ * the recursive domain-transform filter. The first two do their statistics
+ * on a downsampled copy and bring only smooth coefficients back to full
+ * resolution, so the cost follows the image size and hardly the radius.
+ * Every pass is split across the ParallelExecutor threads. Color images
+ * are filtered on their three color channels and keep their alpha, results
+ * are ARGB32. Grayscale8 and Alpha8 images (masks) are filtered as one
+ * channel and keep their format. Values are in 8-bit levels throughout.
+ */
+class EdgeAwareFilters {
+public:
+    // Guided filter (He, Sun and Tang): input becomes locally a linear
+    // function of the gray guide within radius pixels, so it follows the
+    // guide's edges. Detail whose variance is below epsilon (levels squared)
+    // is smoothed away. A null guide guides each channel of input by
+    // itself, the plain edge-preserving smoother. guide is scaled to the
+    // size of input if needed.
+    static QImage guided(const QImage &input, const QImage &guide, int radius, float epsilon);
+
+    // The same filter as joint upsampling: values is one row-major plane of
+    // levels covering guide in blocks of factor x factor pixels (sizes
+    // rounded up). It is brought to the size of guide along the gray edges
+    // of guide and handed over a row at a time as row(y, values), from the
+    // ParallelExecutor threads, each row after guide's row y was read.
+    // radius counts pixels of guide.
+    using RowFunc = std::function<void(int y, const float *values)>;
+    static void guidedUpsample(const QVector<float> &values, int factor, const QImage &guide, int radius,
+                               float epsilon, const RowFunc &row);
+
+    // Bilateral filter of spatialSigma pixels and rangeSigma gray levels,
+    // on a grid with cells of that size (Chen, Paris and Durand). Cells are
+    // at least MinGridCell pixels wide.
+    static constexpr float MinGridCell = 4.0f;
+    static QImage bilateral(const QImage &input, float spatialSigma, float rangeSigma);
+
+    // Domain-transform recursive filter (Gastal and Oliveira), three
+    // iterations of rows then columns. It stays at full resolution, its
+    // passes are linear already and a coarser copy would soften the edges.
+    static QImage domainTransform(const QImage &input, float spatialSigma, float rangeSigma);
+};
+
+} // namespace Utils
+} // namespace Knoux
+
+#endif // EDGEAWAREFILTERS_H
@@ -1,5 +1,6 @@
 #include "ExportManager.h"
 #include "ImageProcessor.h"
+#include "PaletteEngine.h"
 #include <QPainter>
 #include <QFileInfo>
 #include <QDir>
@@ -217,7 +218,9 @@ bool ExportManager::exportImage(const QImage &image, const QString &path, const
     } else if (format.extension == "webp") {
         success = image.save(path, "WebP", format.quality);
     } else if (format.extension == "gif") {
-        success = image.save(path, "GIF");
+        // GIF holds 256 colors, pick them from the image
+        const QVector<QRgb> palette = PaletteEngine::extract(image, PaletteEngine::MaxColors);
+        success = PaletteEngine::quantize(image, palette).save(path, "GIF");
     } else {
         success = image.save(path);
     }
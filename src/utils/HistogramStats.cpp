@@ -0,0 +1,184 @@
+#include "HistogramStats.h"
+#include "ParallelExecutor.h"
+#include "PixelFormat.h"
+
+#include <QPainter>
+#include <QtMath>
+#include <cstring>
+
+namespace Knoux {
+namespace Utils {
+
+HistogramStats::HistogramStats(const QImage &image, const QRect &roi, int stride) {
+    if (image.isNull()) return;
+
+    m_size = image.size();
+    m_roi = roi.isNull() ? image.rect() : roi.intersected(image.rect());
+    m_stride = qMax(1, stride);
+    if (m_roi.isEmpty()) return;
+
+    m_sampleRows = (m_roi.height() + m_stride - 1) / m_stride;
+    const int bands = (m_sampleRows + BandRows - 1) / BandRows;
+    m_bands.fill(0, bands * ChannelCount * Bins);
+
+    countBands(image, 0, bands);
+    merge();
+}
+
+void HistogramStats::update(const QImage &image, const QRect &dirty) {
+    Q_ASSERT(image.size() == m_size);
+
+    const QRect area = dirty.intersected(m_roi);
+    if (area.isEmpty() || m_bands.isEmpty()) return;
+
+    // Sampled rows inside the dirty rectangle
+    const int firstRow = (area.top() - m_roi.top() + m_stride - 1) / m_stride;
+    const int lastRow = (area.bottom() - m_roi.top()) / m_stride;
+    if (firstRow > lastRow) return;
+
+    countBands(image, firstRow / BandRows, lastRow / BandRows + 1);
+    merge();
+}
+
+void HistogramStats::countBands(const QImage &image, int first, int last) {
+    // Formats with traits are counted as stored, 16-bit channels by their
+    // top byte. Anything else is converted once.
+    const bool native = visitPixelFormat(image.format(), [&](auto traits) {
+        countBandsAs<decltype(traits)>(image, first, last);
+        return true;
+    });
+    if (!native) {
+        countBandsAs<PixelTraits<QImage::Format_ARGB32>>(image.convertToFormat(QImage::Format_ARGB32), first, last);
+    }
+}
+
+template <typename Traits>
+void HistogramStats::countBandsAs(const QImage &pixels, int first, int last) {
+    using Pixel = typename Traits::Pixel;
+    const int left = m_roi.left();
+    const int columns = (m_roi.width() + m_stride - 1) / m_stride;
+    quint32 *allBands = m_bands.data();  // Detach before the threads write
+
+    ParallelExecutor::forEachBand(last - first, qsizetype(BandRows) * m_roi.width() * sizeof(Pixel), [&](int begin, int end) {
+        for (int band = first + begin; band < first + end; ++band) {
+            quint32 *bins = allBands + band * ChannelCount * Bins;
+            std::memset(bins, 0, ChannelCount * Bins * sizeof(quint32));
+            quint32 *red = bins + Red * Bins;
+            quint32 *green = bins + Green * Bins;
+            quint32 *blue = bins + Blue * Bins;
+            quint32 *luma = bins + Luma * Bins;
+
+            const int rowEnd = qMin((band + 1) * BandRows, m_sampleRows);
+            for (int row = band * BandRows; row < rowEnd; ++row) {
+                const Pixel *line = reinterpret_cast<const Pixel *>(
+                    pixels.constScanLine(m_roi.top() + row * m_stride)) + left;
+                for (int i = 0; i < columns; ++i) {
+                    const Pixel p = line[i * m_stride];
+                    const int r = toByte<Traits>(Traits::red(p));
+                    const int g = toByte<Traits>(Traits::green(p));
+                    const int b = toByte<Traits>(Traits::blue(p));
+                    ++red[r];
+                    ++green[g];
+                    ++blue[b];
+                    // Luma of the 8-bit values, as the display would show them
+                    ++luma[qGray(r, g, b)];
+                }
+            }
+        }
+    });
+}
+
+void HistogramStats::merge() {
+    std::memset(m_bins, 0, sizeof(m_bins));
+
+    const int bands = m_bands.size() / (ChannelCount * Bins);
+    for (int band = 0; band < bands; ++band) {
+        const quint32 *bins = m_bands.constData() + band * ChannelCount * Bins;
+        for (int c = 0; c < ChannelCount; ++c) {
+            for (int v = 0; v < Bins; ++v) {
+                m_bins[c][v] += bins[c * Bins + v];
+            }
+        }
+    }
+
+    m_total = 0;
+    for (int v = 0; v < Bins; ++v) {
+        m_total += m_bins[Red][v];
+    }
+}
+
+// ============================================================================
+// Statistics
+// ============================================================================
+
+int HistogramStats::minimum(Channel channel) const {
+    for (int v = 0; v < Bins; ++v) {
+        if (m_bins[channel][v]) return v;
+    }
+    return 0;
+}
+
+int HistogramStats::maximum(Channel channel) const {
+    for (int v = Bins - 1; v >= 0; --v) {
+        if (m_bins[channel][v]) return v;
+    }
+    return 0;
+}
+
+double HistogramStats::mean(Channel channel) const {
+    if (m_total == 0) return 0.0;
+
+    quint64 sum = 0;
+    for (int v = 0; v < Bins; ++v) {
+        sum += m_bins[channel][v] * v;
+    }
+    return double(sum) / m_total;
+}
+
+int HistogramStats::percentile(Channel channel, double fraction) const {
+    if (m_total == 0) return 0;
+
+    // Smallest value with at least fraction of the samples at or below it
+    const quint64 target = qMax<quint64>(1, quint64(qCeil(qBound(0.0, fraction, 1.0) * m_total)));
+    quint64 seen = 0;
+    for (int v = 0; v < Bins; ++v) {
+        seen += m_bins[channel][v];
+        if (seen >= target) return v;
+    }
+    return Bins - 1;
+}
+
+// ============================================================================
+// Rendering
+// ============================================================================
+
+QImage HistogramStats::render(int width, int height) const {
+    QImage histogram(width, height, QImage::Format_ARGB32);
+    histogram.fill(Qt::transparent);
+    if (m_total == 0) return histogram;
+
+    // Find max for normalization
+    quint64 maxVal = 0;
+    for (int c = Red; c <= Blue; ++c) {
+        for (int v = 0; v < Bins; ++v) {
+            maxVal = qMax(maxVal, m_bins[c][v]);
+        }
+    }
+
+    QPainter painter(&histogram);
+    painter.setRenderHint(QPainter::Antialiasing);
+
+    const QColor colors[] = {QColor(255, 0, 0, 128), QColor(0, 255, 0, 128), QColor(0, 0, 255, 128)};
+    for (int x = 0; x < width; ++x) {
+        const int v = x * Bins / width;
+        for (int c = Red; c <= Blue; ++c) {
+            painter.setPen(colors[c]);
+            painter.drawLine(x, height, x, height - int(m_bins[c][v] * height / maxVal));
+        }
+    }
+
+    return histogram;
+}
+
+} // namespace Utils
+} // namespace Knoux
@@ -0,0 +1,74 @@
+#ifndef HISTOGRAMSTATS_H
+#define HISTOGRAMSTATS_H
+
+#include <QImage>
+#include <QRect>
+#include <QVector>
+
+namespace Knoux {
+namespace Utils {
+
+/**
+ * @brief Red, green, blue and luma histograms of an image with statistics
+ *
+ * Sampled rows are grouped into bands that are counted in parallel, each
+ * into its own sub-histogram, and summed at the end. The bands are kept so
+ * that update() only recounts the bands a changed rectangle touches.
+ * Luma is qGray() of the pixel.
+ */
+class HistogramStats {
+public:
+    enum Channel {
+        Red,
+        Green,
+        Blue,
+        Luma
+    };
+
+    static constexpr int ChannelCount = 4;
+    static constexpr int Bins = 256;
+
+    HistogramStats() = default;
+
+    // roi is clipped to the image, a null roi means the whole image. Every
+    // stride-th pixel is sampled along both axes.
+    explicit HistogramStats(const QImage &image, const QRect &roi = QRect(), int stride = 1);
+
+    // Recounts the samples inside dirty, image must have the size used before
+    void update(const QImage &image, const QRect &dirty);
+
+    bool isEmpty() const { return m_total == 0; }
+    quint64 count() const { return m_total; }
+    quint64 bin(Channel channel, int value) const { return m_bins[channel][value]; }
+
+    int minimum(Channel channel) const;
+    int maximum(Channel channel) const;
+    double mean(Channel channel) const;
+    int percentile(Channel channel, double fraction) const;  // fraction in 0..1
+    int median(Channel channel) const { return percentile(channel, 0.5); }
+
+    // Red, green and blue bars scaled to the tallest bin
+    QImage render(int width = 256, int height = 100) const;
+
+private:
+    // Sampled rows per band, the unit of parallel work and of updates
+    static constexpr int BandRows = 64;
+
+    void countBands(const QImage &image, int first, int last);
+    template <typename Traits>
+    void countBandsAs(const QImage &pixels, int first, int last);
+    void merge();
+
+    QSize m_size;
+    QRect m_roi;
+    int m_stride = 1;
+    int m_sampleRows = 0;
+    QVector<quint32> m_bands;  // bands x ChannelCount x Bins
+    quint64 m_bins[ChannelCount][Bins] = {};
+    quint64 m_total = 0;
+};
+
+} // namespace Utils
+} // namespace Knoux
+
+#endif // HISTOGRAMSTATS_H
@@ -1,92 +1,391 @@
 #include "ImageProcessor.h"
+#include "AdjustmentCompiler.h"
+#include "BlurKernels.h"
+#include "Compositor.h"
+#include "EdgeAwareFilters.h"
+#include "HistogramStats.h"
+#include "MedianKernels.h"
+#include "PaletteEngine.h"
+#include "PixelKernels.h"
+#include "ScratchArena.h"
+#include "SimdKernels.h"
+#include "SpatialFields.h"
 #include <QPainter>
 #include <QtMath>
 #include <QtConcurrent>
+#include <QVarLengthArray>
+#include <cstring>
+#include <utility>
 
 namespace Knoux {
 namespace Utils {
 
+namespace {
+
+// Dehaze statistics run on a copy of about this many pixels per side
+constexpr int DehazeSide = 1024;
+// Dark channel patch radius on that copy, the paper's 15 x 15 patch
+constexpr int DehazePatch = 7;
+// Share of the haziest pixels the atmospheric light is averaged over
+constexpr double AtmosphereFraction = 0.001;
+// Transmission floor, keeps dense haze from blowing up noise
+constexpr float MinTransmission = 0.1f;
+// Guided filter regularization of the transmission, 0.001 of the range squared
+constexpr float DehazeEpsilon = 0.001f * 255 * 255;
+
+// Highest divisor of highlights and shadows at -100. Dividing by 1 + a * w
+// stays monotonic while a < 1, at 1 the whole range would flatten to one tone.
+constexpr float MaxToneCut = 0.75f;
+
+// Highest gain of highlights and shadows at +100, where the curve has always
+// topped out
+constexpr float MaxToneBoost = 3.0f;
+
+// Highlights and shadows gain for a slider value (-100 to 100, 0 neutral)
+// and a tone weight from 0 (untouched) to 1 (fully in range). Raising
+// multiplies by up to MaxToneBoost, lowering divides by up to
+// 1 + MaxToneCut, and a small move either way is a small change.
+float toneGain(float value, float weight) {
+    const float amount = qBound(-1.0f, value / 100.0f, 1.0f) * weight;
+    return amount >= 0.0f ? 1.0f + amount * (MaxToneBoost - 1.0f) : 1.0f / (1.0f - amount * MaxToneCut);
+}
+
+AffineParams uniformAffine(float scale, float offset) {
+    // Keeps in * mul + add inside 32 bits for any 8-bit input
+    const int mul = PixelKernels::toFixed(qBound(-128.0f, scale, 128.0f));
+    const int add = PixelKernels::toFixed(qBound(-16384.0f, offset, 16384.0f));
+    return {{mul, mul, mul}, {add, add, add}};
+}
+
+inline int affineMap(int value, const AffineParams &params, int channel, int unit, int max) {
+    // Offsets are in 8-bit units, unit scales them to the channel range
+    const qint64 v = (qint64(value) * params.mul[channel] + qint64(params.add[channel]) * unit)
+                   >> PixelKernels::FixedShift;
+    return static_cast<int>(qBound<qint64>(0, v, max));
+}
+
+template <typename Traits>
+void affineRows(const ImageView &view, const AffineParams &params) {
+    constexpr int unit = Traits::Max / 255;
+    PixelKernels::forEachRowAs<Traits>(view, [&params](typename Traits::Pixel *row, int width, int) {
+        for (int x = 0; x < width; ++x) {
+            const typename Traits::Pixel p = row[x];
+            row[x] = Traits::make(affineMap(Traits::red(p), params, 0, unit, Traits::Max),
+                                  affineMap(Traits::green(p), params, 1, unit, Traits::Max),
+                                  affineMap(Traits::blue(p), params, 2, unit, Traits::Max),
+                                  Traits::alpha(p));
+        }
+    });
+}
+
+// Half-float rows are mixed as floats, so values above white survive
+void affineHalfRows(const ImageView &view, const AffineParams &params) {
+    float mul[3];
+    float add[3];
+    for (int c = 0; c < 3; ++c) {
+        mul[c] = params.mul[c] / float(PixelKernels::FixedOne);
+        add[c] = params.add[c] / (255.0f * PixelKernels::FixedOne);
+    }
+    
+    const int width = view.width();
+    const qsizetype values = qsizetype(width) * 4;
+    ParallelExecutor::forEachBand(view.height(), values * sizeof(qfloat16), [&](int begin, int end) {
+        ScratchArena::Buffer buffer = ScratchArena::acquire(values * sizeof(float));
+        float *row = buffer.as<float>();
+        for (int y = begin; y < end; ++y) {
+            qfloat16 *pixels = reinterpret_cast<qfloat16 *>(view.scanLine(y));
+            qFloatFromFloat16(row, pixels, values);
+            for (int x = 0; x < width; ++x) {
+                float *p = row + x * 4;
+                for (int c = 0; c < 3; ++c) p[c] = qMax(0.0f, p[c] * mul[c] + add[c]);
+            }
+            qFloatToFloat16(pixels, row, values);
+        }
+    });
+}
+
+// Per-channel table. Other formats with traits are processed as stored, 16-bit
+// channels interpolate between entries; gray stays gray only when every
+// channel gets the same table.
+QImage applyChannelLut(QImage &&input, const ChannelLut &lut) {
+    if (!PixelKernels::isWorkingFormat(input.format())) {
+        const bool uniform = std::memcmp(lut.red, lut.green, sizeof(lut.red)) == 0
+                          && std::memcmp(lut.red, lut.blue, sizeof(lut.red)) == 0;
+        QImage result;
+        const bool native = visitPixelFormat(input.format(), [&](auto traits) {
+            using Traits = decltype(traits);
+            if (Traits::IsGray && !uniform) return false;
+            result = PixelKernels::toWritable(std::move(input));
+            PixelKernels::applyLutAs<Traits>(ImageView(result), lut);
+            return true;
+        });
+        if (native) return result;
+    }
+    
+    return PixelKernels::mapRows(std::move(input), [&lut](QRgb *row, int width, int) {
+        PixelKernels::applyLut(row, width, lut);
+    });
+}
+
+// c * mul + add per channel in 16.16. The 32-bit formats take the SIMD rows,
+// other formats with traits keep their layout and depth, the deep ones
+// included.
+QImage applyAffine(QImage &&input, const AffineParams &params) {
+    if (!PixelKernels::isWorkingFormat(input.format())) {
+        const bool uniform = params.mul[0] == params.mul[1] && params.mul[0] == params.mul[2]
+                          && params.add[0] == params.add[1] && params.add[0] == params.add[2];
+        QImage result;
+        const bool native = visitPixelFormat(input.format(), [&](auto traits) {
+            using Traits = decltype(traits);
+            if (Traits::IsGray && !uniform) return false;
+            if constexpr (Traits::Max == 255) {
+                // 256 entries are cheaper than a multiply per channel
+                result = applyChannelLut(std::move(input), PixelKernels::makeLut([&params](int channel, int v) {
+                    return affineMap(v, params, channel, 1, 255);
+                }));
+            } else if constexpr (Traits::IsFloat) {
+                result = PixelKernels::toWritable(std::move(input));
+                affineHalfRows(ImageView(result), params);
+            } else {
+                result = PixelKernels::toWritable(std::move(input));
+                affineRows<Traits>(ImageView(result), params);
+            }
+            return true;
+        });
+        if (native) return result;
+    }
+    
+    const SimdKernelTable &kernels = SimdKernels::table();
+    return PixelKernels::mapRows(std::move(input), [&](QRgb *row, int width, int) {
+        kernels.affine(row, width, params);
+    });
+}
+
+void applyVignetteInPlace(QImage &image, float amount, float feather) {
+    // Gains come from a table by squared distance, shared with every call
+    // at this size and strength
+    const QSharedPointer<const SpatialFields::Vignette> field =
+        SpatialFields::vignette(image.size(), amount, feather);
+    const auto radialGain = SimdKernels::table().radialGain;
+    
+    PixelKernels::forEachRow(image, [&](QRgb *row, int width, int y) {
+        radialGain(row, width, field->params(y));
+    });
+}
+
+// Averages the bilinear taps of path for every pixel, edges clamp
+QImage blurAlongPath(const QImage &input, const SpatialFields::Path &path) {
+    const QImage source = PixelKernels::isWorkingFormat(input.format()) ? input : PixelKernels::toWorkingFormat(input);
+    QImage result = ScratchArena::image(source.width(), source.height(), source.format());
+    
+    PathParams params;
+    params.pixels = reinterpret_cast<const QRgb *>(source.constBits());
+    params.stride = int(source.bytesPerLine() / sizeof(QRgb));
+    params.width = source.width();
+    params.height = source.height();
+    params.x = path.x.constData();
+    params.dx = path.dx.constData();
+    params.taps = path.taps();
+    const auto pathBlur = SimdKernels::table().pathBlur;
+    
+    uchar *bits = result.bits();
+    const qsizetype stride = result.bytesPerLine();
+    ParallelExecutor::forEachBand(result.height(), stride * path.taps(), [&](int begin, int end) {
+        QVarLengthArray<qint32, 64> rows(path.taps());
+        PathParams row = params;
+        row.y = rows.constData();
+        for (int y = begin; y < end; ++y) {
+            path.rows(y, rows.data());
+            pathBlur(reinterpret_cast<QRgb *>(bits + y * stride), result.width(), row);
+        }
+    });
+    return result;
+}
+
+// Masks are read as one coverage byte per pixel
+QImage coverageMask(const QImage &mask) {
+    if (mask.isNull()) return QImage();
+    if (mask.format() == QImage::Format_Grayscale8 || mask.format() == QImage::Format_Alpha8) return mask;
+    return mask.convertToFormat(QImage::Format_Grayscale8);
+}
+
+// x * (255 - coverage) / 255 + y * coverage / 255 on all four channels,
+// red/blue and alpha/green side by side in 16-bit lanes
+inline QRgb mixPixel(QRgb x, QRgb y, uint coverage) {
+    const uint inverse = 255 - coverage;
+    uint rb = (x & 0xff00ff) * inverse + (y & 0xff00ff) * coverage;
+    rb = ((rb + ((rb >> 8) & 0xff00ff) + 0x800080) >> 8) & 0xff00ff;
+    uint ag = ((x >> 8) & 0xff00ff) * inverse + ((y >> 8) & 0xff00ff) * coverage;
+    ag = (ag + ((ag >> 8) & 0xff00ff) + 0x800080) & 0xff00ff00;
+    return ag | rb;
+}
+
+// mixPixel() for the layouts with traits, half floats mix as floats
+template <typename Traits>
+typename Traits::Pixel mixPixelAs(typename Traits::Pixel x, typename Traits::Pixel y, int coverage) {
+    if constexpr (Traits::IsFloat) {
+        const float t = coverage / 255.0f;
+        auto mix = [t](float a, float b) { return qfloat16(a + (b - a) * t); };
+        return {mix(x.r, y.r), mix(x.g, y.g), mix(x.b, y.b), mix(x.a, y.a)};
+    } else {
+        auto mix = [coverage](int a, int b) { return (a * (255 - coverage) + b * coverage + 127) / 255; };
+        return Traits::make(mix(Traits::red(x), Traits::red(y)), mix(Traits::green(x), Traits::green(y)),
+                            mix(Traits::blue(x), Traits::blue(y)), mix(Traits::alpha(x), Traits::alpha(y)));
+    }
+}
+
+template <typename Traits>
+void mixRows(const ImageView &target, const ImageView &source, const QImage &coverage,
+             const QPoint &coverageOrigin) {
+    using Pixel = typename Traits::Pixel;
+    PixelKernels::forEachRowAs<Traits>(target, [&](Pixel *dst, int width, int y) {
+        const Pixel *src = reinterpret_cast<const Pixel *>(source.scanLine(y));
+        const uchar *cover = coverage.constScanLine(coverageOrigin.y() + y) + coverageOrigin.x();
+        for (int x = 0; x < width; ++x) {
+            const int c = cover[x];
+            if (c == 255) {
+                dst[x] = src[x];
+            } else if (c != 0) {
+                dst[x] = mixPixelAs<Traits>(dst[x], src[x], c);
+            }
+        }
+    });
+}
+
+// Writes source over target, mixed by the coverage bytes starting at
+// coverageOrigin (everything when coverage is null). Same-size views in the
+// same format, the working format or a deep one.
+void mergeRegion(const ImageView &target, const ImageView &source, const QImage &coverage,
+                 const QPoint &coverageOrigin) {
+    const int width = target.width();
+    const qsizetype rowBytes = qsizetype(width) * target.depth() / 8;
+    if (coverage.isNull()) {
+        ParallelExecutor::forEachBand(target.height(), rowBytes, [&](int begin, int end) {
+            for (int y = begin; y < end; ++y) {
+                std::memcpy(target.scanLine(y), source.scanLine(y), rowBytes);
+            }
+        });
+        return;
+    }
+    
+    if (!PixelKernels::isWorkingFormat(target.format())) {
+        visitPixelFormat(target.format(), [&](auto traits) {
+            mixRows<decltype(traits)>(target, source, coverage, coverageOrigin);
+            return true;
+        });
+        return;
+    }
+    
+    PixelKernels::forEachRow(target, [&](QRgb *dst, int, int y) {
+        const QRgb *src = source.row(y);
+        const uchar *cover = coverage.constScanLine(coverageOrigin.y() + y) + coverageOrigin.x();
+        for (int x = 0; x < width; ++x) {
+            const uint c = cover[x];
+            if (c == 255) {
+                dst[x] = src[x];
+            } else if (c != 0) {
+                dst[x] = mixPixel(dst[x], src[x], c);
+            }
+        }
+    });
+}
+
+QImage blendImages(const QImage &base, const QImage &blend, float opacity, BlendMode mode) {
+    if (base.isNull() || blend.isNull()) return base;
+    
+    // Pixels outside the blend image are left as they are
+    QImage result = PixelKernels::toWorkingFormat(base);
+    Compositor::blend(result, blend, mode, opacity);
+    
+    return result;
+}
+
+// Pixels along one axis that a window clamped to the image reads, with the
+// number of times it reads each: the edge pixels stand in for every
+// position past their edge
+struct ClampedSpan {
+    int first;
+    int last;
+    int weight;
+};
+
+QVector<ClampedSpan> clampedSpans(int center, int radius, int size) {
+    const int begin = center - radius;
+    const int end = center + radius;
+    if (size == 1) return {{0, 0, 2 * radius + 1}};
+    
+    QVector<ClampedSpan> spans;
+    const int before = qBound(0, 1 - begin, 2 * radius + 1);
+    const int after = qBound(0, end - size + 2, 2 * radius + 1);
+    if (before > 0) spans.append({0, 0, before});
+    if (qMax(begin, 1) <= qMin(end, size - 2)) spans.append({qMax(begin, 1), qMin(end, size - 2), 1});
+    if (after > 0) spans.append({size - 1, size - 1, after});
+    return spans;
+}
+
+} // namespace
+
 // ============================================================================
 // Basic Filters
 // ============================================================================
 
 QImage ImageProcessor::applyBrightness(const QImage &input, int value) {
+    return applyBrightness(QImage(input), value);
+}
+
+QImage ImageProcessor::applyBrightness(QImage &&input, int value) {
     if (input.isNull()) return QImage();
     
-    QImage result = input.copy();
     int adjustment = value * 255 / 100;
     
-    for (int y = 0; y < result.height(); ++y) {
-        for (int x = 0; x < result.width(); ++x) {
-            QColor c = result.pixelColor(x, y);
-            int r = qBound(0, c.red() + adjustment, 255);
-            int g = qBound(0, c.green() + adjustment, 255);
-            int b = qBound(0, c.blue() + adjustment, 255);
-            result.setPixelColor(x, y, QColor(r, g, b, c.alpha()));
-        }
-    }
-    
-    return result;
+    return applyAffine(std::move(input), uniformAffine(1.0f, adjustment));
 }
 
 QImage ImageProcessor::applyContrast(const QImage &input, float value) {
+    return applyContrast(QImage(input), value);
+}
+
+QImage ImageProcessor::applyContrast(QImage &&input, float value) {
     if (input.isNull()) return QImage();
     
-    QImage result = input.copy();
     float factor = (value + 100.0f) / 100.0f;
     factor = factor * factor;
     
-    for (int y = 0; y < result.height(); ++y) {
-        for (int x = 0; x < result.width(); ++x) {
-            QColor c = result.pixelColor(x, y);
-            int r = qBound(0, static_cast<int>((c.red() - 128) * factor + 128), 255);
-            int g = qBound(0, static_cast<int>((c.green() - 128) * factor + 128), 255);
-            int b = qBound(0, static_cast<int>((c.blue() - 128) * factor + 128), 255);
-            result.setPixelColor(x, y, QColor(r, g, b, c.alpha()));
-        }
-    }
-    
-    return result;
+    // (c - 128) * factor + 128
+    return applyAffine(std::move(input), uniformAffine(factor, 128.0f - 128.0f * factor));
 }
 
 QImage ImageProcessor::applySaturation(const QImage &input, float value) {
+    return applySaturation(QImage(input), value);
+}
+
+QImage ImageProcessor::applySaturation(QImage &&input, float value) {
     if (input.isNull()) return QImage();
     
-    QImage result = input.copy();
-    float factor = (value + 100.0f) / 100.0f;
-    
-    for (int y = 0; y < result.height(); ++y) {
-        for (int x = 0; x < result.width(); ++x) {
-            QColor c = result.pixelColor(x, y);
-            int gray = qGray(c.rgb());
-            int r = qBound(0, static_cast<int>(gray + (c.red() - gray) * factor), 255);
-            int g = qBound(0, static_cast<int>(gray + (c.green() - gray) * factor), 255);
-            int b = qBound(0, static_cast<int>(gray + (c.blue() - gray) * factor), 255);
-            result.setPixelColor(x, y, QColor(r, g, b, c.alpha()));
-        }
-    }
+    const int factor = PixelKernels::toFixed((value + 100.0f) / 100.0f);
     
-    return result;
+    const SimdKernelTable &kernels = SimdKernels::table();
+    return PixelKernels::mapRows(std::move(input), [&](QRgb *row, int width, int) {
+        kernels.saturate(row, width, factor);
+    });
 }
 
 QImage ImageProcessor::applyHueShift(const QImage &input, int degrees) {
+    return applyHueShift(QImage(input), degrees);
+}
+
+QImage ImageProcessor::applyHueShift(QImage &&input, int degrees) {
     if (input.isNull()) return QImage();
     
-    QImage result = input.copy();
-    
-    for (int y = 0; y < result.height(); ++y) {
-        for (int x = 0; x < result.width(); ++x) {
-            QColor c = result.pixelColor(x, y);
-            int h, s, v;
-            c.getHsv(&h, &s, &v);
-            h = (h + degrees) % 360;
-            if (h < 0) h += 360;
-            c.setHsv(h, s, v);
-            result.setPixelColor(x, y, c);
-        }
-    }
+    // Hue is tracked in 1/256ths of a sextant (1536 units per turn)
+    int shift = (degrees % 360) * 1536 / 360;
+    if (shift < 0) shift += 1536;
+    if (shift == 0) return PixelKernels::toWorkingFormat(std::move(input));
     
-    return result;
+    const SimdKernelTable &kernels = SimdKernels::table();
+    return PixelKernels::mapRows(std::move(input), [&](QRgb *row, int width, int) {
+        kernels.hueShift(row, width, shift);
+    });
 }
 
 // ============================================================================
@@ -94,64 +393,66 @@ QImage ImageProcessor::applyHueShift(const QImage &input, int degrees) {
 // ============================================================================
 
 QImage ImageProcessor::applyColorBalance(const QImage &input, int red, int green, int blue) {
+    return applyColorBalance(QImage(input), red, green, blue);
+}
+
+QImage ImageProcessor::applyColorBalance(QImage &&input, int red, int green, int blue) {
     if (input.isNull()) return QImage();
     
-    QImage result = input.copy();
-    
-    for (int y = 0; y < result.height(); ++y) {
-        for (int x = 0; x < result.width(); ++x) {
-            QColor c = result.pixelColor(x, y);
-            int r = qBound(0, c.red() + red, 255);
-            int g = qBound(0, c.green() + green, 255);
-            int b = qBound(0, c.blue() + blue, 255);
-            result.setPixelColor(x, y, QColor(r, g, b, c.alpha()));
-        }
-    }
+    const AffineParams params = {
+        {PixelKernels::FixedOne, PixelKernels::FixedOne, PixelKernels::FixedOne},
+        {qBound(-255, red, 255) << PixelKernels::FixedShift,
+         qBound(-255, green, 255) << PixelKernels::FixedShift,
+         qBound(-255, blue, 255) << PixelKernels::FixedShift}
+    };
     
-    return result;
+    return applyAffine(std::move(input), params);
 }
 
 QImage ImageProcessor::applyColorTemperature(const QImage &input, int kelvin) {
+    return applyColorTemperature(QImage(input), kelvin);
+}
+
+QImage ImageProcessor::applyColorTemperature(QImage &&input, int kelvin) {
     if (input.isNull()) return QImage();
     
     // Simple temperature adjustment
-    QImage result = input.copy();
     float warmth = (kelvin - 6500) / 100.0f;
     int redAdjust = static_cast<int>(warmth * 2);
     int blueAdjust = static_cast<int>(-warmth * 2);
     
-    return applyColorBalance(result, redAdjust, 0, blueAdjust);
+    return applyColorBalance(std::move(input), redAdjust, 0, blueAdjust);
 }
 
 QImage ImageProcessor::applyTint(const QImage &input, int value) {
+    return applyTint(QImage(input), value);
+}
+
+QImage ImageProcessor::applyTint(QImage &&input, int value) {
     if (input.isNull()) return QImage();
     
-    QImage result = input.copy();
     int greenAdjust = value / 2;
     int magentaAdjust = -value / 2;
     
-    return applyColorBalance(result, magentaAdjust, greenAdjust, magentaAdjust);
+    return applyColorBalance(std::move(input), magentaAdjust, greenAdjust, magentaAdjust);
 }
 
 QImage ImageProcessor::applyVibrance(const QImage &input, float value) {
+    return applyVibrance(QImage(input), value);
+}
+
+QImage ImageProcessor::applyVibrance(QImage &&input, float value) {
     if (input.isNull()) return QImage();
     
-    QImage result = input.copy();
-    float factor = (value + 100.0f) / 100.0f;
+    QImage result = PixelKernels::toWorkingFormat(std::move(input));
     
-    for (int y = 0; y < result.height(); ++y) {
-        for (int x = 0; x < result.width(); ++x) {
-            QColor c = result.pixelColor(x, y);
-            int gray = qGray(c.rgb());
-            float saturation = (c.saturationF() + 1.0f) / 2.0f;
-            float adjustment = factor * (1.0f - saturation);
-            
-            int r = qBound(0, static_cast<int>(gray + (c.red() - gray) * adjustment), 255);
-            int g = qBound(0, static_cast<int>(gray + (c.green() - gray) * adjustment), 255);
-            int b = qBound(0, static_cast<int>(gray + (c.blue() - gray) * adjustment), 255);
-            result.setPixelColor(x, y, QColor(r, g, b, c.alpha()));
-        }
-    }
+    // 20.12 keeps factor * 255 exact in a float for the per-pixel division
+    const int factor = qRound(qBound(0.0f, (value + 100.0f) / 100.0f, 4.0f) * 4096.0f);
+    
+    const SimdKernelTable &kernels = SimdKernels::table();
+    PixelKernels::forEachRow(result, [&](QRgb *row, int width, int) {
+        kernels.vibrance(row, width, factor);
+    });
     
     return result;
 }
@@ -161,108 +462,101 @@ QImage ImageProcessor::applyVibrance(const QImage &input, float value) {
 // ============================================================================
 
 QImage ImageProcessor::applyExposure(const QImage &input, float value) {
+    return applyExposure(QImage(input), value);
+}
+
+QImage ImageProcessor::applyExposure(QImage &&input, float value) {
     if (input.isNull()) return QImage();
     
-    QImage result = input.copy();
     float factor = std::pow(2.0f, value / 100.0f);
     
-    for (int y = 0; y < result.height(); ++y) {
-        for (int x = 0; x < result.width(); ++x) {
-            QColor c = result.pixelColor(x, y);
-            int r = qBound(0, static_cast<int>(c.red() * factor), 255);
-            int g = qBound(0, static_cast<int>(c.green() * factor), 255);
-            int b = qBound(0, static_cast<int>(c.blue() * factor), 255);
-            result.setPixelColor(x, y, QColor(r, g, b, c.alpha()));
-        }
-    }
-    
-    return result;
+    return applyAffine(std::move(input), uniformAffine(factor, 0.0f));
 }
 
 QImage ImageProcessor::applyHighlights(const QImage &input, float value) {
+    return applyHighlights(QImage(input), value);
+}
+
+QImage ImageProcessor::applyHighlights(QImage &&input, float value) {
     if (input.isNull()) return QImage();
     
-    QImage result = input.copy();
-    float factor = (value + 100.0f) / 100.0f;
+    QImage result = PixelKernels::toWorkingFormat(std::move(input));
     
-    for (int y = 0; y < result.height(); ++y) {
-        for (int x = 0; x < result.width(); ++x) {
-            QColor c = result.pixelColor(x, y);
-            int brightness = qGray(c.rgb());
-            
-            if (brightness > 128) {
-                float adjustment = (brightness - 128) / 128.0f * factor;
-                int r = qBound(0, static_cast<int>(c.red() * (1 + adjustment)), 255);
-                int g = qBound(0, static_cast<int>(c.green() * (1 + adjustment)), 255);
-                int b = qBound(0, static_cast<int>(c.blue() * (1 + adjustment)), 255);
-                result.setPixelColor(x, y, QColor(r, g, b, c.alpha()));
-            }
-        }
+    // Gain per luma value, only pixels brighter than mid-gray are touched
+    int gain[256];
+    for (int brightness = 0; brightness < 256; ++brightness) {
+        const float weight = brightness > 128 ? (brightness - 128) / 128.0f : 0.0f;
+        gain[brightness] = PixelKernels::toFixed(toneGain(value, weight));
     }
     
+    PixelKernels::forEachPixel(result, [&gain](QRgb p) {
+        const int brightness = qGray(p);
+        if (brightness <= 128) return p;
+        const int k = gain[brightness];
+        return PixelKernels::pack(
+            PixelKernels::clampByte((qRed(p) * k) >> PixelKernels::FixedShift),
+            PixelKernels::clampByte((qGreen(p) * k) >> PixelKernels::FixedShift),
+            PixelKernels::clampByte((qBlue(p) * k) >> PixelKernels::FixedShift),
+            p);
+    });
+    
     return result;
 }
 
 QImage ImageProcessor::applyShadows(const QImage &input, float value) {
+    return applyShadows(QImage(input), value);
+}
+
+QImage ImageProcessor::applyShadows(QImage &&input, float value) {
     if (input.isNull()) return QImage();
     
-    QImage result = input.copy();
-    float factor = (value + 100.0f) / 100.0f;
+    QImage result = PixelKernels::toWorkingFormat(std::move(input));
     
-    for (int y = 0; y < result.height(); ++y) {
-        for (int x = 0; x < result.width(); ++x) {
-            QColor c = result.pixelColor(x, y);
-            int brightness = qGray(c.rgb());
-            
-            if (brightness < 128) {
-                float adjustment = (128 - brightness) / 128.0f * factor;
-                int r = qBound(0, static_cast<int>(c.red() * (1 + adjustment)), 255);
-                int g = qBound(0, static_cast<int>(c.green() * (1 + adjustment)), 255);
-                int b = qBound(0, static_cast<int>(c.blue() * (1 + adjustment)), 255);
-                result.setPixelColor(x, y, QColor(r, g, b, c.alpha()));
-            }
-        }
+    // Gain per luma value, only pixels darker than mid-gray are touched
+    int gain[256];
+    for (int brightness = 0; brightness < 256; ++brightness) {
+        const float weight = brightness < 128 ? (128 - brightness) / 128.0f : 0.0f;
+        gain[brightness] = PixelKernels::toFixed(toneGain(value, weight));
     }
     
+    PixelKernels::forEachPixel(result, [&gain](QRgb p) {
+        const int brightness = qGray(p);
+        if (brightness >= 128) return p;
+        const int k = gain[brightness];
+        return PixelKernels::pack(
+            PixelKernels::clampByte((qRed(p) * k) >> PixelKernels::FixedShift),
+            PixelKernels::clampByte((qGreen(p) * k) >> PixelKernels::FixedShift),
+            PixelKernels::clampByte((qBlue(p) * k) >> PixelKernels::FixedShift),
+            p);
+    });
+    
     return result;
 }
 
 QImage ImageProcessor::applyWhites(const QImage &input, float value) {
+    return applyWhites(QImage(input), value);
+}
+
+QImage ImageProcessor::applyWhites(QImage &&input, float value) {
     if (input.isNull()) return QImage();
     
-    QImage result = input.copy();
-    float whitePoint = 255.0f * (100.0f - value) / 100.0f;
-    
-    for (int y = 0; y < result.height(); ++y) {
-        for (int x = 0; x < result.width(); ++x) {
-            QColor c = result.pixelColor(x, y);
-            int r = qBound(0, static_cast<int>(c.red() * 255.0f / whitePoint), 255);
-            int g = qBound(0, static_cast<int>(c.green() * 255.0f / whitePoint), 255);
-            int b = qBound(0, static_cast<int>(c.blue() * 255.0f / whitePoint), 255);
-            result.setPixelColor(x, y, QColor(r, g, b, c.alpha()));
-        }
-    }
+    float whitePoint = qMax(1.0f, 255.0f * (100.0f - value) / 100.0f);
     
-    return result;
+    return applyAffine(std::move(input), uniformAffine(255.0f / whitePoint, 0.0f));
 }
 
 QImage ImageProcessor::applyBlacks(const QImage &input, float value) {
+    return applyBlacks(QImage(input), value);
+}
+
+QImage ImageProcessor::applyBlacks(QImage &&input, float value) {
     if (input.isNull()) return QImage();
     
-    QImage result = input.copy();
-    float blackPoint = 255.0f * value / 100.0f;
-    
-    for (int y = 0; y < result.height(); ++y) {
-        for (int x = 0; x < result.width(); ++x) {
-            QColor c = result.pixelColor(x, y);
-            int r = qBound(0, static_cast<int>((c.red() - blackPoint) * 255.0f / (255.0f - blackPoint)), 255);
-            int g = qBound(0, static_cast<int>((c.green() - blackPoint) * 255.0f / (255.0f - blackPoint)), 255);
-            int b = qBound(0, static_cast<int>((c.blue() - blackPoint) * 255.0f / (255.0f - blackPoint)), 255);
-            result.setPixelColor(x, y, QColor(r, g, b, c.alpha()));
-        }
-    }
+    float blackPoint = qMin(254.0f, 255.0f * value / 100.0f);
+    float scale = 255.0f / (255.0f - blackPoint);
     
-    return result;
+    // (c - blackPoint) * 255 / (255 - blackPoint)
+    return applyAffine(std::move(input), uniformAffine(scale, -blackPoint * scale));
 }
 
 // ============================================================================
@@ -270,80 +564,164 @@ QImage ImageProcessor::applyBlacks(const QImage &input, float value) {
 // ============================================================================
 
 QImage ImageProcessor::applySharpness(const QImage &input, float value) {
+    return applySharpness(QImage(input), value);
+}
+
+QImage ImageProcessor::applySharpness(QImage &&input, float value) {
     if (input.isNull()) return QImage();
     
-    // Simple unsharp mask
-    QImage blurred = applyGaussianBlur(input, 2.0f);
-    QImage result = input.copy();
+    // Simple unsharp mask, the blur already comes back in the working format
+    QImage result = PixelKernels::toWorkingFormat(std::move(input));
+    const QImage blurred = applyGaussianBlur(result, 2.0f);
     
-    float amount = value / 100.0f;
+    const int amount = PixelKernels::toFixed(value / 100.0f);
     
-    for (int y = 0; y < result.height(); ++y) {
-        for (int x = 0; x < result.width(); ++x) {
-            QColor original = input.pixelColor(x, y);
-            QColor blur = blurred.pixelColor(x, y);
-            
-            int r = qBound(0, static_cast<int>(original.red() + (original.red() - blur.red()) * amount), 255);
-            int g = qBound(0, static_cast<int>(original.green() + (original.green() - blur.green()) * amount), 255);
-            int b = qBound(0, static_cast<int>(original.blue() + (original.blue() - blur.blue()) * amount), 255);
-            
-            result.setPixelColor(x, y, QColor(r, g, b, original.alpha()));
+    PixelKernels::forEachRow(result, [&blurred, amount](QRgb *row, int width, int y) {
+        const QRgb *blurRow = reinterpret_cast<const QRgb *>(blurred.constScanLine(y));
+        for (int x = 0; x < width; ++x) {
+            const QRgb p = row[x];
+            const QRgb b = blurRow[x];
+            auto sharpen = [amount](int original, int blur) {
+                return PixelKernels::clampByte(
+                    ((original << PixelKernels::FixedShift) + (original - blur) * amount) >> PixelKernels::FixedShift);
+            };
+            row[x] = PixelKernels::pack(sharpen(qRed(p), qRed(b)),
+                                        sharpen(qGreen(p), qGreen(b)),
+                                        sharpen(qBlue(p), qBlue(b)),
+                                        p);
         }
-    }
+    });
     
     return result;
 }
 
 QImage ImageProcessor::applyClarity(const QImage &input, float value) {
+    return applyClarity(QImage(input), value);
+}
+
+QImage ImageProcessor::applyClarity(QImage &&input, float value) {
     if (input.isNull()) return QImage();
     
-    // Clarity is like local contrast
-    QImage result = input.copy();
-    float amount = value / 100.0f;
-    int radius = 10;
-    
-    for (int y = radius; y < result.height() - radius; ++y) {
-        for (int x = radius; x < result.width() - radius; ++x) {
-            QColor center = input.pixelColor(x, y);
-            
-            // Calculate local average
-            float sumR = 0, sumG = 0, sumB = 0;
-            int count = 0;
-            
-            for (int dy = -radius; dy <= radius; ++dy) {
-                for (int dx = -radius; dx <= radius; ++dx) {
-                    QColor c = input.pixelColor(x + dx, y + dy);
-                    sumR += c.red();
-                    sumG += c.green();
-                    sumB += c.blue();
-                    count++;
-                }
-            }
-            
-            float avgR = sumR / count;
-            float avgG = sumG / count;
-            float avgB = sumB / count;
-            
-            int r = qBound(0, static_cast<int>(center.red() + (center.red() - avgR) * amount), 255);
-            int g = qBound(0, static_cast<int>(center.green() + (center.green() - avgG) * amount), 255);
-            int b = qBound(0, static_cast<int>(center.blue() + (center.blue() - avgB) * amount), 255);
-            
-            result.setPixelColor(x, y, QColor(r, g, b, center.alpha()));
+    // Clarity is like local contrast, local averages come from an integral
+    // image so the radius does not change the cost
+    QImage result = PixelKernels::toWorkingFormat(std::move(input));
+    const SummedAreaTable integral(result);
+    const float amount = value / 100.0f;
+    const int radius = 10;
+    
+    PixelKernels::forEachRow(result, [&integral, amount, radius](QRgb *row, int width, int y) {
+        for (int x = 0; x < width; ++x) {
+            const QRect window = SummedAreaTable::window(x, y, radius);
+            const float scale = 1.0f / integral.area(window);
+            const QRgb p = row[x];
+            auto boost = [&](int center, int plane) {
+                const float average = integral.sum(window, plane) * scale;
+                return PixelKernels::clampByte(static_cast<int>(center + (center - average) * amount));
+            };
+            row[x] = PixelKernels::pack(boost(qRed(p), SummedAreaTable::Red),
+                                        boost(qGreen(p), SummedAreaTable::Green),
+                                        boost(qBlue(p), SummedAreaTable::Blue),
+                                        p);
         }
-    }
+    });
     
     return result;
 }
 
 QImage ImageProcessor::applyDehaze(const QImage &input, float value) {
+    return applyDehaze(QImage(input), value);
+}
+
+QImage ImageProcessor::applyDehaze(QImage &&input, float value) {
     if (input.isNull()) return QImage();
     
-    QImage result = input.copy();
-    float amount = value / 100.0f;
+    QImage result = PixelKernels::toWorkingFormat(std::move(input));
+    const float strength = qBound(0.0f, value, 100.0f) / 100.0f;
+    if (strength <= 0.0f) return result;
+    
+    // Dark channel prior (He, Sun and Tang): in haze-free patches some
+    // channel is close to black, so the darkest value around a pixel tells
+    // how much haze lies over it. The statistics run on a reduced copy.
+    const int factor = qMax(1, qMax(result.width(), result.height()) / DehazeSide);
+    const QSize lowSize((result.width() + factor - 1) / factor, (result.height() + factor - 1) / factor);
+    const QImage low = factor > 1 ? Resampler::resize(result, lowSize, ResampleFilter::Area) : result;
+    const qsizetype lowCount = qsizetype(lowSize.width()) * lowSize.height();
+    
+    QImage darkest(lowSize, QImage::Format_Grayscale8);
+    for (int y = 0; y < lowSize.height(); ++y) {
+        const QRgb *row = reinterpret_cast<const QRgb *>(low.constScanLine(y));
+        uchar *out = darkest.scanLine(y);
+        for (int x = 0; x < lowSize.width(); ++x) out[x] = uchar(qMin(qMin(qRed(row[x]), qGreen(row[x])), qBlue(row[x])));
+    }
+    const QImage dark = MedianKernels::minimum(darkest, DehazePatch);
     
-    // Simple dehaze: increase contrast and reduce blue
-    result = applyContrast(result, value * 0.5f);
-    result = applyColorBalance(result, 0, 0, static_cast<int>(-value * 0.3f));
+    // Atmospheric light: mean color of the haziest pixels by dark channel
+    quint64 bins[256] = {};
+    for (int y = 0; y < lowSize.height(); ++y) {
+        const uchar *row = dark.constScanLine(y);
+        for (int x = 0; x < lowSize.width(); ++x) ++bins[row[x]];
+    }
+    int threshold = 255;
+    for (quint64 haziest = bins[255]; threshold > 0 && haziest < lowCount * AtmosphereFraction;) {
+        haziest += bins[--threshold];
+    }
+    
+    double sums[3] = {0.0, 0.0, 0.0};
+    quint64 count = 0;
+    for (int y = 0; y < lowSize.height(); ++y) {
+        const QRgb *row = reinterpret_cast<const QRgb *>(low.constScanLine(y));
+        const uchar *haze = dark.constScanLine(y);
+        for (int x = 0; x < lowSize.width(); ++x) {
+            if (haze[x] < threshold) continue;
+            sums[0] += qRed(row[x]);
+            sums[1] += qGreen(row[x]);
+            sums[2] += qBlue(row[x]);
+            ++count;
+        }
+    }
+    float airlight[3];
+    for (int c = 0; c < 3; ++c) airlight[c] = float(qMax(1.0, sums[c] / qMax<quint64>(count, 1)));
+    
+    // Transmission 1 - w * dark(I / A), in levels. w stays below 1 so far
+    // objects keep a trace of haze.
+    QImage normalized(lowSize, QImage::Format_Grayscale8);
+    for (int y = 0; y < lowSize.height(); ++y) {
+        const QRgb *row = reinterpret_cast<const QRgb *>(low.constScanLine(y));
+        uchar *out = normalized.scanLine(y);
+        for (int x = 0; x < lowSize.width(); ++x) {
+            const float lowest = qMin(qMin(qRed(row[x]) / airlight[0], qGreen(row[x]) / airlight[1]),
+                                      qBlue(row[x]) / airlight[2]);
+            out[x] = uchar(PixelKernels::clampByte(qRound(lowest * 255)));
+        }
+    }
+    const QImage hazeDark = MedianKernels::minimum(normalized, DehazePatch);
+    
+    const float omega = 0.95f * strength;
+    QVector<float> transmission(lowCount);
+    for (int y = 0; y < lowSize.height(); ++y) {
+        const uchar *row = hazeDark.constScanLine(y);
+        float *out = transmission.data() + qsizetype(y) * lowSize.width();
+        for (int x = 0; x < lowSize.width(); ++x) out[x] = 255.0f - omega * row[x];
+    }
+    
+    // Transmission refined along the edges of the full image, which takes
+    // back each row as soon as it is out: J = (I - A) / t + A
+    uchar *bits = result.bits();
+    const qsizetype stride = result.bytesPerLine();
+    const int width = result.width();
+    const float floor = MinTransmission * 255.0f;
+    EdgeAwareFilters::guidedUpsample(transmission, factor, result, 4 * DehazePatch * factor, DehazeEpsilon,
+                                     [&](int y, const float *t) {
+        QRgb *row = reinterpret_cast<QRgb *>(bits + y * stride);
+        for (int x = 0; x < width; ++x) {
+            const float gain = 255.0f / qMax(t[x], floor);
+            auto recover = [&](int value, int c) {
+                return PixelKernels::clampByte(qRound((value - airlight[c]) * gain + airlight[c]));
+            };
+            row[x] = PixelKernels::pack(recover(qRed(row[x]), 0), recover(qGreen(row[x]), 1),
+                                        recover(qBlue(row[x]), 2), row[x]);
+        }
+    });
     
     return result;
 }
@@ -351,33 +729,12 @@ QImage ImageProcessor::applyDehaze(const QImage &input, float value) {
 QImage ImageProcessor::applyNoiseReduction(const QImage &input, float value) {
     if (input.isNull()) return QImage();
     
-    // Simple median filter
-    QImage result = input.copy();
-    int radius = static_cast<int>(value / 50.0f) + 1;
+    // Median filter, histogram based so the radius does not change the cost
+    const QImage source = PixelKernels::toWorkingFormat(input);
+    const int radius = static_cast<int>(value / 50.0f) + 1;
+    if (radius < 1) return source;
     
-    for (int y = radius; y < result.height() - radius; ++y) {
-        for (int x = radius; x < result.width() - radius; ++x) {
-            QVector<int> reds, greens, blues;
-            
-            for (int dy = -radius; dy <= radius; ++dy) {
-                for (int dx = -radius; dx <= radius; ++dx) {
-                    QColor c = input.pixelColor(x + dx, y + dy);
-                    reds.append(c.red());
-                    greens.append(c.green());
-                    blues.append(c.blue());
-                }
-            }
-            
-            std::sort(reds.begin(), reds.end());
-            std::sort(greens.begin(), greens.end());
-            std::sort(blues.begin(), blues.end());
-            
-            int medianIdx = reds.size() / 2;
-            result.setPixelColor(x, y, QColor(reds[medianIdx], greens[medianIdx], blues[medianIdx]));
-        }
-    }
-    
-    return result;
+    return MedianKernels::median(source, radius);
 }
 
 // ============================================================================
@@ -385,64 +742,17 @@ QImage ImageProcessor::applyNoiseReduction(const QImage &input, float value) {
 // ============================================================================
 
 QImage ImageProcessor::applyGaussianBlur(const QImage &input, float radius) {
+    return applyGaussianBlur(QImage(input), radius);
+}
+
+QImage ImageProcessor::applyGaussianBlur(QImage &&input, float radius) {
     if (input.isNull()) return QImage();
     
-    QImage result = input.copy();
+    QImage result = PixelKernels::toWorkingFormat(std::move(input));
     if (radius < 0.5f) return result;
     
-    int size = static_cast<int>(radius * 3) * 2 + 1;
-    QVector<float> kernel(size);
-    float sigma = radius;
-    float sum = 0.0f;
-    
-    // Create Gaussian kernel
-    for (int i = 0; i < size; ++i) {
-        int x = i - size / 2;
-        kernel[i] = std::exp(-(x * x) / (2 * sigma * sigma));
-        sum += kernel[i];
-    }
-    
-    // Normalize
-    for (float &k : kernel) {
-        k /= sum;
-    }
-    
-    // Horizontal pass
-    QImage temp = input.copy();
-    for (int y = 0; y < input.height(); ++y) {
-        for (int x = 0; x < input.width(); ++x) {
-            float r = 0, g = 0, b = 0, a = 0;
-            
-            for (int i = 0; i < size; ++i) {
-                int px = qBound(0, x + i - size / 2, input.width() - 1);
-                QColor c = input.pixelColor(px, y);
-                r += c.redF() * kernel[i];
-                g += c.greenF() * kernel[i];
-                b += c.blueF() * kernel[i];
-                a += c.alphaF() * kernel[i];
-            }
-            
-            temp.setPixelColor(x, y, QColor::fromRgbF(r, g, b, a));
-        }
-    }
-    
-    // Vertical pass
-    for (int y = 0; y < input.height(); ++y) {
-        for (int x = 0; x < input.width(); ++x) {
-            float r = 0, g = 0, b = 0, a = 0;
-            
-            for (int i = 0; i < size; ++i) {
-                int py = qBound(0, y + i - size / 2, input.height() - 1);
-                QColor c = temp.pixelColor(x, py);
-                r += c.redF() * kernel[i];
-                g += c.greenF() * kernel[i];
-                b += c.blueF() * kernel[i];
-                a += c.alphaF() * kernel[i];
-            }
-            
-            result.setPixelColor(x, y, QColor::fromRgbF(r, g, b, a));
-        }
-    }
+    // Stacked box blur on 16-bit rows, same cost for any radius
+    BlurKernels::gaussian(result, radius);
     
     return result;
 }
@@ -450,72 +760,31 @@ QImage ImageProcessor::applyGaussianBlur(const QImage &input, float radius) {
 QImage ImageProcessor::applyMotionBlur(const QImage &input, float angle, float distance) {
     if (input.isNull()) return QImage();
     
-    QImage result = input.copy();
-    float rad = qDegreesToRadians(angle);
-    int steps = static_cast<int>(distance);
-    
-    for (int y = 0; y < result.height(); ++y) {
-        for (int x = 0; x < result.width(); ++x) {
-            float r = 0, g = 0, b = 0;
-            int count = 0;
-            
-            for (int i = -steps / 2; i <= steps / 2; ++i) {
-                int px = qBound(0, static_cast<int>(x + i * std::cos(rad)), input.width() - 1);
-                int py = qBound(0, static_cast<int>(y + i * std::sin(rad)), input.height() - 1);
-                
-                QColor c = input.pixelColor(px, py);
-                r += c.redF();
-                g += c.greenF();
-                b += c.blueF();
-                count++;
-            }
-            
-            result.setPixelColor(x, y, QColor::fromRgbF(r / count, g / count, b / count));
-        }
-    }
-    
-    return result;
+    // Every pixel shares the same taps, built once per angle and distance
+    return blurAlongPath(input, *SpatialFields::motion(angle, distance));
 }
 
 QImage ImageProcessor::applyRadialBlur(const QImage &input, QPointF center, float amount) {
     if (input.isNull()) return QImage();
     
-    QImage result = input.copy();
-    int samples = static_cast<int>(amount / 5) + 3;
-    
-    for (int y = 0; y < result.height(); ++y) {
-        for (int x = 0; x < result.width(); ++x) {
-            float r = 0, g = 0, b = 0;
-            
-            float dx = x - center.x();
-            float dy = y - center.y();
-            float dist = std::sqrt(dx * dx + dy * dy);
-            float angle = std::atan2(dy, dx);
-            
-            for (int i = 0; i < samples; ++i) {
-                float t = i / static_cast<float>(samples);
-                float sampleDist = dist * (1 - t * amount / 100);
-                
-                int px = qBound(0, static_cast<int>(center.x() + sampleDist * std::cos(angle)), input.width() - 1);
-                int py = qBound(0, static_cast<int>(center.y() + sampleDist * std::sin(angle)), input.height() - 1);
-                
-                QColor c = input.pixelColor(px, py);
-                r += c.redF();
-                g += c.greenF();
-                b += c.blueF();
-            }
-            
-            result.setPixelColor(x, y, QColor::fromRgbF(r / samples, g / samples, b / samples));
-        }
-    }
-    
-    return result;
+    // Samples toward the center scale the pixel position, so each tap is
+    // a straight walk along the row
+    return blurAlongPath(input, *SpatialFields::radial(center, amount));
+}
+
+QImage ImageProcessor::applyLensBlur(const QImage &input, float radius, BokehShape shape, float highlights,
+                                     const QImage &depth) {
+    return applyLensBlur(QImage(input), radius, shape, highlights, depth);
 }
 
-QImage ImageProcessor::applyLensBlur(const QImage &input, float radius) {
-    // Lens blur is similar to Gaussian but with bokeh effect
-    // For simplicity, use Gaussian with slight modification
-    return applyGaussianBlur(input, radius * 1.5f);
+QImage ImageProcessor::applyLensBlur(QImage &&input, float radius, BokehShape shape, float highlights,
+                                     const QImage &depth) {
+    if (input.isNull()) return QImage();
+    
+    // Disc or hexagon bokeh in linear light, tiled over the threads; wide
+    // radii run on a shrunk copy so the cost hardly grows with them
+    const QImage source = PixelKernels::toWorkingFormat(std::move(input));
+    return LensBlur::apply(source, radius, shape, highlights, depth);
 }
 
 // ============================================================================
@@ -523,112 +792,113 @@ QImage ImageProcessor::applyLensBlur(const QImage &input, float radius) {
 // ============================================================================
 
 QImage ImageProcessor::applyVignette(const QImage &input, float amount, float feather) {
+    return applyVignette(QImage(input), amount, feather);
+}
+
+QImage ImageProcessor::applyVignette(QImage &&input, float amount, float feather) {
     if (input.isNull()) return QImage();
     
-    QImage result = input.copy();
-    QPointF center(input.width() / 2.0f, input.height() / 2.0f);
-    float maxDist = std::sqrt(center.x() * center.x() + center.y() * center.y());
-    
-    for (int y = 0; y < result.height(); ++y) {
-        for (int x = 0; x < result.width(); ++x) {
-            float dx = x - center.x();
-            float dy = y - center.y();
-            float dist = std::sqrt(dx * dx + dy * dy);
-            
-            float vignette = 1.0f;
-            if (dist > maxDist * (1 - feather / 100)) {
-                float t = (dist - maxDist * (1 - feather / 100)) / (maxDist * feather / 100);
-                vignette = 1.0f - t * amount / 100;
-                vignette = qMax(0.0f, vignette);
-            }
-            
-            QColor c = result.pixelColor(x, y);
-            int r = static_cast<int>(c.red() * vignette);
-            int g = static_cast<int>(c.green() * vignette);
-            int b = static_cast<int>(c.blue() * vignette);
-            result.setPixelColor(x, y, QColor(r, g, b, c.alpha()));
-        }
-    }
+    QImage result = PixelKernels::toWorkingFormat(std::move(input));
+    applyVignetteInPlace(result, amount, feather);
     
     return result;
 }
 
-QImage ImageProcessor::applyFilmGrain(const QImage &input, float amount) {
+QImage ImageProcessor::applyFilmGrain(const QImage &input, float amount, float size, float roughness, quint32 seed) {
+    return applyFilmGrain(QImage(input), amount, size, roughness, seed);
+}
+
+QImage ImageProcessor::applyFilmGrain(QImage &&input, float amount, float size, float roughness, quint32 seed) {
     if (input.isNull()) return QImage();
     
-    QImage result = input.copy();
-    qsrand(QTime::currentTime().msec());
-    
-    for (int y = 0; y < result.height(); ++y) {
-        for (int x = 0; x < result.width(); ++x) {
-            int noise = (qrand() % 256 - 128) * amount / 100;
+    // Noise is read from a seeded texture by pixel position, so the result
+    // does not depend on the thread count or the order rows run in
+    const QSharedPointer<const SpatialFields::Grain> grain = SpatialFields::grain(size, roughness, seed);
+    const int strength = qRound(amount * 256 / 100);
+    const auto grainRow = SimdKernels::table().grain;
+    constexpr int Side = SpatialFields::Grain::Side;
+    
+    QImage result = PixelKernels::toWorkingFormat(std::move(input));
+    PixelKernels::forEachRow(result, [&](QRgb *row, int width, int y) {
+        for (int blockX = 0; blockX * Side < width; ++blockX) {
+            const QPoint offset = grain->offset(blockX, y / Side);
+            const qint32 *noise = grain->row(y + offset.y());
+            const int begin = blockX * Side;
+            const int count = qMin(Side, width - begin);
             
-            QColor c = result.pixelColor(x, y);
-            int r = qBound(0, c.red() + noise, 255);
-            int g = qBound(0, c.green() + noise, 255);
-            int b = qBound(0, c.blue() + noise, 255);
-            result.setPixelColor(x, y, QColor(r, g, b, c.alpha()));
+            // The shifted block wraps around the texture once
+            const int first = qMin(count, Side - offset.x());
+            grainRow(row + begin, noise + offset.x(), first, strength);
+            if (first < count) grainRow(row + begin + first, noise, count - first, strength);
         }
-    }
+    });
     
     return result;
 }
 
 QImage ImageProcessor::applyVintage(const QImage &input, float amount) {
+    return applyVintage(QImage(input), amount);
+}
+
+QImage ImageProcessor::applyVintage(QImage &&input, float amount) {
     if (input.isNull()) return QImage();
     
-    QImage result = input.copy();
-    
-    // Reduce saturation
-    result = applySaturation(result, -amount * 0.3f);
-    
-    // Warm color cast
-    result = applyColorBalance(result, static_cast<int>(amount * 0.3f), 0, static_cast<int>(-amount * 0.2f));
+    // Reduce saturation and add a warm color cast in one pass
+    AdjustmentCompiler adjustments;
+    adjustments.addSaturation(-amount * 0.3f)
+               .addColorBalance(static_cast<int>(amount * 0.3f), 0, static_cast<int>(-amount * 0.2f));
+    QImage result = adjustments.apply(std::move(input));
     
-    // Add vignette
-    result = applyVignette(result, amount * 0.5f, 50);
+    // Add vignette, in place so the chain holds a single frame
+    applyVignetteInPlace(result, amount * 0.5f, 50);
     
     return result;
 }
 
 QImage ImageProcessor::applyBlackAndWhite(const QImage &input, float red, float green, float blue) {
+    return applyBlackAndWhite(QImage(input), red, green, blue);
+}
+
+QImage ImageProcessor::applyBlackAndWhite(QImage &&input, float red, float green, float blue) {
     if (input.isNull()) return QImage();
     
-    QImage result = input.copy();
+    QImage result = PixelKernels::toWorkingFormat(std::move(input));
     float total = red + green + blue;
-    float rWeight = red / total;
-    float gWeight = green / total;
-    float bWeight = blue / total;
-    
-    for (int y = 0; y < result.height(); ++y) {
-        for (int x = 0; x < result.width(); ++x) {
-            QColor c = result.pixelColor(x, y);
-            int gray = static_cast<int>(c.red() * rWeight + c.green() * gWeight + c.blue() * bWeight);
-            result.setPixelColor(x, y, QColor(gray, gray, gray, c.alpha()));
-        }
-    }
+    if (qFuzzyIsNull(total)) return result;
+    
+    const int rWeight = PixelKernels::toFixed(red / total);
+    const int gWeight = PixelKernels::toFixed(green / total);
+    const int bWeight = PixelKernels::toFixed(blue / total);
+    
+    PixelKernels::forEachPixel(result, [rWeight, gWeight, bWeight](QRgb p) {
+        const int gray = PixelKernels::clampByte(
+            (qRed(p) * rWeight + qGreen(p) * gWeight + qBlue(p) * bWeight) >> PixelKernels::FixedShift);
+        return PixelKernels::pack(gray, gray, gray, p);
+    });
     
     return result;
 }
 
 QImage ImageProcessor::applySepia(const QImage &input, float amount) {
+    return applySepia(QImage(input), amount);
+}
+
+QImage ImageProcessor::applySepia(QImage &&input, float amount) {
     if (input.isNull()) return QImage();
     
-    QImage result = input.copy();
+    QImage result = PixelKernels::toWorkingFormat(std::move(input));
     float factor = amount / 100.0f;
     
-    for (int y = 0; y < result.height(); ++y) {
-        for (int x = 0; x < result.width(); ++x) {
-            QColor c = result.pixelColor(x, y);
-            int gray = qGray(c.rgb());
-            
-            int r = qBound(0, static_cast<int>(gray + 40 * factor), 255);
-            int g = qBound(0, static_cast<int>(gray + 20 * factor), 255);
-            int b = qBound(0, static_cast<int>(gray - 20 * factor), 255);
-            
-            result.setPixelColor(x, y, QColor(r, g, b, c.alpha()));
-        }
-    }
+    // Output depends only on luma, so the whole toning curve is one table
+    const ChannelLut tone = PixelKernels::makeLut([factor](int channel, int gray) {
+        static const float offsets[3] = {40.0f, 20.0f, -20.0f};
+        return static_cast<int>(gray + offsets[channel] * factor);
+    });
+    
+    PixelKernels::forEachPixel(result, [&tone](QRgb p) {
+        const int gray = qGray(p);
+        return PixelKernels::pack(tone.red[gray], tone.green[gray], tone.blue[gray], p);
+    });
     
     return result;
 }
@@ -642,17 +912,24 @@ QImage ImageProcessor::crop(const QImage &input, const QRect &rect) {
     return input.copy(rect.intersected(input.rect()));
 }
 
-QImage ImageProcessor::resize(const QImage &input, const QSize &size, Qt::AspectRatioMode mode) {
+QImage ImageProcessor::resize(const QImage &input, const QSize &size, Qt::AspectRatioMode mode,
+                              ResampleFilter filter) {
     if (input.isNull()) return QImage();
-    return input.scaled(size, mode, Qt::SmoothTransformation);
+    
+    // Deep images keep their depth through Qt's resampler
+    if (input.depth() > 32) return input.scaled(size, mode, Qt::SmoothTransformation);
+    return Resampler::resize(input, input.size().scaled(size, mode), filter);
 }
 
-QImage ImageProcessor::rotate(const QImage &input, float degrees) {
+QImage ImageProcessor::rotate(const QImage &input, float degrees, ResampleFilter filter) {
     if (input.isNull()) return QImage();
     
-    QTransform transform;
-    transform.rotate(degrees);
-    return input.transformed(transform, Qt::SmoothTransformation);
+    if (input.depth() > 32) {
+        QTransform transform;
+        transform.rotate(degrees);
+        return input.transformed(transform, Qt::SmoothTransformation);
+    }
+    return Resampler::rotate(input, degrees, filter);
 }
 
 QImage ImageProcessor::flipHorizontal(const QImage &input) {
@@ -666,213 +943,312 @@ QImage ImageProcessor::flipVertical(const QImage &input) {
 }
 
 // ============================================================================
-// Blending Modes
+// Advanced Operations
 // ============================================================================
 
-QImage ImageProcessor::blendNormal(const QImage &base, const QImage &blend, float opacity) {
-    if (base.isNull() || blend.isNull()) return base;
-    
-    QImage result = base.copy();
-    
-    for (int y = 0; y < result.height(); ++y) {
-        for (int x = 0; x < result.width(); ++x) {
-            QColor b = base.pixelColor(x, y);
-            QColor l = blend.pixelColor(qMin(x, blend.width() - 1), qMin(y, blend.height() - 1));
-            
-            int r = static_cast<int>(b.red() * (1 - opacity) + l.red() * opacity);
-            int g = static_cast<int>(b.green() * (1 - opacity) + l.green() * opacity);
-            int b_ = static_cast<int>(b.blue() * (1 - opacity) + l.blue() * opacity);
-            
-            result.setPixelColor(x, y, QColor(r, g, b_, b.alpha()));
-        }
-    }
+QImage ImageProcessor::applyLUT(const QImage &input, const QVector<QColor> &lut) {
+    return applyLUT(QImage(input), lut);
+}
+
+QImage ImageProcessor::applyLUT(QImage &&input, const QVector<QColor> &lut) {
+    if (input.isNull()) return QImage();
     
-    return result;
+    if (lut.isEmpty()) return PixelKernels::toWorkingFormat(std::move(input));
+    
+    // Each channel reads its own component of the entries, a table of any
+    // size is stretched over 0..255 with linear interpolation
+    auto component = [](const QColor &c, int channel) {
+        return channel == 0 ? c.red() : (channel == 1 ? c.green() : c.blue());
+    };
+    const int last = lut.size() - 1;
+    
+    return applyChannelLut(std::move(input), PixelKernels::makeLut([&](int channel, int v) {
+        if (last == 0) return component(lut[0], channel);
+        const float pos = v * last / 255.0f;
+        const int i = qMin(static_cast<int>(pos), last - 1);
+        const float t = pos - i;
+        return qRound(component(lut[i], channel) * (1 - t) + component(lut[i + 1], channel) * t);
+    }));
 }
 
-QImage ImageProcessor::blendMultiply(const QImage &base, const QImage &blend, float opacity) {
-    if (base.isNull() || blend.isNull()) return base;
+QImage ImageProcessor::applyCurves(const QImage &input, const QVector<QPointF> &curve) {
+    return applyCurves(QImage(input), curve);
+}
+
+QImage ImageProcessor::applyCurves(QImage &&input, const QVector<QPointF> &curve) {
+    if (input.isNull()) return QImage();
     
-    QImage result = base.copy();
+    if (curve.size() < 2) return PixelKernels::toWorkingFormat(std::move(input));
     
-    for (int y = 0; y < result.height(); ++y) {
-        for (int x = 0; x < result.width(); ++x) {
-            QColor b = base.pixelColor(x, y);
-            QColor l = blend.pixelColor(qMin(x, blend.width() - 1), qMin(y, blend.height() - 1));
-            
-            int r = static_cast<int>(b.red() * (l.red() / 255.0f) * opacity + b.red() * (1 - opacity));
-            int g = static_cast<int>(b.green() * (l.green() / 255.0f) * opacity + b.green() * (1 - opacity));
-            int b_ = static_cast<int>(b.blue() * (l.blue() / 255.0f) * opacity + b.blue() * (1 - opacity));
-            
-            result.setPixelColor(x, y, QColor(r, g, b_, b.alpha()));
-        }
-    }
+    // Control points are (input, output) pairs in 0..255
+    QVector<QPointF> points = curve;
+    std::sort(points.begin(), points.end(), [](const QPointF &a, const QPointF &b) {
+        return a.x() < b.x();
+    });
     
-    return result;
+    return applyChannelLut(std::move(input), PixelKernels::makeLut([&points](int, int v) {
+        return qRound(applyCurve(v, points));
+    }));
 }
 
-QImage ImageProcessor::blendScreen(const QImage &base, const QImage &blend, float opacity) {
-    if (base.isNull() || blend.isNull()) return base;
-    
-    QImage result = base.copy();
+QImage ImageProcessor::applyLevels(const QImage &input, int black, int gamma, int white) {
+    return applyLevels(QImage(input), black, gamma, white);
+}
+
+QImage ImageProcessor::applyLevels(QImage &&input, int black, int gamma, int white) {
+    if (input.isNull()) return QImage();
     
-    for (int y = 0; y < result.height(); ++y) {
-        for (int x = 0; x < result.width(); ++x) {
-            QColor b = base.pixelColor(x, y);
-            QColor l = blend.pixelColor(qMin(x, blend.width() - 1), qMin(y, blend.height() - 1));
-            
-            int r = static_cast<int>((255 - (255 - b.red()) * (255 - l.red()) / 255.0f) * opacity + b.red() * (1 - opacity));
-            int g = static_cast<int>((255 - (255 - b.green()) * (255 - l.green()) / 255.0f) * opacity + b.green() * (1 - opacity));
-            int b_ = static_cast<int>((255 - (255 - b.blue()) * (255 - l.blue()) / 255.0f) * opacity + b.blue() * (1 - opacity));
-            
-            result.setPixelColor(x, y, QColor(r, g, b_, b.alpha()));
-        }
-    }
+    // gamma is in hundredths, 100 leaves the midtones unchanged
+    black = qBound(0, black, 254);
+    white = qBound(black + 1, white, 255);
+    const float inverseGamma = 100.0f / qBound(10, gamma, 999);
     
-    return result;
+    return applyChannelLut(std::move(input), PixelKernels::makeLut([=](int, int v) {
+        const float t = qBound(0.0f, (v - black) / static_cast<float>(white - black), 1.0f);
+        return qRound(255.0f * std::pow(t, inverseGamma));
+    }));
 }
 
-QImage ImageProcessor::blendOverlay(const QImage &base, const QImage &blend, float opacity) {
-    if (base.isNull() || blend.isNull()) return base;
+float ImageProcessor::applyCurve(float value, const QVector<QPointF> &curve) {
+    // curve is sorted by x, values outside the control points hold the end values
+    const int n = curve.size();
+    if (n == 0) return value;
+    if (value <= curve.first().x()) return curve.first().y();
+    if (value >= curve.last().x()) return curve.last().y();
+    
+    int k = 0;
+    while (k < n - 2 && value > curve[k + 1].x()) ++k;
+    
+    auto secant = [&curve](int i) {
+        const qreal dx = curve[i + 1].x() - curve[i].x();
+        return dx > 0 ? (curve[i + 1].y() - curve[i].y()) / dx : 0.0;
+    };
+    
+    // Monotone cubic tangents (Fritsch-Butland), the curve never overshoots
+    // between control points
+    auto tangent = [&](int i) {
+        if (i == 0) return secant(0);
+        if (i == n - 1) return secant(n - 2);
+        const qreal d0 = secant(i - 1);
+        const qreal d1 = secant(i);
+        if (d0 * d1 <= 0) return 0.0;
+        const qreal h0 = curve[i].x() - curve[i - 1].x();
+        const qreal h1 = curve[i + 1].x() - curve[i].x();
+        return 3 * (h0 + h1) / ((2 * h1 + h0) / d0 + (h1 + 2 * h0) / d1);
+    };
+    
+    const QPointF &p0 = curve[k];
+    const QPointF &p1 = curve[k + 1];
+    const qreal h = p1.x() - p0.x();
+    if (h <= 0) return p1.y();
+    
+    const qreal t = (value - p0.x()) / h;
+    const qreal t2 = t * t;
+    const qreal t3 = t2 * t;
+    return static_cast<float>((2 * t3 - 3 * t2 + 1) * p0.y()
+                            + (t3 - 2 * t2 + t) * h * tangent(k)
+                            + (-2 * t3 + 3 * t2) * p1.y()
+                            + (t3 - t2) * h * tangent(k + 1));
+}
+
+// ============================================================================
+// Masking
+// ============================================================================
+
+QImage ImageProcessor::applyMask(const QImage &input, const QImage &mask) {
+    return applyMask(QImage(input), mask);
+}
+
+QImage ImageProcessor::applyMask(QImage &&input, const QImage &mask) {
+    if (input.isNull()) return QImage();
     
-    QImage result = base.copy();
+    // RGB32 already stores an opaque alpha byte, so relabeling it is free
+    QImage result = PixelKernels::toWorkingFormat(std::move(input));
+    if (result.format() != QImage::Format_ARGB32) {
+        result = std::move(result).convertToFormat(QImage::Format_ARGB32);
+    }
     
-    for (int y = 0; y < result.height(); ++y) {
-        for (int x = 0; x < result.width(); ++x) {
-            QColor b = base.pixelColor(x, y);
-            QColor l = blend.pixelColor(qMin(x, blend.width() - 1), qMin(y, blend.height() - 1));
-            
-            auto overlay = [](int base, int blend) {
-                if (base < 128) {
-                    return 2 * base * blend / 255;
-                } else {
-                    return 255 - 2 * (255 - base) * (255 - blend) / 255;
-                }
-            };
-            
-            int r = static_cast<int>(overlay(b.red(), l.red()) * opacity + b.red() * (1 - opacity));
-            int g = static_cast<int>(overlay(b.green(), l.green()) * opacity + b.green() * (1 - opacity));
-            int b_ = static_cast<int>(overlay(b.blue(), l.blue()) * opacity + b.blue() * (1 - opacity));
-            
-            result.setPixelColor(x, y, QColor(r, g, b_, b.alpha()));
+    // Pixels the mask does not reach have no coverage
+    const QImage coverage = coverageMask(mask);
+    const int maskWidth = coverage.isNull() ? 0 : qMin(coverage.width(), result.width());
+    const int maskHeight = coverage.isNull() ? 0 : coverage.height();
+    
+    PixelKernels::forEachRow(result, [&](QRgb *row, int width, int y) {
+        int x = 0;
+        if (y < maskHeight) {
+            const uchar *cover = coverage.constScanLine(y);
+            for (; x < maskWidth; ++x) {
+                const uint alpha = (row[x] >> 24) * cover[x] + 128;
+                row[x] = (row[x] & 0x00ffffffu) | (((alpha + (alpha >> 8)) >> 8) << 24);
+            }
         }
-    }
+        for (; x < width; ++x) {
+            row[x] &= 0x00ffffffu;
+        }
+    });
     
     return result;
 }
 
-QImage ImageProcessor::blendSoftLight(const QImage &base, const QImage &blend, float opacity) {
-    if (base.isNull() || blend.isNull()) return base;
-    
-    QImage result = base.copy();
+QImage ImageProcessor::createGradientMask(const QSize &size, const QPointF &start, const QPointF &end) {
+    if (size.isEmpty()) return QImage();
+    
+    // Full coverage at start fading linearly to none at end, measured along
+    // the line between them at pixel centers
+    QImage mask(size, QImage::Format_Grayscale8);
+    const qreal dx = end.x() - start.x();
+    const qreal dy = end.y() - start.y();
+    const qreal lengthSquared = dx * dx + dy * dy;
+    if (qFuzzyIsNull(lengthSquared)) {
+        mask.fill(255);
+        return mask;
+    }
     
-    for (int y = 0; y < result.height(); ++y) {
-        for (int x = 0; x < result.width(); ++x) {
-            QColor b = base.pixelColor(x, y);
-            QColor l = blend.pixelColor(qMin(x, blend.width() - 1), qMin(y, blend.height() - 1));
-            
-            auto softLight = [](int base, int blend) {
-                float b = base / 255.0f;
-                float l = blend / 255.0f;
-                if (l < 0.5f) {
-                    return static_cast<int>((2 * b * l + b * b * (1 - 2 * l)) * 255);
-                } else {
-                    return static_cast<int>((2 * b * (1 - l) + std::sqrt(b) * (2 * l - 1)) * 255);
-                }
-            };
-            
-            int r = static_cast<int>(softLight(b.red(), l.red()) * opacity + b.red() * (1 - opacity));
-            int g = static_cast<int>(softLight(b.green(), l.green()) * opacity + b.green() * (1 - opacity));
-            int b_ = static_cast<int>(softLight(b.blue(), l.blue()) * opacity + b.blue() * (1 - opacity));
-            
-            result.setPixelColor(x, y, QColor(r, g, b_, b.alpha()));
+    const float stepX = static_cast<float>(dx / lengthSquared);
+    const float stepY = static_cast<float>(dy / lengthSquared);
+    const float originX = static_cast<float>(start.x()) - 0.5f;
+    const float originY = static_cast<float>(start.y()) - 0.5f;
+    
+    using Gray = PixelTraits<QImage::Format_Grayscale8>;
+    PixelKernels::forEachRowAs<Gray>(ImageView(mask), [&](quint8 *row, int width, int y) {
+        const float rowT = (y - originY) * stepY;
+        for (int x = 0; x < width; ++x) {
+            const float t = qBound(0.0f, rowT + (x - originX) * stepX, 1.0f);
+            row[x] = static_cast<quint8>(qRound(255.0f * (1.0f - t)));
         }
-    }
+    });
     
-    return result;
+    return mask;
 }
 
-QImage ImageProcessor::blendHardLight(const QImage &base, const QImage &blend, float opacity) {
-    if (base.isNull() || blend.isNull()) return base;
-    
-    QImage result = base.copy();
-    
-    for (int y = 0; y < result.height(); ++y) {
-        for (int x = 0; x < result.width(); ++x) {
-            QColor b = base.pixelColor(x, y);
-            QColor l = blend.pixelColor(qMin(x, blend.width() - 1), qMin(y, blend.height() - 1));
-            
-            auto hardLight = [](int base, int blend) {
-                if (blend < 128) {
-                    return 2 * base * blend / 255;
-                } else {
-                    return 255 - 2 * (255 - base) * (255 - blend) / 255;
-                }
-            };
-            
-            int r = static_cast<int>(hardLight(b.red(), l.red()) * opacity + b.red() * (1 - opacity));
-            int g = static_cast<int>(hardLight(b.green(), l.green()) * opacity + b.green() * (1 - opacity));
-            int b_ = static_cast<int>(hardLight(b.blue(), l.blue()) * opacity + b.blue() * (1 - opacity));
-            
-            result.setPixelColor(x, y, QColor(r, g, b_, b.alpha()));
+QImage ImageProcessor::createRadialMask(const QSize &size, const QPointF &center, float radius) {
+    if (size.isEmpty()) return QImage();
+    
+    // Full coverage at center falling linearly to none at radius
+    QImage mask(size, QImage::Format_Grayscale8);
+    mask.fill(0);
+    if (radius <= 0) return mask;
+    
+    const float cx = static_cast<float>(center.x()) - 0.5f;
+    const float cy = static_cast<float>(center.y()) - 0.5f;
+    const float scale = 1.0f / radius;
+    const int top = qMax(0, static_cast<int>(std::floor(cy - radius)));
+    const int bottom = qMin(size.height() - 1, static_cast<int>(std::ceil(cy + radius)));
+    if (top > bottom) return mask;
+    
+    // Only the rows and columns inside the circle's bounding box are touched
+    using Gray = PixelTraits<QImage::Format_Grayscale8>;
+    const QRect rows(0, top, size.width(), bottom - top + 1);
+    PixelKernels::forEachRowAs<Gray>(ImageView(mask, rows), [&](quint8 *row, int width, int y) {
+        const float ry = top + y - cy;
+        const float halfChord = std::sqrt(qMax(0.0f, radius * radius - ry * ry));
+        const int left = qMax(0, static_cast<int>(std::floor(cx - halfChord)));
+        const int right = qMin(width - 1, static_cast<int>(std::ceil(cx + halfChord)));
+        for (int x = left; x <= right; ++x) {
+            const float rx = x - cx;
+            const float t = std::sqrt(rx * rx + ry * ry) * scale;
+            if (t < 1.0f) row[x] = static_cast<quint8>(qRound(255.0f * (1.0f - t)));
         }
-    }
+    });
     
-    return result;
+    return mask;
 }
 
-QImage ImageProcessor::blendColorDodge(const QImage &base, const QImage &blend, float opacity) {
-    if (base.isNull() || blend.isNull()) return base;
-    
-    QImage result = base.copy();
+// ============================================================================
+// Region-Restricted Execution
+// ============================================================================
+
+QImage ImageProcessor::applyInRegion(const QImage &input, const QRect &roi, const QImage &mask,
+                                     const RegionFilter &filter, int margin) {
+    return applyInRegion(QImage(input), roi, mask, filter, margin);
+}
+
+QImage ImageProcessor::applyInRegion(QImage &&input, const QRect &roi, const QImage &mask,
+                                     const RegionFilter &filter, int margin) {
+    if (input.isNull()) return QImage();
     
-    for (int y = 0; y < result.height(); ++y) {
-        for (int x = 0; x < result.width(); ++x) {
-            QColor b = base.pixelColor(x, y);
-            QColor l = blend.pixelColor(qMin(x, blend.width() - 1), qMin(y, blend.height() - 1));
-            
-            auto colorDodge = [](int base, int blend) {
-                if (blend == 255) return 255;
-                return qMin(255, base * 255 / (255 - blend));
-            };
-            
-            int r = static_cast<int>(colorDodge(b.red(), l.red()) * opacity + b.red() * (1 - opacity));
-            int g = static_cast<int>(colorDodge(b.green(), l.green()) * opacity + b.green() * (1 - opacity));
-            int b_ = static_cast<int>(colorDodge(b.blue(), l.blue()) * opacity + b.blue() * (1 - opacity));
-            
-            result.setPixelColor(x, y, QColor(r, g, b_, b.alpha()));
-        }
+    // Deep documents keep their depth, the filter may still return 8 bits
+    const bool deep = input.depth() == 64 && visitPixelFormat(input.format(), [](auto) { return true; });
+    QImage result = deep ? PixelKernels::toWritable(std::move(input))
+                         : PixelKernels::toWorkingFormat(std::move(input));
+    if (!filter) return result;
+    
+    // The mask covers roi from its top-left corner, pixels past it stay as they are
+    const QRect region = roi.isNull() ? result.rect() : roi;
+    const QImage coverage = coverageMask(mask);
+    QRect area = region.intersected(result.rect());
+    if (!coverage.isNull()) area = area.intersected(QRect(region.topLeft(), coverage.size()));
+    if (area.isEmpty()) return result;
+    
+    const ImageView target(result, area);
+    const QPoint coverageOrigin = area.topLeft() - region.topLeft();
+    margin = qMax(0, margin);
+    
+    if (coverage.isNull() && margin == 0) {
+        // Hand the filter the region's own pixels, filters that work in
+        // place then write straight into result without any copy
+        QImage pixels = target.asImage();
+        QImage processed = filter(std::move(pixels));
+        if (processed.size() != area.size() || processed.constBits() == target.bits()) return result;
+        if (processed.format() != result.format()) processed = processed.convertToFormat(result.format());
+        mergeRegion(target, ImageView(processed), QImage(), QPoint());
+        return result;
     }
     
-    return result;
-}
-
-QImage ImageProcessor::blendColorBurn(const QImage &base, const QImage &blend, float opacity) {
-    if (base.isNull() || blend.isNull()) return base;
+    // Filters that read neighbours see margin pixels of real context, the
+    // copy comes from the scratch arena and goes back to it afterwards
+    const QRect context = area.adjusted(-margin, -margin, margin, margin).intersected(result.rect());
+    QImage pixels = ScratchArena::image(context.width(), context.height(), result.format());
+    const ImageView source(result, context);
+    const ImageView copy(pixels);
+    mergeRegion(copy, source, QImage(), QPoint());
     
-    QImage result = base.copy();
+    QImage processed = filter(std::move(pixels));
+    if (processed.size() != context.size()) return result;
+    if (processed.format() != result.format()) processed = processed.convertToFormat(result.format());
     
-    for (int y = 0; y < result.height(); ++y) {
-        for (int x = 0; x < result.width(); ++x) {
-            QColor b = base.pixelColor(x, y);
-            QColor l = blend.pixelColor(qMin(x, blend.width() - 1), qMin(y, blend.height() - 1));
-            
-            auto colorBurn = [](int base, int blend) {
-                if (blend == 0) return 0;
-                return qMax(0, 255 - (255 - base) * 255 / blend);
-            };
-            
-            int r = static_cast<int>(colorBurn(b.red(), l.red()) * opacity + b.red() * (1 - opacity));
-            int g = static_cast<int>(colorBurn(b.green(), l.green()) * opacity + b.green() * (1 - opacity));
-            int b_ = static_cast<int>(colorBurn(b.blue(), l.blue()) * opacity + b.blue() * (1 - opacity));
-            
-            result.setPixelColor(x, y, QColor(r, g, b_, b.alpha()));
-        }
-    }
+    const ImageView inner = ImageView(processed).subView(QRect(area.topLeft() - context.topLeft(), area.size()));
+    mergeRegion(target, inner, coverage, coverageOrigin);
     
     return result;
 }
 
+// ============================================================================
+// Blending Modes
+// ============================================================================
+
+QImage ImageProcessor::blendNormal(const QImage &base, const QImage &blend, float opacity) {
+    return blendImages(base, blend, opacity, BlendMode::Normal);
+}
+
+QImage ImageProcessor::blendMultiply(const QImage &base, const QImage &blend, float opacity) {
+    return blendImages(base, blend, opacity, BlendMode::Multiply);
+}
+
+QImage ImageProcessor::blendScreen(const QImage &base, const QImage &blend, float opacity) {
+    return blendImages(base, blend, opacity, BlendMode::Screen);
+}
+
+QImage ImageProcessor::blendOverlay(const QImage &base, const QImage &blend, float opacity) {
+    return blendImages(base, blend, opacity, BlendMode::Overlay);
+}
+
+QImage ImageProcessor::blendSoftLight(const QImage &base, const QImage &blend, float opacity) {
+    return blendImages(base, blend, opacity, BlendMode::SoftLight);
+}
+
+QImage ImageProcessor::blendHardLight(const QImage &base, const QImage &blend, float opacity) {
+    return blendImages(base, blend, opacity, BlendMode::HardLight);
+}
+
+QImage ImageProcessor::blendColorDodge(const QImage &base, const QImage &blend, float opacity) {
+    return blendImages(base, blend, opacity, BlendMode::ColorDodge);
+}
+
+QImage ImageProcessor::blendColorBurn(const QImage &base, const QImage &blend, float opacity) {
+    return blendImages(base, blend, opacity, BlendMode::ColorBurn);
+}
+
 // ============================================================================
 // Utility Functions
 // ============================================================================
@@ -880,58 +1256,56 @@ QImage ImageProcessor::blendColorBurn(const QImage &base, const QImage &blend, f
 QColor ImageProcessor::sampleColor(const QImage &image, const QPoint &pos, int radius) {
     if (image.isNull()) return QColor();
     
-    float r = 0, g = 0, b = 0;
-    int count = 0;
-    
+    // One query, sum the window directly. Repeated sampling of the same
+    // image should build a SummedAreaTable and use the overload below.
+    // Positions past the edge read the edge pixel, so every sample averages
+    // the full window.
+    radius = qMax(radius, 0);
+    quint64 r = 0, g = 0, b = 0;
     for (int dy = -radius; dy <= radius; ++dy) {
+        const int y = qBound(0, pos.y() + dy, image.height() - 1);
         for (int dx = -radius; dx <= radius; ++dx) {
-            int px = qBound(0, pos.x() + dx, image.width() - 1);
-            int py = qBound(0, pos.y() + dy, image.height() - 1);
-            
-            QColor c = image.pixelColor(px, py);
-            r += c.redF();
-            g += c.greenF();
-            b += c.blueF();
-            count++;
+            const QRgb p = image.pixel(qBound(0, pos.x() + dx, image.width() - 1), y);
+            r += qRed(p);
+            g += qGreen(p);
+            b += qBlue(p);
         }
     }
     
-    return QColor::fromRgbF(r / count, g / count, b / count);
+    const quint64 count = quint64(2 * radius + 1) * (2 * radius + 1);
+    return QColor(int((r + count / 2) / count), int((g + count / 2) / count), int((b + count / 2) / count));
 }
 
-QVector<QColor> ImageProcessor::extractPalette(const QImage &image, int colorCount) {
-    if (image.isNull()) return {};
-    
-    // Simple color quantization
-    QHash<int, int> colorHistogram;
-    
-    for (int y = 0; y < image.height(); y += 4) {
-        for (int x = 0; x < image.width(); x += 4) {
-            QColor c = image.pixelColor(x, y);
-            // Quantize to reduce colors
-            int r = (c.red() / 32) * 32;
-            int g = (c.green() / 32) * 32;
-            int b = (c.blue() / 32) * 32;
-            int key = (r << 16) | (g << 8) | b;
-            colorHistogram[key]++;
+QColor ImageProcessor::sampleColor(const SummedAreaTable &table, const QPoint &pos, int radius) {
+    if (table.isNull()) return QColor();
+    
+    // Same clamped window as above, answered in constant time: at most
+    // three spans per axis, the edge ones weighted by how often they repeat
+    radius = qMax(radius, 0);
+    const QVector<ClampedSpan> columns = clampedSpans(pos.x(), radius, table.width());
+    const QVector<ClampedSpan> rows = clampedSpans(pos.y(), radius, table.height());
+    
+    quint64 sums[3] = {0, 0, 0};
+    for (const ClampedSpan &row : rows) {
+        for (const ClampedSpan &column : columns) {
+            const QRect box(QPoint(column.first, row.first), QPoint(column.last, row.last));
+            const quint64 weight = quint64(row.weight) * column.weight;
+            for (int plane = 0; plane < 3; ++plane) sums[plane] += weight * table.sum(box, plane);
         }
     }
     
-    // Get most frequent colors
-    QVector<QPair<int, int>> sortedColors;
-    for (auto it = colorHistogram.begin(); it != colorHistogram.end(); ++it) {
-        sortedColors.append({it.value(), it.key()});
-    }
-    
-    std::sort(sortedColors.begin(), sortedColors.end(), std::greater<QPair<int, int>>());
+    const quint64 count = quint64(2 * radius + 1) * (2 * radius + 1);
+    return QColor(int((sums[0] + count / 2) / count), int((sums[1] + count / 2) / count),
+                  int((sums[2] + count / 2) / count));
+}
+
+QVector<QColor> ImageProcessor::extractPalette(const QImage &image, int colorCount) {
+    if (image.isNull()) return {};
     
+    // Sampled histogram, median cut and k-means, most common color first
     QVector<QColor> palette;
-    for (int i = 0; i < qMin(colorCount, sortedColors.size()); ++i) {
-        int key = sortedColors[i].second;
-        int r = (key >> 16) & 0xFF;
-        int g = (key >> 8) & 0xFF;
-        int b = key & 0xFF;
-        palette.append(QColor(r, g, b));
+    for (QRgb color : PaletteEngine::extract(image, colorCount)) {
+        palette.append(QColor(color));
     }
     
     return palette;
@@ -940,50 +1314,21 @@ QVector<QColor> ImageProcessor::extractPalette(const QImage &image, int colorCou
 QImage ImageProcessor::createHistogram(const QImage &image) {
     if (image.isNull()) return QImage();
     
-    const int width = 256;
-    const int height = 100;
-    QImage histogram(width, height, QImage::Format_ARGB32);
-    histogram.fill(Qt::transparent);
-    
-    QVector<int> redHist(256, 0);
-    QVector<int> greenHist(256, 0);
-    QVector<int> blueHist(256, 0);
-    
-    for (int y = 0; y < image.height(); ++y) {
-        for (int x = 0; x < image.width(); ++x) {
-            QColor c = image.pixelColor(x, y);
-            redHist[c.red()]++;
-            greenHist[c.green()]++;
-            blueHist[c.blue()]++;
-        }
-    }
-    
-    // Find max for normalization
-    int maxVal = 0;
-    for (int i = 0; i < 256; ++i) {
-        maxVal = qMax(maxVal, redHist[i]);
-        maxVal = qMax(maxVal, greenHist[i]);
-        maxVal = qMax(maxVal, blueHist[i]);
-    }
-    
-    QPainter painter(&histogram);
-    painter.setRenderHint(QPainter::Antialiasing);
-    
-    // Draw histogram
-    for (int i = 0; i < 256; ++i) {
-        int rHeight = redHist[i] * height / maxVal;
-        int gHeight = greenHist[i] * height / maxVal;
-        int bHeight = blueHist[i] * height / maxVal;
-        
-        painter.setPen(QColor(255, 0, 0, 128));
-        painter.drawLine(i, height, i, height - rHeight);
-        painter.setPen(QColor(0, 255, 0, 128));
-        painter.drawLine(i, height, i, height - gHeight);
-        painter.setPen(QColor(0, 0, 255, 128));
-        painter.drawLine(i, height, i, height - bHeight);
-    }
+    // Counting and drawing are separate, HistogramStats has the numbers
+    return HistogramStats(image).render(256, 100);
+}
+
+// ============================================================================
+// Parallel Processing
+// ============================================================================
+
+QImage ImageProcessor::processParallel(const QImage &input,
+                                       std::function<QColor(const QColor&)> pixelFunc) {
+    if (input.isNull() || !pixelFunc) return QImage();
     
-    return histogram;
+    return processParallel(input, [&pixelFunc](QRgb p) {
+        return pixelFunc(QColor::fromRgba(p)).rgba();
+    });
 }
 
 } // namespace Utils
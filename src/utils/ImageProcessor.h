@@ -6,70 +6,136 @@
 #include <QVector>
 #include <QPointF>
 #include <functional>
+#include <type_traits>
+#include <utility>
+
+#include "PixelKernels.h"
+#include "LensBlur.h"
+#include "Resampler.h"
+#include "SummedAreaTable.h"
 
 namespace Knoux {
 namespace Utils {
 
 /**
  * @brief Image processing utilities
+ *
+ * Filters that can work in place also take a QImage&&. Handing them an image
+ * nothing else shares, as in f(g(std::move(image))), runs the whole chain on
+ * that one buffer; the const& overloads make a single copy and forward.
+ *
+ * The per-channel filters (brightness, contrast, exposure, whites, blacks,
+ * color balance, temperature, tint, LUT, curves and levels) keep
+ * Grayscale8, RGB888 and the 16-bit RGBA64 and RGBA16FPx4 layouts as they
+ * are, so a deep document does not drop to 8 bits between them. Other
+ * filters return ARGB32.
  */
 class ImageProcessor {
 public:
     // Basic filters
     static QImage applyBrightness(const QImage &input, int value);
+    static QImage applyBrightness(QImage &&input, int value);
     static QImage applyContrast(const QImage &input, float value);
+    static QImage applyContrast(QImage &&input, float value);
     static QImage applySaturation(const QImage &input, float value);
+    static QImage applySaturation(QImage &&input, float value);
     static QImage applyHueShift(const QImage &input, int degrees);
+    static QImage applyHueShift(QImage &&input, int degrees);
     
     // Color adjustments
     static QImage applyColorBalance(const QImage &input, int red, int green, int blue);
+    static QImage applyColorBalance(QImage &&input, int red, int green, int blue);
     static QImage applyColorTemperature(const QImage &input, int kelvin);
+    static QImage applyColorTemperature(QImage &&input, int kelvin);
     static QImage applyTint(const QImage &input, int value);
+    static QImage applyTint(QImage &&input, int value);
     static QImage applyVibrance(const QImage &input, float value);
+    static QImage applyVibrance(QImage &&input, float value);
     
     // Tone adjustments
     static QImage applyExposure(const QImage &input, float value);
+    static QImage applyExposure(QImage &&input, float value);
     static QImage applyHighlights(const QImage &input, float value);
+    static QImage applyHighlights(QImage &&input, float value);
     static QImage applyShadows(const QImage &input, float value);
+    static QImage applyShadows(QImage &&input, float value);
     static QImage applyWhites(const QImage &input, float value);
+    static QImage applyWhites(QImage &&input, float value);
     static QImage applyBlacks(const QImage &input, float value);
+    static QImage applyBlacks(QImage &&input, float value);
     
     // Detail adjustments
     static QImage applySharpness(const QImage &input, float value);
+    static QImage applySharpness(QImage &&input, float value);
     static QImage applyClarity(const QImage &input, float value);
+    static QImage applyClarity(QImage &&input, float value);
     static QImage applyDehaze(const QImage &input, float value);
+    static QImage applyDehaze(QImage &&input, float value);
     static QImage applyNoiseReduction(const QImage &input, float value);
     
     // Blur effects
     static QImage applyGaussianBlur(const QImage &input, float radius);
+    static QImage applyGaussianBlur(QImage &&input, float radius);
     static QImage applyMotionBlur(const QImage &input, float angle, float distance);
     static QImage applyRadialBlur(const QImage &input, QPointF center, float amount);
-    static QImage applyLensBlur(const QImage &input, float radius);
+    static QImage applyLensBlur(const QImage &input, float radius, BokehShape shape = BokehShape::Disc,
+                                float highlights = 0.0f, const QImage &depth = QImage());
+    static QImage applyLensBlur(QImage &&input, float radius, BokehShape shape = BokehShape::Disc,
+                                float highlights = 0.0f, const QImage &depth = QImage());
     
     // Artistic filters
     static QImage applyVignette(const QImage &input, float amount, float feather);
-    static QImage applyFilmGrain(const QImage &input, float amount);
+    static QImage applyVignette(QImage &&input, float amount, float feather);
+    // Monochrome grain from a seeded texture, the same on every run. size
+    // is the grain diameter in pixels, roughness in 0..1 mixes fine detail
+    // back into larger grain.
+    static QImage applyFilmGrain(const QImage &input, float amount, float size = 1.0f,
+                                 float roughness = 0.5f, quint32 seed = 0);
+    static QImage applyFilmGrain(QImage &&input, float amount, float size = 1.0f,
+                                 float roughness = 0.5f, quint32 seed = 0);
     static QImage applyVintage(const QImage &input, float amount);
+    static QImage applyVintage(QImage &&input, float amount);
     static QImage applyBlackAndWhite(const QImage &input, float red, float green, float blue);
+    static QImage applyBlackAndWhite(QImage &&input, float red, float green, float blue);
     static QImage applySepia(const QImage &input, float amount);
+    static QImage applySepia(QImage &&input, float amount);
     
     // Transformations
     static QImage crop(const QImage &input, const QRect &rect);
-    static QImage resize(const QImage &input, const QSize &size, Qt::AspectRatioMode mode = Qt::KeepAspectRatio);
-    static QImage rotate(const QImage &input, float degrees);
+    static QImage resize(const QImage &input, const QSize &size, Qt::AspectRatioMode mode = Qt::KeepAspectRatio,
+                         ResampleFilter filter = ResampleFilter::Auto);
+    static QImage rotate(const QImage &input, float degrees, ResampleFilter filter = ResampleFilter::Auto);
     static QImage flipHorizontal(const QImage &input);
     static QImage flipVertical(const QImage &input);
     
     // Advanced operations
     static QImage applyLUT(const QImage &input, const QVector<QColor> &lut);
+    static QImage applyLUT(QImage &&input, const QVector<QColor> &lut);
     static QImage applyCurves(const QImage &input, const QVector<QPointF> &curve);
+    static QImage applyCurves(QImage &&input, const QVector<QPointF> &curve);
     static QImage applyLevels(const QImage &input, int black, int gamma, int white);
+    static QImage applyLevels(QImage &&input, int black, int gamma, int white);
     
-    // Masking
-    static QImage applyMask(const QImage &input, const QImage &mask);
+    // Masking. Masks are 8-bit coverage images (Grayscale8 or Alpha8, other
+    // formats are converted to gray): 255 is full coverage, 0 is none.
+    static QImage applyMask(const QImage &input, const QImage &mask);  // Scales alpha by coverage
+    static QImage applyMask(QImage &&input, const QImage &mask);
     static QImage createGradientMask(const QSize &size, const QPointF &start, const QPointF &end);
     static QImage createRadialMask(const QSize &size, const QPointF &center, float radius);
     
+    // Region-restricted execution, for any of the filters above. filter gets
+    // the pixels inside roi (all of them for a null rect) plus margin pixels
+    // of context on each side and must return an image of the same size. Its
+    // result is blended back through mask, whose top-left pixel lies on the
+    // top-left of roi (null for full coverage). Pixels outside roi are left
+    // alone, so the cost follows the size of roi rather than of the image.
+    // 16-bit images stay 16-bit outside of what filter returns.
+    using RegionFilter = std::function<QImage(QImage)>;
+    static QImage applyInRegion(const QImage &input, const QRect &roi, const QImage &mask,
+                                const RegionFilter &filter, int margin = 0);
+    static QImage applyInRegion(QImage &&input, const QRect &roi, const QImage &mask,
+                                const RegionFilter &filter, int margin = 0);
+    
     // Blending modes
     static QImage blendNormal(const QImage &base, const QImage &blend, float opacity);
     static QImage blendMultiply(const QImage &base, const QImage &blend, float opacity);
@@ -82,18 +148,45 @@ public:
     
     // Utility functions
     static QColor sampleColor(const QImage &image, const QPoint &pos, int radius = 1);
+    static QColor sampleColor(const SummedAreaTable &table, const QPoint &pos, int radius = 1);
     static QVector<QColor> extractPalette(const QImage &image, int colorCount = 5);
     static QImage createHistogram(const QImage &image);
     
-    // Parallel processing
+    // Parallel processing, pixelFunc is called concurrently from several threads
     static QImage processParallel(const QImage &input, 
                                    std::function<QColor(const QColor&)> pixelFunc);
+    template <typename PixelFunc,
+              typename = std::enable_if_t<std::is_invocable_r_v<QRgb, PixelFunc &, QRgb>>>
+    static QImage processParallel(const QImage &input, PixelFunc pixelFunc);
+    template <typename PixelFunc,
+              typename = std::enable_if_t<std::is_invocable_r_v<QRgb, PixelFunc &, QRgb>>>
+    static QImage processParallel(QImage &&input, PixelFunc pixelFunc);
     
 private:
     static float applyCurve(float value, const QVector<QPointF> &curve);
     static QColor blendColors(const QColor &base, const QColor &blend, float opacity);
 };
 
+// ============================================================================
+// Template Implementation
+// ============================================================================
+
+template <typename PixelFunc, typename>
+QImage ImageProcessor::processParallel(const QImage &input, PixelFunc pixelFunc) {
+    return processParallel(QImage(input), pixelFunc);
+}
+
+template <typename PixelFunc, typename>
+QImage ImageProcessor::processParallel(QImage &&input, PixelFunc pixelFunc) {
+    // pixelFunc(QRgb) returns the new straight ARGB32 pixel
+    if (input.isNull()) return QImage();
+    
+    QImage result = PixelKernels::toWorkingFormat(std::move(input));
+    PixelKernels::forEachPixel(result, pixelFunc);
+    
+    return result;
+}
+
 } // namespace Utils
 } // namespace Knoux
 
@@ -0,0 +1,188 @@
+#include "ImagePyramid.h"
+#include "ParallelExecutor.h"
+#include "PixelKernels.h"
+#include "SimdKernels.h"
+
+#include <QMutex>
+#include <cmath>
+
+namespace Knoux {
+namespace Utils {
+
+namespace {
+
+// Images whose pyramids the cached lookups keep
+constexpr int CachedPyramids = 4;
+
+QImage levelZero(const QImage &image) {
+    // Working-format images are shared, not copied
+    return PixelKernels::isWorkingFormat(image.format()) ? image : PixelKernels::toWorkingFormat(image);
+}
+
+// Pixels of level that depend on region of level 0
+QRect levelRegion(const QRect &region, int level) {
+    return QRect(QPoint(region.left() >> level, region.top() >> level),
+                 QPoint(region.right() >> level, region.bottom() >> level));
+}
+
+struct CachedPyramid {
+    qint64 key = 0;
+    ImagePyramid pyramid;
+};
+
+QMutex cacheMutex;
+QVector<CachedPyramid> cache;  // Most recently used first
+
+} // namespace
+
+ImagePyramid::ImagePyramid(const QImage &image) {
+    if (image.isNull()) return;
+
+    QSize size = image.size();
+    int count = 1;
+    while ((size.width() + 1) / 2 >= MinSize && (size.height() + 1) / 2 >= MinSize) {
+        size = QSize((size.width() + 1) / 2, (size.height() + 1) / 2);
+        ++count;
+    }
+
+    m_levels.resize(count);
+    m_stale.resize(count);
+    m_levels[0] = levelZero(image);
+}
+
+QSize ImagePyramid::levelSize(int level) const {
+    if (isNull()) return QSize();
+
+    // Odd sizes round up, the last column or row is averaged with itself
+    QSize size = m_levels[0].size();
+    for (int i = 0; i < level; ++i) size = QSize((size.width() + 1) / 2, (size.height() + 1) / 2);
+    return size;
+}
+
+const QImage &ImagePyramid::level(int level) {
+    Q_ASSERT(level >= 0 && level < levelCount());
+    if (level == 0) return m_levels[0];
+
+    this->level(level - 1);
+    if (m_levels[level].isNull()) {
+        const QSize size = levelSize(level);
+        m_levels[level] = QImage(size, m_levels[0].format());
+        m_stale[level] = QRect(QPoint(0, 0), size);
+    }
+    if (!m_stale[level].isEmpty()) {
+        reduce(level, m_stale[level]);
+        m_stale[level] = QRect();
+    }
+    return m_levels[level];
+}
+
+int ImagePyramid::levelForScale(float scale) const {
+    if (isNull() || scale >= 1.0f || scale <= 0.0f) return 0;
+    const int level = int(std::floor(std::log2(1.0f / scale)));
+    return qBound(0, level, levelCount() - 1);
+}
+
+QImage ImagePyramid::scaled(const QSize &size) {
+    if (isNull() || size.isEmpty()) return QImage();
+
+    int closest = 0;
+    while (closest + 1 < levelCount()) {
+        const QSize next = levelSize(closest + 1);
+        if (next.width() < size.width() || next.height() < size.height()) break;
+        ++closest;
+    }
+
+    const QImage &source = level(closest);
+    if (source.size() == size) return source;
+    return source.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+}
+
+void ImagePyramid::update(const QImage &image, const QRect &dirty) {
+    if (isNull() || image.size() != size()) {
+        *this = ImagePyramid(image);
+        return;
+    }
+
+    m_levels[0] = levelZero(image);
+    const QRect region = dirty.isNull() ? m_levels[0].rect() : dirty.intersected(m_levels[0].rect());
+    if (region.isEmpty()) return;
+
+    for (int i = 1; i < levelCount(); ++i) {
+        if (!m_levels[i].isNull()) m_stale[i] |= levelRegion(region, i);
+    }
+}
+
+void ImagePyramid::reduce(int level, const QRect &region) {
+    const QImage &source = m_levels[level - 1];
+    QImage &target = m_levels[level];
+    const auto reduceRow = SimdKernels::table().reduce;
+
+    // Output columns with two source columns, the rest has one
+    const int pairs = source.width() / 2;
+    const int left = region.left();
+    const int right = region.right() + 1;
+    const int count = qMin(right, pairs) - left;
+    const bool lastColumn = right > pairs;
+
+    uchar *bits = target.bits();
+    const qsizetype stride = target.bytesPerLine();
+    ParallelExecutor::forEachBand(region.height(), stride * 2, [&](int begin, int end) {
+        for (int y = region.top() + begin; y < region.top() + end; ++y) {
+            const QRgb *top = reinterpret_cast<const QRgb *>(source.constScanLine(2 * y));
+            const QRgb *bottom = reinterpret_cast<const QRgb *>(
+                source.constScanLine(qMin(2 * y + 1, source.height() - 1)));
+            QRgb *out = reinterpret_cast<QRgb *>(bits + y * stride);
+
+            if (count > 0) reduceRow(out + left, top + 2 * left, bottom + 2 * left, count);
+            if (lastColumn) {
+                const QRgb edgeTop[2] = {top[source.width() - 1], top[source.width() - 1]};
+                const QRgb edgeBottom[2] = {bottom[source.width() - 1], bottom[source.width() - 1]};
+                reduceRow(out + pairs, edgeTop, edgeBottom, 1);
+            }
+        }
+    });
+}
+
+ImagePyramid &ImagePyramid::cached(const QImage &image) {
+    int index = 0;
+    while (index < cache.size() && cache[index].key != image.cacheKey()) ++index;
+
+    if (index == cache.size()) {
+        cache.prepend({image.cacheKey(), ImagePyramid(image)});
+        if (cache.size() > CachedPyramids) cache.removeLast();
+    } else {
+        cache.move(index, 0);
+        cache[0].pyramid.m_levels[0] = levelZero(image);
+    }
+    return cache[0].pyramid;
+}
+
+QImage ImagePyramid::cachedLevel(const QImage &image, int level) {
+    if (image.isNull()) return QImage();
+    if (level <= 0) return levelZero(image);
+
+    QMutexLocker lock(&cacheMutex);
+    ImagePyramid &pyramid = cached(image);
+    const QImage result = pyramid.level(qMin(level, pyramid.levelCount() - 1));
+    // Level 0 is not kept between calls, the caller's image is not pinned
+    pyramid.m_levels[0] = QImage();
+    return result;
+}
+
+QImage ImagePyramid::cachedScaled(const QImage &image, const QSize &size) {
+    if (image.isNull() || size.isEmpty()) return QImage();
+
+    // Enlargements have nothing to start from but the image itself
+    if (size.width() >= image.width() || size.height() >= image.height()) {
+        return levelZero(image).scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    }
+
+    QMutexLocker lock(&cacheMutex);
+    ImagePyramid &pyramid = cached(image);
+    const QImage result = pyramid.scaled(size);
+    pyramid.m_levels[0] = QImage();
+    return result;
+}
+
+} // namespace Utils
+} // namespace Knoux
@@ -0,0 +1,65 @@
+#ifndef IMAGEPYRAMID_H
+#define IMAGEPYRAMID_H
+
+#include <QImage>
+#include <QRect>
+#include <QVector>
+
+namespace Knoux {
+namespace Utils {
+
+/**
+ * @brief Lazily built stack of half-size copies of an image
+ *
+ * Level 0 is the image in the working format, every further level halves
+ * the one below it with a rounded 2x2 box average until either side would
+ * drop under MinSize. Levels are reduced the first time they are asked for
+ * and kept until update() reports the pixels under them as dirty, so a view
+ * that zooms out or a detector that scans several scales pays for each
+ * reduction once per edit instead of resampling the full image per call.
+ * Channels are averaged straight, like the rest of the ARGB32 kernels.
+ */
+class ImagePyramid {
+public:
+    static constexpr int MinSize = 16;
+
+    ImagePyramid() = default;
+    explicit ImagePyramid(const QImage &image);
+
+    bool isNull() const { return m_levels.isEmpty(); }
+    QSize size() const { return levelSize(0); }
+    int levelCount() const { return m_levels.size(); }
+    QSize levelSize(int level) const;
+
+    // Builds the level and the ones between it and the nearest built level
+    const QImage &level(int level);
+
+    // Coarsest level still at least as large as the image drawn at scale
+    int levelForScale(float scale) const;
+
+    // Smooth resample to size, started from the closest level above it
+    QImage scaled(const QSize &size);
+
+    // Takes image, which replaced the one the pyramid was built from. Only
+    // the built levels under dirty (everything for a null rect) are reduced
+    // again; a new size drops them all.
+    void update(const QImage &image, const QRect &dirty = QRect());
+
+    // Shared pyramids for callers that see the same image repeatedly, keyed
+    // by QImage::cacheKey(). Thread-safe; the few most recent images stay.
+    static QImage cachedLevel(const QImage &image, int level);
+    static QImage cachedScaled(const QImage &image, const QSize &size);
+
+private:
+    void reduce(int level, const QRect &region);
+    // Pyramid of image in the shared cache, level 0 set. Needs the cache lock.
+    static ImagePyramid &cached(const QImage &image);
+
+    QVector<QImage> m_levels;  // Null until built
+    QVector<QRect> m_stale;    // Per level, pixels to reduce again before use
+};
+
+} // namespace Utils
+} // namespace Knoux
+
+#endif // IMAGEPYRAMID_H
@@ -0,0 +1,47 @@
+#include "ImageView.h"
+
+namespace Knoux {
+namespace Utils {
+
+ImageView::ImageView(uchar *bits, int width, int height, qsizetype stride, QImage::Format format)
+    : m_bits(bits), m_width(width), m_height(height), m_stride(stride), m_format(format) {
+    if (!m_bits || m_width <= 0 || m_height <= 0) *this = ImageView();
+}
+
+ImageView::ImageView(QImage &image, const QRect &region) {
+    const QRect area = region.isNull() ? image.rect() : region.intersected(image.rect());
+    if (image.isNull() || area.isEmpty()) return;
+
+    // Sub-byte formats cannot start a row at an arbitrary column
+    Q_ASSERT(image.depth() >= 8);
+
+    m_stride = image.bytesPerLine();
+    m_bits = image.bits() + area.top() * m_stride + qsizetype(area.left()) * image.depth() / 8;
+    m_width = area.width();
+    m_height = area.height();
+    m_format = image.format();
+}
+
+int ImageView::depth() const {
+    return m_format == QImage::Format_Invalid ? 0 : QImage::toPixelFormat(m_format).bitsPerPixel();
+}
+
+ImageView ImageView::subView(const QRect &region) const {
+    const QRect area = region.intersected(rect());
+    if (isNull() || area.isEmpty()) return ImageView();
+
+    return ImageView(scanLine(area.top()) + qsizetype(area.left()) * depth() / 8,
+                     area.width(), area.height(), m_stride, m_format);
+}
+
+QImage ImageView::asImage() const {
+    if (isNull()) return QImage();
+    return QImage(m_bits, m_width, m_height, m_stride, m_format);
+}
+
+QImage ImageView::toImage() const {
+    return asImage().copy();
+}
+
+} // namespace Utils
+} // namespace Knoux
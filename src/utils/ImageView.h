@@ -0,0 +1,62 @@
+#ifndef IMAGEVIEW_H
+#define IMAGEVIEW_H
+
+#include <QImage>
+#include <QRect>
+#include <QtGlobal>
+
+namespace Knoux {
+namespace Utils {
+
+/**
+ * @brief Non-owning window onto the pixels of an image
+ *
+ * A pointer to the first pixel, the row stride, a size and a format. Views
+ * of a crop or sub-region address the parent's memory directly, so kernels
+ * that take a view process part of an image in place, without copying it
+ * out and back. A view does not keep its pixels alive: the image it was
+ * taken from must outlive it and must not be detached or resized meanwhile.
+ */
+class ImageView {
+public:
+    ImageView() = default;
+    ImageView(uchar *bits, int width, int height, qsizetype stride, QImage::Format format);
+
+    // Detaches image, then views region of it (all of it for a null rect).
+    // The region is clipped to the image.
+    explicit ImageView(QImage &image, const QRect &region = QRect());
+
+    bool isNull() const { return m_bits == nullptr; }
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+    QSize size() const { return QSize(m_width, m_height); }
+    QRect rect() const { return QRect(0, 0, m_width, m_height); }
+    qsizetype stride() const { return m_stride; }
+    QImage::Format format() const { return m_format; }
+    int depth() const;
+
+    uchar *bits() const { return m_bits; }
+    uchar *scanLine(int y) const { return m_bits + y * m_stride; }
+    QRgb *row(int y) const { return reinterpret_cast<QRgb *>(scanLine(y)); }
+
+    // Region of this view, in its coordinates and clipped to it
+    ImageView subView(const QRect &region) const;
+
+    // QImage over the same memory, for APIs that only take images. Writes go
+    // through to the viewed pixels.
+    QImage asImage() const;
+    // Deep copy of the viewed pixels
+    QImage toImage() const;
+
+private:
+    uchar *m_bits = nullptr;
+    int m_width = 0;
+    int m_height = 0;
+    qsizetype m_stride = 0;
+    QImage::Format m_format = QImage::Format_Invalid;
+};
+
+} // namespace Utils
+} // namespace Knoux
+
+#endif // IMAGEVIEW_H
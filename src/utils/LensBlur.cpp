@@ -0,0 +1,501 @@
+#include "LensBlur.h"
+#include "ParallelExecutor.h"
+#include "PixelKernels.h"
+#include "Resampler.h"
+#include "ScratchArena.h"
+#include "SimdKernels.h"
+
+#include <QPoint>
+#include <QRect>
+#include <QVarLengthArray>
+#include <QVector>
+#include <QtMath>
+#include <algorithm>
+#include <cmath>
+
+namespace Knoux {
+namespace Utils {
+
+namespace {
+
+// Linear RGB, interleaved
+constexpr int Channels = 3;
+// Output tiles are TileSide pixels square
+constexpr int TileSide = 128;
+// A depth map picks between this many blur levels, the first one sharp
+constexpr int DepthLevels = 4;
+// Highlights are pixels brighter than this luma (0 to 1)
+constexpr float HighlightKnee = 0.75f;
+// Linear gain of a white pixel at full highlights
+constexpr float MaxHighlightGain = 8.0f;
+// Linear light to sRGB table entries
+constexpr int EncodeSteps = 1 << 12;
+// Hexagon edge directions, 120 degrees apart
+constexpr float Sin60 = 0.8660254f;
+
+// Two-component fit of a disc (Niemitalo): component c is
+// exp(-a x^2) (cos(b x^2) + i sin(b x^2)), and the disc is the sum of
+// real * Re + imaginary * Im of each component's 2D product
+struct DiscComponent {
+    float a;
+    float b;
+    float real;
+    float imaginary;
+};
+
+constexpr DiscComponent DiscComponents[] = {
+    {0.886528f, 5.268909f, 0.411259f, -0.548794f},
+    {1.960518f, 1.558213f, 0.513282f, 4.561110f}
+};
+constexpr int ComponentCount = int(sizeof(DiscComponents) / sizeof(DiscComponents[0]));
+// Re and Im of every component
+constexpr int DiscPlanes = 2 * ComponentCount;
+// The fitted disc falls to half height at x = DiscEdge and has faded out
+// by DiscExtent, where the taps stop
+constexpr double DiscEdge = 1.1;
+constexpr double DiscExtent = 1.2;
+
+// sRGB levels to linear light
+const float *decodeTable() {
+    static const QVector<float> table = [] {
+        QVector<float> values(256);
+        for (int v = 0; v < 256; ++v) {
+            const double c = v / 255.0;
+            values[v] = float(c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4));
+        }
+        return values;
+    }();
+    return table.constData();
+}
+
+// Linear light from 0 to 1 in EncodeSteps steps to sRGB levels
+const uchar *encodeTable() {
+    static const QVector<uchar> table = [] {
+        QVector<uchar> values(EncodeSteps);
+        for (int i = 0; i < EncodeSteps; ++i) {
+            const double c = double(i) / (EncodeSteps - 1);
+            values[i] = uchar(qRound((c <= 0.0031308 ? c * 12.92 : 1.055 * std::pow(c, 1 / 2.4) - 0.055) * 255));
+        }
+        return values;
+    }();
+    return table.constData();
+}
+
+inline int encode(const uchar *table, float value) {
+    return table[int(qBound(0.0f, value, 1.0f) * (EncodeSteps - 1) + 0.5f)];
+}
+
+inline void toLinear(QRgb pixel, const float *decode, const float *gains, float *out) {
+    const float gain = gains[(qRed(pixel) * 77 + qGreen(pixel) * 150 + qBlue(pixel) * 29) >> 8];
+    out[0] = decode[qRed(pixel)] * gain;
+    out[1] = decode[qGreen(pixel)] * gain;
+    out[2] = decode[qBlue(pixel)] * gain;
+}
+
+// The image the blur runs on: linear light with the highlights boosted,
+// one pixel per factor x factor block of the source
+struct Working {
+    const QImage *source = nullptr;
+    int factor = 1;
+    int width = 0;
+    int height = 0;
+    QVector<float> gains;   // Highlight gain by luma level
+    QVector<float> pixels;  // Block averages when factor > 1, RGB rows
+
+    // Row y over columns [left, left + count), rows and columns past the
+    // edges repeat the edge pixels
+    void read(int y, int left, int count, float *out) const {
+        y = qBound(0, y, height - 1);
+        if (factor == 1) {
+            const QRgb *line = reinterpret_cast<const QRgb *>(source->constScanLine(y));
+            const float *decode = decodeTable();
+            for (int i = 0; i < count; ++i) {
+                toLinear(line[qBound(0, left + i, width - 1)], decode, gains.constData(), out + i * Channels);
+            }
+            return;
+        }
+
+        const float *line = pixels.constData() + qsizetype(y) * width * Channels;
+        for (int i = 0; i < count; ++i) {
+            const float *pixel = line + qBound(0, left + i, width - 1) * Channels;
+            std::copy(pixel, pixel + Channels, out + i * Channels);
+        }
+    }
+};
+
+Working makeWorking(const QImage &source, int factor, float highlights) {
+    Working working;
+    working.source = &source;
+    working.factor = factor;
+    working.width = (source.width() + factor - 1) / factor;
+    working.height = (source.height() + factor - 1) / factor;
+
+    working.gains.resize(256);
+    for (int luma = 0; luma < 256; ++luma) {
+        const float t = qMax(0.0f, (luma / 255.0f - HighlightKnee) / (1 - HighlightKnee));
+        working.gains[luma] = 1 + highlights * (MaxHighlightGain - 1) * t * t;
+    }
+    if (factor == 1) return working;
+
+    // Averaged in linear light, so a small bright spot keeps its energy
+    const int width = source.width();
+    const int height = source.height();
+    working.pixels.resize(qsizetype(working.width) * working.height * Channels);
+    float *pixels = working.pixels.data();
+    const float *decode = decodeTable();
+    const float *gains = working.gains.constData();
+
+    ParallelExecutor::forEachBand(working.height, source.bytesPerLine() * factor, [&](int begin, int end) {
+        for (int y = begin; y < end; ++y) {
+            float *out = pixels + qsizetype(y) * working.width * Channels;
+            std::fill(out, out + working.width * Channels, 0.0f);
+            const int top = y * factor;
+            const int bottom = qMin(top + factor, height);
+
+            for (int sy = top; sy < bottom; ++sy) {
+                const QRgb *line = reinterpret_cast<const QRgb *>(source.constScanLine(sy));
+                for (int x = 0; x < working.width; ++x) {
+                    float *cell = out + x * Channels;
+                    for (int sx = x * factor; sx < qMin(x * factor + factor, width); ++sx) {
+                        float linear[Channels];
+                        toLinear(line[sx], decode, gains, linear);
+                        for (int c = 0; c < Channels; ++c) cell[c] += linear[c];
+                    }
+                }
+            }
+            for (int x = 0; x < working.width; ++x) {
+                const float scale = 1.0f / float((qMin(x * factor + factor, width) - x * factor) * (bottom - top));
+                for (int c = 0; c < Channels; ++c) out[x * Channels + c] *= scale;
+            }
+        }
+    });
+    return working;
+}
+
+// Linear RGB over a rectangle of the working image
+struct Patch {
+    QRect rect;
+    float *data = nullptr;
+
+    float *at(int x, int y) const {
+        return data + (qsizetype(y - rect.top()) * rect.width() + (x - rect.left())) * Channels;
+    }
+};
+
+// ============================================================================
+// Disc
+// ============================================================================
+
+// Row taps of each component, and the column taps with the component
+// weights and the normalization folded in: a column sample of Re and Im
+// weighted by them gives real * Re + imaginary * Im of the 2D product.
+// Both [component][re, im][tap].
+struct DiscKernel {
+    int radius = 0;
+    QVector<float> rows;
+    QVector<float> columns;
+};
+
+DiscKernel makeDisc(float radius) {
+    DiscKernel kernel;
+    kernel.radius = qCeil(radius * DiscExtent / DiscEdge);
+    const int taps = 2 * kernel.radius + 1;
+    kernel.rows.resize(DiscPlanes * taps);
+    kernel.columns.resize(DiscPlanes * taps);
+
+    double total = 0.0;
+    for (int c = 0; c < ComponentCount; ++c) {
+        const DiscComponent &component = DiscComponents[c];
+        double sumRe = 0.0;
+        double sumIm = 0.0;
+        for (int k = -kernel.radius; k <= kernel.radius; ++k) {
+            const double x = k * DiscEdge / radius;
+            const double x2 = qMin(x * x, DiscExtent * DiscExtent);
+            const double envelope = x * x <= DiscExtent * DiscExtent ? std::exp(-component.a * x2) : 0.0;
+            const double re = envelope * std::cos(component.b * x2);
+            const double im = envelope * std::sin(component.b * x2);
+            kernel.rows[(2 * c) * taps + k + kernel.radius] = float(re);
+            kernel.rows[(2 * c + 1) * taps + k + kernel.radius] = float(im);
+            sumRe += re;
+            sumIm += im;
+        }
+        // The 2D kernel sums to the square of the 1D sum
+        total += component.real * (sumRe * sumRe - sumIm * sumIm) + component.imaginary * 2 * sumRe * sumIm;
+    }
+
+    const double scale = 1.0 / total;
+    for (int c = 0; c < ComponentCount; ++c) {
+        const DiscComponent &component = DiscComponents[c];
+        for (int k = 0; k < taps; ++k) {
+            const double re = kernel.rows[(2 * c) * taps + k];
+            const double im = kernel.rows[(2 * c + 1) * taps + k];
+            kernel.columns[(2 * c) * taps + k] = float((component.real * re + component.imaginary * im) * scale);
+            kernel.columns[(2 * c + 1) * taps + k] = float((component.imaginary * re - component.real * im) * scale);
+        }
+    }
+    return kernel;
+}
+
+constexpr qsizetype discScratch(int radius) {
+    return qsizetype(TileSide + 2 * radius) * Channels
+        + qsizetype(TileSide + 2 * radius) * DiscPlanes * TileSide * Channels;
+}
+
+// tile of the working image through the disc kernel into out, tile rows
+// back to back
+void discTile(const Working &working, const DiscKernel &kernel, const QRect &tile, float *scratch, float *out) {
+    const int radius = kernel.radius;
+    const int count = 2 * radius + 1;
+    const int span = tile.width() * Channels;
+    const auto weightedSum = SimdKernels::table().weightedSum;
+    float *line = scratch;
+    float *rows = scratch + qsizetype(TileSide + 2 * radius) * Channels;
+    QVarLengthArray<const float *, 256> taps(DiscPlanes * count);
+
+    // Every row the columns reach, through each component: Re and Im planes
+    for (int k = 0; k < count; ++k) taps[k] = line + k * Channels;
+    for (int j = 0; j < tile.height() + 2 * radius; ++j) {
+        working.read(tile.top() - radius + j, tile.left() - radius, tile.width() + 2 * radius, line);
+        float *planes = rows + qsizetype(j) * DiscPlanes * span;
+        for (int p = 0; p < DiscPlanes; ++p) {
+            weightedSum(planes + p * span, taps.constData(), kernel.rows.constData() + p * count, count, span);
+        }
+    }
+
+    // Columns, the complex products reduced to their weighted parts
+    for (int y = 0; y < tile.height(); ++y) {
+        for (int p = 0; p < DiscPlanes; ++p) {
+            for (int k = 0; k < count; ++k) taps[p * count + k] = rows + (qsizetype(y + k) * DiscPlanes + p) * span;
+        }
+        weightedSum(out + qsizetype(y) * span, taps.constData(), kernel.columns.constData(), DiscPlanes * count, span);
+    }
+}
+
+// ============================================================================
+// Hexagon
+// ============================================================================
+
+// One-sided box along (dx, dy) into to, plus base when given: each pixel
+// averages samples of from spread evenly from the pixel to radius pixels
+// away, the one on the pixel at half weight, as the rhombi share it. Every
+// pixel has the same sample offsets, so a sample is four shifted rows mixed
+// with the same bilinear weights.
+void directionalBox(const Patch &from, const Patch &to, float dx, float dy, float radius, int steps,
+                    const Patch *base = nullptr) {
+    QVarLengthArray<QPoint, 256> offsets;
+    QVarLengthArray<float, 256> weights;
+    for (int s = 0; s <= steps; ++s) {
+        const float ox = dx * radius * s / steps;
+        const float oy = dy * radius * s / steps;
+        const int ix = qFloor(ox);
+        const int iy = qFloor(oy);
+        const float fx = ox - ix;
+        const float fy = oy - iy;
+        const float weight = (s == 0 ? 0.5f : 1.0f) / (steps + 0.5f);
+        const float corners[4] = {(1 - fx) * (1 - fy), fx * (1 - fy), (1 - fx) * fy, fx * fy};
+        for (int corner = 0; corner < 4; ++corner) {
+            if (corners[corner] == 0.0f) continue;
+            offsets.append(QPoint(ix + (corner & 1), iy + (corner >> 1)));
+            weights.append(corners[corner] * weight);
+        }
+    }
+    if (base) weights.append(1.0f);
+
+    const auto weightedSum = SimdKernels::table().weightedSum;
+    QVarLengthArray<const float *, 256> rows(weights.size());
+    for (int y = to.rect.top(); y <= to.rect.bottom(); ++y) {
+        for (int k = 0; k < offsets.size(); ++k) rows[k] = from.at(to.rect.left() + offsets[k].x(), y + offsets[k].y());
+        if (base) rows[offsets.size()] = base->at(to.rect.left(), y);
+        weightedSum(to.at(to.rect.left(), y), rows.constData(), weights.constData(), weights.size(),
+                    to.rect.width() * Channels);
+    }
+}
+
+constexpr qsizetype hexagonScratch(int radius) {
+    return qsizetype(TileSide + 4 * (radius + 1)) * (TileSide + 4 * (radius + 1)) * Channels
+        + 2 * qsizetype(TileSide + 2 * (radius + 1)) * (TileSide + 2 * (radius + 1)) * Channels;
+}
+
+// Hexagon with corners up, down-left and down-right: the three rhombi
+// between pairs of those edges, two passes each (White and Brisebois).
+// With V the upward box and D the down-left one, down-left of V plus
+// down-right of V + D covers all three.
+void hexagonTile(const Working &working, float radius, int steps, const QRect &tile, float *scratch, float *out) {
+    const int margin = steps + 1;
+    const QRect middle = tile.adjusted(-margin, -margin, margin, margin);
+    const QRect outer = middle.adjusted(-margin, -margin, margin, margin);
+
+    const Patch source{outer, scratch};
+    const Patch up{middle, source.data + qsizetype(outer.width()) * outer.height() * Channels};
+    const Patch both{middle, up.data + qsizetype(middle.width()) * middle.height() * Channels};
+    const Patch result{tile, out};
+
+    for (int y = outer.top(); y <= outer.bottom(); ++y) {
+        working.read(y, outer.left(), outer.width(), source.at(outer.left(), y));
+    }
+
+    directionalBox(source, up, 0.0f, -1.0f, radius, steps);
+    directionalBox(source, both, -Sin60, 0.5f, radius, steps, &up);
+
+    directionalBox(up, result, -Sin60, 0.5f, radius, steps);
+    directionalBox(both, result, Sin60, 0.5f, radius, steps, &result);
+
+    const qsizetype count = qsizetype(tile.width()) * tile.height() * Channels;
+    for (qsizetype i = 0; i < count; ++i) out[i] *= 1.0f / 3;
+}
+
+// ============================================================================
+// Levels
+// ============================================================================
+
+// source blurred evenly by radius (at least half a pixel)
+QImage blurLevel(const QImage &source, float radius, BokehShape shape, float highlights) {
+    const int factor = qMax(1, qCeil(radius / LensBlur::MaxWorkingRadius));
+    const Working working = makeWorking(source, factor, highlights);
+    const float scaled = radius / factor;
+    const int reach = qCeil(scaled);
+    const DiscKernel disc = shape == BokehShape::Disc ? makeDisc(scaled) : DiscKernel();
+
+    QImage result = ScratchArena::image(source.width(), source.height(), source.format());
+    uchar *bits = result.bits();
+    const qsizetype stride = result.bytesPerLine();
+    const uchar *encoder = encodeTable();
+
+    // A shrunk working image is blurred into here, then scaled back
+    QVector<float> blurred(factor > 1 ? qsizetype(working.width) * working.height * Channels : 0);
+    float *blurredData = blurred.data();
+
+    const int tileRows = (working.height + TileSide - 1) / TileSide;
+    const int tileColumns = (working.width + TileSide - 1) / TileSide;
+    const qsizetype outFloats = qsizetype(TileSide) * TileSide * Channels;
+    const qsizetype scratchFloats = shape == BokehShape::Disc ? discScratch(disc.radius) : hexagonScratch(reach);
+
+    ParallelExecutor::forEachBand(tileRows, qsizetype(working.width) * TileSide * Channels * sizeof(float),
+                                  [&](int begin, int end) {
+        const ScratchArena::Buffer scratch = ScratchArena::acquire((outFloats + scratchFloats) * sizeof(float));
+        float *out = scratch.as<float>();
+
+        for (int row = begin; row < end; ++row) {
+            for (int column = 0; column < tileColumns; ++column) {
+                const int left = column * TileSide;
+                const int top = row * TileSide;
+                const QRect tile(left, top, qMin(TileSide, working.width - left), qMin(TileSide, working.height - top));
+                if (shape == BokehShape::Disc) {
+                    discTile(working, disc, tile, out + outFloats, out);
+                } else {
+                    hexagonTile(working, scaled, reach, tile, out + outFloats, out);
+                }
+
+                for (int y = tile.top(); y <= tile.bottom(); ++y) {
+                    const float *values = out + qsizetype(y - tile.top()) * tile.width() * Channels;
+                    if (factor > 1) {
+                        std::copy(values, values + tile.width() * Channels,
+                                  blurredData + (qsizetype(y) * working.width + left) * Channels);
+                        continue;
+                    }
+                    const QRgb *in = reinterpret_cast<const QRgb *>(source.constScanLine(y)) + left;
+                    QRgb *line = reinterpret_cast<QRgb *>(bits + y * stride) + left;
+                    for (int x = 0; x < tile.width(); ++x) {
+                        const float *pixel = values + x * Channels;
+                        line[x] = PixelKernels::pack(encode(encoder, pixel[0]), encode(encoder, pixel[1]),
+                                                     encode(encoder, pixel[2]), in[x]);
+                    }
+                }
+            }
+        }
+    });
+    if (factor == 1) return result;
+
+    // Bilinear back to full size, working pixel i centered on source
+    // pixel (i + 0.5) factor
+    const int width = source.width();
+    QVector<int> lefts(width);
+    QVector<float> fractions(width);
+    for (int x = 0; x < width; ++x) {
+        const float position = qMax(0.0f, (x + 0.5f) / factor - 0.5f);
+        lefts[x] = qMin(int(position), working.width - 1);
+        fractions[x] = lefts[x] < working.width - 1 ? position - lefts[x] : 0.0f;
+    }
+
+    ParallelExecutor::forEachBand(source.height(), stride, [&](int begin, int end) {
+        const ScratchArena::Buffer buffer = ScratchArena::acquire(qsizetype(working.width + 1) * Channels * sizeof(float));
+        float *mixed = buffer.as<float>();
+
+        for (int y = begin; y < end; ++y) {
+            const float position = qMax(0.0f, (y + 0.5f) / factor - 0.5f);
+            const int upper = qMin(int(position), working.height - 1);
+            const int lower = qMin(upper + 1, working.height - 1);
+            const float fy = position - upper;
+            const float *a = blurredData + qsizetype(upper) * working.width * Channels;
+            const float *b = blurredData + qsizetype(lower) * working.width * Channels;
+            for (int i = 0; i < working.width * Channels; ++i) mixed[i] = a[i] + (b[i] - a[i]) * fy;
+            std::copy(mixed + (working.width - 1) * Channels, mixed + working.width * Channels,
+                      mixed + working.width * Channels);
+
+            const QRgb *in = reinterpret_cast<const QRgb *>(source.constScanLine(y));
+            QRgb *line = reinterpret_cast<QRgb *>(bits + y * stride);
+            for (int x = 0; x < width; ++x) {
+                const float *p = mixed + lefts[x] * Channels;
+                const float fx = fractions[x];
+                line[x] = PixelKernels::pack(encode(encoder, p[0] + (p[3] - p[0]) * fx),
+                                             encode(encoder, p[1] + (p[4] - p[1]) * fx),
+                                             encode(encoder, p[2] + (p[5] - p[2]) * fx), in[x]);
+            }
+        }
+    });
+    return result;
+}
+
+} // namespace
+
+QImage LensBlur::apply(const QImage &input, float radius, BokehShape shape, float highlights, const QImage &depth) {
+    if (input.isNull()) return QImage();
+
+    const QImage source = PixelKernels::isWorkingFormat(input.format()) ? input : PixelKernels::toWorkingFormat(input);
+    highlights = qBound(0.0f, highlights, 1.0f);
+    if (depth.isNull()) return radius < 0.5f ? source : blurLevel(source, radius, shape, highlights);
+
+    QImage map = depth.size() == source.size() ? depth : Resampler::resize(depth, source.size());
+    if (map.format() != QImage::Format_Grayscale8) map = map.convertToFormat(QImage::Format_Grayscale8);
+
+    // Even steps from sharp to radius, each pixel mixing the two levels
+    // around its depth in linear light
+    QImage levels[DepthLevels];
+    levels[0] = source;
+    for (int i = 1; i < DepthLevels; ++i) {
+        const float levelRadius = radius * i / (DepthLevels - 1);
+        levels[i] = levelRadius < 0.5f ? source : blurLevel(source, levelRadius, shape, highlights);
+    }
+
+    QImage result = ScratchArena::image(source.width(), source.height(), source.format());
+    uchar *bits = result.bits();
+    const qsizetype stride = result.bytesPerLine();
+    const float *decode = decodeTable();
+    const uchar *encoder = encodeTable();
+
+    ParallelExecutor::forEachBand(source.height(), stride * DepthLevels, [&](int begin, int end) {
+        for (int y = begin; y < end; ++y) {
+            const uchar *amounts = map.constScanLine(y);
+            const QRgb *rows[DepthLevels];
+            for (int i = 0; i < DepthLevels; ++i) rows[i] = reinterpret_cast<const QRgb *>(levels[i].constScanLine(y));
+            QRgb *line = reinterpret_cast<QRgb *>(bits + y * stride);
+
+            for (int x = 0; x < source.width(); ++x) {
+                const float position = amounts[x] * ((DepthLevels - 1) / 255.0f);
+                const int level = qMin(int(position), DepthLevels - 2);
+                const float mix = position - level;
+                const QRgb a = rows[level][x];
+                const QRgb b = rows[level + 1][x];
+                const float red = decode[qRed(a)] + (decode[qRed(b)] - decode[qRed(a)]) * mix;
+                const float green = decode[qGreen(a)] + (decode[qGreen(b)] - decode[qGreen(a)]) * mix;
+                const float blue = decode[qBlue(a)] + (decode[qBlue(b)] - decode[qBlue(a)]) * mix;
+                line[x] = PixelKernels::pack(encode(encoder, red), encode(encoder, green), encode(encoder, blue),
+                                             rows[0][x]);
+            }
+        }
+    });
+    return result;
+}
+
+} // namespace Utils
+} // namespace Knoux
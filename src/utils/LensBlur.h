@@ -0,0 +1,43 @@
+#ifndef LENSBLUR_H
+#define LENSBLUR_H
+
+#include <QImage>
+
+namespace Knoux {
+namespace Utils {
+
+enum class BokehShape {
+    Disc,
+    Hexagon
+};
+
+/**
+ * @brief Lens blur, every pixel spread over the shape of the aperture
+ *
+ * The blur runs in linear light, so bright spots keep their energy and
+ * open up into clear discs or hexagons instead of fading into a haze. A
+ * disc is the sum of two separable complex-Gaussian kernels (Niemitalo's
+ * fit, as used by Garcia); a hexagon is three rhombi, each two one-sided
+ * box blurs along the hexagon's edges. Radii past MaxWorkingRadius blur a
+ * shrunk copy and scale the result back, which keeps the cost about the
+ * same for any radius. Output tiles are shared among the ParallelExecutor
+ * threads. Results are in the working format, alpha kept from the source.
+ */
+class LensBlur {
+public:
+    // Widest blur done at full resolution, in pixels
+    static constexpr float MaxWorkingRadius = 12.0f;
+
+    // radius is the disc radius or hexagon circumradius in pixels.
+    // highlights (0 to 1) brightens the brightest pixels before the blur so
+    // they turn into visible bokeh. depth sets the blur per pixel, a gray
+    // map from 0 (sharp) to 255 (full radius), scaled to the size of input
+    // if needed; a null depth blurs everything by radius.
+    static QImage apply(const QImage &input, float radius, BokehShape shape = BokehShape::Disc,
+                        float highlights = 0.0f, const QImage &depth = QImage());
+};
+
+} // namespace Utils
+} // namespace Knoux
+
+#endif // LENSBLUR_H
@@ -0,0 +1,292 @@
+#include "MedianKernels.h"
+#include "PixelKernels.h"
+#include "ScratchArena.h"
+
+#include <QRect>
+#include <cstring>
+
+namespace Knoux {
+namespace Utils {
+
+namespace {
+
+// Filtered channels per pixel, in QRgb byte order (blue, green, red)
+constexpr int Channels = 3;
+constexpr int Bins = 256;
+constexpr int CoarseBins = 16;
+constexpr int FineBins = Bins / CoarseBins;
+// Output pixels per tile side. The column histograms of one tile stay in L2.
+constexpr int TileSize = 256;
+
+inline int channelValue(QRgb pixel, int channel) {
+    return (pixel >> (8 * channel)) & 0xff;
+}
+
+// Fixed-length loops over histogram segments, compilers turn these into
+// a few vector adds
+inline void addBins(quint16 *dst, const quint16 *src) {
+    for (int i = 0; i < FineBins; ++i) dst[i] += src[i];
+}
+
+inline void subtractBins(quint16 *dst, const quint16 *src) {
+    for (int i = 0; i < FineBins; ++i) dst[i] -= src[i];
+}
+
+/**
+ * Histograms of every column of one tile, for one channel. Column c of the
+ * tile covers image column clamp(x0 - radius + c).
+ */
+struct ColumnHistograms {
+    ScratchArena::Buffer coarseBuffer;
+    ScratchArena::Buffer fineBuffer;
+    quint16 *coarse = nullptr;  // columns x CoarseBins
+    quint16 *fine = nullptr;    // columns x Bins
+
+    void reset(int columns) {
+        const qsizetype coarseBytes = qsizetype(columns) * CoarseBins * sizeof(quint16);
+        const qsizetype fineBytes = qsizetype(columns) * Bins * sizeof(quint16);
+        if (coarseBuffer.size() < coarseBytes) coarseBuffer = ScratchArena::acquire(coarseBytes);
+        if (fineBuffer.size() < fineBytes) fineBuffer = ScratchArena::acquire(fineBytes);
+        coarse = coarseBuffer.as<quint16>();
+        fine = fineBuffer.as<quint16>();
+        std::memset(coarse, 0, coarseBytes);
+        std::memset(fine, 0, fineBytes);
+    }
+};
+
+/**
+ * Sliding window histogram for one channel. Fine segments are merged lazily:
+ * synced[k] records the output column at which segment k was last valid.
+ */
+struct KernelHistogram {
+    quint16 coarse[CoarseBins];
+    quint16 fine[Bins];
+    int synced[CoarseBins];
+
+    void start(const ColumnHistograms &columns, int width) {
+        std::memset(coarse, 0, sizeof(coarse));
+        for (int c = 0; c < width; ++c) {
+            const quint16 *column = columns.coarse + c * CoarseBins;
+            for (int k = 0; k < CoarseBins; ++k) coarse[k] += column[k];
+        }
+        for (int k = 0; k < CoarseBins; ++k) synced[k] = -1;
+    }
+
+    void slide(const ColumnHistograms &columns, int enter, int leave) {
+        const quint16 *in = columns.coarse + enter * CoarseBins;
+        const quint16 *out = columns.coarse + leave * CoarseBins;
+        for (int k = 0; k < CoarseBins; ++k) coarse[k] += in[k] - out[k];
+    }
+
+    // Median of the window whose first tile column is i
+    int median(const ColumnHistograms &columns, int i, int width, int rank) {
+        int k = 0;
+        int below = 0;
+        while (below + coarse[k] <= rank) below += coarse[k++];
+
+        quint16 *segment = fine + k * FineBins;
+        const quint16 *histograms = columns.fine + k * FineBins;
+        if (synced[k] < 0 || i - synced[k] >= width) {
+            std::memset(segment, 0, FineBins * sizeof(quint16));
+            for (int c = i; c < i + width; ++c) {
+                addBins(segment, histograms + c * Bins);
+            }
+        } else {
+            for (int j = synced[k] + 1; j <= i; ++j) {
+                addBins(segment, histograms + (j + width - 1) * Bins);
+                subtractBins(segment, histograms + (j - 1) * Bins);
+            }
+        }
+        synced[k] = i;
+
+        int bin = 0;
+        while (below + segment[bin] <= rank) below += segment[bin++];
+        return k * FineBins + bin;
+    }
+};
+
+void medianTile(const QImage &source, uchar *dstBits, qsizetype dstStride, int radius,
+                const QRect &tile, ColumnHistograms *columns) {
+    const uchar *srcBits = source.constBits();
+    const qsizetype srcStride = source.bytesPerLine();
+    const int lastX = source.width() - 1;
+    const int lastY = source.height() - 1;
+
+    const int window = 2 * radius + 1;
+    const int rank = window * window / 2;
+    const int columnCount = tile.width() + 2 * radius;
+    const int firstX = tile.left() - radius;
+
+    auto sourceRow = [&](int y) {
+        return reinterpret_cast<const QRgb *>(srcBits + qBound(0, y, lastY) * srcStride);
+    };
+    auto addRow = [&](int y, int delta) {
+        const QRgb *row = sourceRow(y);
+        for (int ch = 0; ch < Channels; ++ch) {
+            quint16 *coarse = columns[ch].coarse;
+            quint16 *fine = columns[ch].fine;
+            for (int c = 0; c < columnCount; ++c) {
+                const int value = channelValue(row[qBound(0, firstX + c, lastX)], ch);
+                coarse[c * CoarseBins + value / FineBins] += delta;
+                fine[c * Bins + value] += delta;
+            }
+        }
+    };
+
+    for (int ch = 0; ch < Channels; ++ch) {
+        columns[ch].reset(columnCount);
+    }
+    for (int y = tile.top() - radius; y < tile.top() + radius; ++y) {
+        addRow(y, 1);
+    }
+
+    KernelHistogram kernels[Channels];
+    for (int y = tile.top(); y <= tile.bottom(); ++y) {
+        addRow(y + radius, 1);
+        if (y > tile.top()) addRow(y - radius - 1, -1);
+
+        const QRgb *src = sourceRow(y);
+        QRgb *dst = reinterpret_cast<QRgb *>(dstBits + y * dstStride);
+        for (int ch = 0; ch < Channels; ++ch) {
+            kernels[ch].start(columns[ch], window);
+        }
+
+        for (int i = 0; i < tile.width(); ++i) {
+            const int x = tile.left() + i;
+            QRgb pixel = src[x] & 0xff000000u;
+            for (int ch = 0; ch < Channels; ++ch) {
+                if (i > 0) kernels[ch].slide(columns[ch], i + window - 1, i - 1);
+                pixel |= QRgb(kernels[ch].median(columns[ch], i, window, rank)) << (8 * ch);
+            }
+            dst[x] = pixel;
+        }
+    }
+}
+
+// Window minima of one line of n values. Minima running forward and
+// backward inside blocks of the window length give every window as the
+// smaller of two lookups. The line is padded with radius white values on
+// each side, which never win.
+void minimumLine(const uchar *in, uchar *out, int n, int radius, uchar *forward, uchar *backward) {
+    const int window = 2 * radius + 1;
+    const int length = n + 2 * radius;
+    auto at = [&](int p) { return p >= radius && p < radius + n ? in[p - radius] : uchar(255); };
+
+    for (int p = 0; p < length; ++p) {
+        forward[p] = p % window == 0 ? at(p) : qMin(forward[p - 1], at(p));
+    }
+    for (int p = length - 1; p >= 0; --p) {
+        backward[p] = (p % window == window - 1 || p == length - 1) ? at(p) : qMin(backward[p + 1], at(p));
+    }
+    for (int x = 0; x < n; ++x) out[x] = qMin(backward[x], forward[x + window - 1]);
+}
+
+} // namespace
+
+// ============================================================================
+// Median Filter
+// ============================================================================
+
+QImage MedianKernels::median(const QImage &image, int radius) {
+    Q_ASSERT(PixelKernels::isWorkingFormat(image.format()));
+
+    if (image.isNull()) return QImage();
+    QImage result = ScratchArena::image(image.width(), image.height(), image.format());
+
+    // Window counts must fit the 16-bit bins
+    radius = qBound(0, radius, 127);
+
+    const int tilesX = (image.width() + TileSize - 1) / TileSize;
+    const int tilesY = (image.height() + TileSize - 1) / TileSize;
+    const qsizetype tileBytes = qsizetype(TileSize) * TileSize * sizeof(QRgb);
+
+    uchar *bits = result.bits();
+    const qsizetype stride = result.bytesPerLine();
+    ParallelExecutor::forEachBand(tilesX * tilesY, tileBytes, [&](int begin, int end) {
+        ColumnHistograms columns[Channels];
+        for (int t = begin; t < end; ++t) {
+            const int x = (t % tilesX) * TileSize;
+            const int y = (t / tilesX) * TileSize;
+            const QRect tile(x, y, qMin(TileSize, image.width() - x), qMin(TileSize, image.height() - y));
+            medianTile(image, bits, stride, radius, tile, columns);
+        }
+    });
+
+    return result;
+}
+
+// ============================================================================
+// Minimum Filter
+// ============================================================================
+
+QImage MedianKernels::minimum(const QImage &image, int radius) {
+    Q_ASSERT(image.format() == QImage::Format_Grayscale8);
+
+    if (image.isNull()) return QImage();
+    if (radius < 1) return image;
+
+    const int width = image.width();
+    const int height = image.height();
+    QImage rows = ScratchArena::image(width, height, QImage::Format_Grayscale8);
+    QImage result = ScratchArena::image(width, height, QImage::Format_Grayscale8);
+
+    uchar *rowBits = rows.bits();
+    const qsizetype rowStride = rows.bytesPerLine();
+    ParallelExecutor::forEachBand(height, width, [&](int begin, int end) {
+        const ScratchArena::Buffer scratch = ScratchArena::acquire(2 * (width + 2 * radius));
+        for (int y = begin; y < end; ++y) {
+            minimumLine(image.constScanLine(y), rowBits + y * rowStride, width, radius, scratch.data(),
+                        scratch.data() + width + 2 * radius);
+        }
+    });
+
+    // Columns the same way, a band of them at a time with the running
+    // minima kept as whole rows of the band
+    uchar *bits = result.bits();
+    const qsizetype stride = result.bytesPerLine();
+    ParallelExecutor::forEachBand(width, height, [&](int begin, int end) {
+        const int span = end - begin;
+        const int window = 2 * radius + 1;
+        const int length = height + 2 * radius;
+        const ScratchArena::Buffer forwardBuffer = ScratchArena::acquire(qsizetype(length) * span);
+        const ScratchArena::Buffer backwardBuffer = ScratchArena::acquire(qsizetype(length) * span);
+        const ScratchArena::Buffer whiteBuffer = ScratchArena::acquire(span);
+        uchar *forward = forwardBuffer.data();
+        uchar *backward = backwardBuffer.data();
+        const uchar *white = whiteBuffer.data();
+        std::memset(whiteBuffer.data(), 255, span);
+        auto at = [&](int p) {
+            return p >= radius && p < radius + height ? rowBits + (p - radius) * rowStride + begin : white;
+        };
+
+        for (int p = 0; p < length; ++p) {
+            const uchar *in = at(p);
+            uchar *f = forward + qsizetype(p) * span;
+            if (p % window == 0) {
+                std::memcpy(f, in, span);
+            } else {
+                for (int x = 0; x < span; ++x) f[x] = qMin(f[x - span], in[x]);
+            }
+        }
+        for (int p = length - 1; p >= 0; --p) {
+            const uchar *in = at(p);
+            uchar *b = backward + qsizetype(p) * span;
+            if (p % window == window - 1 || p == length - 1) {
+                std::memcpy(b, in, span);
+            } else {
+                for (int x = 0; x < span; ++x) b[x] = qMin(b[x + span], in[x]);
+            }
+        }
+        for (int y = 0; y < height; ++y) {
+            const uchar *b = backward + qsizetype(y) * span;
+            const uchar *f = forward + qsizetype(y + window - 1) * span;
+            uchar *out = bits + y * stride + begin;
+            for (int x = 0; x < span; ++x) out[x] = qMin(b[x], f[x]);
+        }
+    });
+
+    return result;
+}
+
+} // namespace Utils
+} // namespace Knoux
@@ -0,0 +1,35 @@
+#ifndef MEDIANKERNELS_H
+#define MEDIANKERNELS_H
+
+#include <QImage>
+
+namespace Knoux {
+namespace Utils {
+
+/**
+ * @brief Median filter with a cost independent of the radius
+ *
+ * Follows Perreault and Hebert, "Median Filtering in Constant Time": every
+ * column keeps a histogram of its window, and the kernel histogram slides
+ * along a row by adding one column and removing another. Histograms are
+ * split into 16 coarse and 256 fine bins, and fine bins are only merged
+ * for the coarse bin that holds the median. Tiles run on the
+ * ParallelExecutor threads. The minimum filter is the cheaper rank filter
+ * of the same family.
+ */
+class MedianKernels {
+public:
+    // Per-channel median of the (2 * radius + 1)^2 window, with edge pixels
+    // repeated past the border. Alpha is kept from the source pixel.
+    static QImage median(const QImage &image, int radius);  // image must be in the working format
+
+    // Minimum of the (2 * radius + 1)^2 window (gray erosion) of a
+    // Grayscale8 image, windows clipped at the border. Van Herk/Gil-Werman
+    // running minima, three comparisons per pixel and pass at any radius.
+    static QImage minimum(const QImage &image, int radius);
+};
+
+} // namespace Utils
+} // namespace Knoux
+
+#endif // MEDIANKERNELS_H
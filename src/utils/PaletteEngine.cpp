@@ -0,0 +1,306 @@
+#include "PaletteEngine.h"
+#include "PixelKernels.h"
+#include "SimdKernels.h"
+
+#include <QtMath>
+#include <algorithm>
+
+namespace Knoux {
+namespace Utils {
+
+namespace {
+
+constexpr int HistogramBits = 5;
+constexpr int HistogramSize = 1 << (3 * HistogramBits);
+// Keeps the 32-bit bin sums from overflowing
+constexpr int MaxSampleBudget = 1 << 24;
+// k-means passes after median cut, later passes barely move the means
+constexpr int RefinePasses = 3;
+// Colors per parallel work item of the nearest color search
+constexpr int SearchChunk = 64;
+
+struct ColorBin {
+    quint32 count;
+    quint32 sum[3];  // Red, green, blue
+};
+
+// An occupied histogram bin
+struct Entry {
+    int channel[3];  // Mean color of the samples in the bin
+    quint32 count;
+    quint32 sum[3];
+};
+
+// A median cut box, a range of entries
+struct Box {
+    int begin;
+    int end;
+    int axis;      // Channel with the largest variance
+    double error;  // Sum of squared distances to the box mean
+};
+
+struct Cluster {
+    quint64 count;
+    quint64 sum[3];
+};
+
+inline int binIndex(QRgb p) {
+    constexpr int shift = 8 - HistogramBits;
+    return (qRed(p) >> shift) << (2 * HistogramBits) | (qGreen(p) >> shift) << HistogramBits
+         | (qBlue(p) >> shift);
+}
+
+inline QRgb meanColor(quint64 count, const quint64 *sum) {
+    const quint64 half = count / 2;
+    return qRgb(int((sum[0] + half) / count), int((sum[1] + half) / count), int((sum[2] + half) / count));
+}
+
+QVector<Entry> sampleEntries(const QImage &image, int sampleBudget) {
+    QVector<ColorBin> bins(HistogramSize);
+
+    // Even grid with at most sampleBudget points
+    const double pixels = double(image.width()) * image.height();
+    const int step = qMax(1, qCeil(qSqrt(pixels / qBound(1, sampleBudget, MaxSampleBudget))));
+    const bool direct = PixelKernels::isWorkingFormat(image.format());
+    const bool hasAlpha = image.hasAlphaChannel();
+
+    ColorBin *bin = bins.data();
+    for (int y = 0; y < image.height(); y += step) {
+        const QRgb *line = direct ? reinterpret_cast<const QRgb *>(image.constScanLine(y)) : nullptr;
+        for (int x = 0; x < image.width(); x += step) {
+            const QRgb p = line ? line[x] : image.pixel(x, y);
+            if (hasAlpha && qAlpha(p) == 0) continue;
+
+            ColorBin &b = bin[binIndex(p)];
+            ++b.count;
+            b.sum[0] += qRed(p);
+            b.sum[1] += qGreen(p);
+            b.sum[2] += qBlue(p);
+        }
+    }
+
+    QVector<Entry> entries;
+    for (const ColorBin &b : bins) {
+        if (b.count == 0) continue;
+        Entry entry;
+        entry.count = b.count;
+        for (int c = 0; c < 3; ++c) {
+            entry.sum[c] = b.sum[c];
+            entry.channel[c] = int((b.sum[c] + b.count / 2) / b.count);
+        }
+        entries.append(entry);
+    }
+    return entries;
+}
+
+// Sum of squared distances to the mean of count samples
+inline double squaredError(double count, const double *sum, const double *squares) {
+    double error = 0.0;
+    for (int c = 0; c < 3; ++c) error += squares[c] - sum[c] * sum[c] / count;
+    return error;
+}
+
+Box makeBox(const QVector<Entry> &entries, int begin, int end) {
+    double count = 0.0;
+    double sum[3] = {0.0, 0.0, 0.0};
+    double squares[3] = {0.0, 0.0, 0.0};
+    for (int i = begin; i < end; ++i) {
+        const Entry &entry = entries[i];
+        count += entry.count;
+        for (int c = 0; c < 3; ++c) {
+            sum[c] += double(entry.count) * entry.channel[c];
+            squares[c] += double(entry.count) * entry.channel[c] * entry.channel[c];
+        }
+    }
+
+    Box box{begin, end, 0, squaredError(count, sum, squares)};
+    double spread = -1.0;
+    for (int c = 0; c < 3; ++c) {
+        const double variance = squares[c] - sum[c] * sum[c] / count;
+        if (variance > spread) {
+            spread = variance;
+            box.axis = c;
+        }
+    }
+    return box;
+}
+
+// First entry of the upper half when the box is cut where the summed error
+// of both halves is smallest
+int bestCut(const QVector<Entry> &entries, const Box &box) {
+    double total = 0.0;
+    double totalSum[3] = {0.0, 0.0, 0.0};
+    double totalSquares[3] = {0.0, 0.0, 0.0};
+    for (int i = box.begin; i < box.end; ++i) {
+        total += entries[i].count;
+        for (int c = 0; c < 3; ++c) {
+            totalSum[c] += double(entries[i].count) * entries[i].channel[c];
+            totalSquares[c] += double(entries[i].count) * entries[i].channel[c] * entries[i].channel[c];
+        }
+    }
+
+    int cut = box.begin + 1;
+    double best = -1.0;
+    double count = 0.0;
+    double sum[3] = {0.0, 0.0, 0.0};
+    double squares[3] = {0.0, 0.0, 0.0};
+    for (int i = box.begin; i < box.end - 1; ++i) {
+        count += entries[i].count;
+        double restSum[3];
+        double restSquares[3];
+        for (int c = 0; c < 3; ++c) {
+            sum[c] += double(entries[i].count) * entries[i].channel[c];
+            squares[c] += double(entries[i].count) * entries[i].channel[c] * entries[i].channel[c];
+            restSum[c] = totalSum[c] - sum[c];
+            restSquares[c] = totalSquares[c] - squares[c];
+        }
+
+        const double error = squaredError(count, sum, squares) + squaredError(total - count, restSum, restSquares);
+        if (best < 0.0 || error < best) {
+            best = error;
+            cut = i + 1;
+        }
+    }
+    return cut;
+}
+
+QVector<QRgb> medianCut(QVector<Entry> &entries, int colorCount) {
+    QVector<Box> boxes;
+    boxes.append(makeBox(entries, 0, entries.size()));
+
+    while (boxes.size() < colorCount) {
+        // Split the box with the largest error
+        int pick = -1;
+        double worst = 0.5;
+        for (int i = 0; i < boxes.size(); ++i) {
+            if (boxes[i].end - boxes[i].begin > 1 && boxes[i].error > worst) {
+                worst = boxes[i].error;
+                pick = i;
+            }
+        }
+        if (pick < 0) break;
+
+        const Box box = boxes[pick];
+        const int axis = box.axis;
+        std::sort(entries.begin() + box.begin, entries.begin() + box.end,
+                  [axis](const Entry &a, const Entry &b) { return a.channel[axis] < b.channel[axis]; });
+
+        const int cut = bestCut(entries, box);
+        boxes[pick] = makeBox(entries, box.begin, cut);
+        boxes.append(makeBox(entries, cut, box.end));
+    }
+
+    QVector<QRgb> palette;
+    for (const Box &box : boxes) {
+        quint64 count = 0;
+        quint64 sum[3] = {0, 0, 0};
+        for (int i = box.begin; i < box.end; ++i) {
+            count += entries[i].count;
+            for (int c = 0; c < 3; ++c) sum[c] += entries[i].sum[c];
+        }
+        palette.append(meanColor(count, sum));
+    }
+    return palette;
+}
+
+void findNearest(quint32 *indices, const QRgb *colors, int count, const QVector<QRgb> &palette) {
+    const PaletteParams params{palette.constData(), int(palette.size())};
+    const auto nearest = SimdKernels::table().nearest;
+
+    const int chunks = (count + SearchChunk - 1) / SearchChunk;
+    ParallelExecutor::forEachBand(chunks, qsizetype(SearchChunk) * palette.size() * sizeof(QRgb),
+                                  [&](int begin, int end) {
+        const int first = begin * SearchChunk;
+        const int last = qMin(end * SearchChunk, count);
+        nearest(indices + first, colors + first, last - first, params);
+    });
+}
+
+QVector<QRgb> refine(const QVector<Entry> &entries, QVector<QRgb> palette) {
+    QVector<QRgb> colors(entries.size());
+    for (int i = 0; i < entries.size(); ++i) {
+        colors[i] = qRgb(entries[i].channel[0], entries[i].channel[1], entries[i].channel[2]);
+    }
+
+    QVector<quint32> nearest(entries.size());
+    QVector<QPair<quint64, QRgb>> ranked;
+    for (int pass = 0; pass < RefinePasses; ++pass) {
+        findNearest(nearest.data(), colors.constData(), colors.size(), palette);
+
+        QVector<Cluster> clusters(palette.size());
+        for (int i = 0; i < entries.size(); ++i) {
+            Cluster &cluster = clusters[nearest[i]];
+            cluster.count += entries[i].count;
+            for (int c = 0; c < 3; ++c) cluster.sum[c] += entries[i].sum[c];
+        }
+
+        // Clusters that lost all their samples are dropped
+        palette.clear();
+        ranked.clear();
+        for (const Cluster &cluster : clusters) {
+            if (cluster.count == 0) continue;
+            palette.append(meanColor(cluster.count, cluster.sum));
+            ranked.append({cluster.count, palette.last()});
+        }
+    }
+
+    std::stable_sort(ranked.begin(), ranked.end(),
+                     [](const QPair<quint64, QRgb> &a, const QPair<quint64, QRgb> &b) { return a.first > b.first; });
+    for (int i = 0; i < ranked.size(); ++i) palette[i] = ranked[i].second;
+    return palette;
+}
+
+} // namespace
+
+QVector<QRgb> PaletteEngine::extract(const QImage &image, int colorCount, int sampleBudget) {
+    colorCount = qMin(colorCount, MaxColors);
+    if (image.isNull() || colorCount <= 0) return {};
+
+    QVector<Entry> entries = sampleEntries(image, sampleBudget);
+    if (entries.isEmpty()) return {};
+
+    return refine(entries, medianCut(entries, colorCount));
+}
+
+QImage PaletteEngine::quantize(const QImage &image, const QVector<QRgb> &palette) {
+    if (image.isNull() || palette.isEmpty()) return QImage();
+    Q_ASSERT(palette.size() <= MaxColors);
+
+    // Closest entry for every 15-bit color, taken at the bin center
+    QVector<QRgb> centers(HistogramSize);
+    constexpr int shift = 8 - HistogramBits;
+    constexpr int mask = (1 << HistogramBits) - 1;
+    constexpr int center = 1 << (shift - 1);
+    for (int i = 0; i < HistogramSize; ++i) {
+        centers[i] = qRgb(((i >> (2 * HistogramBits)) & mask) << shift | center,
+                          ((i >> HistogramBits) & mask) << shift | center,
+                          (i & mask) << shift | center);
+    }
+    QVector<quint32> nearest(HistogramSize);
+    findNearest(nearest.data(), centers.constData(), HistogramSize, palette);
+
+    // Byte indices keep the table in L1 during the mapping
+    uchar lookup[HistogramSize];
+    for (int i = 0; i < HistogramSize; ++i) lookup[i] = uchar(nearest[i]);
+
+    const QImage pixels = PixelKernels::isWorkingFormat(image.format())
+        ? image : image.convertToFormat(QImage::Format_ARGB32);
+    QImage indexed(pixels.size(), QImage::Format_Indexed8);
+    indexed.setColorTable(palette);
+
+    uchar *bits = indexed.bits();
+    const qsizetype stride = indexed.bytesPerLine();
+    const int width = pixels.width();
+    ParallelExecutor::forEachBand(pixels.height(), pixels.bytesPerLine(), [&](int begin, int end) {
+        for (int y = begin; y < end; ++y) {
+            const QRgb *in = reinterpret_cast<const QRgb *>(pixels.constScanLine(y));
+            uchar *out = bits + y * stride;
+            for (int x = 0; x < width; ++x) out[x] = lookup[binIndex(in[x])];
+        }
+    });
+
+    return indexed;
+}
+
+} // namespace Utils
+} // namespace Knoux
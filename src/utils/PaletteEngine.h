@@ -0,0 +1,38 @@
+#ifndef PALETTEENGINE_H
+#define PALETTEENGINE_H
+
+#include <QImage>
+#include <QVector>
+
+namespace Knoux {
+namespace Utils {
+
+/**
+ * @brief Palette extraction and color quantization
+ *
+ * At most sampleBudget pixels are read on an even grid into a fixed 15-bit
+ * (5 bits per channel) histogram, so the cost does not grow with the image.
+ * Median cut splits the occupied bins into boxes, always cutting the box with
+ * the largest squared error where its halves have the least, and a few
+ * k-means passes refine the box means. Nearest color searches run on the
+ * SIMD kernels.
+ */
+class PaletteEngine {
+public:
+    static constexpr int DefaultSampleBudget = 1 << 18;
+    static constexpr int MaxColors = 256;
+
+    // Up to colorCount opaque colors, the most common first. Fully
+    // transparent pixels are ignored.
+    static QVector<QRgb> extract(const QImage &image, int colorCount,
+                                 int sampleBudget = DefaultSampleBudget);
+
+    // Indexed8 image with palette as its color table, every pixel mapped to
+    // the entry closest to its 15-bit color
+    static QImage quantize(const QImage &image, const QVector<QRgb> &palette);
+};
+
+} // namespace Utils
+} // namespace Knoux
+
+#endif // PALETTEENGINE_H
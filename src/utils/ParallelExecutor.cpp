@@ -0,0 +1,94 @@
+#include "ParallelExecutor.h"
+
+#include <QAtomicInt>
+#include <QThread>
+#include <QThreadPool>
+#include <QVector>
+#include <QtConcurrent>
+
+namespace Knoux {
+namespace Utils {
+
+namespace {
+
+// Smaller bands cost more to schedule than to process
+constexpr qsizetype MinBandBytes = 16 * 1024;
+// Larger bands fall out of a per-core L2 cache
+constexpr qsizetype MaxBandBytes = 256 * 1024;
+// Extra bands per thread absorb rows of uneven cost
+constexpr int BandsPerThread = 4;
+
+struct Band {
+    int begin;
+    int end;
+};
+
+QAtomicInt &threadCountStorage() {
+    static QAtomicInt count(ParallelExecutor::defaultThreadCount());
+    return count;
+}
+
+} // namespace
+
+// ============================================================================
+// Thread Configuration
+// ============================================================================
+
+int ParallelExecutor::defaultThreadCount() {
+    return qBound(1, QThread::idealThreadCount(), MaxThreadCount);
+}
+
+int ParallelExecutor::threadCount() {
+    return threadCountStorage().loadRelaxed();
+}
+
+void ParallelExecutor::setThreadCount(int count) {
+    count = qBound(1, count, MaxThreadCount);
+    threadCountStorage().storeRelaxed(count);
+
+    // The calling thread always takes part, so the pool supplies the rest
+    threadPool()->setMaxThreadCount(qMax(1, count - 1));
+}
+
+QThreadPool *ParallelExecutor::threadPool() {
+    // Never destroyed, so filters can still run from other static destructors
+    static QThreadPool *pool = [] {
+        QThreadPool *p = new QThreadPool();
+        p->setMaxThreadCount(qMax(1, threadCount() - 1));
+        return p;
+    }();
+    return pool;
+}
+
+// ============================================================================
+// Band Scheduling
+// ============================================================================
+
+void ParallelExecutor::forEachBand(int rows, qsizetype bytesPerRow, const BandFunc &func) {
+    if (rows <= 0) return;
+
+    const int threads = threadCount();
+    const qsizetype rowBytes = qMax<qsizetype>(1, bytesPerRow);
+    const int minRows = int(qBound<qsizetype>(1, MinBandBytes / rowBytes, rows));
+    const int maxRows = int(qBound<qsizetype>(minRows, MaxBandBytes / rowBytes, rows));
+    const int wanted = (rows + threads * BandsPerThread - 1) / (threads * BandsPerThread);
+    const int bandRows = qBound(minRows, wanted, maxRows);
+
+    if (threads == 1 || bandRows >= rows) {
+        func(0, rows);
+        return;
+    }
+
+    QVector<Band> bands;
+    bands.reserve((rows + bandRows - 1) / bandRows);
+    for (int begin = 0; begin < rows; begin += bandRows) {
+        bands.append({begin, qMin(begin + bandRows, rows)});
+    }
+
+    QtConcurrent::blockingMap(threadPool(), bands, [&func](const Band &band) {
+        func(band.begin, band.end);
+    });
+}
+
+} // namespace Utils
+} // namespace Knoux
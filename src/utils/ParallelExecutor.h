@@ -0,0 +1,38 @@
+#ifndef PARALLELEXECUTOR_H
+#define PARALLELEXECUTOR_H
+
+#include <QtGlobal>
+#include <functional>
+
+class QThreadPool;
+
+namespace Knoux {
+namespace Utils {
+
+/**
+ * @brief Shared multi-core engine for image processing
+ *
+ * Work is split into bands of whole rows sized to stay cache resident and
+ * run on one thread pool shared by all filters. The calling thread works on
+ * bands too, so nested calls from inside a band cannot deadlock.
+ */
+class ParallelExecutor {
+public:
+    using BandFunc = std::function<void(int begin, int end)>;
+
+    // Thread configuration (Performance/threadCount in the settings)
+    static constexpr int MaxThreadCount = 32;
+    static int defaultThreadCount();
+    static int threadCount();
+    static void setThreadCount(int count);
+    static QThreadPool *threadPool();
+
+    // Calls func(begin, end) for disjoint row ranges covering [0, rows),
+    // concurrently and in no particular order
+    static void forEachBand(int rows, qsizetype bytesPerRow, const BandFunc &func);
+};
+
+} // namespace Utils
+} // namespace Knoux
+
+#endif // PARALLELEXECUTOR_H
@@ -0,0 +1,209 @@
+#ifndef PIXELFORMAT_H
+#define PIXELFORMAT_H
+
+#include <QFloat16>
+#include <QImage>
+#include <QRgba64>
+#include <QRgbaFloat>
+#include <QtGlobal>
+
+namespace Knoux {
+namespace Utils {
+
+/**
+ * @brief Channel depth of the buffers an editing session works in
+ *
+ * Bits8 is the ARGB32 working format every kernel has a fast path for.
+ * The deep modes keep their precision through the operations that have a
+ * native path and cost twice the memory; Float16 is the size of Bits16 but
+ * lets those operations carry values above white from one step to the next.
+ */
+enum class WorkingDepth {
+    Bits8,    // ARGB32
+    Bits16,   // RGBA64
+    Float16   // RGBA16FPx4
+};
+
+/**
+ * @brief Compile-time description of one QImage pixel layout
+ *
+ * Kernels written against PixelTraits<Format> read and write pixels as they
+ * are stored, so a Grayscale8 mask is walked one byte per pixel and an RGBA64
+ * image keeps its 16 bits per channel. Channel values run from 0 to Max.
+ * Formats without an alpha channel report Max for it and ignore it in
+ * make(); Grayscale8 reports its value for all three colors and stores the
+ * qGray() luma of whatever it is given. Half-float channels are read as
+ * 0..65535 clamped to the 0..1 range; IsFloat marks the layouts whose
+ * kernels may prefer to work on the floats directly.
+ */
+template <QImage::Format F>
+struct PixelTraits;
+
+template <>
+struct PixelTraits<QImage::Format_Grayscale8> {
+    using Pixel = quint8;
+    static constexpr QImage::Format Format = QImage::Format_Grayscale8;
+    static constexpr int Max = 255;
+    static constexpr bool HasAlpha = false;
+    static constexpr bool IsGray = true;
+    static constexpr bool IsFloat = false;
+
+    static int red(Pixel p) { return p; }
+    static int green(Pixel p) { return p; }
+    static int blue(Pixel p) { return p; }
+    static int alpha(Pixel) { return Max; }
+    static int luma(Pixel p) { return p; }
+    static Pixel make(int r, int g, int b, int) { return Pixel((r * 11 + g * 16 + b * 5) >> 5); }
+};
+
+/**
+ * @brief Three bytes in red, green, blue order
+ */
+struct Rgb888 {
+    quint8 r;
+    quint8 g;
+    quint8 b;
+};
+
+template <>
+struct PixelTraits<QImage::Format_RGB888> {
+    using Pixel = Rgb888;
+    static constexpr QImage::Format Format = QImage::Format_RGB888;
+    static constexpr int Max = 255;
+    static constexpr bool HasAlpha = false;
+    static constexpr bool IsGray = false;
+    static constexpr bool IsFloat = false;
+
+    static int red(Pixel p) { return p.r; }
+    static int green(Pixel p) { return p.g; }
+    static int blue(Pixel p) { return p.b; }
+    static int alpha(Pixel) { return Max; }
+    static int luma(Pixel p) { return (p.r * 11 + p.g * 16 + p.b * 5) >> 5; }
+    static Pixel make(int r, int g, int b, int) { return {quint8(r), quint8(g), quint8(b)}; }
+};
+
+template <>
+struct PixelTraits<QImage::Format_ARGB32> {
+    using Pixel = QRgb;
+    static constexpr QImage::Format Format = QImage::Format_ARGB32;
+    static constexpr int Max = 255;
+    static constexpr bool HasAlpha = true;
+    static constexpr bool IsGray = false;
+    static constexpr bool IsFloat = false;
+
+    static int red(Pixel p) { return (p >> 16) & 0xff; }
+    static int green(Pixel p) { return (p >> 8) & 0xff; }
+    static int blue(Pixel p) { return p & 0xff; }
+    static int alpha(Pixel p) { return p >> 24; }
+    static int luma(Pixel p) { return (red(p) * 11 + green(p) * 16 + blue(p) * 5) >> 5; }
+    static Pixel make(int r, int g, int b, int a) { return uint(a) << 24 | uint(r) << 16 | uint(g) << 8 | uint(b); }
+};
+
+// Same memory layout with the alpha byte fixed at 0xff
+template <>
+struct PixelTraits<QImage::Format_RGB32> : PixelTraits<QImage::Format_ARGB32> {
+    static constexpr QImage::Format Format = QImage::Format_RGB32;
+    static constexpr bool HasAlpha = false;
+
+    static int alpha(Pixel) { return Max; }
+    static Pixel make(int r, int g, int b, int) { return PixelTraits<QImage::Format_ARGB32>::make(r, g, b, Max); }
+};
+
+template <>
+struct PixelTraits<QImage::Format_RGBA64> {
+    using Pixel = QRgba64;
+    static constexpr QImage::Format Format = QImage::Format_RGBA64;
+    static constexpr int Max = 65535;
+    static constexpr bool HasAlpha = true;
+    static constexpr bool IsGray = false;
+    static constexpr bool IsFloat = false;
+
+    static int red(Pixel p) { return p.red(); }
+    static int green(Pixel p) { return p.green(); }
+    static int blue(Pixel p) { return p.blue(); }
+    static int alpha(Pixel p) { return p.alpha(); }
+    static int luma(Pixel p) { return (red(p) * 11 + green(p) * 16 + blue(p) * 5) >> 5; }
+    static Pixel make(int r, int g, int b, int a) { return QRgba64::fromRgba64(quint16(r), quint16(g), quint16(b), quint16(a)); }
+};
+
+// Same memory layout with the alpha word fixed at 0xffff
+template <>
+struct PixelTraits<QImage::Format_RGBX64> : PixelTraits<QImage::Format_RGBA64> {
+    static constexpr QImage::Format Format = QImage::Format_RGBX64;
+    static constexpr bool HasAlpha = false;
+
+    static int alpha(Pixel) { return Max; }
+    static Pixel make(int r, int g, int b, int) { return PixelTraits<QImage::Format_RGBA64>::make(r, g, b, Max); }
+};
+
+template <>
+struct PixelTraits<QImage::Format_RGBA16FPx4> {
+    using Pixel = QRgbaFloat16;
+    static constexpr QImage::Format Format = QImage::Format_RGBA16FPx4;
+    static constexpr int Max = 65535;
+    static constexpr bool HasAlpha = true;
+    static constexpr bool IsGray = false;
+    static constexpr bool IsFloat = true;
+
+    static int fromFloat(float v) { return v <= 0.0f ? 0 : (v >= 1.0f ? Max : int(v * Max + 0.5f)); }
+    static int red(Pixel p) { return fromFloat(p.red()); }
+    static int green(Pixel p) { return fromFloat(p.green()); }
+    static int blue(Pixel p) { return fromFloat(p.blue()); }
+    static int alpha(Pixel p) { return fromFloat(p.alpha()); }
+    static int luma(Pixel p) { return (red(p) * 11 + green(p) * 16 + blue(p) * 5) >> 5; }
+    static Pixel make(int r, int g, int b, int a) {
+        return Pixel::fromRgba64(quint16(r), quint16(g), quint16(b), quint16(a));
+    }
+};
+
+// Same memory layout with the alpha fixed at 1.0
+template <>
+struct PixelTraits<QImage::Format_RGBX16FPx4> : PixelTraits<QImage::Format_RGBA16FPx4> {
+    static constexpr QImage::Format Format = QImage::Format_RGBX16FPx4;
+    static constexpr bool HasAlpha = false;
+
+    static int alpha(Pixel) { return Max; }
+    static Pixel make(int r, int g, int b, int) { return PixelTraits<QImage::Format_RGBA16FPx4>::make(r, g, b, Max); }
+};
+
+// Top 8 bits of a channel value, exact for values widened from 8 bits
+template <typename Traits>
+inline int toByte(int value) {
+    return Traits::Max == 255 ? value : value >> 8;
+}
+
+/**
+ * @brief Calls func(PixelTraits<F>()) with the traits of format
+ *
+ * Returns what func returns, or false for formats without traits. func is
+ * instantiated once per format, which is how a kernel gets compiled for
+ * every layout it supports.
+ */
+template <typename Func>
+bool visitPixelFormat(QImage::Format format, Func &&func) {
+    switch (format) {
+    case QImage::Format_Grayscale8:
+        return func(PixelTraits<QImage::Format_Grayscale8>());
+    case QImage::Format_RGB888:
+        return func(PixelTraits<QImage::Format_RGB888>());
+    case QImage::Format_ARGB32:
+        return func(PixelTraits<QImage::Format_ARGB32>());
+    case QImage::Format_RGB32:
+        return func(PixelTraits<QImage::Format_RGB32>());
+    case QImage::Format_RGBA64:
+        return func(PixelTraits<QImage::Format_RGBA64>());
+    case QImage::Format_RGBX64:
+        return func(PixelTraits<QImage::Format_RGBX64>());
+    case QImage::Format_RGBA16FPx4:
+        return func(PixelTraits<QImage::Format_RGBA16FPx4>());
+    case QImage::Format_RGBX16FPx4:
+        return func(PixelTraits<QImage::Format_RGBX16FPx4>());
+    default:
+        return false;
+    }
+}
+
+} // namespace Utils
+} // namespace Knoux
+
+#endif // PIXELFORMAT_H
@@ -0,0 +1,119 @@
+#include "PixelKernels.h"
+#include "ScratchArena.h"
+
+#include <cstring>
+#include <utility>
+
+namespace Knoux {
+namespace Utils {
+
+// ============================================================================
+// Format Normalization
+// ============================================================================
+
+bool PixelKernels::isWorkingFormat(QImage::Format format) {
+    // RGB32 shares the ARGB32 memory layout with a fixed 0xff alpha byte, so
+    // both can be processed by the same kernels without conversion
+    return format == QImage::Format_ARGB32 || format == QImage::Format_RGB32;
+}
+
+QImage PixelKernels::toWorkingFormat(const QImage &input) {
+    if (input.isNull()) return QImage();
+
+    // Pooled copy, filter chains hand these back and forth every frame
+    if (isWorkingFormat(input.format())) return toWritable(input);
+
+    // Straight (non-premultiplied) alpha keeps the per-channel math identical
+    // to what QImage::pixelColor() used to return
+    return input.convertToFormat(input.hasAlphaChannel() ? QImage::Format_ARGB32
+                                                         : QImage::Format_RGB32);
+}
+
+QImage PixelKernels::toWorkingFormat(QImage &&input) {
+    // A filter chain written as f(g(std::move(image))) then runs on one buffer
+    if (isWorkingFormat(input.format()) && input.isDetached()) return std::move(input);
+    return toWorkingFormat(static_cast<const QImage &>(input));
+}
+
+QImage PixelKernels::toWritable(const QImage &input) {
+    if (input.isNull()) return QImage();
+
+    QImage result = blankLike(input);
+    uchar *bits = result.bits();
+    const qsizetype stride = result.bytesPerLine();
+    const qsizetype rowBytes = (qsizetype(input.width()) * input.depth() + 7) / 8;
+    ParallelExecutor::forEachBand(input.height(), stride, [&](int begin, int end) {
+        for (int y = begin; y < end; ++y) {
+            std::memcpy(bits + y * stride, input.constScanLine(y), rowBytes);
+        }
+    });
+    return result;
+}
+
+QImage PixelKernels::toWritable(QImage &&input) {
+    if (input.isDetached()) return std::move(input);
+    return toWritable(static_cast<const QImage &>(input));
+}
+
+QImage PixelKernels::blankLike(const QImage &input) {
+    QImage result = ScratchArena::image(input.width(), input.height(), input.format());
+    result.setDotsPerMeterX(input.dotsPerMeterX());
+    result.setDotsPerMeterY(input.dotsPerMeterY());
+    result.setColorSpace(input.colorSpace());
+    result.setColorTable(input.colorTable());
+    return result;
+}
+
+QImage::Format PixelKernels::depthFormat(WorkingDepth depth, bool alpha) {
+    switch (depth) {
+    case WorkingDepth::Bits16:
+        return alpha ? QImage::Format_RGBA64 : QImage::Format_RGBX64;
+    case WorkingDepth::Float16:
+        return alpha ? QImage::Format_RGBA16FPx4 : QImage::Format_RGBX16FPx4;
+    case WorkingDepth::Bits8:
+        break;
+    }
+    return alpha ? QImage::Format_ARGB32 : QImage::Format_RGB32;
+}
+
+bool PixelKernels::hasDepth(QImage::Format format, WorkingDepth depth) {
+    return format == depthFormat(depth, true) || format == depthFormat(depth, false);
+}
+
+QImage PixelKernels::toDepth(QImage &&input, WorkingDepth depth) {
+    if (input.isNull()) return QImage();
+    if (hasDepth(input.format(), depth)) return std::move(input);
+
+    // Qt's row converters are vectorized, half floats use F16C where the CPU
+    // has it, and convertTo() reuses the buffer when the depth allows
+    QImage result = std::move(input);
+    result.convertTo(depthFormat(depth, result.hasAlphaChannel()));
+    return result;
+}
+
+// ============================================================================
+// Lookup Tables
+// ============================================================================
+
+void PixelKernels::applyLut(QImage &image, const ChannelLut &lut) {
+    applyLut(ImageView(image), lut);
+}
+
+void PixelKernels::applyLut(const ImageView &view, const ChannelLut &lut) {
+    forEachRow(view, [&lut](QRgb *row, int width, int) {
+        applyLut(row, width, lut);
+    });
+}
+
+void PixelKernels::applyLut(QRgb *row, int width, const ChannelLut &lut) {
+    for (int x = 0; x < width; ++x) {
+        const QRgb p = row[x];
+        row[x] = (p & 0xff000000u)
+               | (uint(lut.red[(p >> 16) & 0xff]) << 16)
+               | (uint(lut.green[(p >> 8) & 0xff]) << 8)
+               | uint(lut.blue[p & 0xff]);
+    }
+}
+
+} // namespace Utils
+} // namespace Knoux
@@ -0,0 +1,209 @@
+#ifndef PIXELKERNELS_H
+#define PIXELKERNELS_H
+
+#include "ImageView.h"
+#include "ParallelExecutor.h"
+#include "PixelFormat.h"
+
+#include <QImage>
+#include <QtGlobal>
+#include <cstring>
+
+namespace Knoux {
+namespace Utils {
+
+/**
+ * @brief Per-channel 8-bit lookup table
+ */
+struct ChannelLut {
+    uchar red[256];
+    uchar green[256];
+    uchar blue[256];
+};
+
+/**
+ * @brief Scanline pixel kernels used by ImageProcessor
+ *
+ * Images are normalized once to a 32-bit (A)RGB layout, after which kernels
+ * walk raw QRgb rows with integer math instead of calling
+ * QImage::pixelColor()/setPixelColor() and building a QColor per pixel.
+ * Kernels also run on an ImageView, which covers a region of a larger image.
+ * forEachRowAs() walks the other formats that have PixelTraits as stored.
+ */
+class PixelKernels {
+public:
+    // Format normalization
+    static bool isWorkingFormat(QImage::Format format);
+    static QImage toWorkingFormat(const QImage &input);
+    // Keeps the pixels of an image nothing else shares, copies otherwise
+    static QImage toWorkingFormat(QImage &&input);
+    // Unshared image in the same format, pooled copies like above
+    static QImage toWritable(const QImage &input);
+    static QImage toWritable(QImage &&input);
+    // Pooled image of the same size, format and metadata, pixels uninitialized
+    static QImage blankLike(const QImage &input);
+
+    // Working depth, chosen per document and converted to at load and export
+    static QImage::Format depthFormat(WorkingDepth depth, bool alpha = true);
+    static bool hasDepth(QImage::Format format, WorkingDepth depth);
+    static QImage toDepth(QImage &&input, WorkingDepth depth);
+
+    // Lookup tables
+    template <typename ChannelFunc>
+    static ChannelLut makeLut(ChannelFunc func);
+    static void applyLut(QImage &image, const ChannelLut &lut);
+    static void applyLut(const ImageView &view, const ChannelLut &lut);
+    static void applyLut(QRgb *row, int width, const ChannelLut &lut);
+    // Any format with traits, 16-bit channels interpolate between entries
+    template <typename Traits>
+    static void applyLutAs(const ImageView &view, const ChannelLut &lut);
+    template <typename Traits>
+    static int sampleLut(const uchar *table, int value);
+
+    // Row and pixel iteration over a working-format image, split across the
+    // ParallelExecutor threads. func must only touch its own rows.
+    template <typename RowFunc>
+    static void forEachRow(QImage &image, RowFunc func);
+    template <typename RowFunc>
+    static void forEachRow(const ImageView &view, RowFunc func);
+    template <typename PixelFunc>
+    static void forEachPixel(QImage &image, PixelFunc func);
+    template <typename PixelFunc>
+    static void forEachPixel(const ImageView &view, PixelFunc func);
+    // Rows of any format with traits, func(typename Traits::Pixel *row, int width, int y)
+    template <typename Traits, typename RowFunc>
+    static void forEachRowAs(const ImageView &view, RowFunc func);
+    // forEachRow() on input in the working format. A shared input is copied
+    // a row at a time just before func runs on the row, while it is still in
+    // cache, instead of in a full pass of its own.
+    template <typename RowFunc>
+    static QImage mapRows(QImage &&input, RowFunc func);
+
+    // Fixed-point helpers (16.16)
+    static constexpr int FixedShift = 16;
+    static constexpr int FixedOne = 1 << FixedShift;
+
+    static inline int toFixed(float value) { return qRound(value * FixedOne); }
+    static inline int clampByte(int value) { return value < 0 ? 0 : (value > 255 ? 255 : value); }
+    static inline QRgb pack(int r, int g, int b, QRgb alphaSource) {
+        return (alphaSource & 0xff000000u) | (uint(r) << 16) | (uint(g) << 8) | uint(b);
+    }
+};
+
+// ============================================================================
+// Template Implementation
+// ============================================================================
+
+template <typename ChannelFunc>
+ChannelLut PixelKernels::makeLut(ChannelFunc func) {
+    // func(channel, value) returns the unclamped output for channel 0 (red),
+    // 1 (green) or 2 (blue)
+    ChannelLut lut;
+    for (int v = 0; v < 256; ++v) {
+        lut.red[v] = static_cast<uchar>(clampByte(func(0, v)));
+        lut.green[v] = static_cast<uchar>(clampByte(func(1, v)));
+        lut.blue[v] = static_cast<uchar>(clampByte(func(2, v)));
+    }
+    return lut;
+}
+
+template <typename Traits>
+int PixelKernels::sampleLut(const uchar *table, int value) {
+    if constexpr (Traits::Max == 255) {
+        return table[value];
+    } else {
+        // Entry i sits at i * 257, so both ends and every entry are exact
+        static_assert(Traits::Max == 65535, "8 or 16-bit channels only");
+        const int i = qMin(value / 257, 254);
+        const int t = value - i * 257;
+        return table[i] * 257 + (table[i + 1] - table[i]) * t;
+    }
+}
+
+template <typename Traits>
+void PixelKernels::applyLutAs(const ImageView &view, const ChannelLut &lut) {
+    forEachRowAs<Traits>(view, [&lut](typename Traits::Pixel *row, int width, int) {
+        for (int x = 0; x < width; ++x) {
+            const typename Traits::Pixel p = row[x];
+            row[x] = Traits::make(sampleLut<Traits>(lut.red, Traits::red(p)),
+                                  sampleLut<Traits>(lut.green, Traits::green(p)),
+                                  sampleLut<Traits>(lut.blue, Traits::blue(p)),
+                                  Traits::alpha(p));
+        }
+    });
+}
+
+template <typename RowFunc>
+void PixelKernels::forEachRow(QImage &image, RowFunc func) {
+    // Detach once here, scanLine() on a shared image is not thread-safe
+    forEachRow(ImageView(image), func);
+}
+
+template <typename RowFunc>
+void PixelKernels::forEachRow(const ImageView &view, RowFunc func) {
+    // func(QRgb *row, int width, int y), y counts from the top of the view
+    if (view.isNull()) return;
+    Q_ASSERT(isWorkingFormat(view.format()));
+
+    const int width = view.width();
+    ParallelExecutor::forEachBand(view.height(), qsizetype(width) * sizeof(QRgb), [&](int begin, int end) {
+        for (int y = begin; y < end; ++y) {
+            func(view.row(y), width, y);
+        }
+    });
+}
+
+template <typename Traits, typename RowFunc>
+void PixelKernels::forEachRowAs(const ImageView &view, RowFunc func) {
+    if (view.isNull()) return;
+    Q_ASSERT(view.format() == Traits::Format);
+
+    using Pixel = typename Traits::Pixel;
+    const int width = view.width();
+    ParallelExecutor::forEachBand(view.height(), qsizetype(width) * sizeof(Pixel), [&](int begin, int end) {
+        for (int y = begin; y < end; ++y) {
+            func(reinterpret_cast<Pixel *>(view.scanLine(y)), width, y);
+        }
+    });
+}
+
+template <typename RowFunc>
+QImage PixelKernels::mapRows(QImage &&input, RowFunc func) {
+    if (!isWorkingFormat(input.format()) || input.isDetached()) {
+        QImage result = toWorkingFormat(std::move(input));
+        forEachRow(result, func);
+        return result;
+    }
+
+    QImage result = blankLike(input);
+    const ImageView view(result);
+    const int width = view.width();
+    ParallelExecutor::forEachBand(view.height(), qsizetype(width) * sizeof(QRgb), [&](int begin, int end) {
+        for (int y = begin; y < end; ++y) {
+            QRgb *row = view.row(y);
+            std::memcpy(row, input.constScanLine(y), width * sizeof(QRgb));
+            func(row, width, y);
+        }
+    });
+    return result;
+}
+
+template <typename PixelFunc>
+void PixelKernels::forEachPixel(QImage &image, PixelFunc func) {
+    forEachPixel(ImageView(image), func);
+}
+
+template <typename PixelFunc>
+void PixelKernels::forEachPixel(const ImageView &view, PixelFunc func) {
+    // func(QRgb) returns the new pixel value
+    forEachRow(view, [&func](QRgb *row, int width, int) {
+        for (int x = 0; x < width; ++x) {
+            row[x] = func(row[x]);
+        }
+    });
+}
+
+} // namespace Utils
+} // namespace Knoux
+
+#endif // PIXELKERNELS_H
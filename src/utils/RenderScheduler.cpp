@@ -0,0 +1,140 @@
+#include "RenderScheduler.h"
+
+#include <QMetaObject>
+#include <QMutexLocker>
+
+#include <utility>
+
+namespace Knoux {
+namespace Utils {
+
+RenderScheduler::RenderScheduler(QObject *parent)
+    : QObject(parent)
+    , m_latest(0)
+{
+    // One render at a time, its stages spread over the ParallelExecutor threads
+    m_pool.setMaxThreadCount(1);
+}
+
+RenderScheduler::~RenderScheduler() {
+    cancel();
+    m_pool.waitForDone();
+}
+
+quint64 RenderScheduler::request(const QImage &source, const AdjustmentGraph::Parameters &parameters) {
+    QMutexLocker lock(&m_mutex);
+    ++m_stats.requested;
+    if (m_hasPending) ++m_stats.replaced;
+
+    // The running render sees the new version and stops before its next node
+    const quint64 version = m_latest.loadRelaxed() + 1;
+    m_latest.storeRelease(version);
+
+    m_pending.source = source;
+    m_pending.parameters = parameters;
+    m_pending.version = version;
+    m_pending.age.start();
+    m_hasPending = true;
+
+    if (!m_running) {
+        m_running = true;
+        m_pool.start([this] { run(); });
+    }
+    return version;
+}
+
+QImage RenderScheduler::finish() {
+    QMutexLocker lock(&m_mutex);
+    const quint64 version = m_latest.loadRelaxed();
+    if (version <= m_published) return QImage();
+
+    // Only this thread requests, so the newest version cannot move meanwhile
+    while (m_resultVersion != version && m_running) m_changed.wait(&m_mutex);
+    if (m_resultVersion != version) return QImage();
+
+    m_published = version;
+    ++m_stats.completed;
+    m_stats.lastLatencyMs = m_resultAge.elapsed();
+    return std::exchange(m_result, QImage());
+}
+
+void RenderScheduler::cancel() {
+    QMutexLocker lock(&m_mutex);
+    if (m_hasPending) {
+        ++m_stats.replaced;
+        m_pending = Request();
+        m_hasPending = false;
+    }
+    if (m_resultVersion > m_published) ++m_stats.discarded;
+    m_result = QImage();
+
+    // A version no request has: the running render stops, nothing is published
+    const quint64 version = m_latest.loadRelaxed() + 1;
+    m_latest.storeRelease(version);
+    m_published = version;
+}
+
+RenderScheduler::Stats RenderScheduler::stats() const {
+    QMutexLocker lock(&m_mutex);
+    return m_stats;
+}
+
+void RenderScheduler::run() {
+    QMutexLocker lock(&m_mutex);
+    while (m_hasPending) {
+        Request job = std::exchange(m_pending, Request());
+        m_hasPending = false;
+        lock.unlock();
+
+        QElapsedTimer timer;
+        timer.start();
+        const quint64 version = job.version;
+        m_graph.setSource(job.source);
+        QImage result = m_graph.render(job.parameters, [this, version] {
+            return m_latest.loadAcquire() != version;
+        });
+        const qint64 renderMs = timer.elapsed();
+
+        lock.relock();
+        if (m_latest.loadRelaxed() != version) {
+            // A null result is a render the graph stopped early
+            ++(result.isNull() ? m_stats.cancelled : m_stats.discarded);
+            continue;
+        }
+        // An older result still waiting to be published never will be
+        if (m_resultVersion > m_published) ++m_stats.discarded;
+        m_result = std::move(result);
+        m_resultVersion = version;
+        m_resultAge = job.age;
+        m_stats.lastRenderMs = renderMs;
+        m_changed.wakeAll();
+
+        // Published on the scheduler's thread, dropped if it is gone by then
+        QMetaObject::invokeMethod(this, [this, version] { publish(version); }, Qt::QueuedConnection);
+    }
+    m_running = false;
+    m_changed.wakeAll();
+}
+
+void RenderScheduler::publish(quint64 version) {
+    QImage image;
+    {
+        QMutexLocker lock(&m_mutex);
+        // Taken by finish(), or dropped by cancel()
+        if (version != m_resultVersion || version <= m_published) return;
+
+        m_published = version;
+        image = std::exchange(m_result, QImage());
+        if (version != m_latest.loadRelaxed()) {
+            // A newer request came while this one waited to be published
+            ++m_stats.discarded;
+            return;
+        }
+        ++m_stats.completed;
+        m_stats.lastLatencyMs = m_resultAge.elapsed();
+    }
+    emit rendered(image, version);
+}
+
+} // namespace Utils
+} // namespace Knoux
@@ -0,0 +1,94 @@
+#ifndef RENDERSCHEDULER_H
+#define RENDERSCHEDULER_H
+
+#include <QObject>
+#include <QImage>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThreadPool>
+#include <QElapsedTimer>
+#include <QAtomicInteger>
+
+#include "AdjustmentGraph.h"
+
+namespace Knoux {
+namespace Utils {
+
+/**
+ * @brief Renders adjustments off the GUI thread, newest request wins
+ *
+ * Every request gets a version. One render runs at a time on the
+ * scheduler's own thread, through an AdjustmentGraph that keeps its stage
+ * results between renders. A request that arrives while another waits
+ * replaces it; one that arrives while a render runs makes the graph stop
+ * that render before its next node. Only the result of the newest request
+ * is published, through rendered() on the scheduler's thread, so a slider
+ * never waits for a render and the canvas never goes back to an older one.
+ * The ParallelExecutor threads still share the work of each render.
+ */
+class RenderScheduler : public QObject {
+    Q_OBJECT
+
+public:
+    // What became of the requests, for tuning
+    struct Stats {
+        quint64 requested = 0;   // request() calls
+        quint64 completed = 0;   // Renders published, by rendered() or finish()
+        quint64 replaced = 0;    // Dropped before they started, a newer one came
+        quint64 cancelled = 0;   // Stopped between nodes by a newer request
+        quint64 discarded = 0;   // Finished after a newer request came, not published
+        qint64 lastRenderMs = 0;   // Worker time of the last published render
+        qint64 lastLatencyMs = 0;  // From its request to its publication
+    };
+
+    explicit RenderScheduler(QObject *parent = nullptr);
+    // Cancels what is outstanding and waits for the running render
+    ~RenderScheduler();
+
+    // Renders source through parameters and returns the request's version.
+    // Supersedes every earlier request not yet published.
+    quint64 request(const QImage &source, const AdjustmentGraph::Parameters &parameters);
+
+    // Waits for the newest request and returns its result, which is then
+    // not sent through rendered(). Null when nothing is outstanding.
+    QImage finish();
+
+    // Drops every outstanding request, nothing is published for them
+    void cancel();
+
+    Stats stats() const;
+
+signals:
+    void rendered(const QImage &image, quint64 version);
+
+private:
+    struct Request {
+        QImage source;
+        AdjustmentGraph::Parameters parameters;
+        quint64 version = 0;
+        QElapsedTimer age;
+    };
+
+    void run();
+    void publish(quint64 version);
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_changed;  // A render finished or the worker stopped
+    QAtomicInteger<quint64> m_latest;  // Newest version, written under m_mutex
+    quint64 m_published = 0;           // Newest version published or dropped
+    Request m_pending;
+    bool m_hasPending = false;
+    bool m_running = false;
+    QImage m_result;
+    quint64 m_resultVersion = 0;
+    QElapsedTimer m_resultAge;
+    Stats m_stats;
+
+    AdjustmentGraph m_graph;  // Only used by the worker
+    QThreadPool m_pool;
+};
+
+} // namespace Utils
+} // namespace Knoux
+
+#endif // RENDERSCHEDULER_H
@@ -0,0 +1,286 @@
+#include "Resampler.h"
+#include "ParallelExecutor.h"
+#include "ScratchArena.h"
+#include "SimdKernels.h"
+
+#include <QTransform>
+#include <QVarLengthArray>
+#include <QVector>
+#include <QtMath>
+#include <algorithm>
+#include <cmath>
+
+namespace Knoux {
+namespace Utils {
+
+namespace {
+
+// 1.14 fixed point of the separable passes
+constexpr int WeightOne = 1 << 14;
+// Keeps 16.16 warp coordinates of the rotated bounding box inside 32 bits
+constexpr int MaxWarpSide = 16384;
+
+struct AxisPlan {
+    QVector<qint32> first;
+    QVector<qint32> weights;  // Tap-major, taps * size
+    int taps = 0;
+    int size = 0;
+
+    ResampleTaps params(bool premultiplied) const {
+        return {first.constData(), weights.constData(), taps, size, premultiplied};
+    }
+};
+
+double filterRadius(ResampleFilter filter) {
+    switch (filter) {
+    case ResampleFilter::Bilinear: return 1.0;
+    case ResampleFilter::Bicubic: return 2.0;
+    case ResampleFilter::Lanczos3: return 3.0;
+    default: return 0.5;
+    }
+}
+
+double sinc(double x) {
+    if (x == 0.0) return 1.0;
+    x *= M_PI;
+    return std::sin(x) / x;
+}
+
+double filterWeight(ResampleFilter filter, double x) {
+    x = std::abs(x);
+    switch (filter) {
+    case ResampleFilter::Bilinear:
+        return qMax(0.0, 1.0 - x);
+    case ResampleFilter::Bicubic:
+        // Keys cubic with a = -0.5
+        if (x < 1.0) return (1.5 * x - 2.5) * x * x + 1.0;
+        if (x < 2.0) return ((-0.5 * x + 2.5) * x - 4.0) * x + 2.0;
+        return 0.0;
+    case ResampleFilter::Lanczos3:
+        return x < 3.0 ? sinc(x) * sinc(x / 3.0) : 0.0;
+    default:
+        return x < 0.5 ? 1.0 : 0.0;
+    }
+}
+
+AxisPlan makeAxis(int source, int target, ResampleFilter filter) {
+    const double scale = double(target) / source;
+    if (filter == ResampleFilter::Auto) filter = scale < 1.0 ? ResampleFilter::Area : ResampleFilter::Bicubic;
+
+    // Shrinking widens the filter to cover every source pixel
+    const double stretch = qMin(scale, 1.0);
+    const double radius = filterRadius(filter) / stretch;
+    const int span = int(std::ceil(2 * radius)) + 2;
+
+    QVector<int> starts(target);
+    QVector<int> counts(target);
+    QVector<qint32> fixed(qsizetype(target) * span, 0);
+    QVector<double> window(span);
+
+    for (int i = 0; i < target; ++i) {
+        const double center = (i + 0.5) / scale - 0.5;
+        const int lo = int(std::floor(center - radius));
+        const int hi = int(std::ceil(center + radius));
+
+        // Taps past the edges fold onto the edge pixels
+        const int clampedLo = qBound(0, lo, source - 1);
+        window.fill(0.0);
+        for (int j = lo; j <= hi; ++j) {
+            double w;
+            if (filter == ResampleFilter::Area) {
+                w = qMax(0.0, qMin(j + 0.5, center + radius) - qMax(j - 0.5, center - radius));
+            } else {
+                w = filterWeight(filter, (j - center) * stretch);
+            }
+            window[qBound(0, j, source - 1) - clampedLo] += w;
+        }
+
+        int begin = 0;
+        int end = qBound(0, hi, source - 1) - clampedLo + 1;
+        while (begin < end - 1 && window[begin] == 0.0) ++begin;
+        while (end - 1 > begin && window[end - 1] == 0.0) --end;
+
+        double sum = 0.0;
+        for (int k = begin; k < end; ++k) sum += window[k];
+
+        // Exact unit gain, flat areas stay flat
+        qint32 *weights = fixed.data() + qsizetype(i) * span;
+        int total = 0;
+        int largest = 0;
+        for (int k = begin; k < end; ++k) {
+            weights[k - begin] = qRound(window[k] / sum * WeightOne);
+            total += weights[k - begin];
+            if (weights[k - begin] > weights[largest]) largest = k - begin;
+        }
+        weights[largest] += WeightOne - total;
+
+        starts[i] = clampedLo + begin;
+        counts[i] = end - begin;
+    }
+
+    AxisPlan plan;
+    plan.size = target;
+    plan.taps = *std::max_element(counts.cbegin(), counts.cend());
+    plan.first.resize(target);
+    plan.weights.fill(0, qsizetype(plan.taps) * target);
+
+    // Windows near the far edge slide back to keep taps inside the source
+    for (int i = 0; i < target; ++i) {
+        plan.first[i] = qMin(starts[i], source - plan.taps);
+        const int offset = starts[i] - plan.first[i];
+        for (int k = 0; k < counts[i]; ++k) {
+            plan.weights[qsizetype(offset + k) * target + i] = fixed[qsizetype(i) * span + k];
+        }
+    }
+    return plan;
+}
+
+QImage horizontalPass(const QImage &source, const AxisPlan &plan, bool premultiplied) {
+    QImage result = ScratchArena::image(plan.size, source.height(), source.format());
+    const ResampleTaps taps = plan.params(premultiplied);
+    const auto resampleRow = SimdKernels::table().resampleRow;
+
+    uchar *bits = result.bits();
+    const qsizetype stride = result.bytesPerLine();
+    ParallelExecutor::forEachBand(source.height(), source.bytesPerLine(), [&](int begin, int end) {
+        for (int y = begin; y < end; ++y) {
+            resampleRow(reinterpret_cast<QRgb *>(bits + y * stride),
+                        reinterpret_cast<const QRgb *>(source.constScanLine(y)), plan.size, taps);
+        }
+    });
+    return result;
+}
+
+QImage verticalPass(const QImage &source, const AxisPlan &plan, bool premultiplied) {
+    QImage result = ScratchArena::image(source.width(), plan.size, source.format());
+    const ResampleTaps taps = plan.params(premultiplied);
+    const auto resampleColumn = SimdKernels::table().resampleColumn;
+
+    uchar *bits = result.bits();
+    const qsizetype stride = result.bytesPerLine();
+    ParallelExecutor::forEachBand(plan.size, source.bytesPerLine() * plan.taps, [&](int begin, int end) {
+        QVarLengthArray<const QRgb *, 64> rows(plan.taps);
+        for (int y = begin; y < end; ++y) {
+            for (int k = 0; k < plan.taps; ++k) {
+                rows[k] = reinterpret_cast<const QRgb *>(source.constScanLine(plan.first[y] + k));
+            }
+            resampleColumn(reinterpret_cast<QRgb *>(bits + y * stride), rows.constData(), source.width(), taps, y);
+        }
+    });
+    return result;
+}
+
+// weights[tap * 256 + fraction] of the warp kernel, in 1.8 fixed point
+const qint32 *warpWeights(bool bicubic) {
+    static const QVector<qint32> tables[2] = {
+        [] {
+            QVector<qint32> table(2 * 256);
+            for (int f = 0; f < 256; ++f) {
+                table[f] = 256 - f;
+                table[256 + f] = f;
+            }
+            return table;
+        }(),
+        [] {
+            QVector<qint32> table(4 * 256);
+            for (int f = 0; f < 256; ++f) {
+                const double t = f / 256.0;
+                int total = 0;
+                for (int tap = 0; tap < 4; ++tap) {
+                    table[tap * 256 + f] = qRound(filterWeight(ResampleFilter::Bicubic, tap - 1 - t) * 256);
+                    total += table[tap * 256 + f];
+                }
+                table[(t < 0.5 ? 1 : 2) * 256 + f] += 256 - total;
+            }
+            return table;
+        }()
+    };
+    return tables[bicubic ? 1 : 0].constData();
+}
+
+} // namespace
+
+QImage Resampler::resize(const QImage &input, const QSize &size, ResampleFilter filter) {
+    if (input.isNull() || size.isEmpty()) return QImage();
+
+    const bool premultiplied = input.format() == QImage::Format_ARGB32_Premultiplied;
+    const bool alpha = input.hasAlphaChannel();
+    const QImage::Format working = alpha ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32;
+    QImage result = input.format() == working ? input : input.convertToFormat(working);
+
+    const bool scaleX = size.width() != input.width();
+    const bool scaleY = size.height() != input.height();
+    const AxisPlan horizontal = scaleX ? makeAxis(input.width(), size.width(), filter) : AxisPlan();
+    const AxisPlan vertical = scaleY ? makeAxis(input.height(), size.height(), filter) : AxisPlan();
+
+    // Filtering the shrinking axis first leaves less for the second pass
+    const qint64 area = qint64(size.width()) * size.height();
+    const qint64 horizontalFirst = qint64(size.width()) * input.height() * horizontal.taps + area * vertical.taps;
+    const qint64 verticalFirst = qint64(input.width()) * size.height() * vertical.taps + area * horizontal.taps;
+
+    if (horizontalFirst <= verticalFirst) {
+        if (scaleX) result = horizontalPass(result, horizontal, alpha);
+        if (scaleY) result = verticalPass(result, vertical, alpha);
+    } else {
+        if (scaleY) result = verticalPass(result, vertical, alpha);
+        if (scaleX) result = horizontalPass(result, horizontal, alpha);
+    }
+
+    result.setColorSpace(input.colorSpace());
+    return alpha && !premultiplied ? result.convertToFormat(QImage::Format_ARGB32) : result;
+}
+
+QImage Resampler::rotate(const QImage &input, float degrees, ResampleFilter filter) {
+    if (input.isNull()) return QImage();
+
+    QTransform transform;
+    transform.rotate(degrees);
+
+    // Quarter turns only move pixels, and huge images would overflow the
+    // fixed-point source walk
+    if (std::fmod(degrees, 90.0f) == 0.0f || qMax(input.width(), input.height()) > MaxWarpSide) {
+        return input.transformed(transform, Qt::SmoothTransformation);
+    }
+
+    const bool premultiplied = input.format() == QImage::Format_ARGB32_Premultiplied;
+    const QImage source = premultiplied ? input : input.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    const QSizeF bounds = transform.mapRect(QRectF(source.rect())).size();
+    QImage result = ScratchArena::image(qRound(bounds.width()), qRound(bounds.height()),
+                                        QImage::Format_ARGB32_Premultiplied);
+
+    // Output pixel centers mapped back around the source center, where
+    // source pixel centers sit on whole numbers
+    const QTransform inverse = transform.inverted();
+    const QPointF origin(result.width() / 2.0, result.height() / 2.0);
+    const QPointF center(source.width() / 2.0 - 0.5, source.height() / 2.0 - 0.5);
+    const bool bicubic = filter != ResampleFilter::Bilinear;
+
+    WarpParams params;
+    params.pixels = reinterpret_cast<const QRgb *>(source.constBits());
+    params.stride = int(source.bytesPerLine() / sizeof(QRgb));
+    params.width = source.width();
+    params.height = source.height();
+    params.dx = qRound(inverse.m11() * 65536);
+    params.dy = qRound(inverse.m12() * 65536);
+    params.weights = warpWeights(bicubic);
+    params.taps = bicubic ? 4 : 2;
+    const auto warp = SimdKernels::table().warp;
+
+    uchar *bits = result.bits();
+    const qsizetype stride = result.bytesPerLine();
+    ParallelExecutor::forEachBand(result.height(), stride * params.taps, [&](int begin, int end) {
+        WarpParams row = params;
+        for (int y = begin; y < end; ++y) {
+            const QPointF start = inverse.map(QPointF(0.5, y + 0.5) - origin) + center;
+            row.x = qRound(start.x() * 65536);
+            row.y = qRound(start.y() * 65536);
+            warp(reinterpret_cast<QRgb *>(bits + y * stride), result.width(), row);
+        }
+    });
+
+    result.setColorSpace(input.colorSpace());
+    return premultiplied ? result : result.convertToFormat(QImage::Format_ARGB32);
+}
+
+} // namespace Utils
+} // namespace Knoux
@@ -0,0 +1,43 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <QImage>
+
+namespace Knoux {
+namespace Utils {
+
+/**
+ * @brief Reconstruction filters of the resampler
+ */
+enum class ResampleFilter {
+    Auto,      // Area when shrinking, bicubic when enlarging
+    Area,      // Box average over the covered source pixels
+    Bilinear,
+    Bicubic,   // Catmull-Rom
+    Lanczos3
+};
+
+/**
+ * @brief Separable resizing and arbitrary-angle rotation of 32-bit images
+ *
+ * Filter weights are computed once per axis and applied in 1.14 fixed point
+ * by the SIMD row kernels, one pass per axis in whichever order touches
+ * fewer pixels, with both passes split across the ParallelExecutor threads.
+ * Images with alpha are filtered premultiplied so transparent pixels do not
+ * bleed their color into the edges. Results are in the working format,
+ * premultiplied inputs stay premultiplied.
+ */
+class Resampler {
+public:
+    static QImage resize(const QImage &input, const QSize &size, ResampleFilter filter = ResampleFilter::Auto);
+
+    // Rotation about the center into the bounding box of the rotated image,
+    // uncovered corners transparent. Area and Lanczos3 fall back to bicubic,
+    // and Auto is bicubic. Multiples of 90 degrees are moved exactly.
+    static QImage rotate(const QImage &input, float degrees, ResampleFilter filter = ResampleFilter::Auto);
+};
+
+} // namespace Utils
+} // namespace Knoux
+
+#endif // RESAMPLER_H
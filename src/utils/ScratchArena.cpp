@@ -0,0 +1,245 @@
+#include "ScratchArena.h"
+
+#include <QAtomicInteger>
+#include <QHash>
+#include <QMutex>
+#include <QVector>
+#include <new>
+#include <utility>
+
+namespace Knoux {
+namespace Utils {
+
+namespace {
+
+// Smallest size class, tiny requests share it
+constexpr qsizetype MinClassBytes = 4096;
+// Size classes per power of two, bounds the rounding waste to 12.5%
+constexpr int ClassStepsLog2 = 3;
+
+struct Arena {
+    QMutex mutex;
+    QHash<qsizetype, QVector<uchar *>> free;  // Class size -> cached buffers
+    qsizetype cachedBytes = 0;
+    bool threadRunning = true;
+    QAtomicInt refs = 1;  // The owning thread plus every borrowed buffer
+};
+
+QAtomicInteger<quint64> hitCount;
+QAtomicInteger<quint64> missCount;
+QAtomicInteger<qint64> liveBytes;
+QAtomicInteger<qint64> peakBytes;
+QAtomicInteger<qint64> cachedBytes;
+QAtomicInteger<qint64> cacheLimitBytes(ScratchArena::DefaultCacheLimit);
+
+// Arenas of the running threads, for trimming them all
+QMutex registryMutex;
+QVector<Arena *> registry;
+
+qsizetype classSize(qsizetype bytes) {
+    bytes = qMax(bytes, MinClassBytes);
+    int octave = 0;
+    while ((qsizetype(1) << (octave + 1)) <= bytes) ++octave;
+    const qsizetype step = qsizetype(1) << (octave - ClassStepsLog2);
+    return (bytes + step - 1) & ~(step - 1);
+}
+
+uchar *allocate(qsizetype bytes) {
+    return static_cast<uchar *>(::operator new(size_t(bytes), std::align_val_t(ScratchArena::Alignment)));
+}
+
+void deallocate(uchar *data) {
+    ::operator delete(data, std::align_val_t(ScratchArena::Alignment));
+}
+
+void addLive(qsizetype bytes) {
+    const qint64 live = liveBytes.fetchAndAddRelaxed(bytes) + bytes;
+    qint64 peak = peakBytes.loadRelaxed();
+    while (live > peak && !peakBytes.testAndSetRelaxed(peak, live, peak)) {
+    }
+}
+
+void releaseArena(Arena *arena) {
+    if (!arena->refs.deref()) delete arena;
+}
+
+// Frees every cached buffer, outside the lock
+void trimArena(Arena *arena) {
+    QHash<qsizetype, QVector<uchar *>> free;
+    {
+        QMutexLocker lock(&arena->mutex);
+        std::swap(free, arena->free);
+        cachedBytes.fetchAndSubRelaxed(arena->cachedBytes);
+        arena->cachedBytes = 0;
+    }
+    for (const QVector<uchar *> &buffers : free) {
+        for (uchar *data : buffers) deallocate(data);
+    }
+}
+
+/**
+ * The calling thread's arena. It outlives the thread while borrowed
+ * buffers still point at it, but stops caching once the thread is gone.
+ */
+struct ThreadArena {
+    Arena *arena = new Arena;
+
+    ThreadArena() {
+        QMutexLocker lock(&registryMutex);
+        registry.append(arena);
+    }
+
+    ~ThreadArena() {
+        {
+            QMutexLocker lock(&registryMutex);
+            registry.removeOne(arena);
+        }
+        {
+            QMutexLocker lock(&arena->mutex);
+            arena->threadRunning = false;
+        }
+        trimArena(arena);
+        releaseArena(arena);
+    }
+};
+
+Arena *localArena() {
+    thread_local ThreadArena holder;
+    return holder.arena;
+}
+
+void giveBack(Arena *arena, uchar *data, qsizetype bytes) {
+    liveBytes.fetchAndSubRelaxed(bytes);
+
+    // Reserved in the shared total first, so threads returning at the same
+    // time cannot overshoot the limit together
+    bool cached = cachedBytes.fetchAndAddRelaxed(bytes) + bytes <= cacheLimitBytes.loadRelaxed();
+    if (cached) {
+        QMutexLocker lock(&arena->mutex);
+        if (arena->threadRunning) {
+            arena->free[bytes].append(data);
+            arena->cachedBytes += bytes;
+        } else {
+            cached = false;
+        }
+    }
+
+    if (!cached) {
+        cachedBytes.fetchAndSubRelaxed(bytes);
+        deallocate(data);
+    }
+    releaseArena(arena);
+}
+
+void releaseImageBuffer(void *info) {
+    delete static_cast<ScratchArena::Buffer *>(info);
+}
+
+} // namespace
+
+// ============================================================================
+// Buffer
+// ============================================================================
+
+ScratchArena::Buffer::Buffer(Buffer &&other) noexcept
+    : m_data(other.m_data), m_size(other.m_size), m_owner(other.m_owner) {
+    other.m_data = nullptr;
+    other.m_size = 0;
+    other.m_owner = nullptr;
+}
+
+ScratchArena::Buffer &ScratchArena::Buffer::operator=(Buffer &&other) noexcept {
+    if (this != &other) {
+        if (m_data) giveBack(static_cast<Arena *>(m_owner), m_data, m_size);
+        m_data = other.m_data;
+        m_size = other.m_size;
+        m_owner = other.m_owner;
+        other.m_data = nullptr;
+        other.m_size = 0;
+        other.m_owner = nullptr;
+    }
+    return *this;
+}
+
+ScratchArena::Buffer::~Buffer() {
+    if (m_data) giveBack(static_cast<Arena *>(m_owner), m_data, m_size);
+}
+
+// ============================================================================
+// Arena
+// ============================================================================
+
+ScratchArena::Buffer ScratchArena::acquire(qsizetype bytes) {
+    Arena *arena = localArena();
+    const qsizetype size = classSize(bytes);
+
+    uchar *data = nullptr;
+    {
+        QMutexLocker lock(&arena->mutex);
+        auto it = arena->free.find(size);
+        if (it != arena->free.end() && !it.value().isEmpty()) {
+            data = it.value().takeLast();
+            arena->cachedBytes -= size;
+        }
+    }
+
+    if (data) {
+        hitCount.fetchAndAddRelaxed(1);
+        cachedBytes.fetchAndSubRelaxed(size);
+    } else {
+        missCount.fetchAndAddRelaxed(1);
+        data = allocate(size);
+    }
+    addLive(size);
+    arena->refs.ref();
+
+    Buffer buffer;
+    buffer.m_data = data;
+    buffer.m_size = size;
+    buffer.m_owner = arena;
+    return buffer;
+}
+
+QImage ScratchArena::image(int width, int height, QImage::Format format) {
+    if (width <= 0 || height <= 0 || format == QImage::Format_Invalid) return QImage();
+
+    // Same row padding as QImage's own allocations
+    const int depth = QImage::toPixelFormat(format).bitsPerPixel();
+    const qsizetype bytesPerLine = (qsizetype(width) * depth + 31) / 32 * 4;
+
+    Buffer *buffer = new Buffer(acquire(bytesPerLine * height));
+    return QImage(buffer->data(), width, height, bytesPerLine, format, &releaseImageBuffer, buffer);
+}
+
+ScratchArena::Counters ScratchArena::counters() {
+    Counters counters;
+    counters.hits = hitCount.loadRelaxed();
+    counters.misses = missCount.loadRelaxed();
+    counters.liveBytes = liveBytes.loadRelaxed();
+    counters.peakBytes = peakBytes.loadRelaxed();
+    counters.cachedBytes = cachedBytes.loadRelaxed();
+    return counters;
+}
+
+void ScratchArena::resetCounters() {
+    hitCount.storeRelaxed(0);
+    missCount.storeRelaxed(0);
+    peakBytes.storeRelaxed(liveBytes.loadRelaxed());
+}
+
+qsizetype ScratchArena::cacheLimit() {
+    return cacheLimitBytes.loadRelaxed();
+}
+
+void ScratchArena::setCacheLimit(qsizetype bytes) {
+    const qsizetype previous = cacheLimitBytes.fetchAndStoreRelaxed(qMax<qsizetype>(bytes, 0));
+    if (bytes < previous && cachedBytes.loadRelaxed() > bytes) trim();
+}
+
+void ScratchArena::trim() {
+    QMutexLocker lock(&registryMutex);
+    for (Arena *arena : std::as_const(registry)) trimArena(arena);
+}
+
+} // namespace Utils
+} // namespace Knoux
@@ -0,0 +1,81 @@
+#ifndef SCRATCHARENA_H
+#define SCRATCHARENA_H
+
+#include <QImage>
+#include <QtGlobal>
+
+namespace Knoux {
+namespace Utils {
+
+/**
+ * @brief Pool of reusable pixel and scratch buffers
+ *
+ * Every thread owns an arena that caches freed buffers by size class (a
+ * power of two split into eight steps), so a filter chain that runs again
+ * at the same size gets its buffers back without touching the heap.
+ * Buffers are 64-byte aligned and may be released on any thread; they go
+ * back to the arena they came from. The bytes cached by all threads
+ * together stay under one limit, which the editor sizes to the document;
+ * counters are summed over all threads.
+ */
+class ScratchArena {
+public:
+    static constexpr qsizetype Alignment = 64;
+    // Default cache limit over all threads, until the editor sets one
+    static constexpr qsizetype DefaultCacheLimit = qsizetype(256) << 20;
+
+    struct Counters {
+        quint64 hits = 0;           // Requests served from a cache
+        quint64 misses = 0;         // Requests that allocated
+        qsizetype liveBytes = 0;    // Borrowed right now
+        qsizetype peakBytes = 0;    // Most borrowed at once since the last reset
+        qsizetype cachedBytes = 0;  // Kept for reuse
+    };
+
+    /**
+     * @brief Borrowed memory, returned to its arena on destruction
+     */
+    class Buffer {
+    public:
+        Buffer() = default;
+        Buffer(Buffer &&other) noexcept;
+        Buffer &operator=(Buffer &&other) noexcept;
+        Buffer(const Buffer &) = delete;
+        Buffer &operator=(const Buffer &) = delete;
+        ~Buffer();
+
+        uchar *data() const { return m_data; }
+        template <typename T>
+        T *as() const { return reinterpret_cast<T *>(m_data); }
+        qsizetype size() const { return m_size; }
+
+    private:
+        friend class ScratchArena;
+        uchar *m_data = nullptr;
+        qsizetype m_size = 0;
+        void *m_owner = nullptr;
+    };
+
+    // Uninitialized memory of at least bytes
+    static Buffer acquire(qsizetype bytes);
+
+    // Uninitialized image whose pixels live in the arena until the last
+    // copy of the image is destroyed
+    static QImage image(int width, int height, QImage::Format format);
+
+    static Counters counters();
+    static void resetCounters();  // Peak restarts from the live bytes
+
+    // Bytes cached over all threads, returns past it go back to the heap.
+    // Lowering it trims the caches.
+    static qsizetype cacheLimit();
+    static void setCacheLimit(qsizetype bytes);
+
+    // Frees the buffers cached by every thread
+    static void trim();
+};
+
+} // namespace Utils
+} // namespace Knoux
+
+#endif // SCRATCHARENA_H
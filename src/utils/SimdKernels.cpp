@@ -0,0 +1,158 @@
+#include "SimdKernels.h"
+#include "SimdKernelsImpl.h"
+
+#include <QAtomicInt>
+#include <QByteArray>
+
+#if defined(KNOUX_SIMD_X86) && defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+namespace Knoux {
+namespace Utils {
+
+namespace {
+
+const SimdKernelTable &scalarKernels() {
+    static const SimdKernelTable table = makeKernelTable<ScalarLanes>();
+    return table;
+}
+
+SimdLevel detectCpuLevel() {
+#if defined(KNOUX_SIMD_X86)
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    const int maxLeaf = info[0];
+
+    __cpuid(info, 1);
+    const bool sse41 = info[2] & (1 << 19);
+    const bool osxsave = info[2] & (1 << 27);
+    const bool avx = info[2] & (1 << 28);
+
+    // The OS must also save the YMM/ZMM register state on context switches
+    const unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+    const bool ymmEnabled = (xcr0 & 0x06) == 0x06;
+    const bool zmmEnabled = (xcr0 & 0xe6) == 0xe6;
+
+    bool avx2 = false;
+    bool avx512 = false;
+    if (maxLeaf >= 7) {
+        __cpuidex(info, 7, 0);
+        avx2 = info[1] & (1 << 5);
+        avx512 = info[1] & (1 << 16);
+    }
+
+    if (avx512 && zmmEnabled) return SimdLevel::AVX512;
+    if (avx && avx2 && ymmEnabled) return SimdLevel::AVX2;
+    if (sse41) return SimdLevel::SSE41;
+#else
+    // libgcc/compiler-rt also verify OS support through XGETBV
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return SimdLevel::AVX512;
+    if (__builtin_cpu_supports("avx2")) return SimdLevel::AVX2;
+    if (__builtin_cpu_supports("sse4.1")) return SimdLevel::SSE41;
+#endif
+#elif defined(KNOUX_SIMD_NEON)
+    // Advanced SIMD is mandatory on AArch64
+    return SimdLevel::NEON;
+#endif
+    return SimdLevel::Scalar;
+}
+
+SimdLevel levelFromEnvironment(SimdLevel fallback) {
+    const QByteArray requested = qgetenv("KNOUX_SIMD").toLower();
+    if (requested.isEmpty()) return fallback;
+
+    if (requested == "scalar") return SimdLevel::Scalar;
+    if (requested == "sse4.1") return SimdLevel::SSE41;
+    if (requested == "avx2") return SimdLevel::AVX2;
+    if (requested == "avx512") return SimdLevel::AVX512;
+    if (requested == "neon") return SimdLevel::NEON;
+    return fallback;
+}
+
+QAtomicInt &activeLevelStorage() {
+    static QAtomicInt level([] {
+        const SimdLevel detected = detectCpuLevel();
+        const SimdLevel requested = levelFromEnvironment(detected);
+        return static_cast<int>(SimdKernels::isSupported(requested) ? requested : detected);
+    }());
+    return level;
+}
+
+} // namespace
+
+// ============================================================================
+// Dispatch
+// ============================================================================
+
+SimdLevel SimdKernels::detectedLevel() {
+    static const SimdLevel level = detectCpuLevel();
+    return level;
+}
+
+SimdLevel SimdKernels::activeLevel() {
+    return static_cast<SimdLevel>(activeLevelStorage().loadRelaxed());
+}
+
+void SimdKernels::setActiveLevel(SimdLevel level) {
+    if (!isSupported(level)) return;
+    activeLevelStorage().storeRelaxed(static_cast<int>(level));
+}
+
+bool SimdKernels::isSupported(SimdLevel level) {
+    const SimdLevel detected = detectedLevel();
+
+    switch (level) {
+    case SimdLevel::Scalar:
+        return true;
+    case SimdLevel::SSE41:
+    case SimdLevel::AVX2:
+    case SimdLevel::AVX512:
+        // x86 levels are strict supersets of each other
+        return detected != SimdLevel::NEON && static_cast<int>(level) <= static_cast<int>(detected);
+    case SimdLevel::NEON:
+        return detected == SimdLevel::NEON;
+    }
+    return false;
+}
+
+const SimdKernelTable &SimdKernels::table() {
+    return table(activeLevel());
+}
+
+const SimdKernelTable &SimdKernels::table(SimdLevel level) {
+    if (!isSupported(level)) return scalarKernels();
+
+    switch (level) {
+#if defined(KNOUX_SIMD_X86)
+    case SimdLevel::SSE41:
+        return sse41Kernels();
+    case SimdLevel::AVX2:
+        return avx2Kernels();
+    case SimdLevel::AVX512:
+        return avx512Kernels();
+#endif
+#if defined(KNOUX_SIMD_NEON)
+    case SimdLevel::NEON:
+        return neonKernels();
+#endif
+    default:
+        return scalarKernels();
+    }
+}
+
+const char *SimdKernels::levelName(SimdLevel level) {
+    switch (level) {
+    case SimdLevel::Scalar: return "scalar";
+    case SimdLevel::SSE41: return "sse4.1";
+    case SimdLevel::AVX2: return "avx2";
+    case SimdLevel::AVX512: return "avx512";
+    case SimdLevel::NEON: return "neon";
+    }
+    return "unknown";
+}
+
+} // namespace Utils
+} // namespace Knoux
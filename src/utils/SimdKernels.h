@@ -0,0 +1,192 @@
+#ifndef SIMDKERNELS_H
+#define SIMDKERNELS_H
+
+#include <QtGlobal>
+#include <QRgb>
+
+namespace Knoux {
+namespace Utils {
+
+/**
+ * @brief Instruction set used by the pixel row kernels
+ */
+enum class SimdLevel {
+    Scalar,
+    SSE41,
+    AVX2,
+    AVX512,
+    NEON
+};
+
+/**
+ * @brief Separable blend modes implemented by the row kernels
+ */
+enum class BlendMode {
+    Normal,
+    Multiply,
+    Screen,
+    Overlay,
+    SoftLight,
+    HardLight,
+    ColorDodge,
+    ColorBurn,
+    Darken,
+    Lighten,
+    Difference,
+    Exclusion,
+    Count
+};
+
+/**
+ * @brief Per-channel linear transform, out = (in * mul + add) >> 16
+ */
+struct AffineParams {
+    int mul[3];  // Red, green, blue scale (16.16)
+    int add[3];  // Red, green, blue offset (16.16)
+};
+
+/**
+ * @brief 3D color lookup table sampled with tetrahedral interpolation
+ */
+struct CubeLutParams {
+    const QRgb *lattice;  // size^3 entries, red varies fastest
+    const int *axis;      // Per 8-bit value: cell index << 9 | fraction in 1/256ths
+    int size;
+};
+
+/**
+ * @brief Palette searched by the nearest color kernel
+ */
+struct PaletteParams {
+    const QRgb *colors;  // Alpha is ignored
+    int size;
+};
+
+/**
+ * @brief Precomputed filter weights along one resampling axis
+ *
+ * Output pixel i is the sum over k < taps of source pixel first[i] + k times
+ * weights[k * stride + i], in 1.14 fixed point. Windows are padded with zero
+ * weights to the same length and never reach past the source.
+ */
+struct ResampleTaps {
+    const qint32 *first;
+    const qint32 *weights;
+    int taps;
+    int stride;
+    bool premultiplied;  // Clamp the colors to the alpha after filtering
+};
+
+/**
+ * @brief Source walk of a row of an affine warp
+ *
+ * Output pixel i samples the source at (x + i * dx, y + i * dy), in 16.16
+ * with source pixel centers on whole numbers. Samples outside the source
+ * are transparent.
+ */
+struct WarpParams {
+    const QRgb *pixels;      // Premultiplied
+    int stride;              // In pixels
+    int width;
+    int height;
+    int x, y;
+    int dx, dy;
+    const qint32 *weights;   // weights[tap * 256 + fraction] in 1.8 fixed point
+    int taps;                // 2 for bilinear, 4 for bicubic
+};
+
+/**
+ * @brief Gain by distance from a center, looked up per pixel
+ *
+ * The squared distance of pixel x is columns[x] + row, which times scale
+ * indexes gains (0.16 fixed point, the last entry past the end).
+ */
+struct RadialGainParams {
+    const qint32 *columns;
+    float row;
+    float scale;
+    const qint32 *gains;
+    int size;
+};
+
+/**
+ * @brief Bilinear taps averaged along a path
+ *
+ * Tap k of output pixel i samples the source at (x[k] + i * dx[k], y[k]), in
+ * 16.16 with source pixel centers on whole numbers. Samples past the edges
+ * clamp to the edge pixels.
+ */
+struct PathParams {
+    const QRgb *pixels;
+    int stride;  // In pixels
+    int width;
+    int height;
+    const qint32 *x;
+    const qint32 *dx;
+    const qint32 *y;
+    int taps;
+};
+
+/**
+ * @brief Row kernels for one instruction set
+ *
+ * Every entry operates on straight ARGB32 pixels and leaves alpha untouched,
+ * except composite, which produces the source-over alpha, nearest, which
+ * writes palette indices instead of pixels, reduce and the resampling
+ * kernels, which filter all four channels, and weightedSum, which works on
+ * plain float rows.
+ * All variants produce bit-identical output to the scalar table.
+ */
+struct SimdKernelTable {
+    void (*affine)(QRgb *row, int count, const AffineParams &params);
+    void (*saturate)(QRgb *row, int count, int factor);        // factor in 16.16
+    void (*vibrance)(QRgb *row, int count, int factor);        // factor in 20.12
+    void (*hueShift)(QRgb *row, int count, int shift);         // shift in 1/256 sextants
+    void (*cube)(QRgb *row, int count, const CubeLutParams &params);
+    // Filter blend, keeps the base alpha and ignores the layer alpha
+    void (*blend[int(BlendMode::Count)])(QRgb *dst, const QRgb *base, const QRgb *layer,
+                                         int count, int opacity); // opacity in 0..256
+    // Layer composite, source-over with the layer alpha scaled by opacity
+    void (*composite[int(BlendMode::Count)])(QRgb *dst, const QRgb *base, const QRgb *layer,
+                                             int count, int opacity); // opacity in 0..256
+    // Index of the closest palette entry by squared RGB distance, lowest on ties
+    void (*nearest)(quint32 *indices, const QRgb *row, int count, const PaletteParams &params);
+    // 2x2 average, dst[i] from columns 2i and 2i + 1 of top and bottom, rounded
+    void (*reduce)(QRgb *dst, const QRgb *top, const QRgb *bottom, int count);
+    // Horizontal pass, dst[i] from src[taps.first[i] + k]
+    void (*resampleRow)(QRgb *dst, const QRgb *src, int count, const ResampleTaps &taps);
+    // Vertical pass for output row index, rows[k] is source row taps.first[index] + k
+    void (*resampleColumn)(QRgb *dst, const QRgb *const *rows, int count, const ResampleTaps &taps, int index);
+    void (*warp)(QRgb *dst, int count, const WarpParams &params);  // Premultiplied output
+    void (*radialGain)(QRgb *row, int count, const RadialGainParams &params);
+    void (*pathBlur)(QRgb *dst, int count, const PathParams &params);  // Averages alpha too
+    // Adds noise[x] * strength / 256 to the three colors
+    void (*grain)(QRgb *row, const qint32 *noise, int count, int strength);
+    // dst[i] = sum of rows[k][i] * weights[k], k in order; dst may be one of rows
+    void (*weightedSum)(float *dst, const float *const *rows, const float *weights, int taps, int count);
+};
+
+/**
+ * @brief Runtime CPU dispatch for the pixel row kernels
+ *
+ * The best supported instruction set is picked once from CPUID, so one build
+ * runs the widest kernels available on the host. KNOUX_SIMD (scalar, sse4.1,
+ * avx2, avx512, neon) can lower the level for comparisons.
+ */
+class SimdKernels {
+public:
+    static SimdLevel detectedLevel();
+    static SimdLevel activeLevel();
+    static void setActiveLevel(SimdLevel level);
+    static bool isSupported(SimdLevel level);
+
+    static const SimdKernelTable &table();
+    static const SimdKernelTable &table(SimdLevel level);
+
+    static const char *levelName(SimdLevel level);
+};
+
+} // namespace Utils
+} // namespace Knoux
+
+#endif // SIMDKERNELS_H
@@ -0,0 +1,843 @@
+#ifndef SIMDKERNELSIMPL_H
+#define SIMDKERNELSIMPL_H
+
+// Private to the SimdKernels*.cpp translation units.
+//
+// Kernels are written once against a "lanes" traits type (V) that wraps one
+// instruction set, and instantiated per ISA in its own translation unit built
+// with the matching compiler flags. The scalar table is the same code
+// instantiated with ScalarLanes, which is what makes every variant
+// bit-identical: each lane performs exactly the same integer and IEEE float
+// operations in the same order (those TUs are built with FP contraction off).
+//
+// Everything lives in an anonymous namespace, and only C library functions
+// are called, so that code generated with wider ISA flags can never be merged
+// with, or picked instead of, the baseline copy by the linker.
+
+#include "SimdKernels.h"
+
+#include <math.h>
+#include <stdint.h>
+
+namespace Knoux {
+namespace Utils {
+
+// Per-ISA tables, defined in SimdKernels_<isa>.cpp
+const SimdKernelTable &sse41Kernels();
+const SimdKernelTable &avx2Kernels();
+const SimdKernelTable &avx512Kernels();
+const SimdKernelTable &neonKernels();
+
+namespace {
+
+/**
+ * @brief One-lane traits used for the scalar table and for row tails
+ */
+struct ScalarLanes {
+    static constexpr int Lanes = 1;
+    using I = int32_t;
+    using F = float;
+    using M = bool;
+
+    static I load(const QRgb *p) { return static_cast<I>(*p); }
+    static void store(QRgb *p, I v) { *p = static_cast<QRgb>(v); }
+    static I set1(int v) { return v; }
+    static I gather(const int32_t *base, I index) { return base[index]; }
+
+    static I add(I a, I b) { return static_cast<I>(static_cast<uint32_t>(a) + static_cast<uint32_t>(b)); }
+    static I sub(I a, I b) { return static_cast<I>(static_cast<uint32_t>(a) - static_cast<uint32_t>(b)); }
+    static I mul(I a, I b) { return static_cast<I>(static_cast<uint32_t>(a) * static_cast<uint32_t>(b)); }
+    template <int N> static I sra(I a) { return a >> N; }
+    template <int N> static I srl(I a) { return static_cast<I>(static_cast<uint32_t>(a) >> N); }
+    template <int N> static I sll(I a) { return static_cast<I>(static_cast<uint32_t>(a) << N); }
+    static I bitAnd(I a, I b) { return a & b; }
+    static I bitOr(I a, I b) { return a | b; }
+    static I min(I a, I b) { return a < b ? a : b; }
+    static I max(I a, I b) { return a > b ? a : b; }
+
+    static M lessThan(I a, I b) { return a < b; }
+    static M equal(I a, I b) { return a == b; }
+    static M maskOr(M a, M b) { return a || b; }
+    static I select(M m, I a, I b) { return m ? a : b; }
+
+    static F toFloat(I a) { return static_cast<F>(a); }
+    static I truncate(F a) { return static_cast<I>(a); }
+    static F fset1(float v) { return v; }
+    static F fload(const float *p) { return *p; }
+    static void fstore(float *p, F v) { *p = v; }
+    static F fadd(F a, F b) { return a + b; }
+    static F fsub(F a, F b) { return a - b; }
+    static F fmul(F a, F b) { return a * b; }
+    static F fdiv(F a, F b) { return a / b; }
+    static F fsqrt(F a) { return ::sqrtf(a); }
+};
+
+// ============================================================================
+// Lane Helpers
+// ============================================================================
+
+template <typename V>
+struct Channels {
+    typename V::I r, g, b, alpha;
+};
+
+template <typename V>
+inline Channels<V> unpack(typename V::I px) {
+    const typename V::I byteMask = V::set1(0xff);
+    return {
+        V::bitAnd(V::template srl<16>(px), byteMask),
+        V::bitAnd(V::template srl<8>(px), byteMask),
+        V::bitAnd(px, byteMask),
+        V::bitAnd(px, V::set1(static_cast<int>(0xff000000u)))
+    };
+}
+
+template <typename V>
+inline typename V::I pack(typename V::I alpha, typename V::I r, typename V::I g, typename V::I b) {
+    return V::bitOr(V::bitOr(alpha, V::template sll<16>(r)),
+                    V::bitOr(V::template sll<8>(g), b));
+}
+
+template <typename V>
+inline typename V::I clampByte(typename V::I v) {
+    return V::min(V::max(v, V::set1(0)), V::set1(255));
+}
+
+template <typename V>
+inline typename V::I luma(const Channels<V> &c) {
+    // qGray(): (r * 11 + g * 16 + b * 5) / 32
+    return V::template sra<5>(V::add(V::add(V::mul(c.r, V::set1(11)), V::template sll<4>(c.g)),
+                                     V::mul(c.b, V::set1(5))));
+}
+
+template <typename V>
+inline typename V::I divide(typename V::I num, typename V::I den) {
+    // Exact truncating division for |num| < 2^24 and den > 0: the rounded
+    // float quotient can never cross an integer boundary in that range
+    return V::truncate(V::fdiv(V::toFloat(num), V::toFloat(den)));
+}
+
+template <typename V>
+inline typename V::I divideBy255(typename V::I x) {
+    // Exact for 0 <= x <= 65534
+    return V::template srl<8>(V::add(V::add(x, V::set1(1)), V::template srl<8>(x)));
+}
+
+// ============================================================================
+// Point Operations
+// ============================================================================
+
+template <typename V>
+void affineRow(QRgb *row, int count, const AffineParams &params) {
+    using I = typename V::I;
+    const I mulR = V::set1(params.mul[0]), addR = V::set1(params.add[0]);
+    const I mulG = V::set1(params.mul[1]), addG = V::set1(params.add[1]);
+    const I mulB = V::set1(params.mul[2]), addB = V::set1(params.add[2]);
+
+    int x = 0;
+    for (; x + V::Lanes <= count; x += V::Lanes) {
+        const Channels<V> c = unpack<V>(V::load(row + x));
+        const I r = clampByte<V>(V::template sra<16>(V::add(V::mul(c.r, mulR), addR)));
+        const I g = clampByte<V>(V::template sra<16>(V::add(V::mul(c.g, mulG), addG)));
+        const I b = clampByte<V>(V::template sra<16>(V::add(V::mul(c.b, mulB), addB)));
+        V::store(row + x, pack<V>(c.alpha, r, g, b));
+    }
+    if (V::Lanes > 1 && x < count) affineRow<ScalarLanes>(row + x, count - x, params);
+}
+
+template <typename V>
+void saturateRow(QRgb *row, int count, int factor) {
+    using I = typename V::I;
+    const I k = V::set1(factor);
+
+    int x = 0;
+    for (; x + V::Lanes <= count; x += V::Lanes) {
+        const Channels<V> c = unpack<V>(V::load(row + x));
+        const I gray = luma<V>(c);
+        const I base = V::template sll<16>(gray);
+        const I r = clampByte<V>(V::template sra<16>(V::add(base, V::mul(V::sub(c.r, gray), k))));
+        const I g = clampByte<V>(V::template sra<16>(V::add(base, V::mul(V::sub(c.g, gray), k))));
+        const I b = clampByte<V>(V::template sra<16>(V::add(base, V::mul(V::sub(c.b, gray), k))));
+        V::store(row + x, pack<V>(c.alpha, r, g, b));
+    }
+    if (V::Lanes > 1 && x < count) saturateRow<ScalarLanes>(row + x, count - x, factor);
+}
+
+template <typename V>
+void vibranceRow(QRgb *row, int count, int factor) {
+    using I = typename V::I;
+    const I f = V::set1(factor);
+    const I one = V::set1(1);
+
+    int x = 0;
+    for (; x + V::Lanes <= count; x += V::Lanes) {
+        const Channels<V> c = unpack<V>(V::load(row + x));
+        const I maxC = V::max(c.r, V::max(c.g, c.b));
+        const I minC = V::min(c.r, V::min(c.g, c.b));
+
+        // factor * (1 - (hsvSaturation + 1) / 2) == factor * min / (2 * max)
+        const I k = divide<V>(V::mul(f, minC), V::template sll<1>(V::max(maxC, one)));
+
+        const I gray = luma<V>(c);
+        const I base = V::template sll<12>(gray);
+        const I r = clampByte<V>(V::template sra<12>(V::add(base, V::mul(V::sub(c.r, gray), k))));
+        const I g = clampByte<V>(V::template sra<12>(V::add(base, V::mul(V::sub(c.g, gray), k))));
+        const I b = clampByte<V>(V::template sra<12>(V::add(base, V::mul(V::sub(c.b, gray), k))));
+        V::store(row + x, pack<V>(c.alpha, r, g, b));
+    }
+    if (V::Lanes > 1 && x < count) vibranceRow<ScalarLanes>(row + x, count - x, factor);
+}
+
+template <typename V>
+void hueShiftRow(QRgb *row, int count, int shift) {
+    using I = typename V::I;
+    using M = typename V::M;
+    const I turn = V::set1(1536);
+    const I lastHue = V::set1(1535);
+    const I zero = V::set1(0);
+    const I hueShift = V::set1(shift);
+
+    int x = 0;
+    for (; x + V::Lanes <= count; x += V::Lanes) {
+        const Channels<V> c = unpack<V>(V::load(row + x));
+        const I v = V::max(c.r, V::max(c.g, c.b));
+        const I lo = V::min(c.r, V::min(c.g, c.b));
+        const I delta = V::sub(v, lo);
+        const I den = V::max(delta, V::set1(1));
+
+        // Hue in 1/256ths of a sextant (1536 per turn)
+        I hr = divide<V>(V::template sll<8>(V::sub(c.g, c.b)), den);
+        hr = V::add(hr, V::select(V::lessThan(hr, zero), turn, zero));
+        const I hg = V::add(V::set1(512), divide<V>(V::template sll<8>(V::sub(c.b, c.r)), den));
+        const I hb = V::add(V::set1(1024), divide<V>(V::template sll<8>(V::sub(c.r, c.g)), den));
+        I h = V::select(V::equal(v, c.r), hr, V::select(V::equal(v, c.g), hg, hb));
+
+        h = V::add(h, hueShift);
+        h = V::sub(h, V::select(V::lessThan(lastHue, h), turn, zero));
+
+        // Achromatic pixels have delta == 0, so every case below yields v
+        const I sextant = V::template sra<8>(h);
+        const I step = V::template sra<8>(V::mul(delta, V::bitAnd(h, V::set1(255))));
+        const I rising = V::add(lo, step);
+        const I falling = V::sub(v, step);
+
+        const M s0 = V::equal(sextant, V::set1(0));
+        const M s1 = V::equal(sextant, V::set1(1));
+        const M s2 = V::equal(sextant, V::set1(2));
+        const M s3 = V::equal(sextant, V::set1(3));
+        const M s4 = V::equal(sextant, V::set1(4));
+        const M s5 = V::equal(sextant, V::set1(5));
+
+        const I r = V::select(V::maskOr(s0, s5), v,
+                    V::select(s1, falling, V::select(s4, rising, lo)));
+        const I g = V::select(V::maskOr(s1, s2), v,
+                    V::select(s0, rising, V::select(s3, falling, lo)));
+        const I b = V::select(V::maskOr(s3, s4), v,
+                    V::select(s2, rising, V::select(s5, falling, lo)));
+        V::store(row + x, pack<V>(c.alpha, r, g, b));
+    }
+    if (V::Lanes > 1 && x < count) hueShiftRow<ScalarLanes>(row + x, count - x, shift);
+}
+
+template <typename V>
+void cubeRow(QRgb *row, int count, const CubeLutParams &params) {
+    using I = typename V::I;
+    const int32_t *axis = params.axis;
+    const int32_t *lattice = reinterpret_cast<const int32_t *>(params.lattice);
+    const I one = V::set1(1);
+    const I strideG = V::set1(params.size);
+    const I strideB = V::set1(params.size * params.size);
+    const I diagonal = V::set1(1 + params.size + params.size * params.size);
+    const I weightMask = V::set1(0x1ff);
+    const I fraction = V::set1(256);
+    const I redBlue = V::set1(0xff00ff);
+    const I green = V::set1(0xff00);
+
+    int x = 0;
+    for (; x + V::Lanes <= count; x += V::Lanes) {
+        const I px = V::load(row + x);
+        const Channels<V> c = unpack<V>(px);
+        const I er = V::gather(axis, c.r);
+        const I eg = V::gather(axis, c.g);
+        const I eb = V::gather(axis, c.b);
+        const I fr = V::bitAnd(er, weightMask);
+        const I fg = V::bitAnd(eg, weightMask);
+        const I fb = V::bitAnd(eb, weightMask);
+        const I base = V::add(V::template srl<9>(er),
+                              V::add(V::mul(V::template srl<9>(eg), strideG),
+                                     V::mul(V::template srl<9>(eb), strideB)));
+
+        // Tetrahedral interpolation: walk from c000 to c111 stepping first
+        // along the axis with the largest fraction and last along the one
+        // with the smallest. Ties pick different axes, with zero weight.
+        const I hi = V::max(fr, V::max(fg, fb));
+        const I lo = V::min(fr, V::min(fg, fb));
+        const I mid = V::sub(V::sub(V::add(V::add(fr, fg), fb), hi), lo);
+        const I firstStep = V::select(V::maskOr(V::lessThan(fr, fg), V::lessThan(fr, fb)),
+                                      V::select(V::lessThan(fg, fb), strideB, strideG), one);
+        const I lastStep = V::select(V::maskOr(V::lessThan(fr, fb), V::lessThan(fg, fb)),
+                                     V::select(V::lessThan(fr, fg), one, strideG), strideB);
+
+        const I v0 = V::gather(lattice, base);
+        const I v1 = V::gather(lattice, V::add(base, firstStep));
+        const I v2 = V::gather(lattice, V::add(base, V::sub(diagonal, lastStep)));
+        const I v3 = V::gather(lattice, V::add(base, diagonal));
+        const I w0 = V::sub(fraction, hi);
+        const I w1 = V::sub(hi, mid);
+        const I w2 = V::sub(mid, lo);
+
+        // Weights sum to 256, so red/blue and green fit side by side in the
+        // 16-bit halves of one 32-bit multiply-add
+        auto mix = [&](I mask, int rounding) {
+            const I sum = V::add(V::add(V::mul(V::bitAnd(v0, mask), w0), V::mul(V::bitAnd(v1, mask), w1)),
+                                 V::add(V::mul(V::bitAnd(v2, mask), w2), V::mul(V::bitAnd(v3, mask), lo)));
+            return V::bitAnd(V::template srl<8>(V::add(sum, V::set1(rounding))), mask);
+        };
+        V::store(row + x, V::bitOr(c.alpha, V::bitOr(mix(redBlue, 0x800080), mix(green, 0x8000))));
+    }
+    if (V::Lanes > 1 && x < count) cubeRow<ScalarLanes>(row + x, count - x, params);
+}
+
+// ============================================================================
+// Blend Modes
+// ============================================================================
+
+template <typename V>
+struct BlendNormalOp {
+    static typename V::I apply(typename V::I, typename V::I l) { return l; }
+};
+
+template <typename V>
+struct BlendMultiplyOp {
+    static typename V::I apply(typename V::I b, typename V::I l) {
+        return divideBy255<V>(V::mul(b, l));
+    }
+};
+
+template <typename V>
+struct BlendScreenOp {
+    static typename V::I apply(typename V::I b, typename V::I l) {
+        const typename V::I full = V::set1(255);
+        return V::sub(full, divideBy255<V>(V::mul(V::sub(full, b), V::sub(full, l))));
+    }
+};
+
+template <typename V>
+inline typename V::I hardMix(typename V::M low, typename V::I b, typename V::I l) {
+    // low ? 2*b*l/255 : 255 - 2*(255-b)*(255-l)/255
+    const typename V::I full = V::set1(255);
+    const typename V::I dark = divide<V>(V::template sll<1>(V::mul(b, l)), full);
+    const typename V::I light = V::sub(full, divide<V>(
+        V::template sll<1>(V::mul(V::sub(full, b), V::sub(full, l))), full));
+    return V::select(low, dark, light);
+}
+
+template <typename V>
+struct BlendOverlayOp {
+    static typename V::I apply(typename V::I b, typename V::I l) {
+        return hardMix<V>(V::lessThan(b, V::set1(128)), b, l);
+    }
+};
+
+template <typename V>
+struct BlendHardLightOp {
+    static typename V::I apply(typename V::I b, typename V::I l) {
+        return hardMix<V>(V::lessThan(l, V::set1(128)), b, l);
+    }
+};
+
+template <typename V>
+struct BlendSoftLightOp {
+    static typename V::I apply(typename V::I b, typename V::I l) {
+        using F = typename V::F;
+        const F scale = V::fset1(255.0f);
+        const F one = V::fset1(1.0f);
+        const F two = V::fset1(2.0f);
+        const F bf = V::fdiv(V::toFloat(b), scale);
+        const F lf = V::fdiv(V::toFloat(l), scale);
+        const F twoB = V::fmul(two, bf);
+        const F twoL = V::fmul(two, lf);
+
+        // l < 0.5: 2bl + b^2 (1 - 2l), otherwise 2b (1 - l) + sqrt(b) (2l - 1)
+        const F dark = V::fadd(V::fmul(twoB, lf), V::fmul(V::fmul(bf, bf), V::fsub(one, twoL)));
+        const F light = V::fadd(V::fmul(twoB, V::fsub(one, lf)), V::fmul(V::fsqrt(bf), V::fsub(twoL, one)));
+        return V::select(V::lessThan(l, V::set1(128)),
+                         V::truncate(V::fmul(dark, scale)),
+                         V::truncate(V::fmul(light, scale)));
+    }
+};
+
+template <typename V>
+struct BlendColorDodgeOp {
+    static typename V::I apply(typename V::I b, typename V::I l) {
+        const typename V::I full = V::set1(255);
+        const typename V::I den = V::max(V::sub(full, l), V::set1(1));
+        const typename V::I dodged = V::min(full, divide<V>(V::mul(b, full), den));
+        return V::select(V::equal(l, full), full, dodged);
+    }
+};
+
+template <typename V>
+struct BlendColorBurnOp {
+    static typename V::I apply(typename V::I b, typename V::I l) {
+        const typename V::I full = V::set1(255);
+        const typename V::I zero = V::set1(0);
+        const typename V::I den = V::max(l, V::set1(1));
+        const typename V::I burned = V::max(zero, V::sub(full, divide<V>(V::mul(V::sub(full, b), full), den)));
+        return V::select(V::equal(l, zero), zero, burned);
+    }
+};
+
+template <typename V>
+struct BlendDarkenOp {
+    static typename V::I apply(typename V::I b, typename V::I l) { return V::min(b, l); }
+};
+
+template <typename V>
+struct BlendLightenOp {
+    static typename V::I apply(typename V::I b, typename V::I l) { return V::max(b, l); }
+};
+
+template <typename V>
+struct BlendDifferenceOp {
+    static typename V::I apply(typename V::I b, typename V::I l) {
+        return V::sub(V::max(b, l), V::min(b, l));
+    }
+};
+
+template <typename V>
+struct BlendExclusionOp {
+    static typename V::I apply(typename V::I b, typename V::I l) {
+        // b + l - 2bl/255
+        return V::sub(V::add(b, l), divide<V>(V::template sll<1>(V::mul(b, l)), V::set1(255)));
+    }
+};
+
+/**
+ * How the blend row treats alpha. KeepBase is filter blending: the layer's
+ * alpha is ignored and the base keeps its own. SourceOver composites the
+ * layer like QPainter, with the blend mode applied where both are opaque.
+ */
+enum class BlendAlpha {
+    KeepBase,
+    SourceOver
+};
+
+template <typename V, template <typename> class Op, BlendAlpha Alpha>
+void blendRow(QRgb *dst, const QRgb *base, const QRgb *layer, int count, int opacity) {
+    using I = typename V::I;
+    const I full = V::set1(255);
+    const I keep = V::set1(256 - opacity);
+    const I take = V::set1(opacity);
+
+    int x = 0;
+    for (; x + V::Lanes <= count; x += V::Lanes) {
+        const Channels<V> b = unpack<V>(V::load(base + x));
+        const Channels<V> l = unpack<V>(V::load(layer + x));
+
+        if (Alpha == BlendAlpha::KeepBase) {
+            auto mix = [&](I bc, I lc) {
+                const I blended = clampByte<V>(Op<V>::apply(bc, lc));
+                return V::template sra<8>(V::add(V::mul(blended, take), V::mul(bc, keep)));
+            };
+            V::store(dst + x, pack<V>(b.alpha, mix(b.r, l.r), mix(b.g, l.g), mix(b.b, l.b)));
+        } else {
+            // Coverage weights in 255^2 units: layer only, base only, both
+            const I sa = V::template sra<8>(V::mul(V::template srl<24>(l.alpha), take));
+            const I ba = V::template srl<24>(b.alpha);
+            const I both = V::mul(sa, ba);
+            const I layerOnly = V::mul(sa, V::sub(full, ba));
+            const I baseOnly = V::mul(ba, V::sub(full, sa));
+            const I area = V::add(V::add(layerOnly, baseOnly), both);  // 255 * result alpha
+            const I den = V::max(area, V::set1(1));
+            const I half = V::template srl<1>(area);
+
+            auto mix = [&](I bc, I lc) {
+                const I blended = clampByte<V>(Op<V>::apply(bc, lc));
+                const I sum = V::add(V::add(V::mul(layerOnly, lc), V::mul(baseOnly, bc)), V::mul(both, blended));
+                return divide<V>(V::add(sum, half), den);
+            };
+            const I alpha = V::template sll<24>(divideBy255<V>(V::add(area, V::set1(127))));
+            V::store(dst + x, pack<V>(alpha, mix(b.r, l.r), mix(b.g, l.g), mix(b.b, l.b)));
+        }
+    }
+    if (V::Lanes > 1 && x < count) {
+        blendRow<ScalarLanes, Op, Alpha>(dst + x, base + x, layer + x, count - x, opacity);
+    }
+}
+
+template <typename V, template <typename> class Op>
+void setBlendMode(SimdKernelTable &table, BlendMode mode) {
+    table.blend[int(mode)] = &blendRow<V, Op, BlendAlpha::KeepBase>;
+    table.composite[int(mode)] = &blendRow<V, Op, BlendAlpha::SourceOver>;
+}
+
+// ============================================================================
+// Palette Search
+// ============================================================================
+
+template <typename V>
+void nearestRow(quint32 *indices, const QRgb *row, int count, const PaletteParams &params) {
+    using I = typename V::I;
+    using M = typename V::M;
+
+    int x = 0;
+    for (; x + V::Lanes <= count; x += V::Lanes) {
+        const Channels<V> c = unpack<V>(V::load(row + x));
+        I best = V::set1(0);
+        I bestDistance = V::set1(INT32_MAX);
+        for (int i = 0; i < params.size; ++i) {
+            const QRgb entry = params.colors[i];
+            const I dr = V::sub(c.r, V::set1(int((entry >> 16) & 0xff)));
+            const I dg = V::sub(c.g, V::set1(int((entry >> 8) & 0xff)));
+            const I db = V::sub(c.b, V::set1(int(entry & 0xff)));
+            const I distance = V::add(V::add(V::mul(dr, dr), V::mul(dg, dg)), V::mul(db, db));
+            const M closer = V::lessThan(distance, bestDistance);
+            bestDistance = V::select(closer, distance, bestDistance);
+            best = V::select(closer, V::set1(i), best);
+        }
+        V::store(indices + x, best);
+    }
+    if (V::Lanes > 1 && x < count) nearestRow<ScalarLanes>(indices + x, row + x, count - x, params);
+}
+
+// ============================================================================
+// Downsampling
+// ============================================================================
+
+template <typename V>
+void reduceRow(QRgb *dst, const QRgb *top, const QRgb *bottom, int count) {
+    using I = typename V::I;
+    // Lane i reads source columns 2i and 2i + 1. The lanes traits have no
+    // shuffles, so the pairs are gathered.
+    static const QRgb evenColumns[16] = {0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30};
+    const int32_t *topWords = reinterpret_cast<const int32_t *>(top);
+    const int32_t *bottomWords = reinterpret_cast<const int32_t *>(bottom);
+    const I lanes = V::load(evenColumns);
+    const I fields = V::set1(0xff00ff);
+    const I rounding = V::set1(0x20002);
+
+    int x = 0;
+    for (; x + V::Lanes <= count; x += V::Lanes) {
+        const I left = V::add(lanes, V::set1(2 * x));
+        const I right = V::add(left, V::set1(1));
+        const I p0 = V::gather(topWords, left);
+        const I p1 = V::gather(topWords, right);
+        const I p2 = V::gather(bottomWords, left);
+        const I p3 = V::gather(bottomWords, right);
+
+        // Four bytes sum to at most 1020, so red/blue and alpha/green add up
+        // side by side in the 16-bit halves without carrying into each other
+        auto average = [&](I a, I b, I c, I d) {
+            const I sum = V::add(V::add(V::bitAnd(a, fields), V::bitAnd(b, fields)),
+                                 V::add(V::bitAnd(c, fields), V::bitAnd(d, fields)));
+            return V::bitAnd(V::template srl<2>(V::add(sum, rounding)), fields);
+        };
+        const I rb = average(p0, p1, p2, p3);
+        const I ag = average(V::template srl<8>(p0), V::template srl<8>(p1),
+                             V::template srl<8>(p2), V::template srl<8>(p3));
+        V::store(dst + x, V::bitOr(rb, V::template sll<8>(ag)));
+    }
+    if (V::Lanes > 1 && x < count) reduceRow<ScalarLanes>(dst + x, top + 2 * x, bottom + 2 * x, count - x);
+}
+
+// ============================================================================
+// Resampling
+// ============================================================================
+
+template <typename V>
+struct Sums {
+    typename V::I r, g, b, a;
+};
+
+template <typename V>
+inline void accumulate(Sums<V> &sums, typename V::I px, typename V::I weight) {
+    const typename V::I byteMask = V::set1(0xff);
+    sums.r = V::add(sums.r, V::mul(V::bitAnd(V::template srl<16>(px), byteMask), weight));
+    sums.g = V::add(sums.g, V::mul(V::bitAnd(V::template srl<8>(px), byteMask), weight));
+    sums.b = V::add(sums.b, V::mul(V::bitAnd(px, byteMask), weight));
+    sums.a = V::add(sums.a, V::mul(V::template srl<24>(px), weight));
+}
+
+// Rounds sums with Shift fraction bits back to a pixel. Filters with
+// negative lobes overshoot, premultiplied colors are also kept under alpha.
+template <typename V, int Shift>
+inline typename V::I resolve(const Sums<V> &sums, bool premultiplied) {
+    using I = typename V::I;
+    const I half = V::set1(1 << (Shift - 1));
+    const I a = clampByte<V>(V::template sra<Shift>(V::add(sums.a, half)));
+    const I limit = premultiplied ? a : V::set1(255);
+    const I r = V::min(clampByte<V>(V::template sra<Shift>(V::add(sums.r, half))), limit);
+    const I g = V::min(clampByte<V>(V::template sra<Shift>(V::add(sums.g, half))), limit);
+    const I b = V::min(clampByte<V>(V::template sra<Shift>(V::add(sums.b, half))), limit);
+    return pack<V>(V::template sll<24>(a), r, g, b);
+}
+
+template <typename V>
+void resampleRowSpan(QRgb *dst, const QRgb *src, int begin, int end, const ResampleTaps &taps) {
+    using I = typename V::I;
+    const int32_t *words = reinterpret_cast<const int32_t *>(src);
+
+    int x = begin;
+    for (; x + V::Lanes <= end; x += V::Lanes) {
+        const I first = V::load(reinterpret_cast<const QRgb *>(taps.first + x));
+        Sums<V> sums = {V::set1(0), V::set1(0), V::set1(0), V::set1(0)};
+        for (int k = 0; k < taps.taps; ++k) {
+            const I px = V::gather(words, V::add(first, V::set1(k)));
+            const I weight = V::load(reinterpret_cast<const QRgb *>(taps.weights + k * taps.stride + x));
+            accumulate<V>(sums, px, weight);
+        }
+        V::store(dst + x, resolve<V, 14>(sums, taps.premultiplied));
+    }
+    if (V::Lanes > 1 && x < end) resampleRowSpan<ScalarLanes>(dst, src, x, end, taps);
+}
+
+template <typename V>
+void resampleRow(QRgb *dst, const QRgb *src, int count, const ResampleTaps &taps) {
+    resampleRowSpan<V>(dst, src, 0, count, taps);
+}
+
+template <typename V>
+void resampleColumnSpan(QRgb *dst, const QRgb *const *rows, int begin, int end,
+                        const ResampleTaps &taps, int index) {
+    int x = begin;
+    for (; x + V::Lanes <= end; x += V::Lanes) {
+        Sums<V> sums = {V::set1(0), V::set1(0), V::set1(0), V::set1(0)};
+        for (int k = 0; k < taps.taps; ++k) {
+            accumulate<V>(sums, V::load(rows[k] + x), V::set1(taps.weights[k * taps.stride + index]));
+        }
+        V::store(dst + x, resolve<V, 14>(sums, taps.premultiplied));
+    }
+    if (V::Lanes > 1 && x < end) resampleColumnSpan<ScalarLanes>(dst, rows, x, end, taps, index);
+}
+
+template <typename V>
+void resampleColumn(QRgb *dst, const QRgb *const *rows, int count, const ResampleTaps &taps, int index) {
+    resampleColumnSpan<V>(dst, rows, 0, count, taps, index);
+}
+
+template <typename V>
+void warpRow(QRgb *dst, int count, const WarpParams &params) {
+    using I = typename V::I;
+    using M = typename V::M;
+    static const QRgb laneIndex[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+    const int32_t *words = reinterpret_cast<const int32_t *>(params.pixels);
+    const I lanes = V::load(laneIndex);
+    const I zero = V::set1(0);
+    const I fraction = V::set1(0xff);
+    const I lastColumn = V::set1(params.width - 1);
+    const I lastRow = V::set1(params.height - 1);
+    const I stride = V::set1(params.stride);
+    // Taps start one pixel before the sample for bicubic, on it for bilinear
+    const I back = V::set1(params.taps / 2 - 1);
+
+    int i = 0;
+    for (; i + V::Lanes <= count; i += V::Lanes) {
+        const I sx = V::add(V::set1(params.x + i * params.dx), V::mul(lanes, V::set1(params.dx)));
+        const I sy = V::add(V::set1(params.y + i * params.dy), V::mul(lanes, V::set1(params.dy)));
+        const I left = V::sub(V::template sra<16>(sx), back);
+        const I top = V::sub(V::template sra<16>(sy), back);
+        const I fx = V::bitAnd(V::template srl<8>(sx), fraction);
+        const I fy = V::bitAnd(V::template srl<8>(sy), fraction);
+
+        Sums<V> sums = {zero, zero, zero, zero};
+        for (int ty = 0; ty < params.taps; ++ty) {
+            const I row = V::add(top, V::set1(ty));
+            const M rowOutside = V::maskOr(V::lessThan(row, zero), V::lessThan(lastRow, row));
+            const I rowStart = V::mul(V::min(V::max(row, zero), lastRow), stride);
+
+            Sums<V> line = {zero, zero, zero, zero};
+            for (int tx = 0; tx < params.taps; ++tx) {
+                const I column = V::add(left, V::set1(tx));
+                const M outside = V::maskOr(rowOutside,
+                                            V::maskOr(V::lessThan(column, zero), V::lessThan(lastColumn, column)));
+                const I index = V::add(rowStart, V::min(V::max(column, zero), lastColumn));
+                const I px = V::select(outside, zero, V::gather(words, index));
+                accumulate<V>(line, px, V::gather(params.weights + tx * 256, fx));
+            }
+
+            const I weight = V::gather(params.weights + ty * 256, fy);
+            sums.r = V::add(sums.r, V::mul(line.r, weight));
+            sums.g = V::add(sums.g, V::mul(line.g, weight));
+            sums.b = V::add(sums.b, V::mul(line.b, weight));
+            sums.a = V::add(sums.a, V::mul(line.a, weight));
+        }
+        V::store(dst + i, resolve<V, 16>(sums, true));
+    }
+    if (V::Lanes > 1 && i < count) {
+        WarpParams tail = params;
+        tail.x += i * params.dx;
+        tail.y += i * params.dy;
+        warpRow<ScalarLanes>(dst + i, count - i, tail);
+    }
+}
+
+// ============================================================================
+// Spatial Fields
+// ============================================================================
+
+template <typename V>
+void radialGainRow(QRgb *row, int count, const RadialGainParams &params) {
+    using I = typename V::I;
+    using F = typename V::F;
+    const F rowDistance = V::fset1(params.row);
+    const F scale = V::fset1(params.scale);
+    const I last = V::set1(params.size - 1);
+    const I white = V::set1(255);
+
+    int x = 0;
+    for (; x + V::Lanes <= count; x += V::Lanes) {
+        const F distance = V::fadd(V::toFloat(V::load(reinterpret_cast<const QRgb *>(params.columns + x))), rowDistance);
+        const I gain = V::gather(params.gains, V::min(V::truncate(V::fmul(distance, scale)), last));
+        const Channels<V> c = unpack<V>(V::load(row + x));
+        const I r = V::min(V::template srl<16>(V::mul(c.r, gain)), white);
+        const I g = V::min(V::template srl<16>(V::mul(c.g, gain)), white);
+        const I b = V::min(V::template srl<16>(V::mul(c.b, gain)), white);
+        V::store(row + x, pack<V>(c.alpha, r, g, b));
+    }
+    if (V::Lanes > 1 && x < count) {
+        RadialGainParams tail = params;
+        tail.columns += x;
+        radialGainRow<ScalarLanes>(row + x, count - x, tail);
+    }
+}
+
+inline int clampIndex(int value, int last) {
+    return value < 0 ? 0 : (value > last ? last : value);
+}
+
+template <typename V>
+void pathBlurSpan(QRgb *dst, int begin, int end, const PathParams &params) {
+    using I = typename V::I;
+    static const QRgb laneIndex[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+    const int32_t *words = reinterpret_cast<const int32_t *>(params.pixels);
+    const I lanes = V::load(laneIndex);
+    const I zero = V::set1(0);
+    const I fraction = V::set1(0xff);
+    const I full = V::set1(256);
+    const I lastColumn = V::set1(params.width - 1);
+    // Every tap adds a pixel with 8 fraction bits
+    const typename V::F scale = V::fset1(1.0f / (256.0f * params.taps));
+    const typename V::F half = V::fset1(0.5f);
+
+    int i = begin;
+    for (; i + V::Lanes <= end; i += V::Lanes) {
+        Sums<V> sums = {zero, zero, zero, zero};
+        for (int k = 0; k < params.taps; ++k) {
+            const int top = params.y[k] >> 16;
+            const I topRow = V::set1(clampIndex(top, params.height - 1) * params.stride);
+            const I bottomRow = V::set1(clampIndex(top + 1, params.height - 1) * params.stride);
+            const I fy = V::set1((params.y[k] >> 8) & 0xff);
+            const I gy = V::sub(full, fy);
+
+            const I sx = V::add(V::set1(params.x[k] + i * params.dx[k]), V::mul(lanes, V::set1(params.dx[k])));
+            const I column = V::template sra<16>(sx);
+            const I left = V::min(V::max(column, zero), lastColumn);
+            const I right = V::min(V::max(V::add(column, V::set1(1)), zero), lastColumn);
+            const I fx = V::bitAnd(V::template srl<8>(sx), fraction);
+            const I gx = V::sub(full, fx);
+
+            Sums<V> upper = {zero, zero, zero, zero};
+            Sums<V> lower = {zero, zero, zero, zero};
+            accumulate<V>(upper, V::gather(words, V::add(topRow, left)), gx);
+            accumulate<V>(upper, V::gather(words, V::add(topRow, right)), fx);
+            accumulate<V>(lower, V::gather(words, V::add(bottomRow, left)), gx);
+            accumulate<V>(lower, V::gather(words, V::add(bottomRow, right)), fx);
+
+            auto blend = [&](I a, I b) { return V::template srl<8>(V::add(V::mul(a, gy), V::mul(b, fy))); };
+            sums.r = V::add(sums.r, blend(upper.r, lower.r));
+            sums.g = V::add(sums.g, blend(upper.g, lower.g));
+            sums.b = V::add(sums.b, blend(upper.b, lower.b));
+            sums.a = V::add(sums.a, blend(upper.a, lower.a));
+        }
+
+        auto average = [&](I sum) { return V::truncate(V::fadd(V::fmul(V::toFloat(sum), scale), half)); };
+        V::store(dst + i, pack<V>(V::template sll<24>(average(sums.a)), average(sums.r),
+                                  average(sums.g), average(sums.b)));
+    }
+    if (V::Lanes > 1 && i < end) pathBlurSpan<ScalarLanes>(dst, i, end, params);
+}
+
+template <typename V>
+void pathBlurRow(QRgb *dst, int count, const PathParams &params) {
+    pathBlurSpan<V>(dst, 0, count, params);
+}
+
+template <typename V>
+void grainRow(QRgb *row, const qint32 *noise, int count, int strength) {
+    using I = typename V::I;
+    const I k = V::set1(strength);
+
+    int x = 0;
+    for (; x + V::Lanes <= count; x += V::Lanes) {
+        const I n = V::template sra<8>(V::mul(V::load(reinterpret_cast<const QRgb *>(noise + x)), k));
+        const Channels<V> c = unpack<V>(V::load(row + x));
+        V::store(row + x, pack<V>(c.alpha, clampByte<V>(V::add(c.r, n)), clampByte<V>(V::add(c.g, n)),
+                                  clampByte<V>(V::add(c.b, n))));
+    }
+    if (V::Lanes > 1 && x < count) grainRow<ScalarLanes>(row + x, noise + x, count - x, strength);
+}
+
+// Four vectors at a time, so the sums do not wait on each other
+template <typename V>
+void weightedSumRow(float *dst, const float *const *rows, const float *weights, int taps, int count) {
+    using F = typename V::F;
+    constexpr int Block = 4 * V::Lanes;
+
+    int x = 0;
+    for (; x + Block <= count; x += Block) {
+        F sum[4] = {V::fset1(0.0f), V::fset1(0.0f), V::fset1(0.0f), V::fset1(0.0f)};
+        for (int k = 0; k < taps; ++k) {
+            const F w = V::fset1(weights[k]);
+            for (int j = 0; j < 4; ++j) sum[j] = V::fadd(sum[j], V::fmul(V::fload(rows[k] + x + j * V::Lanes), w));
+        }
+        for (int j = 0; j < 4; ++j) V::fstore(dst + x + j * V::Lanes, sum[j]);
+    }
+    for (; x < count; ++x) {
+        float sum = 0.0f;
+        for (int k = 0; k < taps; ++k) sum += rows[k][x] * weights[k];
+        dst[x] = sum;
+    }
+}
+
+// ============================================================================
+// Table
+// ============================================================================
+
+template <typename V>
+SimdKernelTable makeKernelTable() {
+    SimdKernelTable table;
+    table.affine = &affineRow<V>;
+    table.saturate = &saturateRow<V>;
+    table.vibrance = &vibranceRow<V>;
+    table.hueShift = &hueShiftRow<V>;
+    table.cube = &cubeRow<V>;
+    setBlendMode<V, BlendNormalOp>(table, BlendMode::Normal);
+    setBlendMode<V, BlendMultiplyOp>(table, BlendMode::Multiply);
+    setBlendMode<V, BlendScreenOp>(table, BlendMode::Screen);
+    setBlendMode<V, BlendOverlayOp>(table, BlendMode::Overlay);
+    setBlendMode<V, BlendSoftLightOp>(table, BlendMode::SoftLight);
+    setBlendMode<V, BlendHardLightOp>(table, BlendMode::HardLight);
+    setBlendMode<V, BlendColorDodgeOp>(table, BlendMode::ColorDodge);
+    setBlendMode<V, BlendColorBurnOp>(table, BlendMode::ColorBurn);
+    setBlendMode<V, BlendDarkenOp>(table, BlendMode::Darken);
+    setBlendMode<V, BlendLightenOp>(table, BlendMode::Lighten);
+    setBlendMode<V, BlendDifferenceOp>(table, BlendMode::Difference);
+    setBlendMode<V, BlendExclusionOp>(table, BlendMode::Exclusion);
+    table.nearest = &nearestRow<V>;
+    table.reduce = &reduceRow<V>;
+    table.resampleRow = &resampleRow<V>;
+    table.resampleColumn = &resampleColumn<V>;
+    table.warp = &warpRow<V>;
+    table.radialGain = &radialGainRow<V>;
+    table.pathBlur = &pathBlurRow<V>;
+    table.grain = &grainRow<V>;
+    table.weightedSum = &weightedSumRow<V>;
+    return table;
+}
+
+} // namespace
+} // namespace Utils
+} // namespace Knoux
+
+#endif // SIMDKERNELSIMPL_H
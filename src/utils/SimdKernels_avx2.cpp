@@ -0,0 +1,60 @@
+// Built with AVX2 code generation (see CMakeLists.txt). Only reached through
+// SimdKernels::table() after CPUID reported AVX2 support.
+
+#include "SimdKernelsImpl.h"
+
+#include <immintrin.h>
+
+namespace Knoux {
+namespace Utils {
+
+namespace {
+
+struct Avx2Lanes {
+    static constexpr int Lanes = 8;
+    using I = __m256i;
+    using F = __m256;
+    using M = __m256i;
+
+    static I load(const QRgb *p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)); }
+    static void store(QRgb *p, I v) { _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), v); }
+    static I set1(int v) { return _mm256_set1_epi32(v); }
+    static I gather(const int32_t *base, I index) { return _mm256_i32gather_epi32(reinterpret_cast<const int *>(base), index, 4); }
+
+    static I add(I a, I b) { return _mm256_add_epi32(a, b); }
+    static I sub(I a, I b) { return _mm256_sub_epi32(a, b); }
+    static I mul(I a, I b) { return _mm256_mullo_epi32(a, b); }
+    template <int N> static I sra(I a) { return _mm256_srai_epi32(a, N); }
+    template <int N> static I srl(I a) { return _mm256_srli_epi32(a, N); }
+    template <int N> static I sll(I a) { return _mm256_slli_epi32(a, N); }
+    static I bitAnd(I a, I b) { return _mm256_and_si256(a, b); }
+    static I bitOr(I a, I b) { return _mm256_or_si256(a, b); }
+    static I min(I a, I b) { return _mm256_min_epi32(a, b); }
+    static I max(I a, I b) { return _mm256_max_epi32(a, b); }
+
+    static M lessThan(I a, I b) { return _mm256_cmpgt_epi32(b, a); }
+    static M equal(I a, I b) { return _mm256_cmpeq_epi32(a, b); }
+    static M maskOr(M a, M b) { return _mm256_or_si256(a, b); }
+    static I select(M m, I a, I b) { return _mm256_blendv_epi8(b, a, m); }
+
+    static F toFloat(I a) { return _mm256_cvtepi32_ps(a); }
+    static I truncate(F a) { return _mm256_cvttps_epi32(a); }
+    static F fset1(float v) { return _mm256_set1_ps(v); }
+    static F fload(const float *p) { return _mm256_loadu_ps(p); }
+    static void fstore(float *p, F v) { _mm256_storeu_ps(p, v); }
+    static F fadd(F a, F b) { return _mm256_add_ps(a, b); }
+    static F fsub(F a, F b) { return _mm256_sub_ps(a, b); }
+    static F fmul(F a, F b) { return _mm256_mul_ps(a, b); }
+    static F fdiv(F a, F b) { return _mm256_div_ps(a, b); }
+    static F fsqrt(F a) { return _mm256_sqrt_ps(a); }
+};
+
+} // namespace
+
+const SimdKernelTable &avx2Kernels() {
+    static const SimdKernelTable table = makeKernelTable<Avx2Lanes>();
+    return table;
+}
+
+} // namespace Utils
+} // namespace Knoux
@@ -0,0 +1,60 @@
+// Built with AVX-512F code generation (see CMakeLists.txt). Only reached
+// through SimdKernels::table() after CPUID reported AVX-512F support.
+
+#include "SimdKernelsImpl.h"
+
+#include <immintrin.h>
+
+namespace Knoux {
+namespace Utils {
+
+namespace {
+
+struct Avx512Lanes {
+    static constexpr int Lanes = 16;
+    using I = __m512i;
+    using F = __m512;
+    using M = __mmask16;
+
+    static I load(const QRgb *p) { return _mm512_loadu_si512(p); }
+    static void store(QRgb *p, I v) { _mm512_storeu_si512(p, v); }
+    static I set1(int v) { return _mm512_set1_epi32(v); }
+    static I gather(const int32_t *base, I index) { return _mm512_i32gather_epi32(index, base, 4); }
+
+    static I add(I a, I b) { return _mm512_add_epi32(a, b); }
+    static I sub(I a, I b) { return _mm512_sub_epi32(a, b); }
+    static I mul(I a, I b) { return _mm512_mullo_epi32(a, b); }
+    template <int N> static I sra(I a) { return _mm512_srai_epi32(a, N); }
+    template <int N> static I srl(I a) { return _mm512_srli_epi32(a, N); }
+    template <int N> static I sll(I a) { return _mm512_slli_epi32(a, N); }
+    static I bitAnd(I a, I b) { return _mm512_and_si512(a, b); }
+    static I bitOr(I a, I b) { return _mm512_or_si512(a, b); }
+    static I min(I a, I b) { return _mm512_min_epi32(a, b); }
+    static I max(I a, I b) { return _mm512_max_epi32(a, b); }
+
+    static M lessThan(I a, I b) { return _mm512_cmplt_epi32_mask(a, b); }
+    static M equal(I a, I b) { return _mm512_cmpeq_epi32_mask(a, b); }
+    static M maskOr(M a, M b) { return static_cast<M>(a | b); }
+    static I select(M m, I a, I b) { return _mm512_mask_blend_epi32(m, b, a); }
+
+    static F toFloat(I a) { return _mm512_cvtepi32_ps(a); }
+    static I truncate(F a) { return _mm512_cvttps_epi32(a); }
+    static F fset1(float v) { return _mm512_set1_ps(v); }
+    static F fload(const float *p) { return _mm512_loadu_ps(p); }
+    static void fstore(float *p, F v) { _mm512_storeu_ps(p, v); }
+    static F fadd(F a, F b) { return _mm512_add_ps(a, b); }
+    static F fsub(F a, F b) { return _mm512_sub_ps(a, b); }
+    static F fmul(F a, F b) { return _mm512_mul_ps(a, b); }
+    static F fdiv(F a, F b) { return _mm512_div_ps(a, b); }
+    static F fsqrt(F a) { return _mm512_sqrt_ps(a); }
+};
+
+} // namespace
+
+const SimdKernelTable &avx512Kernels() {
+    static const SimdKernelTable table = makeKernelTable<Avx512Lanes>();
+    return table;
+}
+
+} // namespace Utils
+} // namespace Knoux
@@ -0,0 +1,65 @@
+// AArch64 Advanced SIMD kernels. NEON is part of the AArch64 baseline, so no
+// extra code generation flags are needed for this translation unit.
+
+#include "SimdKernelsImpl.h"
+
+#include <arm_neon.h>
+
+namespace Knoux {
+namespace Utils {
+
+namespace {
+
+struct NeonLanes {
+    static constexpr int Lanes = 4;
+    using I = int32x4_t;
+    using F = float32x4_t;
+    using M = uint32x4_t;
+
+    static I load(const QRgb *p) { return vld1q_s32(reinterpret_cast<const int32_t *>(p)); }
+    static void store(QRgb *p, I v) { vst1q_s32(reinterpret_cast<int32_t *>(p), v); }
+    static I set1(int v) { return vdupq_n_s32(v); }
+    static I gather(const int32_t *base, I index) {
+        I v = vdupq_n_s32(base[vgetq_lane_s32(index, 0)]);
+        v = vsetq_lane_s32(base[vgetq_lane_s32(index, 1)], v, 1);
+        v = vsetq_lane_s32(base[vgetq_lane_s32(index, 2)], v, 2);
+        return vsetq_lane_s32(base[vgetq_lane_s32(index, 3)], v, 3);
+    }
+
+    static I add(I a, I b) { return vaddq_s32(a, b); }
+    static I sub(I a, I b) { return vsubq_s32(a, b); }
+    static I mul(I a, I b) { return vmulq_s32(a, b); }
+    template <int N> static I sra(I a) { return vshrq_n_s32(a, N); }
+    template <int N> static I srl(I a) { return vreinterpretq_s32_u32(vshrq_n_u32(vreinterpretq_u32_s32(a), N)); }
+    template <int N> static I sll(I a) { return vshlq_n_s32(a, N); }
+    static I bitAnd(I a, I b) { return vandq_s32(a, b); }
+    static I bitOr(I a, I b) { return vorrq_s32(a, b); }
+    static I min(I a, I b) { return vminq_s32(a, b); }
+    static I max(I a, I b) { return vmaxq_s32(a, b); }
+
+    static M lessThan(I a, I b) { return vcltq_s32(a, b); }
+    static M equal(I a, I b) { return vceqq_s32(a, b); }
+    static M maskOr(M a, M b) { return vorrq_u32(a, b); }
+    static I select(M m, I a, I b) { return vbslq_s32(m, a, b); }
+
+    static F toFloat(I a) { return vcvtq_f32_s32(a); }
+    static I truncate(F a) { return vcvtq_s32_f32(a); }
+    static F fset1(float v) { return vdupq_n_f32(v); }
+    static F fload(const float *p) { return vld1q_f32(p); }
+    static void fstore(float *p, F v) { vst1q_f32(p, v); }
+    static F fadd(F a, F b) { return vaddq_f32(a, b); }
+    static F fsub(F a, F b) { return vsubq_f32(a, b); }
+    static F fmul(F a, F b) { return vmulq_f32(a, b); }
+    static F fdiv(F a, F b) { return vdivq_f32(a, b); }
+    static F fsqrt(F a) { return vsqrtq_f32(a); }
+};
+
+} // namespace
+
+const SimdKernelTable &neonKernels() {
+    static const SimdKernelTable table = makeKernelTable<NeonLanes>();
+    return table;
+}
+
+} // namespace Utils
+} // namespace Knoux
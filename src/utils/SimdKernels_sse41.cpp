@@ -0,0 +1,63 @@
+// Built with SSE4.1 code generation (see CMakeLists.txt). Only reached through
+// SimdKernels::table() after CPUID reported SSE4.1 support.
+
+#include "SimdKernelsImpl.h"
+
+#include <smmintrin.h>
+
+namespace Knoux {
+namespace Utils {
+
+namespace {
+
+struct Sse41Lanes {
+    static constexpr int Lanes = 4;
+    using I = __m128i;
+    using F = __m128;
+    using M = __m128i;
+
+    static I load(const QRgb *p) { return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)); }
+    static void store(QRgb *p, I v) { _mm_storeu_si128(reinterpret_cast<__m128i *>(p), v); }
+    static I set1(int v) { return _mm_set1_epi32(v); }
+    static I gather(const int32_t *base, I index) {
+        return _mm_setr_epi32(base[_mm_cvtsi128_si32(index)], base[_mm_extract_epi32(index, 1)],
+                              base[_mm_extract_epi32(index, 2)], base[_mm_extract_epi32(index, 3)]);
+    }
+
+    static I add(I a, I b) { return _mm_add_epi32(a, b); }
+    static I sub(I a, I b) { return _mm_sub_epi32(a, b); }
+    static I mul(I a, I b) { return _mm_mullo_epi32(a, b); }
+    template <int N> static I sra(I a) { return _mm_srai_epi32(a, N); }
+    template <int N> static I srl(I a) { return _mm_srli_epi32(a, N); }
+    template <int N> static I sll(I a) { return _mm_slli_epi32(a, N); }
+    static I bitAnd(I a, I b) { return _mm_and_si128(a, b); }
+    static I bitOr(I a, I b) { return _mm_or_si128(a, b); }
+    static I min(I a, I b) { return _mm_min_epi32(a, b); }
+    static I max(I a, I b) { return _mm_max_epi32(a, b); }
+
+    static M lessThan(I a, I b) { return _mm_cmplt_epi32(a, b); }
+    static M equal(I a, I b) { return _mm_cmpeq_epi32(a, b); }
+    static M maskOr(M a, M b) { return _mm_or_si128(a, b); }
+    static I select(M m, I a, I b) { return _mm_blendv_epi8(b, a, m); }
+
+    static F toFloat(I a) { return _mm_cvtepi32_ps(a); }
+    static I truncate(F a) { return _mm_cvttps_epi32(a); }
+    static F fset1(float v) { return _mm_set1_ps(v); }
+    static F fload(const float *p) { return _mm_loadu_ps(p); }
+    static void fstore(float *p, F v) { _mm_storeu_ps(p, v); }
+    static F fadd(F a, F b) { return _mm_add_ps(a, b); }
+    static F fsub(F a, F b) { return _mm_sub_ps(a, b); }
+    static F fmul(F a, F b) { return _mm_mul_ps(a, b); }
+    static F fdiv(F a, F b) { return _mm_div_ps(a, b); }
+    static F fsqrt(F a) { return _mm_sqrt_ps(a); }
+};
+
+} // namespace
+
+const SimdKernelTable &sse41Kernels() {
+    static const SimdKernelTable table = makeKernelTable<Sse41Lanes>();
+    return table;
+}
+
+} // namespace Utils
+} // namespace Knoux
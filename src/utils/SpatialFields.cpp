@@ -0,0 +1,236 @@
+#include "SpatialFields.h"
+
+#include <QMutex>
+#include <QtMath>
+#include <cmath>
+#include <tuple>
+
+namespace Knoux {
+namespace Utils {
+
+namespace {
+
+// Fields of each kind kept for reuse
+constexpr int CachedFields = 4;
+// Vignette gain entries, fine enough for one level of error next to the center
+constexpr int GainSteps = 1 << 16;
+// Brightening vignettes stop at this gain
+constexpr float MaxGain = 4.0f;
+
+template <typename Key, typename Field>
+class FieldCache {
+public:
+    template <typename Build>
+    QSharedPointer<const Field> find(const Key &key, Build build) {
+        QMutexLocker lock(&m_mutex);
+        for (int i = 0; i < m_entries.size(); ++i) {
+            if (m_entries[i].key == key) {
+                m_entries.move(i, 0);
+                return m_entries[0].field;
+            }
+        }
+
+        const QSharedPointer<const Field> field(new Field(build()));
+        m_entries.prepend({key, field});
+        if (m_entries.size() > CachedFields) m_entries.removeLast();
+        return field;
+    }
+
+private:
+    struct Entry {
+        Key key;
+        QSharedPointer<const Field> field;
+    };
+
+    QMutex m_mutex;
+    QVector<Entry> m_entries;  // Most recently used first
+};
+
+using VignetteKey = std::tuple<int, int, float, float>;
+using MotionKey = std::tuple<float, float>;
+using RadialKey = std::tuple<double, double, float>;
+using GrainKey = std::tuple<float, float, quint32>;
+
+FieldCache<VignetteKey, SpatialFields::Vignette> vignetteCache;
+FieldCache<MotionKey, SpatialFields::Path> motionCache;
+FieldCache<RadialKey, SpatialFields::Path> radialCache;
+FieldCache<GrainKey, SpatialFields::Grain> grainCache;
+
+qint32 toFixed16(double value) {
+    return qint32(std::lround(value * 65536));
+}
+
+// SplitMix64 finalizer, a counter-based generator: any value is one call
+// away from its key, no state carried from the previous one
+quint64 splitMix(quint64 x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+// Wrapping Gaussian along rows (step 1) or columns (step Side) of a grain
+// texture, so the smoothed texture still tiles
+QVector<double> blurTile(const QVector<double> &source, const QVector<double> &kernel, int step) {
+    const int side = SpatialFields::Grain::Side;
+    const int radius = kernel.size() / 2;
+    QVector<double> result(source.size(), 0.0);
+    for (int i = 0; i < source.size(); ++i) {
+        const int along = step == 1 ? i % side : i / side;
+        const int base = i - along * step;
+        double sum = 0.0;
+        for (int k = -radius; k <= radius; ++k) {
+            sum += kernel[k + radius] * source[base + ((along + k) & (side - 1)) * step];
+        }
+        result[i] = sum;
+    }
+    return result;
+}
+
+} // namespace
+
+RadialGainParams SpatialFields::Vignette::params(int y) const {
+    return {columns.constData(), rows[y], scale, gains.constData(), int(gains.size())};
+}
+
+void SpatialFields::Path::rows(int y, qint32 *out) const {
+    // Far outside rows clamp to the edge all the same, keep them in range
+    const qint64 limit = qint64(1) << 30;
+    for (int k = 0; k < taps(); ++k) {
+        out[k] = qint32(qBound(-limit, qint64(y) * yScale[k] + yOffset[k], limit));
+    }
+}
+
+QPoint SpatialFields::Grain::offset(int blockX, int blockY) const {
+    const quint64 hash = splitMix((quint64(seed) << 32) ^ (quint64(quint32(blockY)) << 16) ^ quint32(blockX));
+    return QPoint(int(hash & (Side - 1)), int((hash >> 16) & (Side - 1)));
+}
+
+QSharedPointer<const SpatialFields::Vignette> SpatialFields::vignette(const QSize &size, float amount, float feather) {
+    const VignetteKey key(size.width(), size.height(), amount, feather);
+    return vignetteCache.find(key, [&] {
+        const int width = size.width();
+        const int height = size.height();
+
+        // Distances in half pixels from the center keep every square exact
+        Vignette field;
+        field.columns.resize(width);
+        for (int x = 0; x < width; ++x) field.columns[x] = (2 * x - width) * (2 * x - width);
+        field.rows.resize(height);
+        for (int y = 0; y < height; ++y) field.rows[y] = float(2 * y - height) * float(2 * y - height);
+
+        const double farthest = double(width) * width + double(height) * height;
+        field.scale = float((GainSteps - 1) / qMax(farthest, 1.0));
+
+        // Full strength at the corners, untouched inside the feathered edge
+        const double maxDist = std::sqrt(farthest) / 2;
+        const double innerDist = maxDist * (1 - feather / 100);
+        const double featherDist = qMax(maxDist * feather / 100, 1e-6);
+
+        field.gains.resize(GainSteps);
+        for (int i = 0; i < GainSteps; ++i) {
+            const double dist = std::sqrt(qMin((i + 0.5) / (GainSteps - 1), 1.0)) * maxDist;
+            double gain = 1.0;
+            if (dist > innerDist) {
+                const double t = (dist - innerDist) / featherDist;
+                gain = qBound(0.0, 1.0 - t * amount / 100, double(MaxGain));
+            }
+            field.gains[i] = toFixed16(gain);
+        }
+        return field;
+    });
+}
+
+QSharedPointer<const SpatialFields::Path> SpatialFields::motion(float angle, float distance) {
+    const MotionKey key(angle, distance);
+    return motionCache.find(key, [&] {
+        const float rad = qDegreesToRadians(angle);
+        const int steps = static_cast<int>(distance);
+
+        Path path;
+        for (int i = -steps / 2; i <= steps / 2; ++i) {
+            path.x.append(toFixed16(i * std::cos(rad)));
+            path.dx.append(65536);
+            path.yScale.append(65536);
+            path.yOffset.append(toFixed16(i * std::sin(rad)));
+        }
+        return path;
+    });
+}
+
+QSharedPointer<const SpatialFields::Path> SpatialFields::radial(const QPointF &center, float amount) {
+    const RadialKey key(center.x(), center.y(), amount);
+    return radialCache.find(key, [&] {
+        const int samples = static_cast<int>(amount / 5) + 3;
+
+        // Sample i of a pixel sits at center + (pixel - center) * scale, an
+        // affine walk along each output row
+        Path path;
+        for (int i = 0; i < samples; ++i) {
+            const double scale = 1 - i / double(samples) * amount / 100;
+            path.x.append(toFixed16(center.x() * (1 - scale)));
+            path.dx.append(toFixed16(scale));
+            path.yScale.append(toFixed16(scale));
+            path.yOffset.append(toFixed16(center.y() * (1 - scale)));
+        }
+        return path;
+    });
+}
+
+QSharedPointer<const SpatialFields::Grain> SpatialFields::grain(float size, float roughness, quint32 seed) {
+    const GrainKey key(size, roughness, seed);
+    return grainCache.find(key, [&] {
+        constexpr int Count = Grain::Side * Grain::Side;
+
+        // Sum of four random bytes, close enough to a Gaussian for grain
+        QVector<double> fine(Count);
+        for (int i = 0; i < Count; ++i) {
+            const quint64 bits = splitMix((quint64(seed) << 32) | quint32(i));
+            int sum = 0;
+            for (int k = 0; k < 4; ++k) sum += int((bits >> (8 * k)) & 0xff);
+            fine[i] = sum - 510;
+        }
+
+        // Larger grain is the same noise smoothed; roughness puts part of the
+        // fine noise back on top
+        QVector<double> noise = fine;
+        const double sigma = 0.5 * (qBound(1.0f, size, 16.0f) - 1);
+        if (sigma > 0.0) {
+            const int radius = qCeil(3 * sigma);
+            QVector<double> kernel(2 * radius + 1);
+            double total = 0.0;
+            for (int k = -radius; k <= radius; ++k) {
+                kernel[k + radius] = std::exp(-k * k / (2 * sigma * sigma));
+                total += kernel[k + radius];
+            }
+            for (double &weight : kernel) weight /= total;
+
+            const QVector<double> smooth = blurTile(blurTile(fine, kernel, 1), kernel, Grain::Side);
+            double fineEnergy = 0.0;
+            double smoothEnergy = 0.0;
+            for (int i = 0; i < Count; ++i) {
+                fineEnergy += fine[i] * fine[i];
+                smoothEnergy += smooth[i] * smooth[i];
+            }
+            // Smoothing loses contrast, matched back before mixing
+            const double gain = std::sqrt(fineEnergy / qMax(smoothEnergy, 1e-9));
+            const double mix = qBound(0.0f, roughness, 1.0f);
+            for (int i = 0; i < Count; ++i) noise[i] = smooth[i] * gain * (1 - mix) + fine[i] * mix;
+        }
+
+        // Same spread at every setting, so amount alone sets the strength:
+        // a standard deviation of 74, the one of uniform noise over -128..127
+        double energy = 0.0;
+        for (double value : noise) energy += value * value;
+        const double scale = 74.0 / qMax(std::sqrt(energy / Count), 1e-9);
+
+        Grain field;
+        field.seed = seed;
+        field.values.resize(Count);
+        for (int i = 0; i < Count; ++i) field.values[i] = qBound(-127, qRound(noise[i] * scale), 127);
+        return field;
+    });
+}
+
+} // namespace Utils
+} // namespace Knoux
@@ -0,0 +1,83 @@
+#ifndef SPATIALFIELDS_H
+#define SPATIALFIELDS_H
+
+#include "SimdKernels.h"
+
+#include <QPoint>
+#include <QPointF>
+#include <QSharedPointer>
+#include <QSize>
+#include <QVector>
+
+namespace Knoux {
+namespace Utils {
+
+/**
+ * @brief Position-dependent tables of the spatial effects, cached by key
+ *
+ * Vignette gains and blur sample paths depend only on the image size and
+ * the effect parameters, so they are built once and shared by every later
+ * call with the same key: a slider dragged back and forth, or one effect
+ * over a batch of same-sized images, finds them ready. Fields are immutable
+ * and may be used from any thread; the few most recent of each kind stay.
+ */
+class SpatialFields {
+public:
+    /**
+     * @brief Vignette gain by squared distance from the image center
+     */
+    struct Vignette {
+        QVector<qint32> columns;  // (2x - width)^2
+        QVector<float> rows;      // (2y - height)^2
+        QVector<qint32> gains;    // 0.16 fixed point
+        float scale = 0.0f;       // Squared distance to gains index
+
+        RadialGainParams params(int y) const;
+    };
+
+    /**
+     * @brief Blur taps, each a line through the source per output row
+     *
+     * Tap k of output row y starts at x[k] and steps by dx[k] per pixel, at
+     * source row y * yScale[k] + yOffset[k], all in 16.16.
+     */
+    struct Path {
+        QVector<qint32> x;
+        QVector<qint32> dx;
+        QVector<qint32> yScale;
+        QVector<qint32> yOffset;
+
+        int taps() const { return x.size(); }
+        void rows(int y, qint32 *out) const;
+    };
+
+    /**
+     * @brief Tileable monochrome grain, values around 0 within -127..127
+     *
+     * Every value comes from a counter-based generator keyed by the seed and
+     * its position, so the texture is the same on every run and machine.
+     * Images are covered with Side-sized blocks of it, each block shifted by
+     * its own seeded offset so the repeat does not show.
+     */
+    struct Grain {
+        static constexpr int Side = 256;
+
+        QVector<qint32> values;  // Side x Side, row-major
+        quint32 seed = 0;
+
+        const qint32 *row(int y) const { return values.constData() + (y & (Side - 1)) * Side; }
+        QPoint offset(int blockX, int blockY) const;
+    };
+
+    static QSharedPointer<const Vignette> vignette(const QSize &size, float amount, float feather);
+    // Taps every pixel along a line of distance pixels through each output pixel
+    static QSharedPointer<const Path> motion(float angle, float distance);
+    // Taps from each output pixel toward center, amount percent of the way
+    static QSharedPointer<const Path> radial(const QPointF &center, float amount);
+    static QSharedPointer<const Grain> grain(float size, float roughness, quint32 seed);
+};
+
+} // namespace Utils
+} // namespace Knoux
+
+#endif // SPATIALFIELDS_H
@@ -0,0 +1,118 @@
+#include "SummedAreaTable.h"
+#include "PixelKernels.h"
+
+namespace Knoux {
+namespace Utils {
+
+namespace {
+
+// Table elements per column strip of the accumulation pass
+constexpr int StripElements = 1024;
+
+} // namespace
+
+SummedAreaTable::SummedAreaTable(const QImage &image, Source source, bool withSquares) {
+    if (image.isNull()) return;
+
+    const QImage pixels = source == Source::Gray
+        ? (image.format() == QImage::Format_Grayscale8 ? image : image.convertToFormat(QImage::Format_Grayscale8))
+        : PixelKernels::toWorkingFormat(image);
+
+    m_width = pixels.width();
+    m_height = pixels.height();
+    m_planes = source == Source::Rgb ? 3 : 1;
+
+    const qsizetype rowElements = qsizetype(m_width + 1) * m_planes;
+    m_sums.fill(0, rowElements * (m_height + 1));
+    if (withSquares) m_squares.fill(0, rowElements * (m_height + 1));
+
+    quint32 *sums = m_sums.data();
+    quint64 *squares = withSquares ? m_squares.data() : nullptr;
+    const int width = m_width;
+    const int planes = m_planes;
+
+    // Pass 1: prefix sums along each row, written one table row down
+    ParallelExecutor::forEachBand(m_height, pixels.bytesPerLine(), [&](int begin, int end) {
+        QVector<int> values(width * planes);
+        for (int y = begin; y < end; ++y) {
+            const uchar *line = pixels.constScanLine(y);
+            if (source == Source::Gray) {
+                for (int x = 0; x < width; ++x) values[x] = line[x];
+            } else {
+                const QRgb *row = reinterpret_cast<const QRgb *>(line);
+                for (int x = 0; x < width; ++x) {
+                    const QRgb p = row[x];
+                    if (source == Source::Rgb) {
+                        values[x * 3 + Red] = qRed(p);
+                        values[x * 3 + Green] = qGreen(p);
+                        values[x * 3 + Blue] = qBlue(p);
+                    } else {
+                        values[x] = qRed(p) + qGreen(p) + qBlue(p);
+                    }
+                }
+            }
+
+            const qsizetype offset = (y + 1) * rowElements + planes;
+            for (int p = 0; p < planes; ++p) {
+                quint32 sum = 0;
+                quint64 squared = 0;
+                for (int x = 0; x < width; ++x) {
+                    const int v = values[x * planes + p];
+                    sum += v;
+                    sums[offset + x * planes + p] = sum;
+                    if (squares) {
+                        squared += quint64(v * v);
+                        squares[offset + x * planes + p] = squared;
+                    }
+                }
+            }
+        }
+    });
+
+    // Pass 2: accumulate rows downwards, one strip of columns per band
+    const int strips = int((rowElements + StripElements - 1) / StripElements);
+    const qsizetype stripBytes = qsizetype(StripElements) * m_height * (withSquares ? 12 : 4);
+    ParallelExecutor::forEachBand(strips, stripBytes, [&](int begin, int end) {
+        const qsizetype first = qsizetype(begin) * StripElements;
+        const qsizetype last = qMin(qsizetype(end) * StripElements, rowElements);
+        for (int y = 2; y <= m_height; ++y) {
+            quint32 *row = sums + y * rowElements;
+            const quint32 *above = row - rowElements;
+            for (qsizetype i = first; i < last; ++i) row[i] += above[i];
+            if (squares) {
+                quint64 *squaredRow = squares + y * rowElements;
+                const quint64 *squaredAbove = squaredRow - rowElements;
+                for (qsizetype i = first; i < last; ++i) squaredRow[i] += squaredAbove[i];
+            }
+        }
+    });
+}
+
+float SummedAreaTable::mean(const QRect &rect, int plane) const {
+    const int count = area(rect);
+    return count > 0 ? float(sum(rect, plane)) / count : 0.0f;
+}
+
+float SummedAreaTable::variance(const QRect &rect, int plane) const {
+    const int count = area(rect);
+    if (count == 0) return 0.0f;
+
+    const double m = double(sum(rect, plane)) / count;
+    return float(qMax(0.0, double(squaredSum(rect, plane)) / count - m * m));
+}
+
+QRgb SummedAreaTable::meanColor(const QRect &rect) const {
+    Q_ASSERT(m_planes == 3);
+
+    qsizetype offsets[4];
+    if (!corners(rect, offsets)) return qRgb(0, 0, 0);
+
+    const quint32 count = area(rect);
+    const quint32 half = count / 2;
+    return qRgb(int((boxSum(m_sums, offsets, Red) + half) / count),
+                int((boxSum(m_sums, offsets, Green) + half) / count),
+                int((boxSum(m_sums, offsets, Blue) + half) / count));
+}
+
+} // namespace Utils
+} // namespace Knoux
@@ -0,0 +1,113 @@
+#ifndef SUMMEDAREATABLE_H
+#define SUMMEDAREATABLE_H
+
+#include <QImage>
+#include <QRect>
+#include <QRgb>
+#include <QVector>
+
+namespace Knoux {
+namespace Utils {
+
+/**
+ * @brief Integral image answering box sums, means and variances in O(1)
+ *
+ * Built in two passes (row prefix sums, then column accumulation), both
+ * split across the ParallelExecutor threads. Sums use wrapping 32-bit
+ * accumulators, which keeps box sums exact as long as the box itself fits
+ * in 32 bits (16M pixels of one 8-bit plane). Squared sums use 64 bits.
+ * Query rectangles are clipped to the image.
+ */
+class SummedAreaTable {
+public:
+    enum class Source {
+        Rgb,        // Three planes: red, green, blue
+        Intensity,  // One plane: red + green + blue
+        Gray        // One plane: the 8-bit gray value
+    };
+
+    enum Plane {
+        Red = 0,
+        Green = 1,
+        Blue = 2
+    };
+
+    SummedAreaTable() = default;
+    explicit SummedAreaTable(const QImage &image, Source source = Source::Rgb, bool withSquares = false);
+
+    bool isNull() const { return m_sums.isEmpty(); }
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+    int planeCount() const { return m_planes; }
+    bool hasSquares() const { return !m_squares.isEmpty(); }
+
+    // Box queries, rect is clipped to the image
+    inline int area(const QRect &rect) const;
+    inline quint32 sum(const QRect &rect, int plane = 0) const;
+    inline quint64 squaredSum(const QRect &rect, int plane = 0) const;  // needs withSquares
+    float mean(const QRect &rect, int plane = 0) const;
+    float variance(const QRect &rect, int plane = 0) const;             // needs withSquares
+    QRgb meanColor(const QRect &rect) const;                            // Rgb tables only
+
+    // Box of the given radius around a pixel
+    static QRect window(int x, int y, int radius) {
+        return QRect(x - radius, y - radius, 2 * radius + 1, 2 * radius + 1);
+    }
+
+private:
+    // Table offsets of the four corners of a clipped box, false if empty
+    inline bool corners(const QRect &rect, qsizetype offsets[4]) const;
+
+    template <typename T>
+    static T boxSum(const QVector<T> &table, const qsizetype offsets[4], int plane) {
+        const T *t = table.constData() + plane;
+        return t[offsets[3]] - t[offsets[1]] - t[offsets[2]] + t[offsets[0]];
+    }
+
+    int m_width = 0;
+    int m_height = 0;
+    int m_planes = 0;
+    QVector<quint32> m_sums;     // (width + 1) x (height + 1) x planes, row and column 0 are zero
+    QVector<quint64> m_squares;  // Same layout, empty unless requested
+};
+
+// ============================================================================
+// Inline Implementation
+// ============================================================================
+
+inline bool SummedAreaTable::corners(const QRect &rect, qsizetype offsets[4]) const {
+    const int x0 = qMax(rect.left(), 0);
+    const int y0 = qMax(rect.top(), 0);
+    const int x1 = qMin(rect.right() + 1, m_width);
+    const int y1 = qMin(rect.bottom() + 1, m_height);
+    if (x0 >= x1 || y0 >= y1) return false;
+
+    const qsizetype row = qsizetype(m_width + 1) * m_planes;
+    offsets[0] = y0 * row + x0 * m_planes;
+    offsets[1] = y0 * row + x1 * m_planes;
+    offsets[2] = y1 * row + x0 * m_planes;
+    offsets[3] = y1 * row + x1 * m_planes;
+    return true;
+}
+
+inline int SummedAreaTable::area(const QRect &rect) const {
+    const int w = qMin(rect.right() + 1, m_width) - qMax(rect.left(), 0);
+    const int h = qMin(rect.bottom() + 1, m_height) - qMax(rect.top(), 0);
+    return (w > 0 && h > 0) ? w * h : 0;
+}
+
+inline quint32 SummedAreaTable::sum(const QRect &rect, int plane) const {
+    qsizetype offsets[4];
+    return corners(rect, offsets) ? boxSum(m_sums, offsets, plane) : 0;
+}
+
+inline quint64 SummedAreaTable::squaredSum(const QRect &rect, int plane) const {
+    Q_ASSERT(hasSquares());
+    qsizetype offsets[4];
+    return corners(rect, offsets) ? boxSum(m_squares, offsets, plane) : 0;
+}
+
+} // namespace Utils
+} // namespace Knoux
+
+#endif // SUMMEDAREATABLE_H
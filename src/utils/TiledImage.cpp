@@ -0,0 +1,145 @@
+#include "TiledImage.h"
+
+#include <cstring>
+
+namespace Knoux {
+namespace Utils {
+
+namespace {
+
+QImage storedPixels(const QImage &image) {
+    // Sub-byte formats cannot be cut at arbitrary columns
+    return image.depth() < 8 ? image.convertToFormat(QImage::Format_ARGB32) : image;
+}
+
+bool samePixels(const QImage &tile, const QImage &image, const QRect &rect) {
+    const qsizetype rowBytes = qsizetype(rect.width()) * image.depth() / 8;
+    const qsizetype offset = qsizetype(rect.left()) * image.depth() / 8;
+    for (int y = 0; y < rect.height(); ++y) {
+        if (std::memcmp(tile.constScanLine(y), image.constScanLine(rect.top() + y) + offset, rowBytes) != 0) {
+            return false;
+        }
+    }
+    return tile.colorTable() == image.colorTable();
+}
+
+} // namespace
+
+TiledImage::TiledImage(const QImage &image) {
+    if (image.isNull()) return;
+
+    const QImage pixels = storedPixels(image);
+    m_size = pixels.size();
+    m_format = pixels.format();
+    m_columns = (m_size.width() + TileSize - 1) / TileSize;
+    m_rows = (m_size.height() + TileSize - 1) / TileSize;
+    m_tiles.resize(m_columns * m_rows);
+
+    QImage *tiles = m_tiles.data();
+    const qsizetype tileRowBytes = pixels.bytesPerLine() * TileSize;
+    ParallelExecutor::forEachBand(m_rows, tileRowBytes, [&](int begin, int end) {
+        for (int row = begin; row < end; ++row) {
+            for (int column = 0; column < m_columns; ++column) {
+                tiles[row * m_columns + column] = pixels.copy(tileRect(column, row));
+            }
+        }
+    });
+}
+
+QRect TiledImage::tileRect(int column, int row) const {
+    return QRect(column * TileSize, row * TileSize, TileSize, TileSize).intersected(rect());
+}
+
+QImage &TiledImage::tileForWrite(int column, int row) {
+    QImage &tile = m_tiles[row * m_columns + column];
+    tile.bits();
+    return tile;
+}
+
+bool TiledImage::sharesTile(const TiledImage &other, int column, int row) const {
+    // Shallow copies of a QImage keep its cache key until one of them detaches
+    return m_size == other.m_size && tile(column, row).cacheKey() == other.tile(column, row).cacheKey();
+}
+
+void TiledImage::tileRange(const QRect &region, int *firstColumn, int *firstRow, int *lastColumn,
+                           int *lastRow) const {
+    const QRect area = region.intersected(rect());
+    if (area.isEmpty()) {
+        *firstColumn = *firstRow = 0;
+        *lastColumn = *lastRow = -1;
+        return;
+    }
+    *firstColumn = area.left() / TileSize;
+    *firstRow = area.top() / TileSize;
+    *lastColumn = area.right() / TileSize;
+    *lastRow = area.bottom() / TileSize;
+}
+
+void TiledImage::update(const QImage &image, const QRect &dirty) {
+    const QImage pixels = storedPixels(image);
+    if (isNull() || pixels.size() != m_size || pixels.format() != m_format) {
+        *this = TiledImage(pixels);
+        return;
+    }
+
+    int firstColumn, firstRow, lastColumn, lastRow;
+    tileRange(dirty.isNull() ? rect() : dirty, &firstColumn, &firstRow, &lastColumn, &lastRow);
+    if (firstColumn > lastColumn || firstRow > lastRow) return;
+
+    QImage *tiles = m_tiles.data();
+    const int columns = lastColumn - firstColumn + 1;
+    const qsizetype tileBytes = qsizetype(TileSize) * TileSize * 4;
+
+    ParallelExecutor::forEachBand((lastRow - firstRow + 1) * columns, tileBytes, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            const int column = firstColumn + i % columns;
+            const int row = firstRow + i / columns;
+            const QRect area = tileRect(column, row);
+            QImage &tile = tiles[row * m_columns + column];
+            if (!samePixels(tile, pixels, area)) tile = pixels.copy(area);
+        }
+    });
+}
+
+QImage TiledImage::toImage() const {
+    return toImage(rect());
+}
+
+QImage TiledImage::toImage(const QRect &region) const {
+    int firstColumn, firstRow, lastColumn, lastRow;
+    tileRange(region, &firstColumn, &firstRow, &lastColumn, &lastRow);
+    if (firstColumn > lastColumn || firstRow > lastRow) return QImage();
+
+    const QRect area = region.intersected(rect());
+    const QImage &first = tile(firstColumn, firstRow);
+    QImage result(area.size(), m_format);
+    result.setColorTable(first.colorTable());
+    result.setDotsPerMeterX(first.dotsPerMeterX());
+    result.setDotsPerMeterY(first.dotsPerMeterY());
+
+    uchar *bits = result.bits();
+    const qsizetype stride = result.bytesPerLine();
+    const int bytesPerPixel = result.depth() / 8;
+
+    ParallelExecutor::forEachBand(lastRow - firstRow + 1, stride * TileSize, [&](int begin, int end) {
+        for (int row = firstRow + begin; row < firstRow + end; ++row) {
+            for (int column = firstColumn; column <= lastColumn; ++column) {
+                const QRect tileArea = tileRect(column, row);
+                const QRect part = tileArea.intersected(area);
+                const QImage &source = tile(column, row);
+                const qsizetype rowBytes = qsizetype(part.width()) * bytesPerPixel;
+                const qsizetype sourceOffset = qsizetype(part.left() - tileArea.left()) * bytesPerPixel;
+                const qsizetype targetOffset = qsizetype(part.left() - area.left()) * bytesPerPixel;
+                for (int y = part.top(); y <= part.bottom(); ++y) {
+                    std::memcpy(bits + (y - area.top()) * stride + targetOffset,
+                                source.constScanLine(y - tileArea.top()) + sourceOffset, rowBytes);
+                }
+            }
+        }
+    });
+
+    return result;
+}
+
+} // namespace Utils
+} // namespace Knoux
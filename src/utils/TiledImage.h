@@ -0,0 +1,96 @@
+#ifndef TILEDIMAGE_H
+#define TILEDIMAGE_H
+
+#include "ParallelExecutor.h"
+
+#include <QImage>
+#include <QRect>
+#include <QVector>
+
+namespace Knoux {
+namespace Utils {
+
+/**
+ * @brief Image stored as copy-on-write 256x256 tiles
+ *
+ * Tiles are implicitly shared QImages, so copying a TiledImage only bumps
+ * reference counts, and writing to a tile copies that tile alone. Undo
+ * snapshots built with update() keep sharing every tile whose pixels did
+ * not change. Conversions from and to QImage happen at the edges.
+ * Images with fewer than 8 bits per pixel are stored as ARGB32.
+ */
+class TiledImage {
+public:
+    static constexpr int TileSize = 256;
+
+    TiledImage() = default;
+    explicit TiledImage(const QImage &image);
+
+    bool isNull() const { return m_tiles.isEmpty(); }
+    QSize size() const { return m_size; }
+    int width() const { return m_size.width(); }
+    int height() const { return m_size.height(); }
+    QRect rect() const { return QRect(QPoint(0, 0), m_size); }
+    QImage::Format format() const { return m_format; }
+
+    // Tile grid
+    int columns() const { return m_columns; }
+    int rows() const { return m_rows; }
+    QRect tileRect(int column, int row) const;
+    const QImage &tile(int column, int row) const { return m_tiles[row * m_columns + column]; }
+    QImage &tileForWrite(int column, int row);  // Detaches the tile
+    bool sharesTile(const TiledImage &other, int column, int row) const;
+
+    // Takes the pixels inside dirty (everything for a null rect) from image,
+    // which must have this size. Tiles whose pixels are unchanged stay shared.
+    void update(const QImage &image, const QRect &dirty = QRect());
+
+    // Assembled pixels, the whole image or a region of it
+    QImage toImage() const;
+    QImage toImage(const QRect &region) const;
+
+    // Calls func(QImage &tile, const QRect &tileRect) for every tile touching
+    // region, concurrently. Only those tiles are detached.
+    template <typename TileFunc>
+    void forEachTile(const QRect &region, TileFunc func);
+
+private:
+    void tileRange(const QRect &region, int *firstColumn, int *firstRow, int *lastColumn, int *lastRow) const;
+
+    QSize m_size;
+    QImage::Format m_format = QImage::Format_Invalid;
+    int m_columns = 0;
+    int m_rows = 0;
+    QVector<QImage> m_tiles;  // Row-major
+};
+
+// ============================================================================
+// Template Implementation
+// ============================================================================
+
+template <typename TileFunc>
+void TiledImage::forEachTile(const QRect &region, TileFunc func) {
+    int firstColumn, firstRow, lastColumn, lastRow;
+    tileRange(region, &firstColumn, &firstRow, &lastColumn, &lastRow);
+    if (firstColumn > lastColumn || firstRow > lastRow) return;
+
+    // Detach the list here, the tiles themselves detach on their own threads
+    QImage *tiles = m_tiles.data();
+    const int columns = lastColumn - firstColumn + 1;
+    const qsizetype tileBytes = qsizetype(TileSize) * TileSize * 4;
+
+    ParallelExecutor::forEachBand((lastRow - firstRow + 1) * columns, tileBytes, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            const int column = firstColumn + i % columns;
+            const int row = firstRow + i / columns;
+            QImage &tile = tiles[row * m_columns + column];
+            tile.bits();
+            func(tile, tileRect(column, row));
+        }
+    });
+}
+
+} // namespace Utils
+} // namespace Knoux
+
+#endif // TILEDIMAGE_H
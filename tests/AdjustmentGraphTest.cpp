@@ -0,0 +1,173 @@
+#include "AdjustmentGraph.h"
+#include "AdjustmentCompiler.h"
+#include "ImageProcessor.h"
+
+#include <QImage>
+
+#include <cstdio>
+
+using namespace Knoux::Utils;
+
+namespace {
+
+int failures = 0;
+
+void expect(bool condition, const char *test, const char *what) {
+    if (condition) return;
+    ++failures;
+    std::printf("FAIL %s: %s\n", test, what);
+}
+
+// xorshift32, the same sequence on every platform
+class Random {
+public:
+    explicit Random(quint32 seed) : m_state(seed ? seed : 1) {}
+
+    quint32 next() {
+        m_state ^= m_state << 13;
+        m_state ^= m_state >> 17;
+        m_state ^= m_state << 5;
+        return m_state;
+    }
+
+private:
+    quint32 m_state;
+};
+
+QImage randomImage(int width, int height, quint32 seed) {
+    QImage image(width, height, QImage::Format_ARGB32);
+    Random random(seed);
+    for (int y = 0; y < height; ++y) {
+        QRgb *row = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 0; x < width; ++x) row[x] = random.next() | 0xff000000u;
+    }
+    return image;
+}
+
+// Every stage run by hand, in the graph's order
+QImage direct(const QImage &source, const AdjustmentGraph::Parameters &p) {
+    QImage image = source;
+    if (p.noiseReduction > 0) image = ImageProcessor::applyNoiseReduction(image, p.noiseReduction);
+
+    AdjustmentCompiler tone;
+    tone.addExposure(p.exposure).addBrightness(p.brightness).addContrast(p.contrast).addHighlights(p.highlights)
+            .addShadows(p.shadows);
+    if (!tone.isEmpty()) image = tone.apply(image);
+
+    AdjustmentCompiler color;
+    color.addTemperature(6500 + p.temperature * 25).addTint(p.tint).addSaturation(p.saturation).addHueShift(p.hue);
+    if (!color.isEmpty()) image = color.apply(image);
+
+    if (p.sharpness > 0) image = ImageProcessor::applySharpness(image, p.sharpness);
+    if (p.blur > 0) image = ImageProcessor::applyGaussianBlur(image, p.blur / 4.0f);
+    if (p.vignette != 0) image = ImageProcessor::applyVignette(image, p.vignette, 50.0f);
+    return image;
+}
+
+AdjustmentGraph::Parameters everything() {
+    AdjustmentGraph::Parameters p;
+    p.noiseReduction = 40;
+    p.exposure = 10;
+    p.brightness = -15;
+    p.contrast = 20;
+    p.highlights = -30;
+    p.shadows = 25;
+    p.temperature = 12;
+    p.tint = -8;
+    p.saturation = 30;
+    p.hue = 15;
+    p.sharpness = 35;
+    p.blur = 6;
+    p.vignette = -40;
+    return p;
+}
+
+// ============================================================================
+// Render
+// ============================================================================
+
+void testRender() {
+    const QImage source = randomImage(160, 120, 3);
+    AdjustmentGraph graph;
+    expect(graph.render(everything()).isNull(), "render", "render without a source");
+
+    graph.setSource(source);
+    const AdjustmentGraph::Parameters neutral;
+    const QImage same = graph.render(neutral);
+    expect(same == source && same.cacheKey() == source.cacheKey(), "render", "neutral render copied the source");
+
+    expect(graph.render(everything()) == direct(source, everything()), "render", "differs from the stages by hand");
+    expect(graph.lastRunCount() == 5, "render", "first render skipped a node");
+}
+
+// Only the changed node and the ones after it run again, with the result of
+// a graph that never rendered anything else
+void testReuse() {
+    const QImage source = randomImage(150, 110, 4);
+    AdjustmentGraph graph;
+    graph.setSource(source);
+    AdjustmentGraph::Parameters p = everything();
+    graph.render(p);
+
+    graph.render(p);
+    expect(graph.lastRunCount() == 0, "reuse", "unchanged render ran a node");
+
+    struct Edit {
+        int AdjustmentGraph::Parameters::*field;
+        int value;
+        int runs;
+    };
+    using P = AdjustmentGraph::Parameters;
+    const Edit edits[] = {
+        {&P::vignette, 30, 1},
+        {&P::sharpness, 10, 2},
+        {&P::hue, -20, 3},
+        {&P::contrast, 5, 4},
+        {&P::noiseReduction, 90, 5},
+        {&P::blur, 0, 1},
+        {&P::sharpness, -50, 2},
+        {&P::sharpness, -10, 0},  // Below 0 is as neutral as -50
+    };
+    for (const Edit &edit : edits) {
+        p.*edit.field = edit.value;
+        const QImage result = graph.render(p);
+        expect(graph.lastRunCount() == edit.runs, "reuse", "wrong nodes ran");
+
+        AdjustmentGraph fresh;
+        fresh.setSource(source);
+        expect(result == fresh.render(p), "reuse", "reused result differs from a fresh render");
+    }
+
+    // The same image keeps the results, a new one drops them
+    graph.setSource(source);
+    graph.render(p);
+    expect(graph.lastRunCount() == 0, "reuse", "same source dropped the results");
+    graph.setSource(source.copy());
+    graph.render(p);
+    expect(graph.lastRunCount() == 5, "reuse", "new source kept the results");
+}
+
+// A stopped render returns nothing, the next one picks up where it stopped
+void testCancel() {
+    const QImage source = randomImage(140, 100, 5);
+    AdjustmentGraph graph;
+    graph.setSource(source);
+
+    int asked = 0;
+    expect(graph.render(everything(), [&] { return ++asked > 2; }).isNull(), "cancel", "stopped render has an image");
+    expect(graph.lastRunCount() == 2, "cancel", "stopped at the wrong node");
+
+    const QImage result = graph.render(everything(), [] { return false; });
+    expect(graph.lastRunCount() == 3, "cancel", "finished nodes ran again");
+    expect(result == direct(source, everything()), "cancel", "resumed render differs");
+}
+
+} // namespace
+
+int main() {
+    testRender();
+    testReuse();
+    testCancel();
+    std::printf("%s AdjustmentGraph\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
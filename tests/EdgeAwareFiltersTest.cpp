@@ -0,0 +1,203 @@
+#include "EdgeAwareFilters.h"
+#include "ImageProcessor.h"
+#include "ParallelExecutor.h"
+
+#include <QImage>
+#include <QMutex>
+#include <QVector>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace Knoux::Utils;
+
+namespace {
+
+int failures = 0;
+
+void expect(bool condition, const char *test, const char *what) {
+    if (condition) return;
+    ++failures;
+    std::printf("FAIL %s: %s\n", test, what);
+}
+
+// xorshift32, the same sequence on every platform
+class Random {
+public:
+    explicit Random(quint32 seed) : m_state(seed ? seed : 1) {}
+
+    quint32 next() {
+        m_state ^= m_state << 13;
+        m_state ^= m_state >> 17;
+        m_state ^= m_state << 5;
+        return m_state;
+    }
+
+    int range(int low, int high) { return low + int(next() % quint32(high - low + 1)); }
+
+private:
+    quint32 m_state;
+};
+
+// Upsampled rows gathered into one plane, with how often each row came
+struct Upsampled {
+    QVector<float> values;
+    QVector<int> visits;
+};
+
+Upsampled upsample(const QVector<float> &values, int factor, const QImage &guide, int radius, float epsilon) {
+    Upsampled result{QVector<float>(qsizetype(guide.width()) * guide.height()), QVector<int>(guide.height())};
+    QMutex mutex;
+    EdgeAwareFilters::guidedUpsample(values, factor, guide, radius, epsilon, [&](int y, const float *row) {
+        QMutexLocker lock(&mutex);
+        ++result.visits[y];
+        std::copy(row, row + guide.width(), result.values.begin() + qsizetype(y) * guide.width());
+    });
+    return result;
+}
+
+// Mean channel difference between two images of the same size
+double meanDifference(const QImage &a, const QImage &b, const QRect &area) {
+    double sum = 0.0;
+    for (int y = area.top(); y <= area.bottom(); ++y) {
+        for (int x = area.left(); x <= area.right(); ++x) {
+            const QRgb p = a.pixel(x, y);
+            const QRgb q = b.pixel(x, y);
+            sum += std::abs(qRed(p) - qRed(q)) + std::abs(qGreen(p) - qGreen(q)) + std::abs(qBlue(p) - qBlue(q));
+        }
+    }
+    return sum / (3.0 * area.width() * area.height());
+}
+
+// ============================================================================
+// Guided Upsampling
+// ============================================================================
+
+void testGuidedUpsample() {
+    const int width = 203, height = 117;
+    QImage guide(width, height, QImage::Format_Grayscale8);
+    Random random(5);
+    for (int y = 0; y < height; ++y) {
+        uchar *row = guide.scanLine(y);
+        for (int x = 0; x < width; ++x) row[x] = uchar(random.range(0, 255));
+    }
+
+    for (int factor : {1, 2, 3}) {
+        const int lowWidth = (width + factor - 1) / factor;
+        const int lowHeight = (height + factor - 1) / factor;
+
+        // A flat plane stays flat, every row comes exactly once
+        const Upsampled flat = upsample(QVector<float>(lowWidth * lowHeight, 90.0f), factor, guide, 8, 50.0f);
+        bool once = true;
+        for (int visits : flat.visits) once = once && visits == 1;
+        expect(once, "guided upsample", "row not handed over exactly once");
+        bool same = true;
+        for (float value : flat.values) same = same && std::abs(value - 90.0f) < 0.01f;
+        expect(same, "guided upsample", "flat plane changed");
+
+        // A plane linear in the block means of the guide comes back as the
+        // same line through the full-resolution guide
+        QVector<float> linear(lowWidth * lowHeight);
+        for (int by = 0; by < lowHeight; ++by) {
+            for (int bx = 0; bx < lowWidth; ++bx) {
+                double sum = 0.0;
+                int count = 0;
+                for (int y = by * factor; y < qMin(height, (by + 1) * factor); ++y) {
+                    for (int x = bx * factor; x < qMin(width, (bx + 1) * factor); ++x, ++count) {
+                        sum += guide.constScanLine(y)[x];
+                    }
+                }
+                linear[by * lowWidth + bx] = float(0.5 * sum / count + 40.0);
+            }
+        }
+        const Upsampled edges = upsample(linear, factor, guide, 8, 1.0f);
+        float worst = 0.0f;
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                const float expected = 0.5f * guide.constScanLine(y)[x] + 40.0f;
+                worst = qMax(worst, std::abs(edges.values[y * width + x] - expected));
+            }
+        }
+        expect(worst < 1.5f, "guided upsample", "guide edges not followed");
+    }
+}
+
+// ============================================================================
+// Dehaze
+// ============================================================================
+
+// Patches that each lack one channel, as the dark channel prior expects,
+// under a sky of the atmospheric light
+QImage clearScene(int width, int height, int skyRows) {
+    QImage image(width, height, QImage::Format_ARGB32);
+    Random random(11);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            if (y < skyRows) {
+                image.setPixel(x, y, qRgb(230, 230, 230));
+                continue;
+            }
+            Random patch(quint32((y / 24) * 1000 + x / 24 + 1));
+            int channels[3] = {patch.range(40, 220), patch.range(40, 220), patch.range(40, 220)};
+            channels[patch.range(0, 2)] = 0;
+            const int detail = random.range(-10, 10);
+            for (int &c : channels) c = c == 0 ? 0 : qBound(0, c + detail, 255);
+            image.setPixel(x, y, qRgb(channels[0], channels[1], channels[2]));
+        }
+    }
+    return image;
+}
+
+// I = J t + A (1 - t) with a uniform transmission
+QImage addHaze(const QImage &scene, float transmission) {
+    QImage image = scene;
+    for (int y = 0; y < image.height(); ++y) {
+        for (int x = 0; x < image.width(); ++x) {
+            const QRgb p = scene.pixel(x, y);
+            auto haze = [&](int c) { return qRound(c * transmission + 230 * (1 - transmission)); };
+            image.setPixel(x, y, qRgb(haze(qRed(p)), haze(qGreen(p)), haze(qBlue(p))));
+        }
+    }
+    return image;
+}
+
+void testDehaze() {
+    for (const QSize &size : {QSize(300, 200), QSize(2100, 240)}) {
+        const int skyRows = size.height() / 4;
+        const QImage scene = clearScene(size.width(), size.height(), skyRows);
+        const QImage hazy = addHaze(scene, 0.6f);
+
+        expect(ImageProcessor::applyDehaze(hazy, 0.0f) == hazy, "dehaze", "zero strength changed the image");
+        expect(ImageProcessor::applyDehaze(hazy, -50.0f) == hazy, "dehaze", "negative strength changed the image");
+
+        // The haze is mostly taken off away from the horizon, the sky stays
+        const QImage result = ImageProcessor::applyDehaze(hazy, 100.0f);
+        const QRect ground(0, skyRows + 40, size.width(), size.height() - skyRows - 40);
+        expect(meanDifference(result, scene, ground) < meanDifference(hazy, scene, ground) / 3, "dehaze",
+               "haze not removed");
+        const QRect sky(0, 0, size.width(), skyRows - 40);
+        expect(meanDifference(result, hazy, sky) < 1.0, "dehaze", "atmospheric light changed");
+
+        // Half strength lands in between
+        const double half = meanDifference(ImageProcessor::applyDehaze(hazy, 50.0f), scene, ground);
+        expect(half < meanDifference(hazy, scene, ground) && half > meanDifference(result, scene, ground), "dehaze",
+               "half strength not in between");
+
+        const int threads = ParallelExecutor::threadCount();
+        for (int count : {1, 4}) {
+            ParallelExecutor::setThreadCount(count);
+            expect(ImageProcessor::applyDehaze(hazy, 100.0f) == result, "dehaze", "result depends on the thread count");
+        }
+        ParallelExecutor::setThreadCount(threads);
+    }
+}
+
+} // namespace
+
+int main() {
+    testGuidedUpsample();
+    testDehaze();
+    std::printf("%s EdgeAwareFilters\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
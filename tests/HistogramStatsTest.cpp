@@ -0,0 +1,184 @@
+#include "HistogramStats.h"
+
+#include <QImage>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+using namespace Knoux::Utils;
+
+namespace {
+
+int failures = 0;
+
+void expect(bool condition, const char *test, const char *what) {
+    if (condition) return;
+    ++failures;
+    std::printf("FAIL %s: %s\n", test, what);
+}
+
+// xorshift32, the same sequence on every platform
+class Random {
+public:
+    explicit Random(quint32 seed) : m_state(seed ? seed : 1) {}
+
+    quint32 next() {
+        m_state ^= m_state << 13;
+        m_state ^= m_state >> 17;
+        m_state ^= m_state << 5;
+        return m_state;
+    }
+
+    int range(int low, int high) { return low + int(next() % quint32(high - low + 1)); }
+
+private:
+    quint32 m_state;
+};
+
+// Skewed channels, so the percentiles land on different values
+QImage randomImage(int width, int height, quint32 seed) {
+    QImage image(width, height, QImage::Format_ARGB32);
+    Random random(seed);
+    for (int y = 0; y < height; ++y) {
+        QRgb *row = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 0; x < width; ++x) {
+            const quint32 n = random.next();
+            row[x] = qRgba(int(n & 255), int((n >> 8) & 127), int(((n >> 16) & 255) * ((n >> 24) & 255) / 255),
+                           int(n >> 24));
+        }
+    }
+    return image;
+}
+
+// Counts the sampled pixels of roi one by one
+struct NaiveHistogram {
+    quint64 bins[HistogramStats::ChannelCount][HistogramStats::Bins] = {};
+    std::vector<int> values[HistogramStats::ChannelCount];
+    quint64 total = 0;
+
+    NaiveHistogram(const QImage &image, const QRect &roi, int stride) {
+        const QRect area = roi.isNull() ? image.rect() : roi.intersected(image.rect());
+        for (int y = area.top(); y <= area.bottom(); y += stride) {
+            for (int x = area.left(); x <= area.right(); x += stride) {
+                const QRgb p = image.pixel(x, y);
+                const int channels[] = {qRed(p), qGreen(p), qBlue(p), qGray(qRed(p), qGreen(p), qBlue(p))};
+                for (int c = 0; c < HistogramStats::ChannelCount; ++c) {
+                    ++bins[c][channels[c]];
+                    values[c].push_back(channels[c]);
+                }
+                ++total;
+            }
+        }
+        for (std::vector<int> &channel : values) std::sort(channel.begin(), channel.end());
+    }
+};
+
+bool sameCounts(const HistogramStats &stats, const NaiveHistogram &naive) {
+    if (stats.count() != naive.total) return false;
+    for (int c = 0; c < HistogramStats::ChannelCount; ++c) {
+        for (int v = 0; v < HistogramStats::Bins; ++v) {
+            if (stats.bin(HistogramStats::Channel(c), v) != naive.bins[c][v]) return false;
+        }
+    }
+    return true;
+}
+
+// ============================================================================
+// Counts
+// ============================================================================
+
+void testCounts() {
+    const QSize sizes[] = {QSize(1, 1), QSize(13, 300), QSize(257, 65)};
+    const QRect rois[] = {QRect(), QRect(3, 5, 7, 190), QRect(-4, -4, 20, 20), QRect(500, 500, 4, 4)};
+    quint32 seed = 1;
+    for (const QSize &size : sizes) {
+        const QImage image = randomImage(size.width(), size.height(), seed++);
+        for (const QRect &roi : rois) {
+            for (int stride : {1, 2, 3, 7}) {
+                const HistogramStats stats(image, roi, stride);
+                const NaiveHistogram naive(image, roi, stride);
+                expect(sameCounts(stats, naive), "counts", "bins differ from a naive count");
+                expect(stats.isEmpty() == (naive.total == 0), "counts", "emptiness differs");
+            }
+        }
+    }
+
+    // Gray images are counted as stored, every channel the same value
+    const QImage gray = randomImage(70, 90, 9).convertToFormat(QImage::Format_Grayscale8);
+    const HistogramStats grayStats(gray);
+    bool same = grayStats.count() == quint64(gray.width()) * gray.height();
+    for (int v = 0; v < HistogramStats::Bins; ++v) {
+        quint64 count = 0;
+        for (int y = 0; y < gray.height(); ++y) {
+            const uchar *line = gray.constScanLine(y);
+            count += quint64(std::count(line, line + gray.width(), uchar(v)));
+        }
+        for (int c = 0; c < HistogramStats::ChannelCount; ++c)
+            same = same && grayStats.bin(HistogramStats::Channel(c), v) == count;
+    }
+    expect(same, "counts", "gray bins differ from a naive count");
+}
+
+// ============================================================================
+// Statistics
+// ============================================================================
+
+void testStatistics() {
+    const QImage image = randomImage(181, 97, 21);
+    const HistogramStats stats(image, QRect(), 2);
+    const NaiveHistogram naive(image, QRect(), 2);
+
+    for (int c = 0; c < HistogramStats::ChannelCount; ++c) {
+        const HistogramStats::Channel channel = HistogramStats::Channel(c);
+        const std::vector<int> &values = naive.values[c];
+        expect(stats.minimum(channel) == values.front(), "statistics", "minimum differs");
+        expect(stats.maximum(channel) == values.back(), "statistics", "maximum differs");
+
+        double sum = 0.0;
+        for (int v : values) sum += v;
+        expect(std::abs(stats.mean(channel) - sum / values.size()) < 1e-9, "statistics", "mean differs");
+
+        // Smallest value with at least fraction of the samples at or below it
+        for (double fraction : {0.0, 0.01, 0.25, 0.5, 0.9, 1.0}) {
+            const size_t rank = qMax<size_t>(1, size_t(std::ceil(fraction * values.size())));
+            expect(stats.percentile(channel, fraction) == values[rank - 1], "statistics", "percentile differs");
+        }
+    }
+}
+
+// ============================================================================
+// Updates
+// ============================================================================
+
+// A dirty rectangle recounts only its bands, the result matches a recount
+void testUpdate() {
+    Random random(33);
+    for (int stride : {1, 3}) {
+        QImage image = randomImage(120, 400, 40 + quint32(stride));
+        const QRect roi(5, 11, 100, 380);
+        HistogramStats stats(image, roi, stride);
+
+        for (int i = 0; i < 20; ++i) {
+            const QRect dirty(random.range(-10, 119), random.range(-10, 399), random.range(1, 60), random.range(1, 200));
+            const QRect inside = dirty.intersected(image.rect());
+            const QRgb color = qRgba(random.range(0, 255), random.range(0, 255), random.range(0, 255), 255);
+            for (int y = inside.top(); y <= inside.bottom(); ++y) {
+                for (int x = inside.left(); x <= inside.right(); ++x) image.setPixel(x, y, color);
+            }
+            stats.update(image, dirty);
+            expect(sameCounts(stats, NaiveHistogram(image, roi, stride)), "update", "updated bins differ from a recount");
+        }
+    }
+}
+
+} // namespace
+
+int main() {
+    testCounts();
+    testStatistics();
+    testUpdate();
+    std::printf("%s HistogramStats\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
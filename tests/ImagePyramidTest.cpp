@@ -0,0 +1,184 @@
+#include "ImagePyramid.h"
+
+#include <QImage>
+
+#include <cstdio>
+
+using namespace Knoux::Utils;
+
+namespace {
+
+int failures = 0;
+
+void expect(bool condition, const char *test, const char *what) {
+    if (condition) return;
+    ++failures;
+    std::printf("FAIL %s: %s\n", test, what);
+}
+
+// xorshift32, the same sequence on every platform
+class Random {
+public:
+    explicit Random(quint32 seed) : m_state(seed ? seed : 1) {}
+
+    quint32 next() {
+        m_state ^= m_state << 13;
+        m_state ^= m_state >> 17;
+        m_state ^= m_state << 5;
+        return m_state;
+    }
+
+    int range(int low, int high) { return low + int(next() % quint32(high - low + 1)); }
+
+private:
+    quint32 m_state;
+};
+
+QImage randomImage(int width, int height, quint32 seed) {
+    QImage image(width, height, QImage::Format_ARGB32);
+    Random random(seed);
+    for (int y = 0; y < height; ++y) {
+        QRgb *row = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 0; x < width; ++x) row[x] = random.next();
+    }
+    return image;
+}
+
+// Rounded 2x2 average per channel, the last odd column or row repeated
+QImage naiveReduce(const QImage &source) {
+    QImage result((source.width() + 1) / 2, (source.height() + 1) / 2, source.format());
+    for (int y = 0; y < result.height(); ++y) {
+        for (int x = 0; x < result.width(); ++x) {
+            const int x0 = 2 * x, x1 = qMin(2 * x + 1, source.width() - 1);
+            const int y0 = 2 * y, y1 = qMin(2 * y + 1, source.height() - 1);
+            const QRgb p[] = {source.pixel(x0, y0), source.pixel(x1, y0), source.pixel(x0, y1), source.pixel(x1, y1)};
+            int channels[4] = {0, 0, 0, 0};
+            for (QRgb q : p) {
+                channels[0] += qRed(q);
+                channels[1] += qGreen(q);
+                channels[2] += qBlue(q);
+                channels[3] += qAlpha(q);
+            }
+            result.setPixel(x, y, qRgba((channels[0] + 2) >> 2, (channels[1] + 2) >> 2, (channels[2] + 2) >> 2,
+                                        (channels[3] + 2) >> 2));
+        }
+    }
+    return result;
+}
+
+void fillRect(QImage &image, const QRect &rect, QRgb color) {
+    const QRect area = rect.intersected(image.rect());
+    for (int y = area.top(); y <= area.bottom(); ++y) {
+        for (int x = area.left(); x <= area.right(); ++x) image.setPixel(x, y, color);
+    }
+}
+
+// ============================================================================
+// Levels
+// ============================================================================
+
+void testLevels() {
+    const QSize sizes[] = {QSize(16, 16), QSize(33, 17), QSize(203, 157), QSize(512, 40)};
+    quint32 seed = 1;
+    for (const QSize &size : sizes) {
+        const QImage image = randomImage(size.width(), size.height(), seed++);
+        ImagePyramid pyramid(image);
+        expect(pyramid.level(0) == image, "levels", "level 0 is not the image");
+
+        QImage expected = image;
+        int count = 1;
+        for (;;) {
+            const QSize next((expected.width() + 1) / 2, (expected.height() + 1) / 2);
+            if (next.width() < ImagePyramid::MinSize || next.height() < ImagePyramid::MinSize) break;
+            expected = naiveReduce(expected);
+            expect(pyramid.levelSize(count) == expected.size(), "levels", "level size");
+            expect(pyramid.level(count) == expected, "levels", "level differs from a naive reduction");
+            ++count;
+        }
+        expect(pyramid.levelCount() == count, "levels", "level count");
+    }
+
+    // Building a deep level first builds the ones above it the same way
+    const QImage image = randomImage(300, 200, 9);
+    ImagePyramid deepFirst(image);
+    ImagePyramid inOrder(image);
+    const QImage deep = deepFirst.level(3);
+    for (int i = 1; i <= 3; ++i) inOrder.level(i);
+    expect(deep == inOrder.level(3), "levels", "deep level built first differs");
+}
+
+void testScale() {
+    const ImagePyramid pyramid(randomImage(400, 300, 4));
+    expect(pyramid.levelForScale(1.0f) == 0 && pyramid.levelForScale(2.0f) == 0, "scale", "enlargement level");
+    expect(pyramid.levelForScale(0.5f) == 1 && pyramid.levelForScale(0.3f) == 1, "scale", "half size level");
+    expect(pyramid.levelForScale(0.25f) == 2, "scale", "quarter size level");
+    expect(pyramid.levelForScale(0.0001f) == pyramid.levelCount() - 1, "scale", "tiny scale level");
+
+    ImagePyramid copy = pyramid;
+    expect(copy.scaled(QSize(100, 75)) == copy.level(2), "scale", "level-sized request is not the level");
+}
+
+// ============================================================================
+// Updates
+// ============================================================================
+
+// After any sequence of edits, every level matches a pyramid built afresh
+void testUpdate() {
+    Random random(21);
+    for (const QSize &size : {QSize(257, 131), QSize(640, 480)}) {
+        QImage image = randomImage(size.width(), size.height(), quint32(size.width()));
+        ImagePyramid pyramid(image);
+        // Some levels built before the edits, the rest after
+        for (int i = 1; i < pyramid.levelCount() - 1; ++i) pyramid.level(i);
+
+        for (int edit = 0; edit < 12; ++edit) {
+            const QRect dirty(random.range(-5, size.width() - 1), random.range(-5, size.height() - 1),
+                              random.range(1, 90), random.range(1, 90));
+            // Each image is a new buffer, as the editor hands over
+            image = image.copy();
+            fillRect(image, dirty, random.next());
+            pyramid.update(image, dirty);
+
+            ImagePyramid fresh(image);
+            bool same = true;
+            for (int i = 0; i < pyramid.levelCount(); ++i) same = same && pyramid.level(i) == fresh.level(i);
+            expect(same, "update", "level after a dirty update differs from a rebuild");
+        }
+
+        // A null rectangle marks everything
+        image = randomImage(size.width(), size.height(), 99);
+        pyramid.update(image);
+        ImagePyramid fresh(image);
+        expect(pyramid.level(pyramid.levelCount() - 1) == fresh.level(fresh.levelCount() - 1), "update",
+               "full update left stale pixels");
+
+        // A new size starts over
+        const QImage smaller = randomImage(size.width() / 2, size.height() / 2, 7);
+        pyramid.update(smaller, QRect(0, 0, 4, 4));
+        expect(pyramid.size() == smaller.size() && pyramid.level(1) == naiveReduce(smaller), "update",
+               "resized image not rebuilt");
+    }
+}
+
+// Shared lookups follow the image they are given
+void testCache() {
+    QImage image = randomImage(320, 240, 30);
+    ImagePyramid pyramid(image);
+    expect(ImagePyramid::cachedLevel(image, 2) == pyramid.level(2), "cache", "cached level differs");
+
+    fillRect(image, QRect(0, 0, 50, 50), 0xff00ff00u);
+    ImagePyramid edited(image);
+    expect(ImagePyramid::cachedLevel(image, 2) == edited.level(2), "cache", "cached level of an edit is stale");
+    expect(ImagePyramid::cachedScaled(image, QSize(80, 60)) == edited.level(2), "cache", "cached scale differs");
+}
+
+} // namespace
+
+int main() {
+    testLevels();
+    testScale();
+    testUpdate();
+    testCache();
+    std::printf("%s ImagePyramid\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
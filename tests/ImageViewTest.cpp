@@ -0,0 +1,176 @@
+#include "ImageView.h"
+#include "BlurKernels.h"
+#include "ImageProcessor.h"
+#include "PixelKernels.h"
+
+#include <QImage>
+
+#include <cstdio>
+#include <functional>
+#include <utility>
+
+using namespace Knoux::Utils;
+
+namespace {
+
+int failures = 0;
+
+void expect(bool condition, const char *test, const char *what) {
+    if (condition) return;
+    ++failures;
+    std::printf("FAIL %s: %s\n", test, what);
+}
+
+// xorshift32, the same sequence on every platform
+class Random {
+public:
+    explicit Random(quint32 seed) : m_state(seed ? seed : 1) {}
+
+    quint32 next() {
+        m_state ^= m_state << 13;
+        m_state ^= m_state >> 17;
+        m_state ^= m_state << 5;
+        return m_state;
+    }
+
+private:
+    quint32 m_state;
+};
+
+QImage randomImage(int width, int height, quint32 seed) {
+    QImage image(width, height, QImage::Format_ARGB32);
+    Random random(seed);
+    for (int y = 0; y < height; ++y) {
+        QRgb *row = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 0; x < width; ++x) row[x] = random.next() | 0xff000000u;
+    }
+    return image;
+}
+
+// Pixels of a and b outside rect are the same
+bool sameOutside(const QImage &a, const QImage &b, const QRect &rect) {
+    for (int y = 0; y < a.height(); ++y) {
+        for (int x = 0; x < a.width(); ++x) {
+            if (!rect.contains(x, y) && a.pixel(x, y) != b.pixel(x, y)) return false;
+        }
+    }
+    return true;
+}
+
+// ============================================================================
+// Views
+// ============================================================================
+
+void testViews() {
+    QImage image = randomImage(120, 80, 1);
+    const QRect region(30, 10, 50, 40);
+    const ImageView view(image, region);
+    expect(view.size() == region.size() && view.stride() == image.bytesPerLine(), "views", "view geometry");
+    expect(view.bits() == image.bits() + 10 * image.bytesPerLine() + 30 * 4, "views", "view does not address the image");
+    expect(view.toImage() == image.copy(region), "views", "viewed pixels differ");
+
+    // Sub-views are in view coordinates and clipped to it
+    const ImageView sub = view.subView(QRect(40, 30, 100, 100));
+    expect(sub.size() == QSize(10, 10) && sub.bits() == image.bits() + 40 * image.bytesPerLine() + 70 * 4,
+           "views", "sub-view geometry");
+    expect(view.subView(QRect(60, 0, 5, 5)).isNull(), "views", "sub-view outside the view is not null");
+    expect(ImageView(image, QRect(500, 500, 3, 3)).isNull(), "views", "view outside the image is not null");
+
+    // Writes through asImage() land in the parent
+    sub.asImage().fill(0xff102030u);
+    expect(image.pixel(75, 45) == 0xff102030u && image.pixel(69, 45) != 0xff102030u, "views",
+           "write through asImage() missed the parent");
+}
+
+// Kernels on a view change the viewed region alone
+void testViewKernels() {
+    const QImage original = randomImage(200, 150, 2);
+    const QRect region(17, 23, 90, 61);
+    const ChannelLut invert = PixelKernels::makeLut([](int, int v) { return 255 - v; });
+
+    QImage image = original;
+    PixelKernels::applyLut(ImageView(image, region), invert);
+    QImage expected = original.copy(region);
+    PixelKernels::applyLut(expected, invert);
+    expect(image.copy(region) == expected, "view kernels", "LUT on a view differs from LUT on a copy");
+    expect(sameOutside(image, original, region), "view kernels", "LUT on a view wrote outside it");
+
+    image = original;
+    BlurKernels::gaussian(ImageView(image, region), 3.0f);
+    expected = original.copy(region);
+    BlurKernels::gaussian(expected, 3.0f);
+    expect(image.copy(region) == expected, "view kernels", "blur on a view differs from blur on a copy");
+    expect(sameOutside(image, original, region), "view kernels", "blur on a view wrote outside it");
+}
+
+// ============================================================================
+// Moved Images
+// ============================================================================
+
+struct Filter {
+    const char *name;
+    std::function<QImage(const QImage &)> byReference;
+    std::function<QImage(QImage &&)> byMove;
+    bool inPlace;  // Reuses the buffer of an unshared image
+};
+
+#define FILTER(name, inPlace, ...)                                                     \
+    Filter{#name, [](const QImage &image) { return ImageProcessor::name(image, __VA_ARGS__); }, \
+           [](QImage &&image) { return ImageProcessor::name(std::move(image), __VA_ARGS__); }, inPlace}
+
+// Both overloads give the same pixels, the const& one leaves its input
+// alone and the && one reuses an unshared buffer where it works in place
+void testMoveOverloads() {
+    const Filter filters[] = {
+        FILTER(applyBrightness, true, 20),
+        FILTER(applyContrast, true, 35.0f),
+        FILTER(applySaturation, true, -40.0f),
+        FILTER(applyHueShift, true, 60),
+        FILTER(applyExposure, true, 0.7f),
+        FILTER(applyLevels, true, 10, 120, 230),
+        FILTER(applyCurves, true, QVector<QPointF>({QPointF(0, 0), QPointF(128, 160), QPointF(255, 255)})),
+        FILTER(applyGaussianBlur, true, 4.0f),
+        FILTER(applyVignette, true, 50.0f, 40.0f),
+        FILTER(applySharpness, false, 60.0f),
+        FILTER(applySepia, false, 80.0f),
+    };
+
+    const QImage original = randomImage(173, 91, 3);
+    for (const Filter &filter : filters) {
+        const QImage input = original.copy();
+        const QImage byReference = filter.byReference(input);
+        expect(input == original, filter.name, "const& overload changed its input");
+
+        // A shared image is copied, the other owner keeps its pixels
+        QImage shared = input;
+        const QImage byMove = filter.byMove(std::move(shared));
+        expect(byMove == byReference, filter.name, "&& and const& overloads differ");
+        expect(input == original, filter.name, "&& overload changed a shared image");
+
+        if (filter.inPlace) {
+            QImage unshared = original.copy();
+            const uchar *bits = unshared.constBits();
+            const QImage result = filter.byMove(std::move(unshared));
+            expect(result.constBits() == bits, filter.name, "unshared image was copied");
+            expect(result == byReference, filter.name, "in-place result differs");
+        }
+    }
+
+    // A chain of in-place filters runs on one buffer
+    QImage image = original.copy();
+    const uchar *bits = image.constBits();
+    const QImage chained = ImageProcessor::applyContrast(ImageProcessor::applyBrightness(std::move(image), 10), 20.0f);
+    expect(chained.constBits() == bits, "chain", "chained filters copied the image");
+    expect(chained == ImageProcessor::applyContrast(ImageProcessor::applyBrightness(original, 10), 20.0f), "chain",
+           "chained result differs");
+}
+
+} // namespace
+
+int main() {
+    testViews();
+    testViewKernels();
+    testMoveOverloads();
+    std::printf("%s ImageView\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,149 @@
+#include "MedianKernels.h"
+
+#include <QImage>
+
+#include <algorithm>
+#include <cstdio>
+
+using namespace Knoux::Utils;
+
+namespace {
+
+int failures = 0;
+
+void expect(bool condition, const char *test, const char *what) {
+    if (condition) return;
+    ++failures;
+    std::printf("FAIL %s: %s\n", test, what);
+}
+
+// xorshift32, the same sequence on every platform
+class Random {
+public:
+    explicit Random(quint32 seed) : m_state(seed ? seed : 1) {}
+
+    quint32 next() {
+        m_state ^= m_state << 13;
+        m_state ^= m_state >> 17;
+        m_state ^= m_state << 5;
+        return m_state;
+    }
+
+private:
+    quint32 m_state;
+};
+
+// Noise on a gradient, so windows hold both runs and outliers
+QImage testImage(int width, int height, QImage::Format format, quint32 seed) {
+    QImage image(width, height, format);
+    Random random(seed);
+    for (int y = 0; y < height; ++y) {
+        QRgb *row = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 0; x < width; ++x) {
+            const quint32 noise = random.next();
+            const int base = (x * 3 + y * 2) & 255;
+            row[x] = qRgba((base + int(noise & 63)) & 255, int(noise >> 8) & 255,
+                           (base ^ int(noise >> 16)) & 255, int(noise >> 24));
+        }
+    }
+    return image;
+}
+
+int channel(QRgb pixel, int c) {
+    return c == 0 ? qRed(pixel) : c == 1 ? qGreen(pixel) : qBlue(pixel);
+}
+
+// ============================================================================
+// Median
+// ============================================================================
+
+// Sorts every window, edge pixels repeated past the border
+QImage naiveMedian(const QImage &image, int radius) {
+    QImage result(image.size(), image.format());
+    const int side = 2 * radius + 1;
+    QVector<int> values(side * side);
+    for (int y = 0; y < image.height(); ++y) {
+        for (int x = 0; x < image.width(); ++x) {
+            int rgb[3];
+            for (int c = 0; c < 3; ++c) {
+                int n = 0;
+                for (int dy = -radius; dy <= radius; ++dy) {
+                    const int sy = qBound(0, y + dy, image.height() - 1);
+                    for (int dx = -radius; dx <= radius; ++dx) {
+                        const int sx = qBound(0, x + dx, image.width() - 1);
+                        values[n++] = channel(image.pixel(sx, sy), c);
+                    }
+                }
+                std::nth_element(values.begin(), values.begin() + n / 2, values.begin() + n);
+                rgb[c] = values[n / 2];
+            }
+            result.setPixel(x, y, qRgba(rgb[0], rgb[1], rgb[2], qAlpha(image.pixel(x, y))));
+        }
+    }
+    return result;
+}
+
+void testMedian() {
+    // Sizes straddle the tile edges, radii cover the unit window and wide ones
+    const QSize sizes[] = {QSize(1, 1), QSize(7, 3), QSize(131, 70), QSize(300, 41)};
+    const int radii[] = {0, 1, 2, 5, 17};
+    quint32 seed = 1;
+    for (const QSize &size : sizes) {
+        for (int radius : radii) {
+            const QImage image = testImage(size.width(), size.height(), QImage::Format_ARGB32, seed++);
+            const QImage fast = MedianKernels::median(image, radius);
+            expect(fast.size() == image.size(), "median", "size changed");
+            expect(fast == naiveMedian(image, radius), "median", "differs from a sorted window");
+        }
+    }
+}
+
+// ============================================================================
+// Minimum
+// ============================================================================
+
+// Smallest value of every window, windows clipped at the border
+QImage naiveMinimum(const QImage &image, int radius) {
+    QImage result(image.size(), QImage::Format_Grayscale8);
+    for (int y = 0; y < image.height(); ++y) {
+        uchar *out = result.scanLine(y);
+        for (int x = 0; x < image.width(); ++x) {
+            int lowest = 255;
+            for (int sy = qMax(0, y - radius); sy <= qMin(image.height() - 1, y + radius); ++sy) {
+                const uchar *in = image.constScanLine(sy);
+                for (int sx = qMax(0, x - radius); sx <= qMin(image.width() - 1, x + radius); ++sx)
+                    lowest = qMin(lowest, int(in[sx]));
+            }
+            out[x] = uchar(lowest);
+        }
+    }
+    return result;
+}
+
+void testMinimum() {
+    const QSize sizes[] = {QSize(1, 1), QSize(5, 9), QSize(97, 64)};
+    const int radii[] = {0, 1, 3, 8, 40};
+    quint32 seed = 100;
+    for (const QSize &size : sizes) {
+        for (int radius : radii) {
+            const QImage gray = testImage(size.width(), size.height(), QImage::Format_ARGB32, seed++)
+                                    .convertToFormat(QImage::Format_Grayscale8);
+            const QImage fast = MedianKernels::minimum(gray, radius);
+            const QImage naive = naiveMinimum(gray, radius);
+            bool same = fast.size() == naive.size();
+            for (int y = 0; same && y < naive.height(); ++y)
+                same = std::equal(naive.constScanLine(y), naive.constScanLine(y) + naive.width(),
+                                  fast.constScanLine(y));
+            expect(same, "minimum", "differs from a scanned window");
+        }
+    }
+}
+
+} // namespace
+
+int main() {
+    testMedian();
+    testMinimum();
+    std::printf("%s MedianKernels\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
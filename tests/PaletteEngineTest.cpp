@@ -0,0 +1,147 @@
+#include "PaletteEngine.h"
+
+#include <QImage>
+
+#include <climits>
+#include <cstdio>
+
+using namespace Knoux::Utils;
+
+namespace {
+
+int failures = 0;
+
+void expect(bool condition, const char *test, const char *what) {
+    if (condition) return;
+    ++failures;
+    std::printf("FAIL %s: %s\n", test, what);
+}
+
+// xorshift32, the same sequence on every platform
+class Random {
+public:
+    explicit Random(quint32 seed) : m_state(seed ? seed : 1) {}
+
+    quint32 next() {
+        m_state ^= m_state << 13;
+        m_state ^= m_state >> 17;
+        m_state ^= m_state << 5;
+        return m_state;
+    }
+
+private:
+    quint32 m_state;
+};
+
+// Smooth color fields with noise, many occupied bins
+QImage randomImage(int width, int height, quint32 seed) {
+    QImage image(width, height, QImage::Format_ARGB32);
+    Random random(seed);
+    for (int y = 0; y < height; ++y) {
+        QRgb *row = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 0; x < width; ++x) {
+            const quint32 n = random.next();
+            row[x] = qRgb((x * 255 / width + int(n & 31)) & 255, (y * 255 / height + int((n >> 8) & 31)) & 255,
+                          ((x + y) * 2 + int((n >> 16) & 15)) & 255);
+        }
+    }
+    return image;
+}
+
+// ============================================================================
+// Extraction
+// ============================================================================
+
+// An image with a few colors gives back exactly those, most common first
+void testFewColors() {
+    const QRgb colors[] = {qRgb(200, 30, 40), qRgb(10, 120, 250), qRgb(90, 90, 90), qRgb(250, 250, 5)};
+    const int shares[] = {40, 30, 20, 10};
+
+    QImage image(100, 50, QImage::Format_ARGB32);
+    for (int y = 0; y < image.height(); ++y) {
+        QRgb *row = reinterpret_cast<QRgb *>(image.scanLine(y));
+        int color = 0, end = shares[0];
+        for (int x = 0; x < image.width(); ++x) {
+            if (x >= end) end += shares[++color];
+            row[x] = colors[color];
+        }
+    }
+    // Transparent pixels of another color are ignored
+    for (int x = 0; x < 30; ++x) image.setPixel(x, 0, qRgba(0, 255, 0, 0));
+
+    const QVector<QRgb> palette = PaletteEngine::extract(image, 4);
+    expect(palette == QVector<QRgb>({colors[0], colors[1], colors[2], colors[3]}), "few colors",
+           "palette is not the image colors by frequency");
+    expect(PaletteEngine::extract(image, 16) == palette, "few colors", "extra colors made up");
+    expect(PaletteEngine::extract(image, 2).size() == 2, "few colors", "more colors than requested");
+
+    const QImage indexed = PaletteEngine::quantize(image, palette);
+    bool exact = indexed.format() == QImage::Format_Indexed8;
+    for (int y = 1; exact && y < image.height(); ++y) {
+        const uchar *line = indexed.constScanLine(y);
+        for (int x = 0; x < image.width(); ++x) exact = exact && palette[line[x]] == image.pixel(x, y);
+    }
+    expect(exact, "few colors", "quantized pixels are not their own colors");
+}
+
+void testDeterministic() {
+    const QImage image = randomImage(640, 480, 3);
+    for (int colors : {1, 5, 16, 64}) {
+        const QVector<QRgb> palette = PaletteEngine::extract(image, colors);
+        expect(!palette.isEmpty() && palette.size() <= colors, "deterministic", "palette size out of range");
+        expect(PaletteEngine::extract(image, colors) == palette, "deterministic", "second extraction differs");
+        bool opaque = true;
+        for (QRgb color : palette) opaque = opaque && qAlpha(color) == 255;
+        expect(opaque, "deterministic", "palette color is not opaque");
+    }
+
+    // A smaller budget samples a sparser grid, still the same result each time
+    const QVector<QRgb> sparse = PaletteEngine::extract(image, 8, 1000);
+    expect(PaletteEngine::extract(image, 8, 1000) == sparse, "deterministic", "sparse extraction differs");
+}
+
+// ============================================================================
+// Quantization
+// ============================================================================
+
+// Every pixel maps to the entry closest to the center of its 15-bit bin,
+// the first one on ties
+void testQuantize() {
+    const QImage image = randomImage(301, 77, 11);
+    const QVector<QRgb> palette = PaletteEngine::extract(image, 16);
+    const QImage indexed = PaletteEngine::quantize(image, palette);
+    expect(indexed.format() == QImage::Format_Indexed8, "quantize", "not an indexed image");
+    expect(indexed.size() == image.size(), "quantize", "size changed");
+    expect(indexed.colorTable() == palette, "quantize", "color table is not the palette");
+
+    bool nearest = true;
+    for (int y = 0; y < image.height(); ++y) {
+        for (int x = 0; x < image.width(); ++x) {
+            const QRgb p = image.pixel(x, y);
+            const int center[] = {(qRed(p) & ~7) | 4, (qGreen(p) & ~7) | 4, (qBlue(p) & ~7) | 4};
+            int best = 0, bestDistance = INT_MAX;
+            for (int i = 0; i < palette.size(); ++i) {
+                const int dr = center[0] - qRed(palette[i]);
+                const int dg = center[1] - qGreen(palette[i]);
+                const int db = center[2] - qBlue(palette[i]);
+                const int distance = dr * dr + dg * dg + db * db;
+                if (distance < bestDistance) {
+                    bestDistance = distance;
+                    best = i;
+                }
+            }
+            nearest = nearest && indexed.constScanLine(y)[x] == best;
+        }
+    }
+    expect(nearest, "quantize", "pixel not mapped to the nearest entry");
+}
+
+} // namespace
+
+int main() {
+    testFewColors();
+    testDeterministic();
+    testQuantize();
+    std::printf("%s PaletteEngine\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
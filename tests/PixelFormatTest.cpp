@@ -0,0 +1,192 @@
+#include "PixelFormat.h"
+#include "HistogramStats.h"
+#include "ImageProcessor.h"
+
+#include <QImage>
+
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+
+using namespace Knoux::Utils;
+
+namespace {
+
+int failures = 0;
+
+void expect(bool condition, const char *test, const char *what) {
+    if (condition) return;
+    ++failures;
+    std::printf("FAIL %s: %s\n", test, what);
+}
+
+// xorshift32, the same sequence on every platform
+class Random {
+public:
+    explicit Random(quint32 seed) : m_state(seed ? seed : 1) {}
+
+    quint32 next() {
+        m_state ^= m_state << 13;
+        m_state ^= m_state >> 17;
+        m_state ^= m_state << 5;
+        return m_state;
+    }
+
+private:
+    quint32 m_state;
+};
+
+QImage randomImage(int width, int height, quint32 seed) {
+    QImage image(width, height, QImage::Format_ARGB32);
+    Random random(seed);
+    for (int y = 0; y < height; ++y) {
+        QRgb *row = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 0; x < width; ++x) row[x] = random.next() | 0xff000000u;
+    }
+    return image;
+}
+
+// Largest channel difference between two images of the same size
+int maxDifference(const QImage &a, const QImage &b) {
+    int difference = 0;
+    for (int y = 0; y < a.height(); ++y) {
+        for (int x = 0; x < a.width(); ++x) {
+            const QRgb p = a.pixel(x, y);
+            const QRgb q = b.pixel(x, y);
+            difference = qMax(difference, qMax(std::abs(qRed(p) - qRed(q)), std::abs(qGreen(p) - qGreen(q))));
+            difference = qMax(difference, std::abs(qBlue(p) - qBlue(q)));
+        }
+    }
+    return difference;
+}
+
+// ============================================================================
+// Traits
+// ============================================================================
+
+// Every layout reads back what make() stored, within its precision
+template <typename Traits>
+bool roundTrips() {
+    for (int v = 0; v <= Traits::Max; v += Traits::Max / 255) {
+        const int r = v, g = Traits::Max - v, b = (v * 7) % (Traits::Max + 1);
+        const typename Traits::Pixel p = Traits::make(r, g, b, v);
+        if constexpr (Traits::IsGray) {
+            if (Traits::red(p) != (r * 11 + g * 16 + b * 5) >> 5) return false;
+            if (Traits::make(v, v, v, v) != v) return false;
+        } else {
+            if (Traits::red(p) != r || Traits::green(p) != g || Traits::blue(p) != b) return false;
+        }
+        if (Traits::alpha(p) != (Traits::HasAlpha ? v : Traits::Max)) return false;
+    }
+    return true;
+}
+
+void testTraits() {
+    expect(roundTrips<PixelTraits<QImage::Format_Grayscale8>>(), "traits", "Grayscale8 round trip");
+    expect(roundTrips<PixelTraits<QImage::Format_ARGB32>>(), "traits", "ARGB32 round trip");
+    expect(roundTrips<PixelTraits<QImage::Format_RGB32>>(), "traits", "RGB32 round trip");
+    expect(roundTrips<PixelTraits<QImage::Format_RGBA64>>(), "traits", "RGBA64 round trip");
+    expect(roundTrips<PixelTraits<QImage::Format_RGBX64>>(), "traits", "RGBX64 round trip");
+
+    // RGB888 has no operator==, compare the channels
+    bool rgb888 = true;
+    using Rgb = PixelTraits<QImage::Format_RGB888>;
+    for (int v = 0; v < 256; ++v) {
+        const Rgb888 p = Rgb::make(v, 255 - v, v / 2, 0);
+        rgb888 = rgb888 && Rgb::red(p) == v && Rgb::green(p) == 255 - v && Rgb::blue(p) == v / 2
+                 && Rgb::alpha(p) == 255;
+    }
+    expect(rgb888, "traits", "RGB888 round trip");
+
+    bool visited = visitPixelFormat(QImage::Format_RGB888, [](auto traits) {
+        return decltype(traits)::Format == QImage::Format_RGB888;
+    });
+    expect(visited, "traits", "visitPixelFormat picked the wrong traits");
+    expect(!visitPixelFormat(QImage::Format_Mono, [](auto) { return true; }), "traits",
+           "visitPixelFormat accepted a format without traits");
+}
+
+// ============================================================================
+// Native Filters
+// ============================================================================
+
+using Filter = std::function<QImage(const QImage &)>;
+
+struct NamedFilter {
+    const char *name;
+    Filter filter;
+    bool perChannel;  // The same operation on every channel
+    bool deep;        // Keeps 16-bit channels, LUT filters work on 8 bits
+};
+
+// The per-channel filters keep Grayscale8, RGB888 and RGBA64 as they are
+// and give the pixels of the ARGB32 path
+void testNativeFilters() {
+    const NamedFilter filters[] = {
+        {"brightness", [](const QImage &i) { return ImageProcessor::applyBrightness(i, 25); }, true, true},
+        {"contrast", [](const QImage &i) { return ImageProcessor::applyContrast(i, -30.0f); }, true, true},
+        {"exposure", [](const QImage &i) { return ImageProcessor::applyExposure(i, 0.6f); }, true, true},
+        {"whites", [](const QImage &i) { return ImageProcessor::applyWhites(i, 40.0f); }, true, true},
+        {"blacks", [](const QImage &i) { return ImageProcessor::applyBlacks(i, -25.0f); }, true, true},
+        {"levels", [](const QImage &i) { return ImageProcessor::applyLevels(i, 20, 140, 220); }, true, false},
+        {"color balance", [](const QImage &i) { return ImageProcessor::applyColorBalance(i, 30, -10, 5); },
+         false, true},
+    };
+
+    const QImage argb = randomImage(97, 61, 5);
+    const QImage rgb888 = argb.convertToFormat(QImage::Format_RGB888);
+    const QImage gray = argb.convertToFormat(QImage::Format_Grayscale8);
+    const QImage rgba64 = argb.convertToFormat(QImage::Format_RGBA64);
+
+    for (const NamedFilter &f : filters) {
+        const QImage expected = f.filter(argb);
+
+        const QImage native888 = f.filter(rgb888);
+        expect(native888.format() == QImage::Format_RGB888, f.name, "RGB888 not kept");
+        expect(native888.convertToFormat(QImage::Format_ARGB32) == expected, f.name, "RGB888 pixels differ");
+
+        // Gray stays gray when every channel gets the same operation
+        const QImage nativeGray = f.filter(gray);
+        const QImage grayExpected = f.filter(gray.convertToFormat(QImage::Format_ARGB32));
+        if (f.perChannel) {
+            expect(nativeGray.format() == QImage::Format_Grayscale8, f.name, "Grayscale8 not kept");
+            expect(nativeGray == grayExpected.convertToFormat(QImage::Format_Grayscale8), f.name,
+                   "Grayscale8 pixels differ");
+        } else {
+            expect(nativeGray.convertToFormat(QImage::Format_ARGB32) == grayExpected, f.name,
+                   "widened gray pixels differ");
+        }
+
+        // 16-bit channels only round differently
+        const QImage native64 = f.filter(rgba64);
+        if (f.deep) expect(native64.format() == QImage::Format_RGBA64, f.name, "RGBA64 not kept");
+        expect(maxDifference(native64.convertToFormat(QImage::Format_ARGB32), expected) <= 1, f.name,
+               "RGBA64 pixels differ by more than rounding");
+    }
+}
+
+// Native layouts are counted as stored, 16-bit channels by their top byte
+void testNativeHistograms() {
+    const QImage argb = randomImage(150, 140, 8);
+    const HistogramStats expected(argb);
+    const QImage::Format formats[] = {QImage::Format_RGB888, QImage::Format_RGB32, QImage::Format_RGBA64};
+    for (QImage::Format format : formats) {
+        const HistogramStats stats(argb.convertToFormat(format));
+        bool same = stats.count() == expected.count();
+        for (int c = 0; c < HistogramStats::ChannelCount; ++c) {
+            const HistogramStats::Channel channel = HistogramStats::Channel(c);
+            for (int v = 0; v < HistogramStats::Bins; ++v) same = same && stats.bin(channel, v) == expected.bin(channel, v);
+        }
+        expect(same, "histograms", "native layout counted differently");
+    }
+}
+
+} // namespace
+
+int main() {
+    testTraits();
+    testNativeFilters();
+    testNativeHistograms();
+    std::printf("%s PixelFormat\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
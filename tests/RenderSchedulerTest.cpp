@@ -0,0 +1,145 @@
+#include "RenderScheduler.h"
+
+#include <QImage>
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+using namespace Knoux::Utils;
+
+namespace {
+
+int failures = 0;
+
+void expect(bool condition, const char *test, const char *what) {
+    if (condition) return;
+    ++failures;
+    std::printf("FAIL %s: %s\n", test, what);
+}
+
+// xorshift32, the same sequence on every platform
+class Random {
+public:
+    explicit Random(quint32 seed) : m_state(seed ? seed : 1) {}
+
+    quint32 next() {
+        m_state ^= m_state << 13;
+        m_state ^= m_state >> 17;
+        m_state ^= m_state << 5;
+        return m_state;
+    }
+
+    int range(int low, int high) { return low + int(next() % quint32(high - low + 1)); }
+
+private:
+    quint32 m_state;
+};
+
+QImage randomImage(int width, int height, quint32 seed) {
+    QImage image(width, height, QImage::Format_ARGB32);
+    Random random(seed);
+    for (int y = 0; y < height; ++y) {
+        QRgb *row = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 0; x < width; ++x) row[x] = random.next() | 0xff000000u;
+    }
+    return image;
+}
+
+QImage render(const QImage &source, const AdjustmentGraph::Parameters &parameters) {
+    AdjustmentGraph graph;
+    graph.setSource(source);
+    return graph.render(parameters);
+}
+
+// Every request ends up in exactly one of the counts once nothing is running
+bool accounted(const RenderScheduler::Stats &stats) {
+    return stats.requested == stats.completed + stats.replaced + stats.cancelled + stats.discarded;
+}
+
+// ============================================================================
+// Requests
+// ============================================================================
+
+void testFinish() {
+    const QImage source = randomImage(200, 150, 1);
+    AdjustmentGraph::Parameters p;
+    p.noiseReduction = 30;
+    p.contrast = 25;
+    p.vignette = -20;
+
+    RenderScheduler scheduler;
+    expect(scheduler.finish().isNull(), "finish", "result without a request");
+    const quint64 version = scheduler.request(source, p);
+    expect(scheduler.finish() == render(source, p), "finish", "result differs from a direct render");
+    expect(scheduler.finish().isNull(), "finish", "the same result returned twice");
+    expect(scheduler.request(source, p) == version + 1, "finish", "versions do not count up");
+    scheduler.finish();
+
+    // A result left waiting, with no event loop to publish it, then superseded
+    scheduler.request(source, p);
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    p.contrast = -10;
+    scheduler.request(source, p);
+    expect(scheduler.finish() == render(source, p), "finish", "result differs after a waiting one");
+
+    const RenderScheduler::Stats stats = scheduler.stats();
+    expect(stats.requested == 4 && stats.completed == 3, "finish", "counts of plain requests");
+    expect(accounted(stats), "finish", "request not accounted for");
+}
+
+// Slider drags: only the newest request of each burst comes out, from
+// whichever source it had
+void testNewestWins() {
+    const QImage sources[] = {randomImage(240, 180, 2), randomImage(240, 180, 3)};
+    Random random(7);
+    RenderScheduler scheduler;
+    for (int burst = 0; burst < 6; ++burst) {
+        AdjustmentGraph::Parameters p;
+        const int count = random.range(1, 15);
+        int source = 0;
+        for (int i = 0; i < count; ++i) {
+            p.noiseReduction = random.range(0, 60);
+            p.brightness = random.range(-50, 50);
+            p.saturation = random.range(-50, 50);
+            p.sharpness = random.range(0, 40);
+            source = random.range(0, 1);
+            scheduler.request(sources[source], p);
+        }
+        expect(scheduler.finish() == render(sources[source], p), "newest wins", "result is not the newest request's");
+    }
+
+    const RenderScheduler::Stats stats = scheduler.stats();
+    expect(stats.completed == 6, "newest wins", "one result per burst");
+    expect(accounted(stats), "newest wins", "request not accounted for");
+}
+
+// Nothing comes out for cancelled requests, later ones still do
+void testCancel() {
+    const QImage source = randomImage(220, 160, 4);
+    AdjustmentGraph::Parameters p;
+    p.noiseReduction = 80;
+    RenderScheduler scheduler;
+
+    scheduler.request(source, p);
+    scheduler.request(source, p);
+    scheduler.cancel();
+    expect(scheduler.finish().isNull(), "cancel", "cancelled request has a result");
+
+    p.hue = 40;
+    scheduler.request(source, p);
+    expect(scheduler.finish() == render(source, p), "cancel", "request after a cancel differs");
+    const RenderScheduler::Stats stats = scheduler.stats();
+    expect(stats.requested == 3 && stats.completed == 1, "cancel", "counts after a cancel");
+    expect(accounted(stats), "cancel", "request not accounted for");
+}
+
+} // namespace
+
+int main() {
+    testFinish();
+    testNewestWins();
+    testCancel();
+    std::printf("%s RenderScheduler\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,182 @@
+#include "Resampler.h"
+
+#include <QImage>
+#include <QtMath>
+
+#include <cstdio>
+#include <cstdlib>
+
+using namespace Knoux::Utils;
+
+namespace {
+
+int failures = 0;
+
+void expect(bool condition, const char *test, const char *what) {
+    if (condition) return;
+    ++failures;
+    std::printf("FAIL %s: %s\n", test, what);
+}
+
+// xorshift32, the same sequence on every platform
+class Random {
+public:
+    explicit Random(quint32 seed) : m_state(seed ? seed : 1) {}
+
+    quint32 next() {
+        m_state ^= m_state << 13;
+        m_state ^= m_state >> 17;
+        m_state ^= m_state << 5;
+        return m_state;
+    }
+
+private:
+    quint32 m_state;
+};
+
+QImage randomImage(int width, int height, quint32 seed) {
+    QImage image(width, height, QImage::Format_RGB32);
+    Random random(seed);
+    for (int y = 0; y < height; ++y) {
+        QRgb *row = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 0; x < width; ++x) row[x] = random.next() | 0xff000000u;
+    }
+    return image;
+}
+
+bool allPixels(const QImage &image, QRgb color) {
+    for (int y = 0; y < image.height(); ++y) {
+        for (int x = 0; x < image.width(); ++x) {
+            if (image.pixel(x, y) != color) return false;
+        }
+    }
+    return true;
+}
+
+const ResampleFilter Filters[] = {ResampleFilter::Auto, ResampleFilter::Area, ResampleFilter::Bilinear,
+                                  ResampleFilter::Bicubic, ResampleFilter::Lanczos3};
+
+// ============================================================================
+// Resize
+// ============================================================================
+
+// Weights of every filter sum to one, a flat image stays flat
+void testConstant() {
+    QImage image(37, 23, QImage::Format_RGB32);
+    image.fill(0xff3c82d7u);
+    const QSize sizes[] = {QSize(37, 23), QSize(100, 9), QSize(5, 60), QSize(1, 1), QSize(74, 46)};
+    for (ResampleFilter filter : Filters) {
+        for (const QSize &size : sizes) {
+            const QImage result = Resampler::resize(image, size, filter);
+            expect(result.size() == size, "constant", "wrong size");
+            expect(allPixels(result, 0xff3c82d7u), "constant", "flat image changed");
+        }
+    }
+}
+
+// Halving with the box filter is the rounded 2x2 mean
+void testArea() {
+    const QImage image = randomImage(64, 48, 3);
+    const QImage result = Resampler::resize(image, QSize(32, 24), ResampleFilter::Area);
+    int worst = 0;
+    for (int y = 0; y < result.height(); ++y) {
+        for (int x = 0; x < result.width(); ++x) {
+            const QRgb p[] = {image.pixel(2 * x, 2 * y), image.pixel(2 * x + 1, 2 * y), image.pixel(2 * x, 2 * y + 1),
+                              image.pixel(2 * x + 1, 2 * y + 1)};
+            const QRgb out = result.pixel(x, y);
+            const int red = (qRed(p[0]) + qRed(p[1]) + qRed(p[2]) + qRed(p[3]) + 2) / 4;
+            const int green = (qGreen(p[0]) + qGreen(p[1]) + qGreen(p[2]) + qGreen(p[3]) + 2) / 4;
+            const int blue = (qBlue(p[0]) + qBlue(p[1]) + qBlue(p[2]) + qBlue(p[3]) + 2) / 4;
+            worst = qMax(worst, qMax(std::abs(qRed(out) - red), qMax(std::abs(qGreen(out) - green),
+                                                                      std::abs(qBlue(out) - blue))));
+        }
+    }
+    expect(worst <= 1, "area", "halved pixel is not the 2x2 mean");
+
+    // Auto shrinks with the box filter and enlarges with bicubic
+    expect(Resampler::resize(image, QSize(20, 30)) == Resampler::resize(image, QSize(20, 30), ResampleFilter::Area),
+           "area", "Auto does not shrink with Area");
+    expect(Resampler::resize(image, QSize(90, 70)) == Resampler::resize(image, QSize(90, 70), ResampleFilter::Bicubic),
+           "area", "Auto does not enlarge with Bicubic");
+}
+
+// A horizontal ramp stays a ramp: rows equal and never decreasing
+void testRamp() {
+    QImage image(16, 8, QImage::Format_RGB32);
+    for (int y = 0; y < image.height(); ++y) {
+        for (int x = 0; x < image.width(); ++x) image.setPixel(x, y, qRgb(x * 17, x * 17, x * 17));
+    }
+    for (ResampleFilter filter : {ResampleFilter::Area, ResampleFilter::Bilinear}) {
+        for (const QSize &size : {QSize(61, 19), QSize(7, 3)}) {
+            const QImage result = Resampler::resize(image, size, filter);
+            bool ramp = true;
+            for (int y = 0; y < result.height(); ++y) {
+                for (int x = 0; x < result.width(); ++x) {
+                    ramp = ramp && result.pixel(x, y) == result.pixel(x, 0);
+                    if (x > 0) ramp = ramp && qRed(result.pixel(x, y)) >= qRed(result.pixel(x - 1, y));
+                }
+            }
+            expect(ramp, "ramp", "ramp lost its order");
+        }
+    }
+}
+
+// Transparent pixels carry no color into their opaque neighbours
+void testAlpha() {
+    QImage image(40, 20, QImage::Format_ARGB32);
+    for (int y = 0; y < image.height(); ++y) {
+        for (int x = 0; x < image.width(); ++x) {
+            image.setPixel(x, y, x < 20 ? qRgba(255, 0, 0, 0) : qRgba(0, 0, 255, 255));
+        }
+    }
+    for (ResampleFilter filter : Filters) {
+        const QImage result = Resampler::resize(image, QSize(23, 31), filter);
+        expect(result.format() == QImage::Format_ARGB32, "alpha", "format not kept");
+        bool clean = true;
+        for (int y = 0; y < result.height(); ++y) {
+            for (int x = 0; x < result.width(); ++x) {
+                const QRgb p = result.pixel(x, y);
+                clean = clean && (qAlpha(p) == 0 || (qRed(p) == 0 && qGreen(p) == 0));
+            }
+        }
+        expect(clean, "alpha", "transparent color bled into the edge");
+    }
+}
+
+// ============================================================================
+// Rotate
+// ============================================================================
+
+void testRotate() {
+    QImage image(120, 80, QImage::Format_ARGB32);
+    image.fill(0xff20c060u);
+    for (ResampleFilter filter : {ResampleFilter::Bilinear, ResampleFilter::Bicubic}) {
+        const QImage result = Resampler::rotate(image, 30.0f, filter);
+        const double radians = qDegreesToRadians(30.0);
+        const int width = qRound(120 * std::cos(radians) + 80 * std::sin(radians));
+        const int height = qRound(120 * std::sin(radians) + 80 * std::cos(radians));
+        expect(result.size() == QSize(width, height), "rotate", "not the bounding box");
+
+        // Covered pixels keep the color, uncovered corners are transparent
+        const QRect middle(result.width() / 2 - 20, result.height() / 2 - 20, 40, 40);
+        bool inside = true;
+        for (int y = middle.top(); y <= middle.bottom(); ++y) {
+            for (int x = middle.left(); x <= middle.right(); ++x) inside = inside && result.pixel(x, y) == 0xff20c060u;
+        }
+        expect(inside, "rotate", "covered pixel changed");
+        expect(qAlpha(result.pixel(0, 0)) == 0 && qAlpha(result.pixel(result.width() - 1, result.height() - 1)) == 0,
+               "rotate", "corner not transparent");
+    }
+}
+
+} // namespace
+
+int main() {
+    testConstant();
+    testArea();
+    testRamp();
+    testAlpha();
+    testRotate();
+    std::printf("%s Resampler\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,98 @@
+#include "ScratchArena.h"
+
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+using namespace Knoux::Utils;
+
+namespace {
+
+int failures = 0;
+
+void expect(bool condition, const char *test, const char *what) {
+    if (condition) return;
+    ++failures;
+    std::printf("FAIL %s: %s\n", test, what);
+}
+
+// Borrows count buffers of bytes each and returns them all at once
+void fill(int count, qsizetype bytes) {
+    std::vector<ScratchArena::Buffer> buffers;
+    for (int i = 0; i < count; ++i) buffers.push_back(ScratchArena::acquire(bytes));
+}
+
+// ============================================================================
+// Cache Limit
+// ============================================================================
+
+void testLimit() {
+    const qsizetype frame = qsizetype(4) << 20;
+    ScratchArena::trim();
+    ScratchArena::setCacheLimit(2 * frame);
+
+    // Twice the limit returned at once, the rest goes back to the heap
+    fill(4, frame);
+    expect(ScratchArena::counters().cachedBytes <= 2 * frame, "limit", "cache grew past the limit");
+    expect(ScratchArena::counters().cachedBytes > 0, "limit", "nothing was cached");
+
+    // The cached buffers come back without an allocation
+    const quint64 misses = ScratchArena::counters().misses;
+    fill(1, frame);
+    expect(ScratchArena::counters().misses == misses, "limit", "cached buffer was not reused");
+
+    // Lowering the limit trims what no longer fits
+    ScratchArena::setCacheLimit(frame / 2);
+    expect(ScratchArena::counters().cachedBytes <= frame / 2, "limit", "lowering the limit did not trim");
+
+    ScratchArena::setCacheLimit(ScratchArena::DefaultCacheLimit);
+}
+
+// ============================================================================
+// Trim
+// ============================================================================
+
+void testTrim() {
+    const qsizetype frame = qsizetype(4) << 20;
+    ScratchArena::trim();
+    ScratchArena::setCacheLimit(8 * frame);
+
+    // Workers keep their caches while they run, trim() frees them from here
+    std::atomic<int> filled(0);
+    std::atomic<bool> done(false);
+    std::vector<std::thread> workers;
+    for (int i = 0; i < 3; ++i) {
+        workers.emplace_back([&] {
+            fill(2, frame);
+            ++filled;
+            while (!done) std::this_thread::yield();
+        });
+    }
+    while (filled < int(workers.size())) std::this_thread::yield();
+    fill(1, frame);
+
+    expect(ScratchArena::counters().cachedBytes > 2 * frame, "trim", "workers cached nothing");
+    ScratchArena::trim();
+    expect(ScratchArena::counters().cachedBytes == 0, "trim", "cache of a running thread survived trim()");
+
+    done = true;
+    for (std::thread &worker : workers) worker.join();
+
+    // Thread exit frees the rest, buffers returned later are not kept
+    fill(1, frame);
+    ScratchArena::trim();
+    expect(ScratchArena::counters().cachedBytes == 0, "trim", "cache left after trim()");
+    expect(ScratchArena::counters().liveBytes == 0, "trim", "buffers still borrowed");
+
+    ScratchArena::setCacheLimit(ScratchArena::DefaultCacheLimit);
+}
+
+} // namespace
+
+int main() {
+    testLimit();
+    testTrim();
+    std::printf("%s ScratchArena\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,414 @@
+#include "SimdKernels.h"
+
+#include <QVector>
+
+#include <cstdio>
+#include <cstring>
+#include <functional>
+
+using namespace Knoux::Utils;
+
+namespace {
+
+// Random pixels on top of the exhaustive channel patterns
+constexpr int RandomPixels = 1 << 20;
+constexpr int PatternPixels = 1 << 16;
+
+int failures = 0;
+
+// xorshift32, the same sequence on every platform
+class Random {
+public:
+    explicit Random(quint32 seed) : m_state(seed ? seed : 1) {}
+
+    quint32 next() {
+        m_state ^= m_state << 13;
+        m_state ^= m_state >> 17;
+        m_state ^= m_state << 5;
+        return m_state;
+    }
+
+    int range(int low, int high) { return low + int(next() % quint32(high - low + 1)); }
+
+private:
+    quint32 m_state;
+};
+
+// Every low and high byte pair once, then random pixels. The pattern puts
+// value i & 255 in one channel and i >> 8 in the next, so each channel sees
+// every pair of values against its neighbour; blend layers get the bytes
+// swapped, which pairs every base value with every layer value.
+QVector<QRgb> testPixels(quint32 seed, bool swapped) {
+    QVector<QRgb> pixels(PatternPixels + RandomPixels);
+    for (int i = 0; i < PatternPixels; ++i) {
+        const quint32 low = quint32(swapped ? i >> 8 : i & 255);
+        const quint32 high = quint32(swapped ? i & 255 : i >> 8);
+        pixels[i] = (low << 24) | (high << 16) | (low << 8) | high;
+    }
+    Random random(seed);
+    for (int i = PatternPixels; i < pixels.size(); ++i) pixels[i] = random.next();
+    return pixels;
+}
+
+// Runs kernel over count items in chunks of random length, so every tail
+// length and alignment is covered
+void forChunks(int count, quint32 seed, const std::function<void(int offset, int length)> &kernel) {
+    Random random(seed);
+    for (int offset = 0; offset < count;) {
+        const int length = qMin(count - offset, random.range(1, 300));
+        kernel(offset, length);
+        offset += length;
+    }
+}
+
+template <typename T>
+void expectEqual(const QVector<T> &expected, const QVector<T> &actual, SimdLevel level, const char *kernel) {
+    if (std::memcmp(expected.constData(), actual.constData(), size_t(expected.size()) * sizeof(T)) == 0) return;
+
+    int index = 0;
+    while (std::memcmp(&expected[index], &actual[index], sizeof(T)) == 0) ++index;
+    ++failures;
+    std::printf("FAIL %s %s: item %d differs from scalar\n", SimdKernels::levelName(level), kernel, index);
+}
+
+// Both tables through the same row kernel on copies of input
+template <typename Kernel>
+void compareRows(const QVector<QRgb> &input, SimdLevel level, const char *name, Kernel kernel) {
+    QVector<QRgb> expected = input;
+    QVector<QRgb> actual = input;
+    forChunks(input.size(), 7, [&](int offset, int length) {
+        kernel(SimdKernels::table(SimdLevel::Scalar), expected.data() + offset, length, offset);
+        kernel(SimdKernels::table(level), actual.data() + offset, length, offset);
+    });
+    expectEqual(expected, actual, level, name);
+}
+
+// ============================================================================
+// Color Operations
+// ============================================================================
+
+void testColorOps(SimdLevel level) {
+    const QVector<QRgb> pixels = testPixels(1, false);
+    Random random(2);
+
+    for (int i = 0; i < 4; ++i) {
+        AffineParams params;
+        for (int c = 0; c < 3; ++c) {
+            params.mul[c] = random.range(-(4 << 16), 4 << 16);
+            params.add[c] = random.range(-(255 << 16), 255 << 16);
+        }
+        compareRows(pixels, level, "affine", [&](const SimdKernelTable &table, QRgb *row, int count, int) {
+            table.affine(row, count, params);
+        });
+    }
+
+    for (int factor : {0, 1 << 15, 1 << 16, 3 << 16, -(1 << 16)}) {
+        compareRows(pixels, level, "saturate", [&](const SimdKernelTable &table, QRgb *row, int count, int) {
+            table.saturate(row, count, factor);
+        });
+    }
+
+    for (int factor : {0, 2048, 4096, -4096, 8192}) {
+        compareRows(pixels, level, "vibrance", [&](const SimdKernelTable &table, QRgb *row, int count, int) {
+            table.vibrance(row, count, factor);
+        });
+    }
+
+    for (int shift : {0, 1, 255, 256, 700, 1535}) {
+        compareRows(pixels, level, "hueShift", [&](const SimdKernelTable &table, QRgb *row, int count, int) {
+            table.hueShift(row, count, shift);
+        });
+    }
+
+    // Random lattice, axis entries as the adjustment compiler builds them
+    for (int size : {2, 17, 33}) {
+        QVector<QRgb> lattice(size * size * size);
+        for (QRgb &color : lattice) color = random.next();
+        QVector<int> axis(256);
+        for (int v = 0; v < 256; ++v) {
+            const int position = v * (size - 1) * 256 / 255;
+            const int cell = qMin(position >> 8, size - 2);
+            axis[v] = cell << 9 | (position - (cell << 8));
+        }
+        const CubeLutParams params = {lattice.constData(), axis.constData(), size};
+        compareRows(pixels, level, "cube", [&](const SimdKernelTable &table, QRgb *row, int count, int) {
+            table.cube(row, count, params);
+        });
+    }
+
+    QVector<qint32> noise(pixels.size());
+    for (qint32 &n : noise) n = random.range(-512, 512);
+    for (int strength : {0, 64, 256, 1024}) {
+        compareRows(pixels, level, "grain", [&](const SimdKernelTable &table, QRgb *row, int count, int offset) {
+            table.grain(row, noise.constData() + offset, count, strength);
+        });
+    }
+
+    // Squared distances of a centered row and gains past 1 that clip
+    QVector<qint32> columns(pixels.size());
+    for (int x = 0; x < columns.size(); ++x) columns[x] = (x % 4096 - 2048) * (x % 4096 - 2048);
+    QVector<qint32> gains(1024);
+    for (int i = 0; i < gains.size(); ++i) gains[i] = (3 << 16) - i * 150;
+    for (float row : {0.0f, 1.0e6f, 3.3e6f}) {
+        compareRows(pixels, level, "radialGain", [&](const SimdKernelTable &table, QRgb *line, int count, int offset) {
+            const RadialGainParams params = {columns.constData() + offset, row, 1.0f / 8192.0f,
+                                             gains.constData(), int(gains.size())};
+            table.radialGain(line, count, params);
+        });
+    }
+}
+
+// ============================================================================
+// Blending
+// ============================================================================
+
+void testBlends(SimdLevel level) {
+    const QVector<QRgb> base = testPixels(3, false);
+    const QVector<QRgb> layer = testPixels(4, true);
+
+    for (int mode = 0; mode < int(BlendMode::Count); ++mode) {
+        for (int opacity : {256, 255, 128, 1, 0}) {
+            compareRows(base, level, "blend", [&](const SimdKernelTable &table, QRgb *dst, int count, int offset) {
+                table.blend[mode](dst, base.constData() + offset, layer.constData() + offset, count, opacity);
+            });
+            compareRows(base, level, "composite", [&](const SimdKernelTable &table, QRgb *dst, int count, int offset) {
+                table.composite[mode](dst, base.constData() + offset, layer.constData() + offset, count, opacity);
+            });
+        }
+    }
+}
+
+// ============================================================================
+// Palette, Reduction and Resampling
+// ============================================================================
+
+void testNearest(SimdLevel level) {
+    const QVector<QRgb> pixels = testPixels(5, false);
+    Random random(6);
+
+    for (int size : {1, 2, 16, 255}) {
+        // Repeated entries check that ties go to the lowest index
+        QVector<QRgb> colors(size);
+        for (int i = 0; i < size; ++i) colors[i] = i % 3 == 2 ? colors[i - 1] : random.next();
+        const PaletteParams params = {colors.constData(), size};
+
+        QVector<quint32> expected(pixels.size());
+        QVector<quint32> actual(pixels.size());
+        forChunks(pixels.size(), 8, [&](int offset, int length) {
+            SimdKernels::table(SimdLevel::Scalar).nearest(expected.data() + offset, pixels.constData() + offset, length, params);
+            SimdKernels::table(level).nearest(actual.data() + offset, pixels.constData() + offset, length, params);
+        });
+        expectEqual(expected, actual, level, "nearest");
+    }
+}
+
+void testReduce(SimdLevel level) {
+    const QVector<QRgb> top = testPixels(7, false);
+    const QVector<QRgb> bottom = testPixels(8, true);
+    const int count = top.size() / 2;
+
+    QVector<QRgb> expected(count);
+    QVector<QRgb> actual(count);
+    forChunks(count, 9, [&](int offset, int length) {
+        const QRgb *t = top.constData() + 2 * offset;
+        const QRgb *b = bottom.constData() + 2 * offset;
+        SimdKernels::table(SimdLevel::Scalar).reduce(expected.data() + offset, t, b, length);
+        SimdKernels::table(level).reduce(actual.data() + offset, t, b, length);
+    });
+    expectEqual(expected, actual, level, "reduce");
+}
+
+// Random windows with negative lobes, weights summing to one in 1.14
+void makeTaps(Random &random, int count, int sourceWidth, int taps,
+              QVector<qint32> &first, QVector<qint32> &weights) {
+    first.resize(count);
+    weights.resize(count * taps);
+    for (int i = 0; i < count; ++i) {
+        first[i] = random.range(0, sourceWidth - taps);
+        int sum = 0;
+        for (int k = 1; k < taps; ++k) {
+            weights[k * count + i] = random.range(-4096, 12288);
+            sum += weights[k * count + i];
+        }
+        weights[i] = 16384 - sum;
+    }
+}
+
+void testResample(SimdLevel level) {
+    const QVector<QRgb> pixels = testPixels(10, false);
+    Random random(11);
+    constexpr int Width = 1031;
+    constexpr int Rows = 64;
+
+    for (int taps : {1, 2, 4, 6, 12}) {
+        for (bool premultiplied : {false, true}) {
+            QVector<qint32> first, weights;
+            makeTaps(random, Width, Width, taps, first, weights);
+            const ResampleTaps params = {first.constData(), weights.constData(), taps, Width, premultiplied};
+
+            QVector<QRgb> expected(Width * Rows);
+            QVector<QRgb> actual(Width * Rows);
+            for (int y = 0; y < Rows; ++y) {
+                const QRgb *src = pixels.constData() + y * Width;
+                SimdKernels::table(SimdLevel::Scalar).resampleRow(expected.data() + y * Width, src, Width - y, params);
+                SimdKernels::table(level).resampleRow(actual.data() + y * Width, src, Width - y, params);
+            }
+            expectEqual(expected, actual, level, "resampleRow");
+
+            QVector<const QRgb *> rows(taps);
+            for (int y = 0; y < Rows; ++y) {
+                for (int k = 0; k < taps; ++k) rows[k] = pixels.constData() + (y * 7 + k) * Width;
+                const int index = random.range(0, Width - 1);
+                SimdKernels::table(SimdLevel::Scalar).resampleColumn(expected.data() + y * Width, rows.constData(),
+                                                                     Width - y, params, index);
+                SimdKernels::table(level).resampleColumn(actual.data() + y * Width, rows.constData(),
+                                                         Width - y, params, index);
+            }
+            expectEqual(expected, actual, level, "resampleColumn");
+        }
+    }
+}
+
+// ============================================================================
+// Sampling Along Paths
+// ============================================================================
+
+void testWarp(SimdLevel level) {
+    const QVector<QRgb> pixels = testPixels(12, false);
+    Random random(13);
+    constexpr int Width = 997;
+    constexpr int Height = 512;
+    constexpr int Count = 1200;
+
+    // Bilinear and a cubic with negative lobes, both summing to 256
+    QVector<qint32> bilinear(2 * 256), cubic(4 * 256);
+    for (int f = 0; f < 256; ++f) {
+        bilinear[f] = 256 - f;
+        bilinear[256 + f] = f;
+        const int outer = -(f * (256 - f)) / 512;
+        cubic[f] = outer;
+        cubic[256 + f] = 256 - f - outer;
+        cubic[512 + f] = f - outer;
+        cubic[768 + f] = outer;
+    }
+
+    for (int taps : {2, 4}) {
+        QVector<QRgb> expected(Count * 64);
+        QVector<QRgb> actual(Count * 64);
+        for (int row = 0; row < 64; ++row) {
+            // Walks that start and end outside the source too
+            WarpParams params;
+            params.pixels = pixels.constData();
+            params.stride = Width;
+            params.width = Width;
+            params.height = Height;
+            params.x = random.range(-(200 << 16), (Width + 200) << 16);
+            params.y = random.range(-(200 << 16), (Height + 200) << 16);
+            params.dx = random.range(-(2 << 16), 2 << 16);
+            params.dy = random.range(-(1 << 16), 1 << 16);
+            params.weights = taps == 2 ? bilinear.constData() : cubic.constData();
+            params.taps = taps;
+            const int count = Count - row;
+            SimdKernels::table(SimdLevel::Scalar).warp(expected.data() + row * Count, count, params);
+            SimdKernels::table(level).warp(actual.data() + row * Count, count, params);
+        }
+        expectEqual(expected, actual, level, "warp");
+    }
+}
+
+void testPathBlur(SimdLevel level) {
+    const QVector<QRgb> pixels = testPixels(14, false);
+    Random random(15);
+    constexpr int Width = 997;
+    constexpr int Height = 512;
+    constexpr int Count = 1200;
+
+    for (int taps : {1, 3, 9, 32}) {
+        QVector<qint32> x(taps), dx(taps), y(taps);
+        QVector<QRgb> expected(Count * 16);
+        QVector<QRgb> actual(Count * 16);
+        for (int row = 0; row < 16; ++row) {
+            for (int k = 0; k < taps; ++k) {
+                x[k] = random.range(-(50 << 16), (Width + 50) << 16);
+                dx[k] = random.range(1 << 15, 3 << 15);
+                y[k] = random.range(-(50 << 16), (Height + 50) << 16);
+            }
+            const PathParams params = {pixels.constData(), Width, Width, Height,
+                                       x.constData(), dx.constData(), y.constData(), taps};
+            const int count = Count - row;
+            SimdKernels::table(SimdLevel::Scalar).pathBlur(expected.data() + row * Count, count, params);
+            SimdKernels::table(level).pathBlur(actual.data() + row * Count, count, params);
+        }
+        expectEqual(expected, actual, level, "pathBlur");
+    }
+}
+
+// ============================================================================
+// Float Rows
+// ============================================================================
+
+void testWeightedSum(SimdLevel level) {
+    Random random(16);
+    constexpr int Count = 4099;
+    constexpr int MaxTaps = 13;
+
+    QVector<float> source(Count * MaxTaps);
+    for (float &value : source) value = float(random.range(-100000, 100000)) / 391.0f;
+
+    for (int taps : {1, 2, 5, 13}) {
+        QVector<float> weights(taps);
+        for (float &weight : weights) weight = float(random.range(-1000, 1000)) / 997.0f;
+        QVector<const float *> rows(taps);
+        for (int k = 0; k < taps; ++k) rows[k] = source.constData() + k * Count;
+
+        QVector<float> expected(Count);
+        QVector<float> actual(Count);
+        forChunks(Count, 17, [&](int offset, int length) {
+            QVector<const float *> shifted(taps);
+            for (int k = 0; k < taps; ++k) shifted[k] = rows[k] + offset;
+            SimdKernels::table(SimdLevel::Scalar).weightedSum(expected.data() + offset, shifted.constData(),
+                                                             weights.constData(), taps, length);
+            SimdKernels::table(level).weightedSum(actual.data() + offset, shifted.constData(),
+                                                 weights.constData(), taps, length);
+        });
+        expectEqual(expected, actual, level, "weightedSum");
+
+        // dst may be one of the rows
+        QVector<float> inPlaceExpected(source.constData(), source.constData() + Count);
+        QVector<float> inPlaceActual = inPlaceExpected;
+        QVector<const float *> aliased = rows;
+        aliased[0] = inPlaceExpected.constData();
+        SimdKernels::table(SimdLevel::Scalar).weightedSum(inPlaceExpected.data(), aliased.constData(),
+                                                         weights.constData(), taps, Count);
+        aliased[0] = inPlaceActual.constData();
+        SimdKernels::table(level).weightedSum(inPlaceActual.data(), aliased.constData(),
+                                             weights.constData(), taps, Count);
+        expectEqual(inPlaceExpected, inPlaceActual, level, "weightedSum in place");
+    }
+}
+
+} // namespace
+
+// Every SIMD table against the scalar one, bit for bit. Levels the host
+// cannot run are reported and skipped.
+int main() {
+    const SimdLevel levels[] = {SimdLevel::SSE41, SimdLevel::AVX2, SimdLevel::AVX512, SimdLevel::NEON};
+    for (SimdLevel level : levels) {
+        if (!SimdKernels::isSupported(level)) {
+            std::printf("SKIP %s: not supported on this host\n", SimdKernels::levelName(level));
+            continue;
+        }
+
+        const int before = failures;
+        testColorOps(level);
+        testBlends(level);
+        testNearest(level);
+        testReduce(level);
+        testResample(level);
+        testWarp(level);
+        testPathBlur(level);
+        testWeightedSum(level);
+        std::printf("%s %s\n", failures == before ? "PASS" : "FAIL", SimdKernels::levelName(level));
+    }
+    return failures == 0 ? 0 : 1;
+}
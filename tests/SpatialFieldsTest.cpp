@@ -0,0 +1,220 @@
+#include "SpatialFields.h"
+#include "ImageProcessor.h"
+#include "ParallelExecutor.h"
+
+#include <QImage>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace Knoux::Utils;
+
+namespace {
+
+int failures = 0;
+
+void expect(bool condition, const char *test, const char *what) {
+    if (condition) return;
+    ++failures;
+    std::printf("FAIL %s: %s\n", test, what);
+}
+
+// xorshift32, the same sequence on every platform
+class Random {
+public:
+    explicit Random(quint32 seed) : m_state(seed ? seed : 1) {}
+
+    quint32 next() {
+        m_state ^= m_state << 13;
+        m_state ^= m_state >> 17;
+        m_state ^= m_state << 5;
+        return m_state;
+    }
+
+private:
+    quint32 m_state;
+};
+
+// Random rows, every pixel of a row the same; transposed for columns
+QImage stripes(int width, int height, bool columns, quint32 seed) {
+    QImage image(width, height, QImage::Format_ARGB32);
+    Random random(seed);
+    QVector<QRgb> colors(columns ? width : height);
+    for (QRgb &color : colors) color = random.next() | 0xff000000u;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) image.setPixel(x, y, colors[columns ? x : y]);
+    }
+    return image;
+}
+
+// ============================================================================
+// Cache
+// ============================================================================
+
+// The same key finds the same field, a field built again has the same values
+void testCache() {
+    const auto first = SpatialFields::vignette(QSize(300, 200), 40.0f, 30.0f);
+    expect(SpatialFields::vignette(QSize(300, 200), 40.0f, 30.0f) == first, "cache", "same key built twice");
+    expect(SpatialFields::vignette(QSize(300, 201), 40.0f, 30.0f) != first, "cache", "other size shared a field");
+
+    // Push it out of the cache, then compare a rebuilt one
+    for (int i = 0; i < 8; ++i) SpatialFields::vignette(QSize(10 + i, 10), 40.0f, 30.0f);
+    const auto rebuilt = SpatialFields::vignette(QSize(300, 200), 40.0f, 30.0f);
+    expect(rebuilt->gains == first->gains && rebuilt->columns == first->columns && rebuilt->rows == first->rows,
+           "cache", "rebuilt vignette differs");
+
+    const auto motion = SpatialFields::motion(30.0f, 12.0f);
+    expect(SpatialFields::motion(30.0f, 12.0f) == motion, "cache", "same motion key built twice");
+    expect(motion->taps() == 13, "cache", "motion tap count");
+    const auto radial = SpatialFields::radial(QPointF(50, 40), 30.0f);
+    expect(SpatialFields::radial(QPointF(50, 40), 30.0f) == radial, "cache", "same radial key built twice");
+    expect(radial->taps() == 9, "cache", "radial tap count");
+}
+
+// ============================================================================
+// Vignette
+// ============================================================================
+
+// The table gives the gain of the direct distance formula within a level
+void testVignette() {
+    const int width = 257, height = 190;
+    QImage image(width, height, QImage::Format_ARGB32);
+    image.fill(0xffc8c8c8u);
+
+    for (float amount : {60.0f, -40.0f}) {
+        const float feather = 50.0f;
+        const QImage result = ImageProcessor::applyVignette(image, amount, feather);
+        const double maxDist = std::sqrt(double(width) * width + double(height) * height) / 2;
+        const double innerDist = maxDist * (1 - feather / 100);
+        const double featherDist = maxDist * feather / 100;
+
+        int worst = 0;
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                const double dx = (2 * x - width) / 2.0, dy = (2 * y - height) / 2.0;
+                const double dist = std::sqrt(dx * dx + dy * dy);
+                double gain = 1.0;
+                if (dist > innerDist) gain = qBound(0.0, 1.0 - (dist - innerDist) / featherDist * amount / 100, 4.0);
+                const int expected = qMin(255, int(200 * gain));
+                worst = qMax(worst, std::abs(qRed(result.pixel(x, y)) - expected));
+            }
+        }
+        expect(worst <= 1, "vignette", "gain differs from the distance formula");
+        expect(result.pixel(width / 2, height / 2) == 0xffc8c8c8u, "vignette", "center changed");
+    }
+}
+
+// ============================================================================
+// Blur Paths
+// ============================================================================
+
+// Motion blur moves along its angle only, radial blur keeps flat areas
+void testPaths() {
+    const QImage rows = stripes(120, 90, false, 3);
+    const QImage columns = stripes(120, 90, true, 4);
+    expect(ImageProcessor::applyMotionBlur(rows, 0.0f, 15.0f) == rows, "paths", "horizontal blur changed flat rows");
+    expect(ImageProcessor::applyMotionBlur(columns, 90.0f, 15.0f) == columns, "paths",
+           "vertical blur changed flat columns");
+    expect(ImageProcessor::applyMotionBlur(columns, 0.0f, 15.0f) != columns, "paths", "horizontal blur did nothing");
+
+    QImage flat(150, 100, QImage::Format_ARGB32);
+    flat.fill(0xff4080c0u);
+    expect(ImageProcessor::applyMotionBlur(flat, 37.0f, 20.0f) == flat, "paths", "motion blur changed a flat image");
+    expect(ImageProcessor::applyRadialBlur(flat, QPointF(40, 70), 50.0f) == flat, "paths",
+           "radial blur changed a flat image");
+
+    // Every radial tap of the center pixel is the center pixel
+    const QImage noise = stripes(101, 101, true, 5);
+    const QImage radial = ImageProcessor::applyRadialBlur(noise, QPointF(50, 50), 60.0f);
+    expect(radial.pixel(50, 50) == noise.pixel(50, 50), "paths", "radial blur moved its center");
+}
+
+// ============================================================================
+// Grain
+// ============================================================================
+
+// The texture is bounded, keeps its spread and depends only on its key
+void testGrainField() {
+    const auto fine = SpatialFields::grain(1.0f, 0.5f, 7);
+    const auto coarse = SpatialFields::grain(6.0f, 0.0f, 7);
+    for (const auto &field : {fine, coarse}) {
+        bool bounded = field->values.size() == SpatialFields::Grain::Side * SpatialFields::Grain::Side;
+        double energy = 0.0;
+        for (qint32 value : field->values) {
+            bounded = bounded && value >= -127 && value <= 127;
+            energy += double(value) * value;
+        }
+        expect(bounded, "grain field", "value out of range");
+        // Normalized to 74 before the clamp, which trims the tails
+        const double spread = std::sqrt(energy / field->values.size());
+        expect(spread > 60.0 && spread <= 74.0, "grain field", "spread is not near 74");
+    }
+
+    // Larger grain is smoother: neighbours differ less, also across the wrap
+    const auto roughness = [](const SpatialFields::Grain &field) {
+        constexpr int Side = SpatialFields::Grain::Side;
+        double sum = 0.0;
+        for (int y = 0; y < Side; ++y) {
+            for (int x = 0; x < Side; ++x) sum += std::abs(field.row(y)[x] - field.row(y)[(x + 1) & (Side - 1)]);
+        }
+        return sum;
+    };
+    const double wrap = [&] {
+        double sum = 0.0;
+        for (int y = 0; y < SpatialFields::Grain::Side; ++y) sum += std::abs(coarse->row(y)[255] - coarse->row(y)[0]);
+        return sum / SpatialFields::Grain::Side;
+    }();
+    expect(roughness(*coarse) < roughness(*fine) / 2, "grain field", "larger grain is not smoother");
+    expect(wrap < 2 * roughness(*coarse) / (256.0 * 256.0), "grain field", "texture does not tile");
+
+    // Rebuilt after leaving the cache with the same values; seeds differ
+    for (quint32 seed = 100; seed < 108; ++seed) SpatialFields::grain(1.0f, 0.5f, seed);
+    const auto rebuilt = SpatialFields::grain(1.0f, 0.5f, 7);
+    expect(rebuilt != fine && rebuilt->values == fine->values, "grain field", "rebuilt texture differs");
+    expect(SpatialFields::grain(1.0f, 0.5f, 8)->values != fine->values, "grain field", "seed ignored");
+}
+
+// Each pixel gets the texture value at its position in its shifted block,
+// whatever the thread count
+void testFilmGrain() {
+    constexpr int Side = SpatialFields::Grain::Side;
+    QImage flat(600, 300, QImage::Format_ARGB32);
+    flat.fill(0xff808080u);
+    const float amount = 40.0f;
+    const QImage result = ImageProcessor::applyFilmGrain(flat, amount, 2.0f, 0.3f, 11);
+
+    const auto grain = SpatialFields::grain(2.0f, 0.3f, 11);
+    const int strength = qRound(amount * 256 / 100);
+    bool same = true;
+    for (int y = 0; y < flat.height(); ++y) {
+        for (int x = 0; x < flat.width(); ++x) {
+            const QPoint offset = grain->offset(x / Side, y / Side);
+            const int noise = grain->row(y + offset.y())[(x % Side + offset.x()) & (Side - 1)];
+            const int value = qBound(0, 128 + ((noise * strength) >> 8), 255);
+            same = same && result.pixel(x, y) == qRgb(value, value, value);
+        }
+    }
+    expect(same, "film grain", "pixel is not its texture value");
+
+    const int threads = ParallelExecutor::threadCount();
+    for (int count : {1, 3, 8}) {
+        ParallelExecutor::setThreadCount(count);
+        expect(ImageProcessor::applyFilmGrain(flat, amount, 2.0f, 0.3f, 11) == result, "film grain",
+               "result depends on the thread count");
+    }
+    ParallelExecutor::setThreadCount(threads);
+    expect(ImageProcessor::applyFilmGrain(flat, amount, 2.0f, 0.3f, 12) != result, "film grain", "seed ignored");
+}
+
+} // namespace
+
+int main() {
+    testCache();
+    testVignette();
+    testPaths();
+    testGrainField();
+    testFilmGrain();
+    std::printf("%s SpatialFields\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
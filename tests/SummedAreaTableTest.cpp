@@ -0,0 +1,139 @@
+#include "SummedAreaTable.h"
+#include "ImageProcessor.h"
+
+#include <QColor>
+#include <QImage>
+
+#include <cstdio>
+
+using namespace Knoux::Utils;
+
+namespace {
+
+int failures = 0;
+
+void expect(bool condition, const char *test, const char *what) {
+    if (condition) return;
+    ++failures;
+    std::printf("FAIL %s: %s\n", test, what);
+}
+
+// xorshift32, the same sequence on every platform
+class Random {
+public:
+    explicit Random(quint32 seed) : m_state(seed ? seed : 1) {}
+
+    quint32 next() {
+        m_state ^= m_state << 13;
+        m_state ^= m_state >> 17;
+        m_state ^= m_state << 5;
+        return m_state;
+    }
+
+    int range(int low, int high) { return low + int(next() % quint32(high - low + 1)); }
+
+private:
+    quint32 m_state;
+};
+
+QImage randomImage(int width, int height, quint32 seed) {
+    QImage image(width, height, QImage::Format_RGB32);
+    Random random(seed);
+    for (int y = 0; y < height; ++y) {
+        QRgb *row = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 0; x < width; ++x) row[x] = 0xff000000u | random.next();
+    }
+    return image;
+}
+
+// Rectangles inside, across and outside the border, some empty
+QRect randomRect(Random &random, const QSize &size) {
+    const int x = random.range(-8, size.width() + 4);
+    const int y = random.range(-8, size.height() + 4);
+    return QRect(x, y, random.range(0, size.width() + 8), random.range(0, size.height() + 8));
+}
+
+// Plane value of a pixel: red, green and blue for Rgb tables, their sum
+// for Intensity ones
+int planeValue(QRgb pixel, SummedAreaTable::Source source, int plane) {
+    if (source == SummedAreaTable::Source::Intensity) return qRed(pixel) + qGreen(pixel) + qBlue(pixel);
+    return plane == 0 ? qRed(pixel) : plane == 1 ? qGreen(pixel) : qBlue(pixel);
+}
+
+// ============================================================================
+// Box Sums
+// ============================================================================
+
+void testSums(SummedAreaTable::Source source) {
+    const QSize sizes[] = {QSize(1, 1), QSize(3, 17), QSize(1100, 9), QSize(160, 120)};
+    Random random(7);
+    quint32 seed = 1;
+    for (const QSize &size : sizes) {
+        const QImage image = randomImage(size.width(), size.height(), seed++);
+        const QImage gray = image.convertToFormat(QImage::Format_Grayscale8);
+        const SummedAreaTable table(image, source, true);
+        expect(table.width() == size.width() && table.height() == size.height(), "sums", "table size");
+
+        for (int i = 0; i < 200; ++i) {
+            const QRect rect = randomRect(random, size);
+            const QRect clipped = rect.intersected(image.rect());
+            for (int plane = 0; plane < table.planeCount(); ++plane) {
+                quint64 sum = 0, squared = 0;
+                for (int y = clipped.top(); y <= clipped.bottom(); ++y) {
+                    for (int x = clipped.left(); x <= clipped.right(); ++x) {
+                        const int v = source == SummedAreaTable::Source::Gray
+                            ? gray.constScanLine(y)[x]
+                            : planeValue(image.pixel(x, y), source, plane);
+                        sum += v;
+                        squared += quint64(v) * v;
+                    }
+                }
+                const int area = clipped.isEmpty() ? 0 : clipped.width() * clipped.height();
+                expect(table.area(rect) == area, "sums", "area differs from the clipped box");
+                expect(table.sum(rect, plane) == sum, "sums", "sum differs from a naive count");
+                expect(table.squaredSum(rect, plane) == squared, "sums", "squared sum differs from a naive count");
+
+                if (area > 0 && source == SummedAreaTable::Source::Rgb) {
+                    const int mean = planeValue(table.meanColor(rect), source, plane);
+                    const quint64 half = quint64(area) / 2;
+                    expect(mean == int((sum + half) / quint64(area)), "sums", "mean color differs");
+                }
+            }
+        }
+    }
+}
+
+// ============================================================================
+// Color Sampling
+// ============================================================================
+
+// Both sampleColor overloads read the same clamped window
+void testSampleColor() {
+    const QSize sizes[] = {QSize(1, 1), QSize(2, 5), QSize(40, 30)};
+    quint32 seed = 50;
+    for (const QSize &size : sizes) {
+        const QImage image = randomImage(size.width(), size.height(), seed++);
+        const SummedAreaTable table(image);
+        for (int radius : {0, 1, 3, 12, 45}) {
+            for (int y = -3; y < size.height() + 3; ++y) {
+                for (int x = -3; x < size.width() + 3; ++x) {
+                    const QPoint pos(x, y);
+                    const QColor direct = ImageProcessor::sampleColor(image, pos, radius);
+                    const QColor summed = ImageProcessor::sampleColor(table, pos, radius);
+                    expect(direct == summed, "sampleColor", "table and image windows differ");
+                }
+            }
+        }
+    }
+}
+
+} // namespace
+
+int main() {
+    testSums(SummedAreaTable::Source::Rgb);
+    testSums(SummedAreaTable::Source::Intensity);
+    testSums(SummedAreaTable::Source::Gray);
+    testSampleColor();
+    std::printf("%s SummedAreaTable\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
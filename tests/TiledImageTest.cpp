@@ -0,0 +1,168 @@
+#include "TiledImage.h"
+
+#include <QImage>
+
+#include <cstdio>
+
+using namespace Knoux::Utils;
+
+namespace {
+
+int failures = 0;
+
+void expect(bool condition, const char *test, const char *what) {
+    if (condition) return;
+    ++failures;
+    std::printf("FAIL %s: %s\n", test, what);
+}
+
+// xorshift32, the same sequence on every platform
+class Random {
+public:
+    explicit Random(quint32 seed) : m_state(seed ? seed : 1) {}
+
+    quint32 next() {
+        m_state ^= m_state << 13;
+        m_state ^= m_state >> 17;
+        m_state ^= m_state << 5;
+        return m_state;
+    }
+
+    int range(int low, int high) { return low + int(next() % quint32(high - low + 1)); }
+
+private:
+    quint32 m_state;
+};
+
+QImage randomImage(int width, int height, QImage::Format format, quint32 seed) {
+    QImage image(width, height, QImage::Format_ARGB32);
+    Random random(seed);
+    for (int y = 0; y < height; ++y) {
+        QRgb *row = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 0; x < width; ++x) row[x] = random.next();
+    }
+    return format == QImage::Format_ARGB32 ? image : image.convertToFormat(format);
+}
+
+void fillRect(QImage &image, const QRect &rect, QRgb color) {
+    const QRect area = rect.intersected(image.rect());
+    for (int y = area.top(); y <= area.bottom(); ++y) {
+        for (int x = area.left(); x <= area.right(); ++x) image.setPixel(x, y, color);
+    }
+}
+
+// Tiles of copy that still share their pixels with original
+int sharedTiles(const TiledImage &copy, const TiledImage &original) {
+    int shared = 0;
+    for (int row = 0; row < copy.rows(); ++row) {
+        for (int column = 0; column < copy.columns(); ++column) shared += copy.sharesTile(original, column, row);
+    }
+    return shared;
+}
+
+// ============================================================================
+// Round Trip
+// ============================================================================
+
+void testRoundTrip() {
+    const QSize sizes[] = {QSize(1, 1), QSize(256, 256), QSize(600, 300), QSize(257, 513)};
+    const QImage::Format formats[] = {QImage::Format_ARGB32, QImage::Format_RGB888, QImage::Format_Grayscale8,
+                                      QImage::Format_RGBA64};
+    Random random(5);
+    quint32 seed = 1;
+    for (const QSize &size : sizes) {
+        for (QImage::Format format : formats) {
+            const QImage image = randomImage(size.width(), size.height(), format, seed++);
+            const TiledImage tiled(image);
+            expect(tiled.size() == size && tiled.format() == format, "round trip", "size or format changed");
+            expect(tiled.toImage() == image, "round trip", "assembled image differs");
+
+            for (int i = 0; i < 10; ++i) {
+                const QRect region(random.range(-20, size.width()), random.range(-20, size.height()),
+                                   random.range(1, size.width() + 40), random.range(1, size.height() + 40));
+                const QRect area = region.intersected(image.rect());
+                if (area.isEmpty()) continue;
+                expect(tiled.toImage(region) == image.copy(area), "round trip", "assembled region differs");
+            }
+        }
+    }
+}
+
+// ============================================================================
+// Copy-On-Write
+// ============================================================================
+
+// Editing a copy detaches the touched tiles only, the original keeps its pixels
+void testCopyOnWrite() {
+    const QImage image = randomImage(700, 600, QImage::Format_ARGB32, 9);
+    const TiledImage original(image);
+    const int tiles = original.columns() * original.rows();
+
+    TiledImage copy = original;
+    expect(sharedTiles(copy, original) == tiles, "copy on write", "copy did not share every tile");
+
+    // Touches columns 0 and 1 of row 1
+    const QRect region(200, 300, 100, 50);
+    copy.forEachTile(region, [&](QImage &tile, const QRect &tileRect) {
+        const QRect local = region.intersected(tileRect).translated(-tileRect.topLeft());
+        fillRect(tile, local, qRgba(1, 2, 3, 4));
+    });
+    expect(original.toImage() == image, "copy on write", "edit of a copy changed the original");
+    expect(!copy.sharesTile(original, 0, 1) && !copy.sharesTile(original, 1, 1), "copy on write",
+           "edited tile still shared");
+    expect(sharedTiles(copy, original) == tiles - 2, "copy on write", "untouched tile detached");
+
+    QImage expected = image;
+    fillRect(expected, region, qRgba(1, 2, 3, 4));
+    expect(copy.toImage() == expected, "copy on write", "edit missing from the copy");
+
+    // Writing one tile detaches that tile alone
+    TiledImage second = original;
+    second.tileForWrite(2, 2).fill(0);
+    expect(original.toImage() == image, "copy on write", "tileForWrite changed the original");
+    expect(sharedTiles(second, original) == tiles - 1, "copy on write", "tileForWrite detached other tiles");
+}
+
+// ============================================================================
+// Updates
+// ============================================================================
+
+// An undo snapshot taken before an edit keeps its pixels, and the updated
+// image only stops sharing the tiles whose pixels changed
+void testUpdate() {
+    QImage image = randomImage(800, 520, QImage::Format_ARGB32, 13);
+    const QImage before = image;
+    TiledImage current(image);
+    const TiledImage snapshot = current;
+    const int tiles = current.columns() * current.rows();
+
+    const QRect edit(260, 10, 30, 240);  // Inside tile (1, 0)
+    fillRect(image, edit, qRgb(255, 0, 0));
+    // The dirty rectangle is wider than the edit, unchanged tiles stay shared
+    current.update(image, QRect(0, 0, 520, 256));
+
+    expect(current.toImage() == image, "update", "updated image differs");
+    expect(snapshot.toImage() == before, "update", "snapshot changed");
+    expect(!current.sharesTile(snapshot, 1, 0), "update", "changed tile still shared");
+    expect(sharedTiles(current, snapshot) == tiles - 1, "update", "unchanged tile no longer shared");
+
+    // Pixels outside the dirty rectangle are not read
+    QImage outside = image;
+    fillRect(outside, QRect(700, 500, 10, 10), qRgb(0, 255, 0));
+    current.update(outside, QRect(0, 0, 10, 10));
+    expect(current.toImage() == image, "update", "pixels outside the dirty rectangle taken");
+
+    // A null rectangle takes everything
+    current.update(outside);
+    expect(current.toImage() == outside, "update", "full update missed pixels");
+}
+
+} // namespace
+
+int main() {
+    testRoundTrip();
+    testCopyOnWrite();
+    testUpdate();
+    std::printf("%s TiledImage\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}